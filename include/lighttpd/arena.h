@@ -0,0 +1,65 @@
+#ifndef _LIGHTTPD_ARENA_H_
+#define _LIGHTTPD_ARENA_H_
+
+#include <lighttpd/settings.h>
+
+#include <lighttpd/mempool.h>
+
+typedef struct liArena liArena;
+typedef struct liArenaStats liArenaStats;
+
+#define LI_ARENA_BLOCK_SIZE (16*1024)
+
+/* statistics shared by a group of arenas (e.g. all request arenas of a worker);
+ * only the thread owning the arenas updates them
+ */
+struct liArenaStats {
+	gchar *name;
+	gsize high_water;    /** most bytes allocated from one arena between two resets */
+	guint64 resets;
+	guint64 blocks;      /** blocks allocated from the mempool */
+	gsize idle;          /** bytes kept by arenas without allocations since their last reset */
+};
+
+/* All data here is private; use the functions to interact with the arena */
+
+struct liArena {
+	liArenaStats *stats;
+	gpointer blocks;     /** current block first */
+	gchar *pos, *end;    /** free space in the current block */
+	gsize used;          /** bytes allocated since the last reset */
+	gsize idle;          /** size of the block kept by the last reset until it gets used */
+};
+
+/*
+ * bump allocator for objects which all die at the same time (like everything belonging to one request):
+ * there is no free for single objects, li_arena_reset releases everything at once.
+ * memory comes in LI_ARENA_BLOCK_SIZE blocks from the mempool; bigger objects get a block of their own.
+ */
+
+/* stats may be NULL */
+LI_API void li_arena_init(liArena *arena, liArenaStats *stats);
+/* invalidates all allocations; keeps one block for the next round */
+LI_API void li_arena_reset(liArena *arena);
+/* releases the block kept by li_arena_reset if nothing was allocated since (e.g. before waiting for keep-alive) */
+LI_API void li_arena_trim(liArena *arena);
+/* invalidates all allocations and releases all memory */
+LI_API void li_arena_clear(liArena *arena);
+
+LI_API gpointer li_arena_alloc(liArena *arena, gsize size);
+LI_API gpointer li_arena_alloc0(liArena *arena, gsize size);
+/* returns a 0-terminated copy */
+LI_API gchar* li_arena_strndup(liArena *arena, const gchar *str, gsize len);
+
+#define li_arena_new(arena, type) ((type*) li_arena_alloc((arena), sizeof(type)))
+#define li_arena_new0(arena, type) ((type*) li_arena_alloc0((arena), sizeof(type)))
+
+/* registers the stats for li_arena_stats_foreach */
+LI_API liArenaStats* li_arena_stats_new(const gchar *name);
+LI_API void li_arena_stats_free(liArenaStats *stats);
+
+typedef void (*liArenaStatsCB)(liArenaStats *stats, gpointer data);
+/* threadsafe; the values are read without synchronization */
+LI_API void li_arena_stats_foreach(liArenaStatsCB cb, gpointer data);
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * backends - connections to backends (proxy, scgi, fastcgi)
+ *
+ * A liBackendPool is created by a module for each backend address it talks to. Each worker keeps its own state
+ * for the pool (created on first use): connections in use, idle keep-alive connections and requests waiting
+ * for a connection. This handles:
+ *  - connect() with a timeout (connect_timeout covers waiting for a free slot and connecting)
+ *  - at most max_connections connections per worker; other requests wait and get woken up when one is free
+ *  - keeping up to max_idle connections for the next request (the module decides whether a connection
+ *    can be reused when it gives it back)
+ *  - statistics: pool hits/misses, connect and first byte latency histograms (in liStatistics)
+ *
+ * Usage in a backend handler:
+ *  - li_backend_get() until it doesn't return LI_BACKEND_WAIT; the vrequest is woken up (handle_request_body)
+ *    when it should try again
+ *  - li_backend_wait_stop() if the vrequest goes away while waiting
+ *  - li_backend_first_byte() when the response starts
+ *  - li_backend_put() when done; the fd watcher of the module has to be stopped before
+ */
+
+#ifndef _LIGHTTPD_BACKENDS_H_
+#define _LIGHTTPD_BACKENDS_H_
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+/* latency histogram buckets: < 1ms, < 2ms, < 5ms, ..., < 5s, >= 5s */
+#define LI_BACKEND_LATENCY_BUCKETS 13
+
+typedef enum {
+	LI_BACKEND_SUCCESS, /* got a connected connection */
+	LI_BACKEND_WAIT,    /* connecting or waiting for a free slot; the vrequest gets woken up */
+	LI_BACKEND_ERROR    /* no connection: *berror tells why */
+} liBackendResult;
+
+struct liBackendConfig {
+	liSocketAddress sock;
+
+	gint max_connections;  /* per worker, -1: unlimited */
+	guint connect_timeout; /* seconds, 0: no timeout */
+
+	guint max_idle;        /* idle connections kept per worker, 0: no keep-alive */
+	guint idle_timeout;    /* seconds */
+	guint max_requests;    /* requests per connection, 0: unlimited */
+};
+
+struct liBackendPool {
+	gint refcount;
+	liBackendConfig config;
+	GString *name;         /* socket address for log messages */
+
+	gint last_errno;       /* only log connect errors once; use atomic access */
+};
+
+struct liBackendWorkerPool {
+	liBackendPool *pool;
+	liWorker *wrk;
+
+	guint active;          /* connections in use or connecting, including slots reserved for waiting requests */
+	GQueue idle;           /* liBackendConnection, most recently used first */
+	liWaitQueue idle_queue;
+	GQueue waiting;        /* liBackendWait for a free slot */
+	liWaitQueue connect_queue; /* liBackendWait: connect timeout */
+};
+
+struct liBackendConnection {
+	int fd;
+	guint requests;        /* requests on this connection, including the current one */
+
+	/* private */
+	liBackendWorkerPool *wpool;
+	ev_io watcher;         /* connecting: EV_WRITE; idle: EV_READ (eof) */
+	liBackendWait *wait;   /* while connecting */
+	liWaitQueueElem idle_elem;
+	GList idle_link;
+	ev_tstamp ts_connect, ts_request;
+	gboolean first_byte;
+};
+
+struct liBackendWait {
+	liJobRef *vr_ref;
+	liBackendWorkerPool *wpool;
+	liBackendConnection *bcon; /* connecting for this request, or handed over from another request */
+	gboolean reserved;     /* a slot was freed for this request */
+	gboolean failed;
+	liBackendError berror;
+	GList link;            /* in wpool->waiting */
+	liWaitQueueElem timeout_elem;
+};
+
+/* defaults: unlimited connections, no connect timeout, no keep-alive (idle_timeout 30s) */
+LI_API void li_backend_config_init(liBackendConfig *config);
+
+/* parses a hash entry of a backend action ("socket", "max_connections", "connect_timeout", "max_idle",
+ * "idle_timeout", "max_requests"); module is the name used in error messages.
+ * returns 1 if the key was handled, 0 for an unknown key and -1 for an invalid value (already logged)
+ */
+LI_API gint li_backend_config_option(liServer *srv, const gchar *module, liBackendConfig *config, GString **socket_str, const gchar *key, liValue *val);
+
+/* copies the config; sock is taken from socket_str */
+LI_API liBackendPool* li_backend_pool_new(liServer *srv, const liBackendConfig *config, GString *socket_str, guint tcp_default_port);
+LI_API void li_backend_pool_acquire(liBackendPool *bpool);
+LI_API void li_backend_pool_release(liBackendPool *bpool);
+
+/* on LI_BACKEND_WAIT *pbwait is set, call it again with the same pbwait after the vrequest got woken up */
+LI_API liBackendResult li_backend_get(liVRequest *vr, liBackendPool *bpool, liBackendConnection **pbcon, liBackendWait **pbwait, liBackendError *berror);
+LI_API void li_backend_wait_stop(liVRequest *vr, liBackendPool *bpool, liBackendWait **pbwait);
+/* records the first byte latency (only the first call per request counts) */
+LI_API void li_backend_first_byte(liWorker *wrk, liBackendConnection *bcon);
+/* gives the connection back: it is kept for the next request unless closecon is set */
+LI_API void li_backend_put(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon, gboolean closecon);
+
+/* upper bound of a latency bucket in milliseconds, 0 for the last one */
+LI_API guint li_backend_latency_bucket_limit(guint bucket);
+LI_API guint li_backend_latency_bucket(ev_tstamp duration);
+
+/* worker.c */
+LI_API void li_backend_worker_stop(liWorker *wrk);
+LI_API void li_backend_worker_free(liWorker *wrk);
+
+#endif
@@ -33,6 +33,7 @@
 #include <lighttpd/angel_connection.h>
 
 #include <lighttpd/buffer.h>
+#include <lighttpd/arena.h>
 #include <lighttpd/chunk.h>
 #include <lighttpd/chunk_parser.h>
 
@@ -58,14 +59,16 @@
 #include <lighttpd/virtualrequest.h>
 #include <lighttpd/log.h>
 #include <lighttpd/stat_cache.h>
+#include <lighttpd/fd_cache.h>
+#include <lighttpd/content_cache.h>
 #include <lighttpd/throttle.h>
 #include <lighttpd/mimetype.h>
+#include <lighttpd/network.h>
 
 #include <lighttpd/connection.h>
 
 #include <lighttpd/filter_chunked.h>
 #include <lighttpd/collect.h>
-#include <lighttpd/network.h>
 #include <lighttpd/etag.h>
 #include <lighttpd/utils.h>
 
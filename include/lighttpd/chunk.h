@@ -15,15 +15,39 @@ struct liChunkFile {
 	GString *name; /* name of the file */
 	int fd;
 	gboolean is_temp; /* file is temporary and will be deleted on cleanup */
+
+	/* li_chunk_readahead state; per file, so it doesn't take space in every chunk */
+	struct {
+		off_t next; /* file offset up to which the data was requested (0: not yet) */
+		off_t dropped; /* file offset up to which the pages were dropped */
+	} readahead;
+	gpointer read_job; /* last li_chunkiter_read_async block, running or not picked up yet */
 };
 
+/* A pipe holding data spliced from a socket, so it can be spliced to
+ * another socket without copying it to userspace.
+ * Only one chunk at a time may reference a pipe (the data has to be consumed in order).
+ */
+struct liChunkPipe {
+	gint refcount;
+
+	int fd[2];
+	goffset size; /* capacity of the pipe */
+	goffset used; /* octets in the pipe */
+};
+
+/* max size of data stored in the chunk itself (fits in the union without growing liChunk) */
+#define LI_CHUNK_INLINE_SIZE 47
+
 struct liChunk {
-	enum { UNUSED_CHUNK, STRING_CHUNK, MEM_CHUNK, FILE_CHUNK, BUFFER_CHUNK } type;
+	enum { UNUSED_CHUNK, STRING_CHUNK, MEM_CHUNK, FILE_CHUNK, BUFFER_CHUNK, PIPE_CHUNK, INLINE_CHUNK } type;
 
 	goffset offset;
 	/* if type == FILE_CHUNK and mem != NULL,
 	 * mem contains the data [file.mmap.offset .. file.mmap.offset + file.mmap.length)
 	 * from the file, and file.mmap.start is NULL as mmap failed and read(...) was used.
+	 * if type == PIPE_CHUNK and mem != NULL, the data was read from the pipe into mem
+	 * and mem->data[0] is at pipe.mem_offset.
 	 */
 	GByteArray *mem;
 
@@ -44,10 +68,16 @@ struct liChunk {
 			liBuffer *buffer;
 			gsize offset, length;
 		} buffer;
+		struct {
+			liChunkPipe *pipe;
+			goffset length; /* if mem == NULL, [length - pipe->used .. length) is in the pipe */
+			goffset mem_offset;
+		} pipe;
+		struct {
+			guint8 length;
+			gchar data[LI_CHUNK_INLINE_SIZE];
+		} inl; /* moves with the chunk: pointers to it are only valid until the queue gets modified */
 	} data;
-
-	/* a chunk can only be in one queue, so we just reserve the memory for the link in it */
-	GList cq_link;
 };
 
 typedef void (*liCQLimitNnotifyCB)(liVRequest *vr, gpointer context, gboolean locked);
@@ -71,12 +101,18 @@ struct liChunkQueue {
 	goffset bytes_in, bytes_out, length, mem_usage;
 	liCQLimit *limit; /* limit is the sum of all { c->mem->len | c->type == STRING_CHUNK } */
 /* private */
-	GQueue queue;
+	/* the chunks are stored in a ring buffer of "size" entries (0 or a power of 2);
+	 * head and tail are free running indices, chunk i is in chunks[i & (size-1)].
+	 * liChunk pointers are only valid until the queue gets modified
+	 */
+	liChunk *chunks;
+	guint size, head, tail;
 };
 
 struct liChunkIter {
 /* private */
-	GList *element;
+	liChunkQueue *cq;
+	guint ndx;
 };
 
 /******************
@@ -92,6 +128,21 @@ void li_chunkfile_release(liChunkFile *cf);
  */
 LI_API liHandlerResult li_chunkfile_open(liVRequest *vr, liChunkFile *cf);
 
+/* for FILE_CHUNKs of at least static.readahead_min_size bytes: keeps static.readahead bytes in front of the
+ * current position read ahead from a tasklet; with static.drop_behind it also drops the pages already sent.
+ * the file has to be open.
+ */
+LI_API void li_chunk_readahead(liVRequest *vr, liChunk *c);
+
+/******************
+ *   chunkpipe    *
+ ******************/
+
+/* returns NULL (with errno set) if pipe() failed */
+LI_API liChunkPipe* li_chunkpipe_new(void);
+LI_API void li_chunkpipe_acquire(liChunkPipe *cp);
+LI_API void li_chunkpipe_release(liChunkPipe *cp);
+
 /******************
  * chunk iterator *
  ******************/
@@ -102,6 +153,7 @@ INLINE goffset li_chunkiter_length(liChunkIter iter);
 
 /* get the data from a chunk; easy in case of a STRING_CHUNK,
  * but needs to do io in case of FILE_CHUNK; the data is _not_ marked as "done"
+ * a PIPE_CHUNK is read completely into memory (and stays there)
  * may return HANDLER_GO_ON, HANDLER_ERROR
  */
 LI_API liHandlerResult li_chunkiter_read(liVRequest *vr, liChunkIter iter, off_t start, off_t length, char **data_start, off_t *data_len);
@@ -111,6 +163,13 @@ LI_API liHandlerResult li_chunkiter_read(liVRequest *vr, liChunkIter iter, off_t
  */
 LI_API liHandlerResult li_chunkiter_read_mmap(liVRequest *vr, liChunkIter iter, off_t start, off_t length, char **data_start, off_t *data_len);
 
+/* same as li_chunkiter_read, but reads FILE_CHUNKs in the tasklet pool of the worker:
+ * returns HANDLER_WAIT_FOR_EVENT until the data is available and wakes vr then; call it again
+ * with the same iterator. The block stays in the chunk until the next read starting outside it.
+ * may return HANDLER_GO_ON, HANDLER_WAIT_FOR_EVENT, HANDLER_ERROR
+ */
+LI_API liHandlerResult li_chunkiter_read_async(liVRequest *vr, liChunkIter iter, off_t start, off_t length, char **data_start, off_t *data_len);
+
 /******************
  *     chunk      *
  ******************/
@@ -142,13 +201,13 @@ LI_API goffset li_chunkqueue_limit_available(liChunkQueue *cq);
 
  /* pass ownership of str to chunkqueue, do not free/modify it afterwards
   * you may modify the data (not the length) if you are sure it isn't sent before.
-  * if the length is NULL, str is destroyed immediately
+  * if the length is NULL or small, str is destroyed immediately (small data gets copied)
   */
 LI_API void li_chunkqueue_append_string(liChunkQueue *cq, GString *str);
 
  /* pass ownership of mem to chunkqueue, do not free/modify it afterwards
   * you may modify the data (not the length) if you are sure it isn't sent before.
-  * if the length is NULL, mem is destroyed immediately
+  * if the length is NULL or small, mem is destroyed immediately (small data gets copied)
   */
 LI_API void li_chunkqueue_append_bytearr(liChunkQueue *cq, GByteArray *mem);
 
@@ -158,7 +217,9 @@ LI_API void li_chunkqueue_append_bytearr(liChunkQueue *cq, GByteArray *mem);
 LI_API void li_chunkqueue_append_buffer(liChunkQueue *cq, liBuffer *buffer);
 LI_API void li_chunkqueue_append_buffer2(liChunkQueue *cq, liBuffer *buffer, gsize offset, gsize length);
 
-/* memory gets copied */
+/* memory gets copied: appended to the last chunk if it has room for it, small data
+ * (<= LI_CHUNK_INLINE_SIZE) is stored in the new chunk itself
+ */
 LI_API void li_chunkqueue_append_mem(liChunkQueue *cq, const void *mem, gssize len);
 
 /* increases reference for cf (if length > 0) */
@@ -176,6 +237,11 @@ LI_API void li_chunkqueue_append_tempfile(liChunkQueue *cq, GString *filename, o
 LI_API void li_chunkqueue_append_tempfile_fd(liChunkQueue *cq, GString *filename, off_t start, off_t length, int fd);
 
 
+/* increases reference for cp (if length > 0); the length bytes must already be in the pipe
+ * and no other chunk may reference cp
+ */
+LI_API void li_chunkqueue_append_pipe(liChunkQueue *cq, liChunkPipe *cp, goffset length);
+
 /* steal up to length bytes from in and put them into out, return number of bytes stolen */
 LI_API goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset length);
 
@@ -198,6 +264,9 @@ INLINE liChunkIter li_chunkqueue_iter(liChunkQueue *cq);
 
 INLINE liChunk* li_chunkqueue_first_chunk(liChunkQueue *cq);
 
+/* number of chunks in the queue */
+INLINE guint li_chunkqueue_count(liChunkQueue *cq);
+
 LI_API gboolean li_chunkqueue_extract_to(liVRequest *vr, liChunkQueue *cq, goffset len, GString *dest);
 LI_API gboolean li_chunkqueue_extract_to_bytearr(liVRequest *vr, liChunkQueue *cq, goffset len, GByteArray *dest);
 
@@ -212,18 +281,30 @@ LI_API liBuffer* li_chunkqueue_get_last_buffer(liChunkQueue *cq, guint min_space
  */
 LI_API void li_chunkqueue_update_last_buffer_size(liChunkQueue *cq, goffset add_length);
 
+/* helper functions to append to the last PIPE_CHUNK of a chunkqueue */
+
+/* returns the liChunkPipe from the last chunk in cq, if the chunk has type PIPE_CHUNK
+ * and wasn't read into memory (NULL otherwise) */
+LI_API liChunkPipe* li_chunkqueue_get_last_pipe(liChunkQueue *cq);
+/* only call this if li_chunkqueue_get_last_pipe returned a pipe and add_length bytes were
+ * spliced into it; don't modify the chunkqueue between the two calls
+ */
+LI_API void li_chunkqueue_update_last_pipe_size(liChunkQueue *cq, goffset add_length);
+
 /********************
  * Inline functions *
  ********************/
 
 INLINE liChunk* li_chunkiter_chunk(liChunkIter iter) {
-	if (!iter.element) return NULL;
-	return (liChunk*) iter.element->data;
+	liChunkQueue *cq = iter.cq;
+	if (!cq || iter.ndx - cq->head >= cq->tail - cq->head) return NULL;
+	return &cq->chunks[iter.ndx & (cq->size - 1)];
 }
 
 INLINE gboolean li_chunkiter_next(liChunkIter *iter) {
-	if (!iter || !iter->element) return FALSE;
-	return NULL != (iter->element = g_list_next(iter->element));
+	if (!iter || !li_chunkiter_chunk(*iter)) return FALSE;
+	iter->ndx++;
+	return NULL != li_chunkiter_chunk(*iter);
 }
 
 INLINE goffset li_chunkiter_length(liChunkIter iter) {
@@ -243,18 +324,28 @@ INLINE goffset li_chunk_length(liChunk *c) {
 		return c->data.file.length - c->offset;
 	case BUFFER_CHUNK:
 		return c->data.buffer.length - c->offset;
+	case PIPE_CHUNK:
+		return c->data.pipe.length - c->offset;
+	case INLINE_CHUNK:
+		return c->data.inl.length - c->offset;
 	}
 	return 0;
 }
 
 INLINE liChunkIter li_chunkqueue_iter(liChunkQueue *cq) {
 	liChunkIter i;
-	i.element = g_queue_peek_head_link(&cq->queue);
+	i.cq = cq;
+	i.ndx = cq->head;
 	return i;
 }
 
 INLINE liChunk* li_chunkqueue_first_chunk(liChunkQueue *cq) {
-	return (liChunk*) g_queue_peek_head(&cq->queue);
+	if (cq->head == cq->tail) return NULL;
+	return &cq->chunks[cq->head & (cq->size - 1)];
+}
+
+INLINE guint li_chunkqueue_count(liChunkQueue *cq) {
+	return cq->tail - cq->head;
 }
 
 #endif
@@ -31,6 +31,7 @@ LI_API liCollectInfo* li_collect_start(liWorker *ctx, liCollectFuncCB func, gpoi
 LI_API void li_collect_break(liCollectInfo* ci); /** this will result in complete == FALSE in the callback; call it if cbdata gets invalid */
 
 /* internal functions */
+LI_API liMPSCRing* li_collect_queue_new(void);
 LI_API void li_collect_watcher_cb(struct ev_loop *loop, ev_async *w, int revents);
 
 #endif
@@ -57,6 +57,10 @@ struct liConnection {
 
 	ev_io sock_watcher;
 	gboolean can_read, can_write;
+	liNetworkZeroCopy zerocopy; /** buffers of MSG_ZEROCOPY sends the kernel didn't release yet */
+#ifdef USE_IO_URING
+	liNetworkURingWrite uring_write; /** writes in flight with the io_uring backend */
+#endif
 
 	/* I/O timeout data */
 	liWaitQueueElem io_timeout_elem;
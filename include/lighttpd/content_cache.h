@@ -0,0 +1,70 @@
+/*
+ * content cache - serving small static files from memory
+ *
+ * Files up to content_cache.max_file_size bytes are read into a liBuffer once and then sent as BUFFER_CHUNKs
+ * by all workers.
+ * An entry is only used if dev, inode, size and mtime match the stat() info the caller got for the path
+ * (from the stat cache), so it is as fresh as the stat cache.
+ *
+ * The cache is split into shards with a lock and a LRU list each; every shard holds at most
+ * content_cache.max_size / LI_CONTENT_CACHE_SHARDS bytes.
+ */
+
+#ifndef _LIGHTTPD_CONTENT_CACHE_H_
+#define _LIGHTTPD_CONTENT_CACHE_H_
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+#define LI_CONTENT_CACHE_SHARDS 16
+
+struct liContentCacheEntry {
+	gint refcount;                    /* the cache and every user hold a reference, atomic access */
+
+	GString *path;
+	liBuffer *buf;                    /* the file content */
+
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+
+	GList lru_link;                   /* only valid while cached, protected by the shard lock */
+};
+
+struct liContentCacheStats {
+	guint64 hits;
+	guint64 misses;
+	guint64 bytes;                    /* size of the cached files */
+	guint entries;
+};
+
+struct liContentCache {
+	struct {
+		GStaticMutex lock;
+		GHashTable *entries;          /* path -> liContentCacheEntry */
+		GQueue lru;                   /* least recently used first */
+		gsize size;
+		guint64 hits, misses;
+	} shards[LI_CONTENT_CACHE_SHARDS];
+
+	goffset max_file_size;
+	gsize max_size;
+};
+
+LI_API liContentCache* li_content_cache_new(goffset max_file_size, gsize max_size);
+LI_API void li_content_cache_free(liContentCache *cc);
+
+/*
+ returns a new reference to the entry for path if it matches st; on a miss the file is read
+ (from fd if it isn't -1, the fd is not closed) and inserted.
+ returns NULL if the file can't be cached (too big, empty, changed while reading it, read errors);
+ the caller should serve the file the normal way then.
+*/
+LI_API liContentCacheEntry* li_content_cache_get(liVRequest *vr, GString *path, struct stat *st, int fd);
+LI_API void li_content_cache_entry_release(liContentCacheEntry *cce);
+
+LI_API void li_content_cache_get_stats(liContentCache *cc, liContentCacheStats *stats);
+
+#endif
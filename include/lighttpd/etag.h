@@ -13,4 +13,12 @@ LI_API gboolean li_http_response_handle_cachable(liVRequest *vr);
 LI_API void li_etag_mutate(GString *mut, GString *etag);
 LI_API void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable);
 
+/* the pieces of li_etag_set_header, for callers that cache the strings */
+#define LI_ETAG_LAST_MODIFIED_SIZE 64
+LI_API void li_etag_format(GString *dest, struct stat *st, guint flags);
+/* returns the length of the 0-terminated string in buf, 0 on error */
+LI_API gsize li_etag_format_last_modified(gchar *buf, gsize size, time_t mtime);
+/* etag NULL removes the ETag header, last_modified NULL skips Last-Modified */
+LI_API void li_etag_set_header_strings(liVRequest *vr, GString *etag, GString *last_modified, gboolean *cachable);
+
 #endif
@@ -0,0 +1,55 @@
+/*
+ * fd cache - keeping static files open for the next request
+ *
+ * Each worker keeps up to fd_cache.max_open files open, so hot files can be served without open()/fstat()/close().
+ * The cached liChunkFile is handed out with an additional reference; it is only closed after it was removed
+ * from the cache and the last chunk using it is gone.
+ *
+ * An entry is only used if dev, inode, size and mtime match the stat() info the caller got for the path
+ * (from the stat cache); otherwise the file is opened again and replaces the entry.
+ * The least recently used entry is dropped if the cache is full; unused entries are closed after LI_FD_CACHE_IDLE seconds.
+ */
+
+#ifndef _LIGHTTPD_FD_CACHE_H_
+#define _LIGHTTPD_FD_CACHE_H_
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+#define LI_FD_CACHE_IDLE 10.0
+
+struct liFdCacheEntry {
+	GString *path;
+	liChunkFile *cf;
+
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+
+	liWaitQueueElem lru_elem;         /* least recently used first */
+};
+
+struct liFdCache {
+	GHashTable *entries;              /* path -> liFdCacheEntry */
+	liWaitQueue lru;
+	guint max_open;
+
+	guint64 hits;
+	guint64 misses;
+};
+
+LI_API liFdCache* li_fd_cache_new(liWorker *wrk, guint max_open);
+LI_API void li_fd_cache_free(liFdCache *fdc);
+/* closes all cached files (chunks still using them keep them open) */
+LI_API void li_fd_cache_flush(liFdCache *fdc);
+
+/*
+ returns a new reference to an open liChunkFile for path; st has to be the stat() info for path.
+ if the file isn't cached (or changed) it is opened, and *st is updated if the opened file differs from it.
+ returns NULL and sets *err in case of an error
+*/
+LI_API liChunkFile* li_fd_cache_get(liVRequest *vr, GString *path, struct stat *st, int *err);
+
+#endif
@@ -21,6 +21,7 @@ struct liHttpHeader {
 
 struct liHttpHeaders {
 	GQueue entries;
+	liArena *arena;   /** NULL: entries are allocated with g_slice/g_string */
 };
 
 /* strings always get copied, so you should free key and value yourself */
@@ -29,6 +30,9 @@ LI_API liHttpHeaders* li_http_headers_new();
 LI_API void li_http_headers_reset(liHttpHeaders* headers);
 LI_API void li_http_headers_free(liHttpHeaders* headers);
 
+/** allocate new entries from arena (headers must be empty); reset the headers before the arena */
+LI_API void li_http_headers_use_arena(liHttpHeaders* headers, liArena *arena);
+
 /** If header does not exist, just insert normal header. If it exists, append (", %s", value) */
 LI_API void li_http_header_append(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen);
 
@@ -11,6 +11,7 @@ struct liHttpResponseCtx {
 
 	gboolean accept_cgi, accept_nph;
 	gboolean drop_header; /* for 1xx responses */
+	liHttpVersion http_version; /* of the status line, LI_HTTP_VERSION_UNSET without one */
 
 	liChunkParserMark mark;
 	GString *h_key, *h_value;
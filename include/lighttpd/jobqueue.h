@@ -2,6 +2,7 @@
 #define _LIGHTTPD_JOBQUEUE_H_
 
 #include <lighttpd/settings.h>
+#include <lighttpd/mpscring.h>
 
 typedef struct liJob liJob;
 typedef struct liJobRef liJobRef;
@@ -33,7 +34,7 @@ struct liJobQueue {
 	GQueue queue;
 	ev_timer queue_watcher;
 
-	GAsyncQueue *async_queue;
+	liMPSCRing *async_queue; /* (liJobRef*) */
 	ev_async async_queue_watcher;
 };
 
@@ -0,0 +1,51 @@
+#ifndef _LIGHTTPD_MPSCRING_H_
+#define _LIGHTTPD_MPSCRING_H_
+
+#include <lighttpd/settings.h>
+
+typedef struct liMPSCRing liMPSCRing;
+
+/* All data here is private; use the functions to interact with the ring */
+
+struct liMPSCRing {
+	guint8 *cells;
+	guint elem_size, cell_size, mask;
+
+	gint tail;   /* next cell to claim; producers, atomic access */
+	gint wakeup; /* 1 if a producer already requested a wakeup; atomic access */
+
+	gchar pad[64]; /* keep producer and consumer data on different cache lines */
+
+	guint head;  /* next cell to read; consumer only */
+
+	/* used only if the ring is full; entries are copied with g_slice_copy */
+	GMutex *overflow_mutex;
+	GQueue overflow;
+	gint overflow_len; /* atomic access */
+};
+
+/*
+ * lock-free multi-producer single-consumer queue; elements of elem_size bytes are copied in and out.
+ * push is wait-free as long as the ring isn't full; if it is full, the elements go to a mutex
+ * protected overflow queue (so push never fails, but the order isn't strictly FIFO anymore).
+ *
+ * wakeup coalescing: the consumer calls li_mpsc_ring_wakeup_reset() before it drains the ring,
+ * and a producer only has to wake the consumer (ev_async_send) if li_mpsc_ring_push() returns TRUE.
+ */
+
+/* size is rounded up to a power of 2 */
+LI_API liMPSCRing* li_mpsc_ring_new(guint elem_size, guint size);
+/* remaining elements are dropped */
+LI_API void li_mpsc_ring_free(liMPSCRing *ring);
+
+/* threadsafe. returns TRUE if the consumer has to be woken up */
+LI_API gboolean li_mpsc_ring_push(liMPSCRing *ring, gconstpointer elem);
+
+/* consumer only */
+LI_API void li_mpsc_ring_wakeup_reset(liMPSCRing *ring);
+/* consumer only; returns FALSE if the ring is empty */
+LI_API gboolean li_mpsc_ring_pop(liMPSCRing *ring, gpointer elem);
+/* consumer only; includes elements that are being pushed right now */
+LI_API guint li_mpsc_ring_length(liMPSCRing *ring);
+
+#endif
@@ -9,14 +9,38 @@
 # define USE_SENDFILE
 #endif
 
+#if defined(LIGHTY_OS_LINUX) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+# define USE_MSG_ZEROCOPY
+#endif
+
 /** repeats write after EINTR */
 LI_API ssize_t li_net_write(int fd, void *buf, ssize_t nbyte);
 
 /** repeats read after EINTR */
 LI_API ssize_t li_net_read(int fd, void *buf, ssize_t nbyte);
 
+/* FILE_CHUNKs up to this size are read into memory and sent with the surrounding mem chunks by the "auto" backend */
+#define LI_NETWORK_INLINE_FILE_MAX (16*1024)
+
+typedef liNetworkStatus (*liNetworkWriteCB)(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
+
+struct liNetworkBackend {
+	const gchar *name;
+	liNetworkWriteCB write;
+	goffset inline_file_max; /** FILE_CHUNKs the backend sends in the same writev() as mem chunks; -1: none */
+};
+
+/* uses the backend selected with the "network.backend" setup */
 LI_API liNetworkStatus li_network_write(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max);
 LI_API liNetworkStatus li_network_read(liVRequest *vr, int fd, liChunkQueue *cq, liBuffer **buffer);
+/* splice up to max_read bytes (-1: no limit) from fd into a pipe and append it as PIPE_CHUNK;
+ * *pipe is reused like *buffer in li_network_read.
+ * uses li_network_read if splice isn't available (or not supported for fd)
+ */
+LI_API liNetworkStatus li_network_read_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset max_read, liBuffer **buffer, liChunkPipe **pipe);
+
+/* use writev for mem chunks and small files, sendfile (or buffered read/write) for large files */
+LI_API liNetworkStatus li_network_write_auto(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
 
 /* use writev for mem chunks, buffered read/write for files */
 LI_API liNetworkStatus li_network_write_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
@@ -26,9 +50,70 @@ LI_API liNetworkStatus li_network_write_writev(liVRequest *vr, int fd, liChunkQu
 LI_API liNetworkStatus li_network_write_sendfile(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
 #endif
 
+#ifdef USE_IO_URING
+/* backend entry for sockets without liNetworkURingWrite state: uses sendfile/writev directly */
+LI_API liNetworkStatus li_network_write_uring(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
+LI_API void li_network_uring_free(liNetworkURing *nu);
+
+/* a chain of writev for mem chunks and splice for files in flight on vr->wrk->uring */
+struct liNetworkURingWrite {
+	gpointer batch; /** private */
+	void (*callback)(liNetworkURingWrite *w); /** called when the chain completed */
+	gpointer data;
+};
+
+LI_API void li_network_uring_write_init(liNetworkURingWrite *w, void (*callback)(liNetworkURingWrite *w), gpointer data);
+/* whether ops are still in flight; don't wait for EV_WRITE then */
+LI_API gboolean li_network_uring_write_busy(liNetworkURingWrite *w);
+/* call before closing fd; returns TRUE if ops are still in flight: the chunks of cq and fd were taken
+ * over then and fd is closed when they completed. otherwise fd is left alone.
+ */
+LI_API gboolean li_network_uring_write_release(liNetworkURingWrite *w, liChunkQueue *cq, int fd);
+/* queues the chunks as one linked chain (submitted with the chains of the other connections
+ * before the loop blocks) and returns WAIT_FOR_EVENT; the next call after w->callback applies
+ * the result to cq. falls back to sendfile/writev if vr->wrk->uring is NULL
+ */
+LI_API liNetworkStatus li_network_write_uring_async(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, liNetworkURingWrite *w);
+#endif
+
+/* MSG_ZEROCOPY sends of a socket; each holds a reference to its liBuffer until the kernel
+ * reports on the socket error queue that it doesn't need the pages anymore
+ */
+struct liNetworkZeroCopy {
+	gint state;       /** 0: not enabled yet, 1: SO_ZEROCOPY enabled, -1: not supported (or the kernel copies anyway) */
+	guint32 next_seq; /** the kernel numbers successful MSG_ZEROCOPY sends per socket */
+	GQueue pending;
+};
+
+LI_API void li_network_zerocopy_init(liNetworkZeroCopy *zc);
+/* releases all pending buffers - only after the socket was closed */
+LI_API void li_network_zerocopy_reset(liNetworkZeroCopy *zc);
+/* dest is initialized with the pending sends of src, src is reinitialized */
+LI_API void li_network_zerocopy_move(liNetworkZeroCopy *dest, liNetworkZeroCopy *src);
+/* releases the buffers of completed sends; vr may be NULL (no logging then) */
+LI_API void li_network_zerocopy_reap(liVRequest *vr, int fd, liNetworkZeroCopy *zc);
+/* closes fd and releases all buffers; if the kernel still holds some, the unsent data is dropped
+ * with an abortive close (RST) first, so it can't send from reused buffers anymore
+ */
+LI_API void li_network_zerocopy_close(int fd, liNetworkZeroCopy *zc);
+
+/* like li_network_write, but sends BUFFER_CHUNKs of at least "network.zerocopy" bytes with MSG_ZEROCOPY */
+LI_API liNetworkStatus li_network_write_zerocopy(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, liNetworkZeroCopy *zc);
+
+/* "auto", "writev", "sendfile", "io_uring"; returns NULL if the backend is unknown or not available on this platform */
+LI_API const liNetworkBackend* li_network_backend_find(const gchar *name);
+
+/* whether a single writev() can send the chunks up to write_max; used to decide whether TCP_CORK is needed */
+LI_API gboolean li_network_writev_single(liChunkQueue *cq, goffset write_max, goffset inline_file_max);
+
 /* write backends */
 LI_API liNetworkStatus li_network_backend_write(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
 LI_API liNetworkStatus li_network_backend_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
+#ifdef USE_SENDFILE
+LI_API liNetworkStatus li_network_backend_sendfile(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
+#endif
+/* first chunk must be a PIPE_CHUNK; uses read/write if splice isn't available */
+LI_API liNetworkStatus li_network_backend_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max);
 
 #define LI_NETWORK_FALLBACK(f, write_max) do { \
 	liNetworkStatus res; \
@@ -5,6 +5,9 @@
 
 typedef enum { LI_ETAG_USE_INODE = 1, LI_ETAG_USE_MTIME = 2, LI_ETAG_USE_SIZE = 4 } liETagFlags;
 
+/* values of the stat.async option */
+typedef enum { LI_STAT_ASYNC_OFF = 0, LI_STAT_ASYNC_THREADS, LI_STAT_ASYNC_IO_URING } liStatAsyncMode;
+
 enum liCoreOptions {
 	LI_CORE_OPTION_DEBUG_REQUEST_HANDLING = 0,
 
@@ -15,7 +18,11 @@ enum liCoreOptions {
 
 	LI_CORE_OPTION_ETAG_FLAGS,
 
-	LI_CORE_OPTION_ASYNC_STAT
+	LI_CORE_OPTION_ASYNC_STAT,
+
+	LI_CORE_OPTION_STATIC_READAHEAD,
+	LI_CORE_OPTION_STATIC_READAHEAD_MIN_SIZE,
+	LI_CORE_OPTION_STATIC_DROP_BEHIND
 };
 
 enum liCoreOptionPtrs {
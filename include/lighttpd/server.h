@@ -34,6 +34,7 @@ typedef enum {
 struct liServerSocket {
 	gint refcount;
 	liServer *srv;
+	liWorker *wrk;            /** NULL: shared socket, accepted in main worker; else SO_REUSEPORT socket owned by wrk */
 	ev_io watcher;
 
 	liSocketAddress local_addr;
@@ -86,6 +87,7 @@ struct liServer {
 	ev_timer srv_1sec_timer;
 
 	GPtrArray *sockets;          /** array of (server_socket*) */
+	GPtrArray *reuseport_addrs;  /** array of (GString*), "listen.reuseport" addresses; one socket per worker is requested on loading */
 
 	liModules *modules;
 
@@ -127,7 +129,7 @@ struct liServer {
 	GString *started_str;
 
 	guint connection_load, max_connections;
-	gboolean connection_limit_hit; /** true if limit was hit and the sockets are disabled */
+	gboolean connection_limit_hit; /** true if limit was hit and the sockets are disabled, atomic access */
 
 	/* keep alive timeout */
 	guint keep_alive_queue_timeout;
@@ -138,7 +140,14 @@ struct liServer {
 	liRadixTree *throttle_ip_pools;
 
 	gdouble stat_cache_ttl;
+	liStatCacheShared *stat_cache_shared;    /** NULL: disabled (default) */
+	guint fd_cache_max_open;                 /** per worker; 0: disabled (default) */
+	liContentCache *content_cache;           /** NULL: disabled (default) */
+	gsize content_cache_max_size;
 	gint tasklet_pool_threads;
+
+	const liNetworkBackend *network_backend; /** "auto" by default, see li_network_backend_find */
+	goffset network_zerocopy_min;            /** send buffer chunks at least this big with MSG_ZEROCOPY; 0: disabled */
 };
 
 
@@ -147,6 +156,8 @@ LI_API void li_server_free(liServer* srv);
 LI_API gboolean li_server_loop_init(liServer *srv);
 
 LI_API liServerSocket* li_server_listen(liServer *srv, int fd);
+/* SO_REUSEPORT socket accepted directly in the loop of wrk; only call before the worker threads are started */
+LI_API liServerSocket* li_server_listen_worker(liServer *srv, liWorker *wrk, int fd);
 
 /* exit asap with cleanup */
 LI_API void li_server_exit(liServer *srv);
@@ -111,6 +111,19 @@
 # include <sys/uio.h>
 #endif
 
+#if defined(LIGHTY_OS_LINUX) && defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_WRITEV)
+# define USE_IO_URING
+#endif
+
+#if defined(LIGHTY_OS_LINUX) && defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT)
+# define USE_INOTIFY
+#endif
+
+#if defined(LIGHTY_OS_LINUX) && defined(HAVE_SPLICE)
+# define USE_SPLICE
+# include <fcntl.h>
+#endif
+
 #if defined(LIGHTY_OS_MACOSX) && defined(HAVE_SYS_UIO_H) && defined(HAVE_SENDFILE)
 # define USE_OSX_SENDFILE
 # include <sys/uio.h>
@@ -6,13 +6,24 @@
  * This means that there will be more blocking stat() calls than there would be with only one shared cache but since there
  * should be mostly hits in most cases (few items requested frequently) it will outweight the locking contention.
  * To prevent the stat() from blocking all other requests of that worker, we hand it over to another thread.
+ * Directory listings are read by one thread; the stat()s of the entries are then done by all threads in batches.
+ * With stat.async = "io_uring" the stat() is a statx submitted through the io_uring of the worker instead; all lookups
+ * of one loop iteration are submitted with a single syscall. Directory listings and systems without io_uring use the threads.
  *
  * Entries are removed after 10 seconds (adjustable through stat_cache.ttl setup)
  *
+ * With the stat_cache.shared setup (linux only) there is also one server-wide cache for stat() results.
+ * Its entries are removed when inotify reports a change in the directory containing them, and expire after
+ * stat_cache.ttl like the worker entries: only the containing directory is watched, so a renamed parent directory
+ * or a replaced symlink in the path (current -> release-N) is noticed after the ttl.
+ * It is split into shards with a lock each; a hit needs no syscall at all.
+ *
+ * For static files the worker cache also remembers the formatted ETag, Last-Modified and the Content-Type,
+ * so a hit only copies strings into the response headers. Such an entry is used as long as dev, inode, size and mtime
+ * match the stat info and the etag/mimetype options are the same; it is dropped after the ttl like the stat entries.
+ *
  * TODO:
- *     - create ETAGs
  *     - get content type from xattr
- *     - add support for inotify (linux). TTL for entries can be increased to 60s
  *
  * Technical details:
  * If a stat is requested, the following procedure takes place:
@@ -61,28 +72,78 @@ struct liStatCacheEntry {
 
 	liStatCacheEntryData data;
 	GArray *dirlist;                  /* array of stat_cache_entry_data, used together with STAT_CACHE_ENTRY_DIR */
+	guint dirlist_ready;              /* dirlist entries [0, dirlist_ready) are complete; grows while the entry is WAITING */
+	gpointer dirlist_job;             /* private, collecting the dirlist */
 
 	liStatCache *sc;
+	guint64 id;                       /* unique in the worker; a new lookup of the same path gets a new id */
 	GPtrArray *vrequests;             /* vrequests waiting for this info */
 	guint refcount;                   /* vrequests, delete_queue and tasklet hold references; dirlist/entrie cache entries are always in delete_queue too */
 	liWaitQueueElem queue_elem;       /* queue element for the delete_queue */
 	gboolean cached;
 };
 
+struct liStatCacheStaticHeaders {
+	GString *path;
+
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+
+	guint etag_flags;                 /* etag was created with these LI_ETAG_USE_* flags */
+	gconstpointer mime_types;         /* content_type was looked up in this mime_types option */
+
+	GString *etag;                    /* NULL if etag_flags is 0 */
+	GString *last_modified;           /* NULL if the mtime couldn't be formatted */
+	const GString *content_type;      /* belongs to the mime_types option; NULL if no mime type matched */
+
+	liWaitQueueElem queue_elem;
+};
+
 struct liStatCache {
 	GHashTable *dirlists;
 	GHashTable *entries;
 	liWaitQueue delete_queue;
+	GHashTable *static_headers;       /* path -> liStatCacheStaticHeaders */
+	liWaitQueue static_headers_queue;
 	gdouble ttl;
 
+	gboolean uring_failed;            /* io_uring (or statx with io_uring) not available, use the tasklets */
+	guint64 last_id;
+
 	guint64 hits;
 	guint64 misses;
 	guint64 errors;
 };
 
+#define LI_STAT_CACHE_SHARDS 16
+
+struct liStatCacheShared {
+	liServer *srv;
+
+	struct {
+		GStaticMutex lock;
+		GHashTable *entries;
+	} shards[LI_STAT_CACHE_SHARDS];
+
+	gint generation;                  /* incremented on every invalidation, atomic access */
+	gint disabled;                    /* set if reading events failed, atomic access */
+
+	int inotify_fd;
+	ev_io inotify_watcher;            /* in the loop of the main worker */
+	GStaticMutex watch_lock;
+	GHashTable *watch_dirs;           /* directory -> watch descriptor */
+	GHashTable *watch_wds;            /* watch descriptor -> directory */
+};
+
 LI_API liStatCache* li_stat_cache_new(liWorker *wrk, gdouble ttl);
 LI_API void li_stat_cache_free(liStatCache *sc);
 
+/* returns NULL if inotify isn't available */
+LI_API liStatCacheShared* li_stat_cache_shared_new(liServer *srv);
+LI_API void li_stat_cache_shared_free(liServer *srv, liStatCacheShared *shared);
+
 /*
  gets a stat_cache_entry for a specified path
  if fd is set, a new fd is acquired via open() and stat info via fstat(), otherwise only a stat() is performed
@@ -96,9 +157,17 @@ LI_API liHandlerResult li_stat_cache_get_sync(liVRequest *vr, GString *path, str
 /*
  sce->dirlist will contain a list of stat_cache_entry_data upon success
  returns HANDLER_WAIT_FOR_EVENT in case of a cache MISS, HANDLER_GO_ON in case of a hit and HANDLER_ERROR in case of an error
+ the stat()s for the dirlist are split across the tasklet threads. while waiting, *result is set too: the first
+ sce->dirlist_ready entries (data too if dirlist_ready > 0) can already be used, the vrequest is woken up whenever it grows.
 */
 LI_API liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatCacheEntry **result);
 
+/*
+ returns the header strings for the static file path with stat info st, formatting them if they aren't cached yet.
+ returns NULL if the stat cache is disabled; the result is only valid until the worker returns to the event loop.
+*/
+LI_API liStatCacheStaticHeaders* li_stat_cache_get_static_headers(liVRequest *vr, GString *path, struct stat *st);
+
 LI_API void li_stat_cache_entry_acquire(liVRequest *vr, liStatCacheEntry *sce);
 /* release a stat_cache_entry so it can be cleaned up */
 LI_API void li_stat_cache_entry_release(liVRequest *vr, liStatCacheEntry *sce);
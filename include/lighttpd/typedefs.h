@@ -50,6 +50,8 @@ typedef enum {
 
 typedef struct liChunkFile liChunkFile;
 
+typedef struct liChunkPipe liChunkPipe;
+
 typedef struct liChunk liChunk;
 
 typedef struct liCQLimit liCQLimit;
@@ -122,6 +124,13 @@ typedef enum {
 	LI_NETWORK_STATUS_WAIT_FOR_EVENT       /**< read/write returned -1 with errno=EAGAIN/EWOULDBLOCK */
 } liNetworkStatus;
 
+typedef struct liNetworkBackend liNetworkBackend;
+
+typedef struct liNetworkURing liNetworkURing;
+typedef struct liNetworkURingWrite liNetworkURingWrite;
+
+typedef struct liNetworkZeroCopy liNetworkZeroCopy;
+
 /* options.h */
 
 typedef union liOptionValue liOptionValue;
@@ -245,5 +254,26 @@ typedef struct liWorker liWorker;
 typedef struct liStatCacheEntryData liStatCacheEntryData;
 typedef struct liStatCacheEntry liStatCacheEntry;
 typedef struct liStatCache liStatCache;
+typedef struct liStatCacheShared liStatCacheShared;
+typedef struct liStatCacheStaticHeaders liStatCacheStaticHeaders;
+
+/* fd_cache.h */
+
+typedef struct liFdCacheEntry liFdCacheEntry;
+typedef struct liFdCache liFdCache;
+
+/* backends.h */
+
+typedef struct liBackendConfig liBackendConfig;
+typedef struct liBackendPool liBackendPool;
+typedef struct liBackendWorkerPool liBackendWorkerPool;
+typedef struct liBackendConnection liBackendConnection;
+typedef struct liBackendWait liBackendWait;
+
+/* content_cache.h */
+
+typedef struct liContentCacheEntry liContentCacheEntry;
+typedef struct liContentCacheStats liContentCacheStats;
+typedef struct liContentCache liContentCache;
 
 #endif
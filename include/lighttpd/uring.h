@@ -0,0 +1,78 @@
+#ifndef _LIGHTTPD_URING_H_
+#define _LIGHTTPD_URING_H_
+
+#include <lighttpd/settings.h>
+
+typedef struct liURing liURing;
+typedef struct liURingOp liURingOp;
+
+#ifdef USE_IO_URING
+
+#include <linux/io_uring.h>
+
+typedef void (*liURingCB)(liURingOp *op);
+
+struct liURingOp {
+	liURingCB callback; /** NULL for ops waited for with li_uring_wait() */
+	gpointer data;
+	gint res;           /** result of the completed op: >= 0 on success, -errno on error */
+
+	GList link;         /** private */
+};
+
+/* All data here is private; use the functions to interact with the ring */
+
+struct liURing {
+	int fd, event_fd;
+	struct ev_loop *loop;
+	ev_io event_watcher;   /** completions for async ops */
+	ev_prepare prepare;    /** submits the queued entries once per loop iteration */
+
+	/* submission queue (shared with the kernel) */
+	guint *sq_head, *sq_tail, *sq_array;
+	guint sq_mask, sq_entries;
+	struct io_uring_sqe *sqes;
+	guint sqe_tail;        /** entries handed out by li_uring_get_sqe, not yet flushed */
+	guint sqe_reserved;    /** entries of li_uring_reserve not handed out yet */
+
+	/* completion queue (shared with the kernel) */
+	guint *cq_head, *cq_tail;
+	guint cq_mask;
+	struct io_uring_cqe *cqes;
+
+	gpointer sq_ring, cq_ring;
+	gsize sq_ring_size, cq_ring_size, sqes_size;
+
+	guint sync_pending;    /** ops without callback not completed yet */
+	guint async_pending;   /** ops with callback not completed yet */
+	GQueue completed;      /** async ops completed while waiting for sync ops; dispatched from the loop */
+};
+
+/* returns NULL (with errno set) if io_uring is not available; we do not keep the loop alive */
+LI_API liURing* li_uring_new(struct ev_loop *loop, guint entries);
+/* blocks until the in-flight ops are completed and runs their callbacks, as they may own memory */
+LI_API void li_uring_free(liURing *ring);
+
+/* returns a zeroed entry for op (op must stay valid until it is completed); entries are
+ * submitted before the loop blocks next time or by li_uring_wait. returns NULL if the
+ * submission queue is full and couldn't be flushed. reserved entries are handed out first
+ * and never flush the queue.
+ */
+LI_API struct io_uring_sqe* li_uring_get_sqe(liURing *ring, liURingOp *op);
+
+/* call before queueing a chain of linked entries: a flush in the middle would submit the
+ * partial chain, its last entry linked to whatever comes next. makes room for n entries if
+ * possible and reserves them; returns the number reserved (less than n if the queue is smaller
+ * or couldn't be flushed). unused reservations are dropped with the next li_uring_reserve.
+ */
+LI_API guint li_uring_reserve(liURing *ring, guint n);
+
+/* submit all queued entries and block until all ops without callback are completed.
+ * callbacks of async ops completed meanwhile are delayed to the next loop iteration.
+ * returns FALSE (with errno set) if io_uring_enter failed.
+ */
+LI_API gboolean li_uring_wait(liURing *ring);
+
+#endif
+
+#endif
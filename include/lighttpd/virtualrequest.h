@@ -105,6 +105,11 @@ struct liVRequest {
 	liPhysical physical;
 	liResponse response;
 
+	/* memory for objects which live until li_vrequest_reset (e.g. response headers);
+	 * blocks come from the mempool of the worker thread
+	 */
+	liArena arena;
+
 	/* environment entries will be passed to the backends */
 	liEnvironment env;
 
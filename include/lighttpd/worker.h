@@ -7,6 +7,9 @@
 
 #include <lighttpd/tasklet.h>
 #include <lighttpd/jobqueue.h>
+#include <lighttpd/mpscring.h>
+#include <lighttpd/uring.h>
+#include <lighttpd/backends.h>
 
 struct lua_State;
 
@@ -42,6 +45,15 @@ struct liStatistics {
 	guint64 last_requests;
 	double requests_per_sec;
 	ev_tstamp last_update;
+
+	/* keep-alive pools of backend connections */
+	guint64 backend_pool_hits;   /** backend requests that reused an idle connection */
+	guint64 backend_pool_misses; /** backend requests that had to connect although pooling is enabled */
+	guint backend_pool_idle;     /** idle backend connections */
+
+	/* backend latency histograms, see li_backend_latency_bucket() */
+	guint64 backend_connect_latency[LI_BACKEND_LATENCY_BUCKETS];    /** connect() until the connection is established */
+	guint64 backend_first_byte_latency[LI_BACKEND_LATENCY_BUCKETS]; /** got a connection until the first response byte */
 };
 
 #define CUR_TS(wrk) ev_now((wrk)->loop)
@@ -84,6 +96,8 @@ struct liWorker {
 
 	GString *tmp_str;         /**< can be used everywhere for local temporary needed strings */
 
+	liArenaStats *request_arena_stats; /** shared by the arenas of all vrequests of this worker */
+
 	/* keep alive timeout queue */
 	ev_timer keep_alive_timer;
 	GQueue keep_alive_queue;
@@ -97,10 +111,16 @@ struct liWorker {
 	GArray *timestamps_gmt; /** array of (worker_ts), use only from local worker context and through li_worker_current_timestamp(wrk, LI_GMTIME, ndx) */
 	GArray *timestamps_local;
 
+	/* SO_REUSEPORT listening sockets owned by this worker */
+	GPtrArray *listen_sockets;  /** array of (liServerSocket*), filled before the worker thread starts */
+	ev_async listen_watcher;
+	gint listen_active;         /** whether the server wants the sockets to accept; use atomic access */
+
 	/* incoming queues */
 	/*  - new connections (after accept) */
 	ev_async new_con_watcher;
-	GAsyncQueue *new_con_queue;
+	liMPSCRing *new_con_queue;
+	gboolean new_con_pending; /** li_worker_new_con_push needs a wakeup in li_worker_new_con_flush; main worker only */
 
 	liServerStateWait wait_for_stop_connections;
 
@@ -109,15 +129,22 @@ struct liWorker {
 
 	/* collect framework */
 	ev_async collect_watcher;
-	GAsyncQueue *collect_queue;
+	liMPSCRing *collect_queue;
 
 	liJobQueue jobqueue;
 
 	liTaskletPool *tasklets;
 
 	liStatCache *stat_cache;
+	liFdCache *fd_cache;           /** NULL if disabled (fd_cache.max_open = 0) */
 
 	liBuffer *network_read_buf; /** available buffer - steal it if you need it, can be NULL. refcount must be 1, no other references. */
+
+	liURing *uring;                /** NULL if io_uring isn't used or not available */
+	liNetworkURing *network_uring; /** state of the io_uring network backend, created on first use */
+
+	GHashTable *backend_pools;     /** liBackendPool* -> liBackendWorkerPool*, created on first use */
+	gboolean backends_stopped;     /** don't keep idle backend connections after li_worker_stop */
 };
 
 LI_API liWorker* li_worker_new(liServer *srv, struct ev_loop *loop);
@@ -131,12 +158,24 @@ LI_API void li_worker_exit(liWorker *context, liWorker *wrk);
 
 LI_API void li_worker_new_con(liWorker *ctx, liWorker *wrk, liSocketAddress remote_addr, int s, liServerSocket *srv_sock);
 
+/* batched handover from the main worker to another worker: the address is copied into the ring entry,
+ * the target worker isn't woken up before li_worker_new_con_flush().
+ * returns FALSE if the address is too long (the caller keeps ownership of everything then) */
+LI_API gboolean li_worker_new_con_push(liWorker *wrk, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock);
+LI_API void li_worker_new_con_flush(liWorker *wrk);
+
+/* start/stop accepting on the SO_REUSEPORT sockets owned by wrk */
+LI_API void li_worker_listen(liWorker *context, liWorker *wrk, gboolean active);
+
 LI_API void li_worker_check_keepalive(liWorker *wrk);
 
 LI_API GString* li_worker_current_timestamp(liWorker *wrk, liTimeFunc, guint format_ndx);
 
-/* shutdown write and wait for eof before shutdown read and close */
-LI_API void li_worker_add_closing_socket(liWorker *wrk, int fd);
+/* shutdown write and wait for eof before shutdown read and close;
+ * pending zerocopy sends (may be NULL) are taken over: the socket stays open until the kernel
+ * released their buffers, or the unsent data is dropped at the timeout (see li_network_zerocopy_close)
+ */
+LI_API void li_worker_add_closing_socket(liWorker *wrk, int fd, liNetworkZeroCopy *zerocopy);
 
 /* internal function to recycle connection */
 LI_API void li_worker_con_put(liConnection *con);
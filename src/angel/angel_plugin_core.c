@@ -20,6 +20,7 @@ struct listen_socket {
 
 	liSocketAddress addr;
 	int fd;
+	gboolean reuseport; /* SO_REUSEPORT sockets are not shared and not in config->listen_sockets */
 };
 
 struct listen_ref_resource {
@@ -277,13 +278,16 @@ static const liPluginItem core_items[] = {
 	{ NULL, NULL, NULL }
 };
 
-static listen_socket* listen_new_socket(liSocketAddress *addr, int fd) {
+static void _listen_socket_free(gpointer ptr);
+
+static listen_socket* listen_new_socket(liSocketAddress *addr, int fd, gboolean reuseport) {
 	listen_socket *sock = g_slice_new0(listen_socket);
 
 	sock->refcount = 0;
 
 	sock->addr = *addr;
 	sock->fd = fd;
+	sock->reuseport = reuseport;
 
 	return sock;
 }
@@ -302,7 +306,11 @@ static void listen_ref_release(liServer *srv, liInstance *i, liPlugin *p, liInst
 	if (g_atomic_int_dec_and_test(&sock->refcount)) {
 		liPluginCoreConfig *config = (liPluginCoreConfig*) p->data;
 
-		g_hash_table_remove(config->listen_sockets, &sock->addr);
+		if (sock->reuseport) {
+			_listen_socket_free(sock);
+		} else {
+			g_hash_table_remove(config->listen_sockets, &sock->addr);
+		}
 	}
 
 	g_slice_free(listen_ref_resource, ref);
@@ -417,10 +425,17 @@ static gboolean listen_check_acl(liServer *srv, liPluginCoreConfig *config, liSo
 	return FALSE;
 }
 
-static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
+static int do_listen(liServer *srv, liSocketAddress *addr, GString *str, gboolean reuseport) {
 	int s, v;
 	GString *ipv6_str;
 
+#ifndef SO_REUSEPORT
+	if (reuseport) {
+		ERROR(srv, "SO_REUSEPORT not supported, can't listen on '%s'", str->str);
+		return -1;
+	}
+#endif
+
 	switch (addr->addr->plain.sa_family) {
 	case AF_INET:
 		if (-1 == (s = socket(AF_INET, SOCK_STREAM, 0))) {
@@ -433,6 +448,13 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 			ERROR(srv, "Couldn't setsockopt(SO_REUSEADDR): %s", g_strerror(errno));
 			return -1;
 		}
+#ifdef SO_REUSEPORT
+		if (reuseport && -1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+			close(s);
+			ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+			return -1;
+		}
+#endif
 		if (-1 == bind(s, &addr->addr->plain, addr->len)) {
 			close(s);
 			ERROR(srv, "Couldn't bind socket to '%s': %s", str->str, g_strerror(errno));
@@ -462,6 +484,14 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 			g_string_free(ipv6_str, TRUE);
 			return -1;
 		}
+#ifdef SO_REUSEPORT
+		if (reuseport && -1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+			close(s);
+			ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+			g_string_free(ipv6_str, TRUE);
+			return -1;
+		}
+#endif
 		if (-1 == setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v))) {
 			close(s);
 			ERROR(srv, "Couldn't setsockopt(IPV6_V6ONLY): %s", g_strerror(errno));
@@ -486,6 +516,10 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 #endif
 #ifdef HAVE_SYS_UN_H
 	case AF_UNIX:
+		if (reuseport) {
+			ERROR(srv, "Can't use SO_REUSEPORT with unix socket '%s'", str->str);
+			return -1;
+		}
 		if (-1 == unlink(addr->addr->un.sun_path)) {
 			switch (errno) {
 			case ENOENT:
@@ -519,7 +553,7 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 	return -1;
 }
 
-static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+static void core_listen_socket(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data, gboolean reuseport) {
 	GError *err = NULL;
 	gint fd;
 	GArray *fds;
@@ -527,7 +561,7 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 	liSocketAddress addr;
 	listen_socket *sock;
 
-	DEBUG(srv, "core_listen(%i) '%s'", id, data->str);
+	DEBUG(srv, "core_listen%s(%i) '%s'", reuseport ? "_reuseport" : "", id, data->str);
 
 	if (-1 == id) return; /* ignore simple calls */
 
@@ -553,8 +587,8 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 		return;
 	}
 
-	if (NULL == (sock = g_hash_table_lookup(config->listen_sockets, &addr))) {
-		fd = do_listen(srv, &addr, data);
+	if (reuseport || NULL == (sock = g_hash_table_lookup(config->listen_sockets, &addr))) {
+		fd = do_listen(srv, &addr, data, reuseport);
 
 		if (-1 == fd) {
 			GString *error = g_string_sized_new(0);
@@ -568,8 +602,8 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 		}
 
 		li_fd_init(fd);
-		sock = listen_new_socket(&addr, fd);
-		g_hash_table_insert(config->listen_sockets, &sock->addr, sock);
+		sock = listen_new_socket(&addr, fd, reuseport);
+		if (!reuseport) g_hash_table_insert(config->listen_sockets, &sock->addr, sock);
 	} else {
 		li_sockaddr_clear(&addr);
 	}
@@ -599,6 +633,15 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 	}
 }
 
+static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+	core_listen_socket(srv, p, i, id, data, FALSE);
+}
+
+/* every call creates a new socket, so each worker gets its own accept queue */
+static void core_listen_reuseport(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+	core_listen_socket(srv, p, i, id, data, TRUE);
+}
+
 static void core_reached_state(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
 	UNUSED(srv);
 	UNUSED(p);
@@ -801,6 +844,7 @@ static gboolean core_init(liServer *srv, liPlugin *p) {
 	config->listen_sockets = g_hash_table_new_full(li_hash_sockaddr, li_equal_sockaddr, NULL, _listen_socket_free);
 
 	li_angel_plugin_add_angel_cb(p, "listen", core_listen);
+	li_angel_plugin_add_angel_cb(p, "listen-reuseport", core_listen_reuseport);
 	li_angel_plugin_add_angel_cb(p, "reached-state", core_reached_state);
 	li_angel_plugin_add_angel_cb(p, "log-open-file", core_log_open_file);
 
@@ -0,0 +1,186 @@
+
+#include <lighttpd/arena.h>
+
+#define ARENA_ALIGN (2 * sizeof(gpointer))
+#define ARENA_ALIGN_SIZE(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* objects bigger than this get a block of their own, so we don't waste the rest of the current block */
+#define ARENA_LARGE (LI_ARENA_BLOCK_SIZE / 4)
+
+typedef struct arena_block arena_block;
+struct arena_block {
+	arena_block *next;
+	mempool_ptr ptr;
+	gsize size;
+};
+
+#define ARENA_BLOCK_HEADER ARENA_ALIGN_SIZE(sizeof(arena_block))
+
+static GStaticMutex arena_stats_mutex = G_STATIC_MUTEX_INIT;
+static GList *arena_stats_list = NULL;
+
+static arena_block* arena_block_new(liArena *arena, gsize size) {
+	mempool_ptr ptr;
+	arena_block *block;
+
+	size = mempool_align_page_size(size);
+	ptr = mempool_alloc(size);
+
+	block = ptr.data;
+	block->ptr = ptr;
+	block->size = size;
+	block->next = NULL;
+
+	if (arena->stats) arena->stats->blocks++;
+
+	return block;
+}
+
+static void arena_block_free(arena_block *block) {
+	mempool_free(block->ptr, block->size);
+}
+
+static void arena_set_idle(liArena *arena, gsize idle) {
+	if (arena->stats) arena->stats->idle = arena->stats->idle - arena->idle + idle;
+	arena->idle = idle;
+}
+
+void li_arena_init(liArena *arena, liArenaStats *stats) {
+	arena->stats = stats;
+	arena->blocks = NULL;
+	arena->pos = arena->end = NULL;
+	arena->used = 0;
+	arena->idle = 0;
+}
+
+void li_arena_reset(liArena *arena) {
+	arena_block *block, *next, *keep = NULL;
+
+	if (arena->stats) {
+		if (arena->used > arena->stats->high_water) arena->stats->high_water = arena->used;
+		arena->stats->resets++;
+	}
+	arena->used = 0;
+
+	for (block = arena->blocks; NULL != block; block = next) {
+		next = block->next;
+		if (NULL == keep && LI_ARENA_BLOCK_SIZE == block->size) {
+			keep = block;
+		} else {
+			arena_block_free(block);
+		}
+	}
+
+	arena->blocks = keep;
+	if (NULL != keep) {
+		keep->next = NULL;
+		arena->pos = ((gchar*) keep) + ARENA_BLOCK_HEADER;
+		arena->end = ((gchar*) keep) + keep->size;
+		arena_set_idle(arena, keep->size);
+	} else {
+		arena->pos = arena->end = NULL;
+		arena_set_idle(arena, 0);
+	}
+}
+
+void li_arena_trim(liArena *arena) {
+	arena_block *block, *next;
+
+	if (0 != arena->used) return;
+
+	for (block = arena->blocks; NULL != block; block = next) {
+		next = block->next;
+		arena_block_free(block);
+	}
+
+	arena->blocks = NULL;
+	arena->pos = arena->end = NULL;
+	arena_set_idle(arena, 0);
+}
+
+void li_arena_clear(liArena *arena) {
+	li_arena_reset(arena);
+	li_arena_trim(arena);
+}
+
+gpointer li_arena_alloc(liArena *arena, gsize size) {
+	arena_block *block;
+	gchar *p;
+
+	size = ARENA_ALIGN_SIZE(size);
+	arena->used += size;
+	if (0 != arena->idle) arena_set_idle(arena, 0);
+
+	if (size <= (gsize) (arena->end - arena->pos)) {
+		p = arena->pos;
+		arena->pos += size;
+		return p;
+	}
+
+	if (size > ARENA_LARGE) {
+		/* insert behind the current block, we still can use the rest of it */
+		block = arena_block_new(arena, ARENA_BLOCK_HEADER + size);
+		if (NULL == arena->blocks) {
+			arena->blocks = block;
+		} else {
+			block->next = ((arena_block*) arena->blocks)->next;
+			((arena_block*) arena->blocks)->next = block;
+		}
+		return ((gchar*) block) + ARENA_BLOCK_HEADER;
+	}
+
+	block = arena_block_new(arena, LI_ARENA_BLOCK_SIZE);
+	block->next = arena->blocks;
+	arena->blocks = block;
+
+	p = ((gchar*) block) + ARENA_BLOCK_HEADER;
+	arena->pos = p + size;
+	arena->end = ((gchar*) block) + block->size;
+
+	return p;
+}
+
+gpointer li_arena_alloc0(liArena *arena, gsize size) {
+	gpointer p = li_arena_alloc(arena, size);
+	memset(p, 0, size);
+	return p;
+}
+
+gchar* li_arena_strndup(liArena *arena, const gchar *str, gsize len) {
+	gchar *s = li_arena_alloc(arena, len + 1);
+	memcpy(s, str, len);
+	s[len] = '\0';
+	return s;
+}
+
+liArenaStats* li_arena_stats_new(const gchar *name) {
+	liArenaStats *stats = g_slice_new0(liArenaStats);
+	stats->name = g_strdup(name);
+
+	g_static_mutex_lock(&arena_stats_mutex);
+	arena_stats_list = g_list_prepend(arena_stats_list, stats);
+	g_static_mutex_unlock(&arena_stats_mutex);
+
+	return stats;
+}
+
+void li_arena_stats_free(liArenaStats *stats) {
+	if (!stats) return;
+
+	g_static_mutex_lock(&arena_stats_mutex);
+	arena_stats_list = g_list_remove(arena_stats_list, stats);
+	g_static_mutex_unlock(&arena_stats_mutex);
+
+	g_free(stats->name);
+	g_slice_free(liArenaStats, stats);
+}
+
+void li_arena_stats_foreach(liArenaStatsCB cb, gpointer data) {
+	GList *iter;
+
+	g_static_mutex_lock(&arena_stats_mutex);
+	for (iter = g_list_last(arena_stats_list); NULL != iter; iter = iter->prev) {
+		cb((liArenaStats*) iter->data, data);
+	}
+	g_static_mutex_unlock(&arena_stats_mutex);
+}
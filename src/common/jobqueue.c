@@ -51,12 +51,14 @@ static void job_queue_watcher_cb(struct ev_loop *loop, ev_timer *w, int revents)
 /* run jobs for async queued jobs */
 static void job_async_queue_cb(struct ev_loop *loop, ev_async *w, int revents) {
 	liJobQueue* jq = (liJobQueue*) w->data;
-	GAsyncQueue *q = jq->async_queue;
+	liMPSCRing *q = jq->async_queue;
 	liJobRef *jobref;
 	UNUSED(loop);
 	UNUSED(revents);
 
-	while (NULL != (jobref = g_async_queue_try_pop(q))) {
+	li_mpsc_ring_wakeup_reset(q);
+
+	while (li_mpsc_ring_pop(q, &jobref)) {
 		li_job_now_ref(jobref);
 		li_job_ref_release(jobref);
 	}
@@ -76,7 +78,7 @@ void li_job_queue_init(liJobQueue* jq, struct ev_loop *loop) {
 	ev_timer_init(&jq->queue_watcher, job_queue_watcher_cb, 0, 0);
 	jq->queue_watcher.data = jq;
 
-	jq->async_queue = g_async_queue_new();
+	jq->async_queue = li_mpsc_ring_new(sizeof(liJobRef*), 256);
 	ev_async_init(&jq->async_queue_watcher, job_async_queue_cb);
 	jq->async_queue_watcher.data = jq;
 	ev_async_start(jq->loop, &jq->async_queue_watcher);
@@ -84,10 +86,10 @@ void li_job_queue_init(liJobQueue* jq, struct ev_loop *loop) {
 }
 
 void li_job_queue_clear(liJobQueue *jq) {
-	while (jq->queue.length > 0 || g_async_queue_length(jq->async_queue) > 0) {
+	while (jq->queue.length > 0 || li_mpsc_ring_length(jq->async_queue) > 0) {
 		liJobRef *jobref;
 
-		while (NULL != (jobref = g_async_queue_try_pop(jq->async_queue))) {
+		while (li_mpsc_ring_pop(jq->async_queue, &jobref)) {
 			li_job_now_ref(jobref);
 			li_job_ref_release(jobref);
 		}
@@ -95,7 +97,7 @@ void li_job_queue_clear(liJobQueue *jq) {
 		job_queue_run(jq, 1);
 	}
 
-	g_async_queue_unref(jq->async_queue);
+	li_mpsc_ring_free(jq->async_queue);
 	jq->async_queue = NULL;
 
 	li_ev_safe_ref_and_stop(ev_async_stop, jq->loop, &jq->async_queue_watcher);
@@ -184,11 +186,12 @@ void li_job_now_ref(liJobRef *jobref) {
 
 void li_job_async(liJobRef *jobref) {
 	liJobQueue *jq = jobref->queue;
-	GAsyncQueue *const q = jq->async_queue;
+	liMPSCRing *const q = jq->async_queue;
 	if (NULL == q) return;
 	li_job_ref_acquire(jobref);
-	g_async_queue_push(q, jobref);
-	ev_async_send(jq->loop, &jq->async_queue_watcher);
+	if (li_mpsc_ring_push(q, &jobref)) {
+		ev_async_send(jq->loop, &jq->async_queue_watcher);
+	}
 }
 
 liJobRef* li_job_ref(liJobQueue *jq, liJob *job) {
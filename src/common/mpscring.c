@@ -0,0 +1,135 @@
+
+#include <lighttpd/mpscring.h>
+
+/* bounded queue with a sequence number per cell (Vyukov):
+ *   seq == pos      : cell is free for the producer claiming pos
+ *   seq == pos + 1  : cell contains the element for pos, ready for the consumer
+ *   seq < pos       : ring is full (the consumer didn't read the element from the last round yet)
+ */
+
+typedef struct mpsc_ring_cell mpsc_ring_cell;
+struct mpsc_ring_cell {
+	gint seq;
+	union { gpointer p; gint64 i; gdouble d; } data[1];
+};
+
+#define CELL_DATA_OFFSET (G_STRUCT_OFFSET(mpsc_ring_cell, data))
+#define RING_CELL(ring, pos) ((mpsc_ring_cell*) ((ring)->cells + ((pos) & (ring)->mask) * (ring)->cell_size))
+#define CELL_DATA(cell) (((guint8*) (cell)) + CELL_DATA_OFFSET)
+
+liMPSCRing* li_mpsc_ring_new(guint elem_size, guint size) {
+	liMPSCRing *ring = g_slice_new0(liMPSCRing);
+	guint i, align = sizeof(((mpsc_ring_cell*) NULL)->data[0]);
+
+	for (i = 1; i < size; i <<= 1) ;
+	size = MAX(i, 2);
+
+	ring->elem_size = elem_size;
+	ring->cell_size = CELL_DATA_OFFSET + ((elem_size + align - 1) / align) * align;
+	ring->mask = size - 1;
+	ring->cells = g_malloc0(ring->cell_size * size);
+
+	for (i = 0; i < size; i++) {
+		RING_CELL(ring, i)->seq = i;
+	}
+
+	ring->tail = 0;
+	ring->head = 0;
+	ring->wakeup = 0;
+
+	ring->overflow_mutex = g_mutex_new();
+	g_queue_init(&ring->overflow);
+	ring->overflow_len = 0;
+
+	return ring;
+}
+
+void li_mpsc_ring_free(liMPSCRing *ring) {
+	gpointer elem;
+
+	if (!ring) return;
+
+	while (NULL != (elem = g_queue_pop_head(&ring->overflow))) {
+		g_slice_free1(ring->elem_size, elem);
+	}
+	g_mutex_free(ring->overflow_mutex);
+
+	g_free(ring->cells);
+	g_slice_free(liMPSCRing, ring);
+}
+
+gboolean li_mpsc_ring_push(liMPSCRing *ring, gconstpointer elem) {
+	mpsc_ring_cell *cell;
+	guint pos = (guint) g_atomic_int_get(&ring->tail);
+
+	for (;;) {
+		gint dif;
+
+		cell = RING_CELL(ring, pos);
+		dif = (gint) ((guint) g_atomic_int_get(&cell->seq) - pos);
+
+		if (0 == dif) {
+			/* free cell, try to claim it */
+			if (g_atomic_int_compare_and_exchange(&ring->tail, (gint) pos, (gint) (pos + 1))) break;
+			pos = (guint) g_atomic_int_get(&ring->tail);
+		} else if (dif < 0) {
+			/* full */
+			gpointer copy = g_slice_copy(ring->elem_size, elem);
+
+			g_mutex_lock(ring->overflow_mutex);
+			g_queue_push_tail(&ring->overflow, copy);
+			g_atomic_int_inc(&ring->overflow_len);
+			g_mutex_unlock(ring->overflow_mutex);
+
+			goto wakeup;
+		} else {
+			/* another producer claimed it before us */
+			pos = (guint) g_atomic_int_get(&ring->tail);
+		}
+	}
+
+	memcpy(CELL_DATA(cell), elem, ring->elem_size);
+	/* publish element */
+	g_atomic_int_set(&cell->seq, (gint) (pos + 1));
+
+wakeup:
+	/* only the first producer after li_mpsc_ring_wakeup_reset has to wake up the consumer */
+	return g_atomic_int_compare_and_exchange(&ring->wakeup, 0, 1);
+}
+
+void li_mpsc_ring_wakeup_reset(liMPSCRing *ring) {
+	g_atomic_int_set(&ring->wakeup, 0);
+}
+
+gboolean li_mpsc_ring_pop(liMPSCRing *ring, gpointer elem) {
+	mpsc_ring_cell *cell = RING_CELL(ring, ring->head);
+
+	if ((guint) g_atomic_int_get(&cell->seq) == ring->head + 1) {
+		memcpy(elem, CELL_DATA(cell), ring->elem_size);
+		/* free cell for the next round */
+		g_atomic_int_set(&cell->seq, (gint) (ring->head + ring->mask + 1));
+		ring->head++;
+		return TRUE;
+	}
+
+	if (g_atomic_int_get(&ring->overflow_len) > 0) {
+		gpointer copy;
+
+		g_mutex_lock(ring->overflow_mutex);
+		copy = g_queue_pop_head(&ring->overflow);
+		if (NULL != copy) g_atomic_int_add(&ring->overflow_len, -1);
+		g_mutex_unlock(ring->overflow_mutex);
+
+		if (NULL != copy) {
+			memcpy(elem, copy, ring->elem_size);
+			g_slice_free1(ring->elem_size, copy);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+guint li_mpsc_ring_length(liMPSCRing *ring) {
+	return ((guint) g_atomic_int_get(&ring->tail) - ring->head) + (guint) g_atomic_int_get(&ring->overflow_len);
+}
@@ -345,6 +345,24 @@ static void profiler_dump_frame(guint level, profiler_stackframe *frame, gsize m
 	}
 }
 
+static void profiler_dump_arena(liArenaStats *stats, gpointer data) {
+	gchar str[1024];
+	gint len;
+	UNUSED(data);
+
+	len = snprintf(str, sizeof(str),
+		"%s: high water %"G_GSIZE_FORMAT" %s, %"G_GUINT64_FORMAT" resets, %"G_GUINT64_FORMAT" blocks, %"G_GSIZE_FORMAT" %s idle\n",
+		stats->name,
+		(stats->high_water > 1024) ? stats->high_water / 1024 : stats->high_water,
+		(stats->high_water > 1024) ? "kilobytes" : "bytes",
+		stats->resets,
+		stats->blocks,
+		(stats->idle > 1024) ? stats->idle / 1024 : stats->idle,
+		(stats->idle > 1024) ? "kilobytes" : "bytes"
+	);
+	profiler_write(str, MIN(len, (gint) sizeof(str) - 1));
+}
+
 void li_profiler_dump(gint minsize) {
 	profiler_stackframe *tree_cur, *frame;
 	gchar **symbols;
@@ -418,6 +436,15 @@ void li_profiler_dump(gint minsize) {
 	);
 	profiler_write(str, len);
 
+	/* the arena stats lock must not be taken while holding the profiler lock:
+	 * registering stats allocates, which takes the profiler lock
+	 */
+	g_static_mutex_unlock(&profiler_mutex);
+	len = sprintf(str, "--------------- arenas ---------------\n");
+	profiler_write(str, len);
+	li_arena_stats_foreach(profiler_dump_arena, NULL);
+	g_static_mutex_lock(&profiler_mutex);
+
 	len = sprintf(str, "--------------- memory profiler dump end ---------------\n");
 
 	free(tree);
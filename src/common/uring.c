@@ -0,0 +1,282 @@
+
+#include <lighttpd/uring.h>
+
+#ifdef USE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#ifndef __NR_io_uring_setup
+# if defined(__alpha__)
+#  define __NR_io_uring_setup 535
+#  define __NR_io_uring_enter 536
+#  define __NR_io_uring_register 537
+# else
+#  define __NR_io_uring_setup 425
+#  define __NR_io_uring_enter 426
+#  define __NR_io_uring_register 427
+# endif
+#endif
+
+#define URING_PTR(base, offset) ((gpointer) (((guint8*) (base)) + (offset)))
+
+static int uring_setup(guint entries, struct io_uring_params *p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, guint to_submit, guint min_complete, guint flags) {
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, guint opcode, gpointer arg, guint nr_args) {
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* publish the entries from li_uring_get_sqe; returns the number of entries the kernel didn't consume yet */
+static guint uring_flush(liURing *ring) {
+	guint tail = *ring->sq_tail;
+
+	for ( ; tail != ring->sqe_tail; tail++) {
+		ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+	}
+	g_atomic_int_set((gint*) ring->sq_tail, (gint) tail);
+
+	return tail - (guint) g_atomic_int_get((gint*) ring->sq_head);
+}
+
+static void uring_reap(liURing *ring) {
+	guint head = *ring->cq_head, tail = (guint) g_atomic_int_get((gint*) ring->cq_tail);
+
+	for ( ; head != tail; head++) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+		liURingOp *op = (liURingOp*) (uintptr_t) cqe->user_data;
+
+		op->res = cqe->res;
+		if (NULL == op->callback) {
+			ring->sync_pending--;
+		} else {
+			ring->async_pending--;
+			g_queue_push_tail_link(&ring->completed, &op->link);
+		}
+	}
+
+	g_atomic_int_set((gint*) ring->cq_head, (gint) head);
+}
+
+static int uring_submit(liURing *ring, guint min_complete) {
+	guint to_submit = uring_flush(ring);
+	int r;
+
+	if (0 == to_submit && 0 == min_complete) return 0;
+
+	while (-1 == (r = uring_enter(ring->fd, to_submit, min_complete, (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0))) {
+		switch (errno) {
+		case EINTR:
+			break; /* try again */
+		case EAGAIN:
+		case EBUSY:
+			/* completion queue is full, make room */
+			uring_reap(ring);
+			return 0;
+		default:
+			return -1;
+		}
+	}
+
+	return r;
+}
+
+static void uring_dispatch(liURing *ring) {
+	GList *link;
+
+	while (NULL != (link = g_queue_pop_head_link(&ring->completed))) {
+		liURingOp *op = (liURingOp*) link->data;
+		op->callback(op);
+	}
+}
+
+static void uring_event_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	liURing *ring = (liURing*) w->data;
+	eventfd_t value;
+	UNUSED(loop);
+	UNUSED(revents);
+
+	if (-1 == eventfd_read(ring->event_fd, &value) && EAGAIN != errno) {
+		g_warning("reading io_uring eventfd failed: %s", g_strerror(errno));
+	}
+
+	uring_reap(ring);
+	uring_dispatch(ring);
+}
+
+static void uring_prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents) {
+	liURing *ring = (liURing*) w->data;
+	UNUSED(loop);
+	UNUSED(revents);
+
+	if (ring->sqe_tail != *ring->sq_tail) {
+		if (-1 == uring_submit(ring, 0)) {
+			g_warning("io_uring_enter failed: %s", g_strerror(errno));
+		}
+	}
+}
+
+liURing* li_uring_new(struct ev_loop *loop, guint entries) {
+	liURing *ring;
+	struct io_uring_params p;
+	int fd, err;
+
+	memset(&p, 0, sizeof(p));
+	if (-1 == (fd = uring_setup(entries, &p))) return NULL;
+
+	ring = g_slice_new0(liURing);
+	ring->fd = fd;
+	ring->event_fd = -1;
+	ring->loop = loop;
+	ring->sq_ring = ring->cq_ring = ring->sqes = MAP_FAILED;
+	g_queue_init(&ring->completed);
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(guint);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sq_ring_size = ring->cq_ring_size = MAX(ring->sq_ring_size, ring->cq_ring_size);
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == ring->sq_ring) goto error;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == ring->cq_ring) goto error;
+	}
+
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (MAP_FAILED == ring->sqes) goto error;
+
+	ring->sq_head = URING_PTR(ring->sq_ring, p.sq_off.head);
+	ring->sq_tail = URING_PTR(ring->sq_ring, p.sq_off.tail);
+	ring->sq_array = URING_PTR(ring->sq_ring, p.sq_off.array);
+	ring->sq_mask = *(guint*) URING_PTR(ring->sq_ring, p.sq_off.ring_mask);
+	ring->sq_entries = p.sq_entries;
+	ring->sqe_tail = *ring->sq_tail;
+
+	ring->cq_head = URING_PTR(ring->cq_ring, p.cq_off.head);
+	ring->cq_tail = URING_PTR(ring->cq_ring, p.cq_off.tail);
+	ring->cq_mask = *(guint*) URING_PTR(ring->cq_ring, p.cq_off.ring_mask);
+	ring->cqes = URING_PTR(ring->cq_ring, p.cq_off.cqes);
+
+	if (-1 == (ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) goto error;
+	if (-1 == uring_register(fd, IORING_REGISTER_EVENTFD, &ring->event_fd, 1)) goto error;
+
+	ev_io_init(&ring->event_watcher, uring_event_cb, ring->event_fd, EV_READ);
+	ring->event_watcher.data = ring;
+	ev_io_start(loop, &ring->event_watcher);
+	ev_unref(loop); /* this watcher shouldn't keep the loop alive */
+
+	ev_init(&ring->prepare, uring_prepare_cb);
+	ring->prepare.data = ring;
+	ev_prepare_start(loop, &ring->prepare);
+	ev_unref(loop); /* this watcher shouldn't keep the loop alive */
+
+	return ring;
+
+error:
+	err = errno;
+	li_uring_free(ring);
+	errno = err;
+	return NULL;
+}
+
+void li_uring_free(liURing *ring) {
+	if (!ring) return;
+
+	/* the kernel may still write to the ops (and their buffers), and the callbacks release them */
+	while (ring->sync_pending + ring->async_pending > 0) {
+		if (-1 == uring_submit(ring, ring->sync_pending + ring->async_pending)) {
+			g_warning("io_uring_enter failed, leaking %u in-flight ops: %s", ring->sync_pending + ring->async_pending, g_strerror(errno));
+			break;
+		}
+		uring_reap(ring);
+		uring_dispatch(ring);
+	}
+	uring_dispatch(ring);
+
+	if (ev_is_active(&ring->event_watcher)) {
+		ev_ref(ring->loop);
+		ev_io_stop(ring->loop, &ring->event_watcher);
+	}
+	if (ev_is_active(&ring->prepare)) {
+		ev_ref(ring->loop);
+		ev_prepare_stop(ring->loop, &ring->prepare);
+	}
+
+	if (MAP_FAILED != ring->sqes) munmap(ring->sqes, ring->sqes_size);
+	if (MAP_FAILED != ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+	if (MAP_FAILED != ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+
+	if (-1 != ring->event_fd) close(ring->event_fd);
+	close(ring->fd);
+
+	g_slice_free(liURing, ring);
+}
+
+guint li_uring_reserve(liURing *ring, guint n) {
+	guint free_entries = ring->sq_entries - (ring->sqe_tail - (guint) g_atomic_int_get((gint*) ring->sq_head));
+
+	/* the queued entries are complete chains here, they may be submitted */
+	if (free_entries < n && -1 != uring_submit(ring, 0)) {
+		free_entries = ring->sq_entries - (ring->sqe_tail - (guint) g_atomic_int_get((gint*) ring->sq_head));
+	}
+
+	ring->sqe_reserved = MIN(n, free_entries);
+	return ring->sqe_reserved;
+}
+
+struct io_uring_sqe* li_uring_get_sqe(liURing *ring, liURingOp *op) {
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_reserved > 0) {
+		ring->sqe_reserved--;
+	} else if (ring->sqe_tail - (guint) g_atomic_int_get((gint*) ring->sq_head) >= ring->sq_entries) {
+		/* submission queue full */
+		if (-1 == uring_submit(ring, 0)) return NULL;
+		if (ring->sqe_tail - (guint) g_atomic_int_get((gint*) ring->sq_head) >= ring->sq_entries) return NULL;
+	}
+
+	sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+	ring->sqe_tail++;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (guint64) (uintptr_t) op;
+
+	op->res = 0;
+	op->link.data = op;
+	op->link.next = op->link.prev = NULL;
+	if (NULL == op->callback) {
+		ring->sync_pending++;
+	} else {
+		ring->async_pending++;
+	}
+
+	return sqe;
+}
+
+gboolean li_uring_wait(liURing *ring) {
+	while (ring->sync_pending > 0) {
+		if (-1 == uring_submit(ring, ring->sync_pending)) return FALSE;
+		uring_reap(ring);
+	}
+
+	if (ring->completed.length > 0) {
+		ev_feed_event(ring->loop, &ring->event_watcher, EV_READ);
+	}
+
+	return TRUE;
+}
+
+#endif
@@ -8,8 +8,10 @@
 #define PACKAGE_VERSION "${PACKAGE_VERSION}"
 
 /* System */
+#cmakedefine HAVE_LINUX_IO_URING_H
 #cmakedefine HAVE_SYS_DEVPOLL_H
 #cmakedefine HAVE_SYS_EPOLL_H
+#cmakedefine HAVE_SYS_EVENTFD_H
 #cmakedefine HAVE_SYS_EVENT_H
 #cmakedefine HAVE_SYS_MMAN_H
 #cmakedefine HAVE_SYS_POLL_H
@@ -119,6 +121,7 @@
 #cmakedefine  HAVE_CRYPT_R
 #cmakedefine  HAVE_EPOLL_CTL
 #cmakedefine  HAVE_FORK
+#cmakedefine  HAVE_FSTATAT
 #cmakedefine  HAVE_GETRLIMIT
 #cmakedefine  HAVE_GETUID
 #cmakedefine  HAVE_GMTIME_R
@@ -143,6 +146,7 @@
 #cmakedefine  HAVE_SIGACTION
 #cmakedefine  HAVE_SIGNAL
 #cmakedefine  HAVE_SIGTIMEDWAIT
+#cmakedefine  HAVE_SPLICE
 #cmakedefine  HAVE_STRPTIME
 #cmakedefine  HAVE_SYSLOG
 #cmakedefine  HAVE_WRITEV
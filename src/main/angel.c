@@ -58,13 +58,13 @@ static void li_angel_listen_cb(liAngelCall *acall, gpointer pctx, gboolean timeo
 
 	if (timeout) {
 		ERROR(srv, "listen failed: %s", "time out");
-		return;
+		goto failed;
 	}
 
 	if (error->len > 0) {
 		ERROR(srv, "listen failed: %s", error->str);
 		/* TODO: exit? */
-		return;
+		goto failed;
 	}
 
 	if (fds && fds->len > 0) {
@@ -80,11 +80,16 @@ static void li_angel_listen_cb(liAngelCall *acall, gpointer pctx, gboolean timeo
 		g_array_set_size(fds, 0);
 	} else {
 		ERROR(srv, "listen failed: %s", "received no filedescriptors");
+		goto failed;
 	}
+
+	return;
+
+failed:
+	if (ctx.cb) ctx.cb(srv, -1, ctx.data);
 }
 
-/* listen to a socket */
-void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer data) {
+static void angel_listen(liServer *srv, const gchar *action, gsize action_len, GString *str, gboolean reuseport, liAngelListenCB cb, gpointer data) {
 	if (srv->acon) {
 		liAngelCall *acall = li_angel_call_new(li_angel_listen_cb, 20.0);
 		angel_listen_cb_ctx *ctx = g_slice_new0(angel_listen_cb_ctx);
@@ -94,15 +99,16 @@ void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer d
 		ctx->cb = cb;
 		ctx->data = data;
 		acall->context = ctx;
-		if (!li_angel_send_call(srv->acon, CONST_STR_LEN("core"), CONST_STR_LEN("listen"), acall, g_string_new_len(GSTR_LEN(str)), &err)) {
+		if (!li_angel_send_call(srv->acon, CONST_STR_LEN("core"), action, action_len, acall, g_string_new_len(GSTR_LEN(str)), &err)) {
 			ERROR(srv, "couldn't send call: %s", err->message);
 			g_error_free(err);
 		}
 	} else {
-		int fd = li_angel_fake_listen(srv, str);
+		int fd = li_angel_fake_listen(srv, str, reuseport);
 		if (-1 == fd) {
 			ERROR(srv, "listen('%s') failed", str->str);
 			/* TODO: exit? */
+			if (cb) cb(srv, -1, data);
 		} else {
 			if (cb) {
 				cb(srv, fd, data);
@@ -113,6 +119,16 @@ void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer d
 	}
 }
 
+/* listen to a socket */
+void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer data) {
+	angel_listen(srv, CONST_STR_LEN("listen"), str, FALSE, cb, data);
+}
+
+/* listen to a new SO_REUSEPORT socket */
+void li_angel_listen_reuseport(liServer *srv, GString *str, liAngelListenCB cb, gpointer data) {
+	angel_listen(srv, CONST_STR_LEN("listen-reuseport"), str, TRUE, cb, data);
+}
+
 /* send log messages while startup to angel */
 void li_angel_log(liServer *srv, GString *str) {
 	li_angel_fake_log(srv, str);
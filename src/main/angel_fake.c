@@ -6,7 +6,7 @@
 #include <fcntl.h>
 
 /* listen to a socket */
-int li_angel_fake_listen(liServer *srv, GString *str) {
+int li_angel_fake_listen(liServer *srv, GString *str, gboolean reuseport) {
 	guint32 ipv4;
 #ifdef HAVE_IPV6
 	guint8 ipv6[16];
@@ -19,6 +19,11 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 		struct sockaddr_un *un;
 		socklen_t slen = str->len + 1 - 5 + sizeof(un->sun_family);
 
+		if (reuseport) {
+			ERROR(srv, "Can't use SO_REUSEPORT with unix socket '%s'", str->str);
+			return -1;
+		}
+
 		un = g_malloc0(slen);
 		un->sun_family = AF_UNIX;
 		strcpy(un->sun_path, str->str + 5);
@@ -54,6 +59,12 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 		DEBUG(srv, "listen to unix socket: '%s'", str->str);
 		return s;
 	} else
+#endif
+#ifndef SO_REUSEPORT
+	if (reuseport) {
+		ERROR(srv, "SO_REUSEPORT not supported, can't listen on '%s'", str->str);
+		return -1;
+	} else
 #endif
 	if (li_parse_ipv4(str->str, &ipv4, NULL, &port)) {
 		int s, v;
@@ -74,6 +85,13 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 			ERROR(srv, "Couldn't setsockopt(SO_REUSEADDR): %s", g_strerror(errno));
 			return -1;
 		}
+#ifdef SO_REUSEPORT
+		if (reuseport && -1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+			close(s);
+			ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+			return -1;
+		}
+#endif
 		if (-1 == bind(s, (struct sockaddr*)&addr, sizeof(addr))) {
 			close(s);
 			ERROR(srv, "Couldn't bind socket to '%s': %s", inet_ntoa(addr.sin_addr), g_strerror(errno));
@@ -110,6 +128,14 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 			g_string_free(ipv6_str, TRUE);
 			return -1;
 		}
+#ifdef SO_REUSEPORT
+		if (reuseport && -1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+			close(s);
+			ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+			g_string_free(ipv6_str, TRUE);
+			return -1;
+		}
+#endif
 		if (-1 == setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v))) {
 			close(s);
 			ERROR(srv, "Couldn't setsockopt(IPV6_V6ONLY): %s", g_strerror(errno));
@@ -0,0 +1,536 @@
+
+#include <lighttpd/base.h>
+
+static const guint latency_bucket_limits[LI_BACKEND_LATENCY_BUCKETS - 1] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+guint li_backend_latency_bucket_limit(guint bucket) {
+	return (bucket < LI_BACKEND_LATENCY_BUCKETS - 1) ? latency_bucket_limits[bucket] : 0;
+}
+
+guint li_backend_latency_bucket(ev_tstamp duration) {
+	ev_tstamp ms = duration * 1000;
+	guint i;
+
+	for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS - 1; i++) {
+		if (ms < latency_bucket_limits[i]) return i;
+	}
+
+	return LI_BACKEND_LATENCY_BUCKETS - 1;
+}
+
+/**********************************************************************************/
+/* config */
+
+void li_backend_config_init(liBackendConfig *config) {
+	config->sock.len = 0;
+	config->sock.addr = NULL;
+	config->max_connections = -1;
+	config->connect_timeout = 0;
+	config->max_idle = 0;
+	config->idle_timeout = 30;
+	config->max_requests = 0;
+}
+
+static gboolean backend_config_number(liServer *srv, const gchar *module, const gchar *key, liValue *val, gint64 min, gint64 *result) {
+	if (val->type != LI_VALUE_NUMBER || val->data.number < min) {
+		ERROR(srv, "%s %s expects a %s number as parameter", module, key, (min > 0) ? "positive" : "non-negative");
+		return FALSE;
+	}
+	*result = val->data.number;
+	return TRUE;
+}
+
+gint li_backend_config_option(liServer *srv, const gchar *module, liBackendConfig *config, GString **socket_str, const gchar *key, liValue *val) {
+	gint64 n;
+
+	if (g_str_equal(key, "socket")) {
+		if (val->type != LI_VALUE_STRING) {
+			ERROR(srv, "%s socket expects a string as parameter", module);
+			return -1;
+		}
+		*socket_str = val->data.string;
+	} else if (g_str_equal(key, "max_connections")) {
+		if (!backend_config_number(srv, module, key, val, 1, &n)) return -1;
+		config->max_connections = n;
+	} else if (g_str_equal(key, "connect_timeout")) {
+		if (!backend_config_number(srv, module, key, val, 0, &n)) return -1;
+		config->connect_timeout = n;
+	} else if (g_str_equal(key, "max_idle")) {
+		if (!backend_config_number(srv, module, key, val, 0, &n)) return -1;
+		config->max_idle = n;
+	} else if (g_str_equal(key, "idle_timeout")) {
+		if (!backend_config_number(srv, module, key, val, 1, &n)) return -1;
+		config->idle_timeout = n;
+	} else if (g_str_equal(key, "max_requests")) {
+		if (!backend_config_number(srv, module, key, val, 0, &n)) return -1;
+		config->max_requests = n;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+/**********************************************************************************/
+/* pool */
+
+liBackendPool* li_backend_pool_new(liServer *srv, const liBackendConfig *config, GString *socket_str, guint tcp_default_port) {
+	liBackendPool *bpool;
+	liSocketAddress saddr;
+
+	saddr = li_sockaddr_from_string(socket_str, tcp_default_port);
+	if (NULL == saddr.addr) {
+		ERROR(srv, "Invalid socket address '%s'", socket_str->str);
+		return NULL;
+	}
+
+	bpool = g_slice_new0(liBackendPool);
+	bpool->refcount = 1;
+	bpool->config = *config;
+	bpool->config.sock = saddr;
+	bpool->name = g_string_new_len(GSTR_LEN(socket_str));
+
+	return bpool;
+}
+
+void li_backend_pool_acquire(liBackendPool *bpool) {
+	assert(g_atomic_int_get(&bpool->refcount) > 0);
+	g_atomic_int_inc(&bpool->refcount);
+}
+
+void li_backend_pool_release(liBackendPool *bpool) {
+	if (!bpool) return;
+	assert(g_atomic_int_get(&bpool->refcount) > 0);
+	if (g_atomic_int_dec_and_test(&bpool->refcount)) {
+		li_sockaddr_clear(&bpool->config.sock);
+		g_string_free(bpool->name, TRUE);
+		g_slice_free(liBackendPool, bpool);
+	}
+}
+
+/**********************************************************************************/
+/* connections */
+
+static void backend_connection_free(liBackendConnection *bcon) {
+	liBackendWorkerPool *wpool = bcon->wpool;
+
+	ev_io_stop(wpool->wrk->loop, &bcon->watcher);
+	if (NULL != bcon->idle_link.data) {
+		li_waitqueue_remove(&wpool->idle_queue, &bcon->idle_elem);
+		g_queue_unlink(&wpool->idle, &bcon->idle_link);
+		bcon->idle_link.data = NULL;
+		wpool->wrk->stats.backend_pool_idle--;
+	}
+	if (-1 != bcon->fd) close(bcon->fd);
+	g_slice_free(liBackendConnection, bcon);
+}
+
+static liBackendWait* backend_wait_new(liVRequest *vr, liBackendWorkerPool *wpool) {
+	liBackendWait *bwait = g_slice_new0(liBackendWait);
+
+	bwait->vr_ref = li_vrequest_get_ref(vr);
+	bwait->wpool = wpool;
+	bwait->link.data = bwait;
+	bwait->timeout_elem.data = bwait;
+	if (wpool->pool->config.connect_timeout > 0) {
+		li_waitqueue_push(&wpool->connect_queue, &bwait->timeout_elem);
+	}
+
+	return bwait;
+}
+
+static void backend_wait_free(liBackendWait *bwait) {
+	li_waitqueue_remove(&bwait->wpool->connect_queue, &bwait->timeout_elem);
+	li_job_ref_release(bwait->vr_ref);
+	g_slice_free(liBackendWait, bwait);
+}
+
+/* a connection slot is free: give it to the next waiting request */
+static void backend_slot_free(liBackendWorkerPool *wpool) {
+	GList *link = g_queue_pop_head_link(&wpool->waiting);
+	liBackendWait *bwait;
+
+	if (NULL == link) {
+		wpool->active--;
+		return;
+	}
+
+	bwait = link->data;
+	bwait->reserved = TRUE;
+	li_job_later_ref(bwait->vr_ref);
+}
+
+static liBackendError backend_connect_error(liBackendWorkerPool *wpool, int err) {
+	liBackendPool *bpool = wpool->pool;
+
+	if (EAGAIN == err) return LI_BACKEND_OVERLOAD; /* backend overloaded */
+
+	if (err != g_atomic_int_get(&bpool->last_errno)) {
+		g_atomic_int_set(&bpool->last_errno, err);
+		ERROR(wpool->wrk->srv, "Couldn't connect to '%s': %s", bpool->name->str, g_strerror(err));
+	}
+
+	return LI_BACKEND_DEAD;
+}
+
+static void backend_connected(liBackendConnection *bcon) {
+	liWorker *wrk = bcon->wpool->wrk;
+
+	g_atomic_int_set(&bcon->wpool->pool->last_errno, 0);
+	wrk->stats.backend_connect_latency[li_backend_latency_bucket(ev_now(wrk->loop) - bcon->ts_connect)]++;
+}
+
+static liBackendResult backend_use(liWorker *wrk, liBackendConnection *bcon, liBackendConnection **pbcon) {
+	bcon->requests++;
+	bcon->ts_request = ev_now(wrk->loop);
+	bcon->first_byte = FALSE;
+	*pbcon = bcon;
+
+	return LI_BACKEND_SUCCESS;
+}
+
+static void backend_connect_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	liBackendConnection *bcon = w->data;
+	liBackendWorkerPool *wpool = bcon->wpool;
+	liBackendWait *bwait = bcon->wait;
+	liBackendPool *bpool = wpool->pool;
+	UNUSED(revents);
+
+	if (-1 == connect(bcon->fd, &bpool->config.sock.addr->plain, bpool->config.sock.len)) {
+		switch (errno) {
+		case EINPROGRESS:
+		case EALREADY:
+		case EINTR:
+			return;
+		case EISCONN:
+			break;
+		default:
+			bwait->failed = TRUE;
+			bwait->berror = backend_connect_error(wpool, errno);
+			bwait->bcon = NULL;
+			backend_connection_free(bcon);
+			backend_slot_free(wpool);
+			li_waitqueue_remove(&wpool->connect_queue, &bwait->timeout_elem);
+			li_job_later_ref(bwait->vr_ref);
+			return;
+		}
+	}
+
+	ev_io_stop(loop, w);
+	bcon->wait = NULL;
+	backend_connected(bcon);
+	li_waitqueue_remove(&wpool->connect_queue, &bwait->timeout_elem);
+	li_job_later_ref(bwait->vr_ref);
+}
+
+/* the slot is already counted in wpool->active */
+static liBackendResult backend_connect(liVRequest *vr, liBackendWorkerPool *wpool, liBackendConnection **pbcon, liBackendWait **pbwait, liBackendError *berror) {
+	liBackendPool *bpool = wpool->pool;
+	liBackendConnection *bcon;
+	int fd;
+
+	do {
+		fd = socket(bpool->config.sock.addr->plain.sa_family, SOCK_STREAM, 0);
+	} while (-1 == fd && errno == EINTR);
+	if (-1 == fd) {
+		if (errno == EMFILE) {
+			li_server_out_of_fds(vr->wrk->srv);
+		}
+		VR_ERROR(vr, "Couldn't open socket: %s", g_strerror(errno));
+		*berror = LI_BACKEND_OVERLOAD;
+		goto failed;
+	}
+	li_fd_init(fd);
+
+	bcon = g_slice_new0(liBackendConnection);
+	bcon->fd = fd;
+	bcon->wpool = wpool;
+	bcon->ts_connect = ev_now(vr->wrk->loop);
+	ev_init(&bcon->watcher, backend_connect_cb);
+	ev_io_set(&bcon->watcher, fd, EV_WRITE);
+	bcon->watcher.data = bcon;
+
+	if (-1 == connect(fd, &bpool->config.sock.addr->plain, bpool->config.sock.len)) {
+		switch (errno) {
+		case EINPROGRESS:
+		case EALREADY:
+		case EINTR:
+			if (NULL == *pbwait) *pbwait = backend_wait_new(vr, wpool);
+			(*pbwait)->bcon = bcon;
+			bcon->wait = *pbwait;
+			ev_io_start(vr->wrk->loop, &bcon->watcher);
+			return LI_BACKEND_WAIT;
+		case EISCONN:
+			break;
+		default:
+			*berror = backend_connect_error(wpool, errno);
+			backend_connection_free(bcon);
+			goto failed;
+		}
+	}
+
+	backend_connected(bcon);
+	if (NULL != *pbwait) {
+		backend_wait_free(*pbwait);
+		*pbwait = NULL;
+	}
+
+	return backend_use(vr->wrk, bcon, pbcon);
+
+failed:
+	backend_slot_free(wpool);
+	if (NULL != *pbwait) {
+		backend_wait_free(*pbwait);
+		*pbwait = NULL;
+	}
+	return LI_BACKEND_ERROR;
+}
+
+static void backend_idle_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	UNUSED(loop); UNUSED(revents);
+
+	/* eof (or data we didn't ask for): the connection is useless */
+	backend_connection_free(w->data);
+}
+
+static void backend_idle_timeout_cb(liWaitQueue *wq, gpointer data) {
+	liWaitQueueElem *wqe;
+	UNUSED(data);
+
+	while (NULL != (wqe = li_waitqueue_pop(wq))) {
+		backend_connection_free(wqe->data);
+	}
+
+	li_waitqueue_update(wq);
+}
+
+static void backend_connect_timeout_cb(liWaitQueue *wq, gpointer data) {
+	liBackendWorkerPool *wpool = data;
+	liWaitQueueElem *wqe;
+
+	while (NULL != (wqe = li_waitqueue_pop(wq))) {
+		liBackendWait *bwait = wqe->data;
+
+		if (bwait->reserved) {
+			/* got a slot too late: pass it on */
+			bwait->reserved = FALSE;
+			backend_slot_free(wpool);
+			bwait->berror = LI_BACKEND_OVERLOAD;
+		} else if (NULL != bwait->bcon) {
+			/* still connecting */
+			backend_connection_free(bwait->bcon);
+			bwait->bcon = NULL;
+			backend_slot_free(wpool);
+			bwait->berror = backend_connect_error(wpool, ETIMEDOUT);
+		} else {
+			/* no free slot */
+			g_queue_unlink(&wpool->waiting, &bwait->link);
+			bwait->berror = LI_BACKEND_OVERLOAD;
+		}
+		bwait->failed = TRUE;
+		li_job_later_ref(bwait->vr_ref);
+	}
+
+	li_waitqueue_update(wq);
+}
+
+static void backend_worker_pool_free(gpointer data) {
+	liBackendWorkerPool *wpool = data;
+	GList *link;
+
+	while (NULL != (link = g_queue_peek_head_link(&wpool->idle))) {
+		backend_connection_free(link->data);
+	}
+	li_waitqueue_stop(&wpool->idle_queue);
+	li_waitqueue_stop(&wpool->connect_queue);
+
+	li_backend_pool_release(wpool->pool);
+	g_slice_free(liBackendWorkerPool, wpool);
+}
+
+static liBackendWorkerPool* backend_worker_pool_get(liWorker *wrk, liBackendPool *bpool) {
+	liBackendWorkerPool *wpool;
+
+	if (NULL == wrk->backend_pools) {
+		wrk->backend_pools = g_hash_table_new_full(NULL, NULL, NULL, backend_worker_pool_free);
+	} else if (NULL != (wpool = g_hash_table_lookup(wrk->backend_pools, bpool))) {
+		return wpool;
+	}
+
+	wpool = g_slice_new0(liBackendWorkerPool);
+	li_backend_pool_acquire(bpool);
+	wpool->pool = bpool;
+	wpool->wrk = wrk;
+	li_waitqueue_init(&wpool->idle_queue, wrk->loop, backend_idle_timeout_cb, bpool->config.idle_timeout, wpool);
+	li_waitqueue_init(&wpool->connect_queue, wrk->loop, backend_connect_timeout_cb, bpool->config.connect_timeout, wpool);
+	g_hash_table_insert(wrk->backend_pools, bpool, wpool);
+
+	return wpool;
+}
+
+liBackendResult li_backend_get(liVRequest *vr, liBackendPool *bpool, liBackendConnection **pbcon, liBackendWait **pbwait, liBackendError *berror) {
+	liWorker *wrk = vr->wrk;
+	liBackendWorkerPool *wpool = backend_worker_pool_get(wrk, bpool);
+	liBackendWait *bwait = *pbwait;
+	liBackendConnection *bcon;
+	char c;
+
+	*pbcon = NULL;
+
+	if (NULL != bwait) {
+		if (bwait->failed) {
+			*berror = bwait->berror;
+			backend_wait_free(bwait);
+			*pbwait = NULL;
+			return LI_BACKEND_ERROR;
+		}
+
+		if (NULL != (bcon = bwait->bcon)) {
+			if (bcon->wait == bwait) return LI_BACKEND_WAIT; /* still connecting */
+
+			/* connected, or handed over by li_backend_put */
+			backend_wait_free(bwait);
+			*pbwait = NULL;
+			return backend_use(wrk, bcon, pbcon);
+		}
+
+		if (!bwait->reserved) return LI_BACKEND_WAIT; /* no free slot yet */
+
+		bwait->reserved = FALSE;
+		return backend_connect(vr, wpool, pbcon, pbwait, berror);
+	}
+
+	while (NULL != (bcon = g_queue_peek_head(&wpool->idle))) {
+		/* the backend may have closed it since the last loop iteration */
+		if (-1 == recv(bcon->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+			ev_io_stop(wrk->loop, &bcon->watcher);
+			li_waitqueue_remove(&wpool->idle_queue, &bcon->idle_elem);
+			g_queue_unlink(&wpool->idle, &bcon->idle_link);
+			bcon->idle_link.data = NULL;
+			wrk->stats.backend_pool_idle--;
+
+			wpool->active++;
+			wrk->stats.backend_pool_hits++;
+			return backend_use(wrk, bcon, pbcon);
+		}
+		backend_connection_free(bcon);
+	}
+	if (bpool->config.max_idle > 0) wrk->stats.backend_pool_misses++;
+
+	if (bpool->config.max_connections >= 0 && wpool->active >= (guint) bpool->config.max_connections) {
+		bwait = backend_wait_new(vr, wpool);
+		g_queue_push_tail_link(&wpool->waiting, &bwait->link);
+		*pbwait = bwait;
+		return LI_BACKEND_WAIT;
+	}
+
+	wpool->active++;
+	return backend_connect(vr, wpool, pbcon, pbwait, berror);
+}
+
+void li_backend_wait_stop(liVRequest *vr, liBackendPool *bpool, liBackendWait **pbwait) {
+	liBackendWait *bwait = *pbwait;
+	liBackendWorkerPool *wpool;
+	liBackendConnection *bcon;
+	UNUSED(vr);
+
+	if (NULL == bwait) return;
+	*pbwait = NULL;
+	wpool = bwait->wpool;
+
+	if (NULL != (bcon = bwait->bcon)) {
+		if (bcon->wait == bwait) {
+			/* connecting */
+			backend_connection_free(bcon);
+			backend_slot_free(wpool);
+		} else {
+			/* handed over: the next request can use it */
+			li_backend_put(wpool->wrk, bpool, bcon, FALSE);
+		}
+	} else if (bwait->reserved) {
+		backend_slot_free(wpool);
+	} else if (!bwait->failed) {
+		g_queue_unlink(&wpool->waiting, &bwait->link);
+	}
+
+	backend_wait_free(bwait);
+}
+
+void li_backend_first_byte(liWorker *wrk, liBackendConnection *bcon) {
+	if (bcon->first_byte) return;
+
+	bcon->first_byte = TRUE;
+	wrk->stats.backend_first_byte_latency[li_backend_latency_bucket(ev_now(wrk->loop) - bcon->ts_request)]++;
+}
+
+void li_backend_put(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon, gboolean closecon) {
+	liBackendWorkerPool *wpool = bcon->wpool;
+	liBackendConfig *config = &bpool->config;
+	GList *link;
+
+	if (closecon || 0 == config->max_idle || wrk->backends_stopped
+	    || (0 != config->max_requests && bcon->requests >= config->max_requests)) {
+		backend_connection_free(bcon);
+		backend_slot_free(wpool);
+		return;
+	}
+
+	if (NULL != (link = g_queue_pop_head_link(&wpool->waiting))) {
+		/* hand it over to the next waiting request, the slot stays in use */
+		liBackendWait *bwait = link->data;
+
+		li_waitqueue_remove(&wpool->connect_queue, &bwait->timeout_elem);
+		bwait->bcon = bcon;
+		li_job_later_ref(bwait->vr_ref);
+		return;
+	}
+
+	if (wpool->idle.length >= config->max_idle) {
+		/* drop the least recently used one */
+		backend_connection_free(g_queue_peek_tail(&wpool->idle));
+	}
+
+	ev_set_cb(&bcon->watcher, backend_idle_cb);
+	ev_io_set(&bcon->watcher, bcon->fd, EV_READ);
+	ev_io_start(wrk->loop, &bcon->watcher);
+
+	bcon->idle_elem.data = bcon;
+	li_waitqueue_push(&wpool->idle_queue, &bcon->idle_elem);
+	bcon->idle_link.data = bcon;
+	g_queue_push_head_link(&wpool->idle, &bcon->idle_link);
+
+	wrk->stats.backend_pool_idle++;
+	wpool->active--;
+}
+
+/**********************************************************************************/
+/* worker */
+
+void li_backend_worker_stop(liWorker *wrk) {
+	GHashTableIter it;
+	gpointer val;
+
+	wrk->backends_stopped = TRUE;
+	if (NULL == wrk->backend_pools) return;
+
+	/* close idle connections, requests still running close theirs when done */
+	g_hash_table_iter_init(&it, wrk->backend_pools);
+	while (g_hash_table_iter_next(&it, NULL, &val)) {
+		liBackendWorkerPool *wpool = val;
+		GList *link;
+
+		while (NULL != (link = g_queue_peek_head_link(&wpool->idle))) {
+			backend_connection_free(link->data);
+		}
+		li_waitqueue_stop(&wpool->idle_queue);
+	}
+}
+
+void li_backend_worker_free(liWorker *wrk) {
+	if (NULL == wrk->backend_pools) return;
+
+	g_hash_table_destroy(wrk->backend_pools);
+	wrk->backend_pools = NULL;
+}
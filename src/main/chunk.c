@@ -1,9 +1,12 @@
 
 #include <lighttpd/base.h>
+#include <lighttpd/plugin_core.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
 
+static void chunk_read_job_detach(liChunkFile *cf);
+
 /******************
  *   chunkfile    *
  ******************/
@@ -18,6 +21,8 @@ liChunkFile *li_chunkfile_new(GString *name, int fd, gboolean is_temp) {
 	}
 	cf->fd = fd;
 	cf->is_temp = is_temp;
+	cf->readahead.next = cf->readahead.dropped = 0;
+	cf->read_job = NULL;
 	return cf;
 }
 
@@ -30,6 +35,7 @@ void li_chunkfile_release(liChunkFile *cf) {
 	if (!cf) return;
 	assert(g_atomic_int_get(&cf->refcount) > 0);
 	if (g_atomic_int_dec_and_test(&cf->refcount)) {
+		chunk_read_job_detach(cf);
 		if (-1 != cf->fd) close(cf->fd);
 		cf->fd = -1;
 		if (cf->is_temp) unlink(cf->name->str);
@@ -71,6 +77,178 @@ liHandlerResult li_chunkfile_open(liVRequest *vr, liChunkFile *cf) {
 	return LI_HANDLER_GO_ON;
 }
 
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED) && defined(POSIX_FADV_DONTNEED)
+
+typedef struct chunk_readahead chunk_readahead;
+struct chunk_readahead {
+	liChunkFile *file;
+	off_t drop_offset, drop_length;   /* already sent */
+	off_t offset, length;             /* to read ahead */
+};
+
+static void chunk_readahead_run(gpointer data) {
+	chunk_readahead *ra = data;
+
+	/* WILLNEED starts the same readahead as readahead(2), but doesn't wait for the page cache lookups */
+	if (ra->drop_length > 0) posix_fadvise(ra->file->fd, ra->drop_offset, ra->drop_length, POSIX_FADV_DONTNEED);
+	if (ra->length > 0) posix_fadvise(ra->file->fd, ra->offset, ra->length, POSIX_FADV_WILLNEED);
+}
+
+static void chunk_readahead_finished(gpointer data) {
+	chunk_readahead *ra = data;
+
+	li_chunkfile_release(ra->file);
+	g_slice_free(chunk_readahead, ra);
+}
+
+void li_chunk_readahead(liVRequest *vr, liChunk *c) {
+	goffset window = CORE_OPTION(LI_CORE_OPTION_STATIC_READAHEAD).number;
+	liChunkFile *cf;
+	chunk_readahead *ra;
+	off_t pos, end;
+
+	if (FILE_CHUNK != c->type || window <= 0) return;
+	cf = c->data.file.file;
+	if (-1 == cf->fd) return;
+	if (c->data.file.length < CORE_OPTION(LI_CORE_OPTION_STATIC_READAHEAD_MIN_SIZE).number) return;
+
+	pos = c->data.file.start + c->offset;
+	end = c->data.file.start + c->data.file.length;
+
+	if (0 == cf->readahead.next || pos < cf->readahead.dropped || cf->readahead.next - pos > window) {
+		/* first read, or another chunk (or request) of the file reads somewhere else: start at pos */
+		cf->readahead.next = cf->readahead.dropped = pos;
+	} else if (cf->readahead.next >= end || cf->readahead.next - pos > window / 2) {
+		/* everything requested or still enough in front of us */
+		return;
+	}
+
+	ra = g_slice_new(chunk_readahead);
+	ra->file = cf;
+	li_chunkfile_acquire(ra->file);
+
+	/* other requests may still need the pages of popular files: only drop them if configured */
+	ra->drop_offset = cf->readahead.dropped;
+	ra->drop_length = 0;
+	if (CORE_OPTION(LI_CORE_OPTION_STATIC_DROP_BEHIND).boolean) {
+		ra->drop_length = pos - ra->drop_offset;
+		cf->readahead.dropped = pos;
+	}
+
+	ra->offset = MAX(cf->readahead.next, pos);
+	ra->length = MIN(pos + window, end) - ra->offset;
+	cf->readahead.next = ra->offset + ra->length;
+
+	li_tasklet_push(vr->wrk->tasklets, chunk_readahead_run, chunk_readahead_finished, ra);
+}
+
+#else
+
+void li_chunk_readahead(liVRequest *vr, liChunk *c) {
+	UNUSED(vr); UNUSED(c);
+}
+
+#endif
+
+/******************
+ *   chunkpipe    *
+ ******************/
+
+liChunkPipe* li_chunkpipe_new(void) {
+	liChunkPipe *cp;
+	int fds[2];
+
+	if (-1 == pipe(fds)) return NULL;
+	li_fd_init(fds[0]);
+	li_fd_init(fds[1]);
+
+	cp = g_slice_new0(liChunkPipe);
+	cp->refcount = 1;
+	cp->fd[0] = fds[0];
+	cp->fd[1] = fds[1];
+#ifdef F_GETPIPE_SZ
+	cp->size = fcntl(fds[1], F_GETPIPE_SZ);
+	if (cp->size <= 0)
+#endif
+		cp->size = 4096;
+
+	return cp;
+}
+
+void li_chunkpipe_acquire(liChunkPipe *cp) {
+	assert(g_atomic_int_get(&cp->refcount) > 0);
+	g_atomic_int_inc(&cp->refcount);
+}
+
+void li_chunkpipe_release(liChunkPipe *cp) {
+	if (!cp) return;
+	assert(g_atomic_int_get(&cp->refcount) > 0);
+	if (g_atomic_int_dec_and_test(&cp->refcount)) {
+		close(cp->fd[0]);
+		close(cp->fd[1]);
+		g_slice_free(liChunkPipe, cp);
+	}
+}
+
+/* only one chunk uses a pipe, and the pipe contains the last cp->used bytes of the chunk */
+
+/* read the remaining data of a PIPE_CHUNK into c->mem */
+static gboolean chunk_pipe_read(liChunk *c) {
+	liChunkPipe *cp = c->data.pipe.pipe;
+	goffset len = cp->used, have = 0;
+	ssize_t r;
+
+	if (c->mem) return TRUE;
+
+	c->data.pipe.mem_offset = c->data.pipe.length - len;
+	c->mem = g_byte_array_sized_new(len);
+	g_byte_array_set_size(c->mem, len);
+
+	while (have < len) {
+		if (-1 == (r = read(cp->fd[0], c->mem->data + have, len - have))) {
+			if (EINTR == errno) continue;
+			break;
+		} else if (0 == r) {
+			break;
+		}
+		have += r;
+	}
+	cp->used -= have;
+
+	if (have != len) {
+		g_byte_array_free(c->mem, TRUE);
+		c->mem = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* throw away the data of a PIPE_CHUNK before c->offset that is still in the pipe (all data if all is TRUE);
+ * if that fails the pipe isn't empty and won't be reused
+ */
+static void chunk_pipe_discard(liChunk *c, gboolean all) {
+	liChunkPipe *cp = c->data.pipe.pipe;
+	goffset len;
+	gchar buf[4096];
+	ssize_t r;
+
+	if (c->mem) return;
+
+	len = all ? cp->used : c->offset - (c->data.pipe.length - cp->used);
+
+	while (len > 0) {
+		if (-1 == (r = read(cp->fd[0], buf, MIN(len, (goffset) sizeof(buf))))) {
+			if (EINTR == errno) continue;
+			return;
+		} else if (0 == r) {
+			return;
+		}
+		len -= r;
+		cp->used -= r;
+	}
+}
+
 /******************
  * chunk iterator *
  ******************/
@@ -78,6 +256,7 @@ liHandlerResult li_chunkfile_open(liVRequest *vr, liChunkFile *cf) {
 /* must be powers of 2 */
 #define MAX_MMAP_CHUNK (2*1024*1024)
 #define MMAP_CHUNK_ALIGN (4*1024)
+#define READ_ASYNC_WINDOW (512*1024) /* li_chunkiter_read_async reads at least this much ahead into c->mem */
 
 /* get the data from a chunk; easy in case of a STRING_CHUNK,
  * but needs to do io in case of FILE_CHUNK; the data is _not_ marked as "done"
@@ -107,6 +286,7 @@ liHandlerResult li_chunkiter_read(liVRequest *vr, liChunkIter iter, off_t start,
 		break;
 	case FILE_CHUNK:
 		if (LI_HANDLER_GO_ON != (res = li_chunkfile_open(vr, c->data.file.file))) return res;
+		li_chunk_readahead(vr, c);
 
 		if (length > MAX_MMAP_CHUNK) length = MAX_MMAP_CHUNK;
 
@@ -140,6 +320,11 @@ read_chunk:
 			length = we_have;
 			g_byte_array_set_size(c->mem, length);
 		}
+		if (MAP_FAILED == c->data.file.mmap.data) {
+			/* describe the block in c->mem, li_chunkiter_read_async can reuse it */
+			c->data.file.mmap.offset = our_start;
+			c->data.file.mmap.length = length;
+		}
 		*data_start = (char*) c->mem->data;
 		*data_len = length;
 		break;
@@ -147,6 +332,18 @@ read_chunk:
 		*data_start = (char*) c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset + start;
 		*data_len = length;
 		break;
+	case PIPE_CHUNK:
+		if (!chunk_pipe_read(c)) {
+			VR_ERROR(vr, "reading from pipe (fd = %i) failed: %s", c->data.pipe.pipe->fd[0], g_strerror(errno));
+			return LI_HANDLER_ERROR;
+		}
+		*data_start = (char*) c->mem->data + c->offset - c->data.pipe.mem_offset + start;
+		*data_len = length;
+		break;
+	case INLINE_CHUNK:
+		*data_start = c->data.inl.data + c->offset + start;
+		*data_len = length;
+		break;
 	}
 	return LI_HANDLER_GO_ON;
 }
@@ -179,6 +376,7 @@ liHandlerResult li_chunkiter_read_mmap(liVRequest *vr, liChunkIter iter, off_t s
 		break;
 	case FILE_CHUNK:
 		if (LI_HANDLER_GO_ON != (res = li_chunkfile_open(vr, c->data.file.file))) return res;
+		li_chunk_readahead(vr, c);
 
 		if (length > MAX_MMAP_CHUNK) length = MAX_MMAP_CHUNK;
 
@@ -255,19 +453,200 @@ read_chunk:
 		*data_start = (char*) c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset + start;
 		*data_len = length;
 		break;
+	case PIPE_CHUNK:
+		if (!chunk_pipe_read(c)) {
+			VR_ERROR(vr, "reading from pipe (fd = %i) failed: %s", c->data.pipe.pipe->fd[0], g_strerror(errno));
+			return LI_HANDLER_ERROR;
+		}
+		*data_start = (char*) c->mem->data + c->offset - c->data.pipe.mem_offset + start;
+		*data_len = length;
+		break;
+	case INLINE_CHUNK:
+		*data_start = c->data.inl.data + c->offset + start;
+		*data_len = length;
+		break;
 	}
 	return LI_HANDLER_GO_ON;
 }
 
+typedef struct chunk_read_job chunk_read_job;
+struct chunk_read_job {
+	liChunkFile *file;    /* only referenced while running */
+	off_t offset, length;
+	GByteArray *mem;
+	int error;            /* errno of pread, -1 for an unexpected end of file */
+
+	gboolean done, cancelled;
+	liJobRef *wakeup;     /* identifies the request too */
+};
+
+static void chunk_read_job_free(chunk_read_job *job) {
+	li_chunkfile_release(job->file);
+	if (job->mem) g_byte_array_free(job->mem, TRUE);
+	li_job_ref_release(job->wakeup);
+	g_slice_free(chunk_read_job, job);
+}
+
+static void chunk_read_job_run(gpointer data) {
+	chunk_read_job *job = data;
+	ssize_t r;
+
+	g_byte_array_set_size(job->mem, job->length);
+	while (-1 == (r = pread(job->file->fd, job->mem->data, job->length, job->offset))) {
+		if (EINTR != errno) {
+			job->error = errno;
+			return;
+		}
+	}
+	if (0 == r) job->error = -1;
+	g_byte_array_set_size(job->mem, r);
+}
+
+static void chunk_read_job_finished(gpointer data) {
+	chunk_read_job *job = data;
+	liChunkFile *cf = job->file;
+
+	/* a finished job doesn't keep the file open: it is freed with the file if nobody picks it up */
+	job->file = NULL;
+	if (job->cancelled) {
+		chunk_read_job_free(job);
+	} else {
+		job->done = TRUE;
+		li_job_later_ref(job->wakeup);
+	}
+	li_chunkfile_release(cf);
+}
+
+/* removes the job from the file; a running job frees itself when it is finished */
+static void chunk_read_job_detach(liChunkFile *cf) {
+	chunk_read_job *job = cf->read_job;
+
+	if (NULL == job) return;
+	cf->read_job = NULL;
+
+	if (job->done) {
+		chunk_read_job_free(job);
+	} else {
+		job->cancelled = TRUE;
+	}
+}
+
+liHandlerResult li_chunkiter_read_async(liVRequest *vr, liChunkIter iter, off_t start, off_t length, char **data_start, off_t *data_len) {
+	liChunk *c = li_chunkiter_chunk(iter);
+	liChunkFile *cf;
+	chunk_read_job *job;
+	off_t we_have, our_start, file_end;
+	liHandlerResult res;
+
+	if (!c) return LI_HANDLER_ERROR;
+	if (!data_start || !data_len) return LI_HANDLER_ERROR;
+	if (FILE_CHUNK != c->type) return li_chunkiter_read(vr, iter, start, length, data_start, data_len);
+
+	we_have = li_chunk_length(c) - start;
+	if (length > we_have) length = we_have;
+	if (length <= 0) return LI_HANDLER_ERROR;
+	if (length > MAX_MMAP_CHUNK) length = MAX_MMAP_CHUNK;
+
+	our_start = start + c->offset + c->data.file.start;
+	cf = c->data.file.file;
+
+	if (NULL != (job = cf->read_job)) {
+		liJobRef *ref = li_vrequest_get_ref(vr);
+		gboolean ours = (ref == job->wakeup);
+		li_job_ref_release(ref);
+
+		if (!job->done) {
+			if (ours) return LI_HANDLER_WAIT_FOR_EVENT;
+			/* another request reads from the file; only it gets woken up */
+			return li_chunkiter_read(vr, iter, start, length, data_start, data_len);
+		}
+		cf->read_job = NULL;
+
+		if (!ours || our_start < job->offset || our_start >= job->offset + job->length) {
+			/* not the block we asked for */
+			chunk_read_job_free(job);
+		} else {
+			/* the window starts before our_start: a short read might not reach it */
+			if (0 == job->error && job->offset + (off_t) job->mem->len <= our_start) job->error = -1;
+			if (0 != job->error) {
+				if (-1 == job->error) {
+					VR_ERROR(vr, "pread returned 0 bytes for '%s' (fd = %i): unexpected end of file?",
+						GSTR_SAFE_STR(cf->name), cf->fd);
+				} else {
+					VR_ERROR(vr, "pread failed for '%s' (fd = %i): %s",
+						GSTR_SAFE_STR(cf->name), cf->fd,
+						g_strerror(job->error));
+				}
+				chunk_read_job_free(job);
+				return LI_HANDLER_ERROR;
+			}
+
+			/* keep the data in the chunk the same way li_chunkiter_read_mmap does for its pread fallback */
+			if (MAP_FAILED != c->data.file.mmap.data) {
+				munmap(c->data.file.mmap.data, c->data.file.mmap.length);
+				c->data.file.mmap.data = MAP_FAILED;
+			}
+			if (c->mem) g_byte_array_free(c->mem, TRUE);
+			c->mem = job->mem;
+			job->mem = NULL;
+			c->data.file.mmap.offset = job->offset;
+			c->data.file.mmap.length = c->mem->len;
+			chunk_read_job_free(job);
+		}
+	}
+
+	if (c->mem && our_start >= c->data.file.mmap.offset
+		&& our_start < c->data.file.mmap.offset + (off_t) c->data.file.mmap.length) {
+		we_have = c->data.file.mmap.offset + c->data.file.mmap.length - our_start;
+		*data_start = (char*) c->mem->data + (our_start - c->data.file.mmap.offset);
+		*data_len = MIN(length, we_have);
+		return LI_HANDLER_GO_ON;
+	}
+
+	/* without threads the tasklet would run in this thread anyway */
+	if (0 == li_tasklet_pool_get_threads(vr->wrk->tasklets)) {
+		return li_chunkiter_read(vr, iter, start, length, data_start, data_len);
+	}
+
+	if (LI_HANDLER_GO_ON != (res = li_chunkfile_open(vr, cf))) return res;
+	li_chunk_readahead(vr, c);
+
+	job = g_slice_new0(chunk_read_job);
+	job->file = cf;
+	li_chunkfile_acquire(job->file);
+	/* read an aligned window: the following small reads (like the 4k blocks of mod_deflate) come from c->mem */
+	file_end = c->data.file.start + c->data.file.length;
+	job->offset = our_start & ~((off_t) MMAP_CHUNK_ALIGN - 1);
+	job->length = MAX(our_start + length, MIN(job->offset + READ_ASYNC_WINDOW, file_end)) - job->offset;
+	/* reuse the buffer of the previous block */
+	if (c->mem) {
+		job->mem = c->mem;
+		c->mem = NULL;
+	} else {
+		job->mem = g_byte_array_sized_new(job->length);
+	}
+	job->wakeup = li_vrequest_get_ref(vr);
+	cf->read_job = job;
+
+	li_tasklet_push(vr->wrk->tasklets, chunk_read_job_run, chunk_read_job_finished, job);
+
+	return LI_HANDLER_WAIT_FOR_EVENT;
+}
+
 /******************
  *     chunk      *
  ******************/
 
-static liChunk* chunk_new() {
-	liChunk *c = g_slice_new0(liChunk);
-	c->data.file.mmap.data = MAP_FAILED;
-	c->cq_link.data = c;
-	return c;
+/* memory of the chunk that counts for the cqlimit */
+static goffset chunk_mem_usage(liChunk *c) {
+	switch (c->type) {
+	case STRING_CHUNK: return c->data.str->len;
+	case MEM_CHUNK: return c->mem->len;
+	case BUFFER_CHUNK: return c->data.buffer.length;
+	case PIPE_CHUNK: return c->data.pipe.length;
+	case INLINE_CHUNK: return c->data.inl.length;
+	default: return 0;
+	}
 }
 
 /*
@@ -288,11 +667,21 @@ static void chunk_reset(chunk *c) {
 }
 */
 
-static void chunk_free(liChunkQueue *cq, liChunk *c) {
-	if (!c) return;
-	if (cq) {
-		g_queue_unlink(&cq->queue, &c->cq_link);
+/* store a copy of mem in an empty chunk; small data is kept in the chunk itself */
+static void chunk_copy_mem(liChunk *c, const void *mem, gsize len) {
+	if (len <= LI_CHUNK_INLINE_SIZE) {
+		c->type = INLINE_CHUNK;
+		c->data.inl.length = len;
+		memcpy(c->data.inl.data, mem, len);
+	} else {
+		c->type = MEM_CHUNK;
+		c->mem = g_byte_array_sized_new(len);
+		g_byte_array_append(c->mem, mem, len);
 	}
+}
+
+/* releases the data of the chunk; the chunk itself lives in the ring of its queue */
+static void chunk_free(liChunk *c) {
 	switch (c->type) {
 	case UNUSED_CHUNK:
 		break;
@@ -305,6 +694,10 @@ static void chunk_free(liChunkQueue *cq, liChunk *c) {
 		break;
 	case FILE_CHUNK:
 		if (c->data.file.file) {
+			/* drop a block nobody picked up; a running job keeps the file */
+			if (NULL != c->data.file.file->read_job && ((chunk_read_job*) c->data.file.file->read_job)->done) {
+				chunk_read_job_detach(c->data.file.file);
+			}
 			li_chunkfile_release(c->data.file.file);
 			c->data.file.file = NULL;
 		}
@@ -316,13 +709,19 @@ static void chunk_free(liChunkQueue *cq, liChunk *c) {
 	case BUFFER_CHUNK:
 		li_buffer_release(c->data.buffer.buffer);
 		break;
+	case PIPE_CHUNK:
+		chunk_pipe_discard(c, TRUE);
+		li_chunkpipe_release(c->data.pipe.pipe);
+		c->data.pipe.pipe = NULL;
+		break;
+	case INLINE_CHUNK:
+		break;
 	}
 	c->type = UNUSED_CHUNK;
 	if (c->mem) {
 		g_byte_array_free(c->mem, TRUE);
 		c->mem = NULL;
 	}
-	g_slice_free(liChunk, c);
 }
 
 /******************
@@ -423,34 +822,114 @@ void li_cqlimit_set_limit(liCQLimit *cql, goffset limit) {
  *   chunkqueue   *
  ******************/
 
+#define CHUNKQUEUE_MIN_SIZE 8 /* initial size of the ring */
+#define CHUNKQUEUE_KEEP_SIZE 64 /* reset frees bigger rings */
+
+#define CHUNKQUEUE_CHUNK(cq, ndx) (&(cq)->chunks[(ndx) & ((cq)->size - 1)])
+
 liChunkQueue* li_chunkqueue_new() {
 	liChunkQueue *cq = g_slice_new0(liChunkQueue);
-	g_queue_init(&cq->queue);
 	return cq;
 }
 
-static void __chunk_free(gpointer _c, gpointer userdata) {
-	liChunk *c = (liChunk *)_c;
-	liChunkQueue *cq = (liChunkQueue*) userdata;
-	if (c->type == STRING_CHUNK) cqlimit_update(cq, - (goffset)c->data.str->len);
-	else if (c->type == MEM_CHUNK) cqlimit_update(cq, - (goffset)c->mem->len);
-	else if (c->type == BUFFER_CHUNK) cqlimit_update(cq, - (goffset)c->data.buffer.length);
-	chunk_free(cq, c);
+static void chunkqueue_grow(liChunkQueue *cq) {
+	guint size = cq->size ? 2 * cq->size : CHUNKQUEUE_MIN_SIZE;
+	liChunk *chunks = g_new(liChunk, size);
+	guint i;
+
+	/* the indices stay the same, so iterators stay valid */
+	for (i = cq->head; i != cq->tail; i++) {
+		chunks[i & (size - 1)] = *CHUNKQUEUE_CHUNK(cq, i);
+	}
+
+	g_free(cq->chunks);
+	cq->chunks = chunks;
+	cq->size = size;
+}
+
+/* append an UNUSED_CHUNK to the queue; invalidates other liChunk pointers into the queue */
+static liChunk* chunkqueue_push(liChunkQueue *cq) {
+	liChunk *c;
+
+	if (cq->tail - cq->head == cq->size) chunkqueue_grow(cq);
+
+	c = CHUNKQUEUE_CHUNK(cq, cq->tail);
+	cq->tail++;
+	memset(c, 0, sizeof(*c));
+	c->data.file.mmap.data = MAP_FAILED;
+	return c;
+}
+
+static liChunk* chunkqueue_last(liChunkQueue *cq) {
+	if (cq->head == cq->tail) return NULL;
+	return CHUNKQUEUE_CHUNK(cq, cq->tail - 1);
+}
+
+/* remove the first chunk; the caller has to update length and cqlimit */
+static void chunkqueue_pop(liChunkQueue *cq) {
+	chunk_free(CHUNKQUEUE_CHUNK(cq, cq->head));
+	cq->head++;
+}
+
+/* move the first chunk of in to the end of out (doesn't update length and cqlimit) */
+static liChunk* chunkqueue_move_first(liChunkQueue *out, liChunkQueue *in) {
+	liChunk *c = chunkqueue_push(out);
+	*c = *CHUNKQUEUE_CHUNK(in, in->head);
+	in->head++;
+	return c;
+}
+
+/* copy mem to the end of the last chunk if it is an INLINE_CHUNK or a BUFFER_CHUNK
+ * with enough free space (see li_chunkqueue_get_last_buffer)
+ */
+static gboolean chunkqueue_append_last(liChunkQueue *cq, const void *mem, gsize len) {
+	liChunk *c = chunkqueue_last(cq);
+	liBuffer *buf;
+
+	if (NULL == c) return FALSE;
+
+	if (INLINE_CHUNK == c->type) {
+		if (c->data.inl.length + len > LI_CHUNK_INLINE_SIZE) return FALSE;
+		memcpy(c->data.inl.data + c->data.inl.length, mem, len);
+		c->data.inl.length += len;
+		cq->length += len;
+		cq->bytes_in += len;
+		cqlimit_update(cq, len);
+		return TRUE;
+	}
+
+	if (NULL == (buf = li_chunkqueue_get_last_buffer(cq, len))) return FALSE;
+	memcpy(buf->addr + buf->used, mem, len);
+	li_chunkqueue_update_last_buffer_size(cq, len);
+	return TRUE;
+}
+
+static void chunkqueue_clear(liChunkQueue *cq) {
+	while (cq->head != cq->tail) {
+		cqlimit_update(cq, - chunk_mem_usage(CHUNKQUEUE_CHUNK(cq, cq->head)));
+		chunkqueue_pop(cq);
+	}
 }
 
 void li_chunkqueue_reset(liChunkQueue *cq) {
 	if (!cq) return;
 	cq->is_closed = FALSE;
 	cq->bytes_in = cq->bytes_out = cq->length = 0;
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
+	chunkqueue_clear(cq);
 	assert(cq->mem_usage == 0);
 	cq->mem_usage = 0;
-	g_queue_init(&cq->queue); /* should be empty now */
+	if (cq->size > CHUNKQUEUE_KEEP_SIZE) {
+		g_free(cq->chunks);
+		cq->chunks = NULL;
+		cq->size = 0;
+	}
 }
 
 void li_chunkqueue_free(liChunkQueue *cq) {
 	if (!cq) return;
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
+	chunkqueue_clear(cq);
+	g_free(cq->chunks);
+	cq->chunks = NULL;
 	li_cqlimit_release(cq->limit);
 	cq->limit = NULL;
 	assert(cq->mem_usage == 0);
@@ -486,18 +965,19 @@ goffset li_chunkqueue_limit_available(liChunkQueue *cq) {
 
  /* pass ownership of str to chunkqueue, do not free/modify it afterwards
   * you may modify the data (not the length) if you are sure it isn't sent before.
-  * if the length is NULL, str is destroyed immediately
+  * if the length is NULL or small, str is destroyed immediately (small data gets copied)
   */
 void li_chunkqueue_append_string(liChunkQueue *cq, GString *str) {
 	liChunk *c;
-	if (!str->len) {
+	if (str->len <= LI_CHUNK_INLINE_SIZE) {
+		/* copying is cheaper than keeping the allocation */
+		li_chunkqueue_append_mem(cq, str->str, str->len);
 		g_string_free(str, TRUE);
 		return;
 	}
-	c = chunk_new();
+	c = chunkqueue_push(cq);
 	c->type = STRING_CHUNK;
 	c->data.str = str;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
 	cq->length += str->len;
 	cq->bytes_in += str->len;
 	cqlimit_update(cq, str->len);
@@ -505,18 +985,19 @@ void li_chunkqueue_append_string(liChunkQueue *cq, GString *str) {
 
  /* pass ownership of mem to chunkqueue, do not free/modify it afterwards
   * you may modify the data (not the length) if you are sure it isn't sent before.
-  * if the length is NULL, mem is destroyed immediately
+  * if the length is NULL or small, mem is destroyed immediately (small data gets copied)
   */
 void li_chunkqueue_append_bytearr(liChunkQueue *cq, GByteArray *mem) {
 	liChunk *c;
-	if (!mem->len) {
+	if (mem->len <= LI_CHUNK_INLINE_SIZE) {
+		/* copying is cheaper than keeping the allocation */
+		li_chunkqueue_append_mem(cq, mem->data, mem->len);
 		g_byte_array_free(mem, TRUE);
 		return;
 	}
-	c = chunk_new();
+	c = chunkqueue_push(cq);
 	c->type = MEM_CHUNK;
 	c->mem = mem;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
 	cq->length += mem->len;
 	cq->bytes_in += mem->len;
 	cqlimit_update(cq, mem->len);
@@ -531,12 +1012,11 @@ void li_chunkqueue_append_buffer(liChunkQueue *cq, liBuffer *buffer) {
 		li_buffer_release(buffer);
 		return;
 	}
-	c = chunk_new();
+	c = chunkqueue_push(cq);
 	c->type = BUFFER_CHUNK;
 	c->data.buffer.buffer = buffer;
 	c->data.buffer.offset = 0;
 	c->data.buffer.length = buffer->used;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
 	cq->length += buffer->used;
 	cq->bytes_in += buffer->used;
 	cqlimit_update(cq, buffer->used);
@@ -549,35 +1029,34 @@ void li_chunkqueue_append_buffer2(liChunkQueue *cq, liBuffer *buffer, gsize offs
 		return;
 	}
 	assert(offset + length <= buffer->used);
-	c = chunk_new();
+	c = chunkqueue_push(cq);
 	c->type = BUFFER_CHUNK;
 	c->data.buffer.buffer = buffer;
 	c->data.buffer.offset = offset;
 	c->data.buffer.length = length;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
 	cq->length += length;
 	cq->bytes_in += length;
 	cqlimit_update(cq, length);
 }
 
-/* memory gets copied */
+/* memory gets copied: appended to the last chunk if it has room for it, small data
+ * (<= LI_CHUNK_INLINE_SIZE) is stored in the new chunk itself
+ */
 void li_chunkqueue_append_mem(liChunkQueue *cq, const void *mem, gssize len) {
 	liChunk *c;
-	if (!len) return;
-	c = chunk_new();
-	c->type = MEM_CHUNK;
-	c->mem = g_byte_array_sized_new(len);
-	g_byte_array_append(c->mem, mem, len);
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
-	cq->length += c->mem->len;
-	cq->bytes_in += c->mem->len;
-	cqlimit_update(cq, c->mem->len);
+	if (len <= 0) return;
+	if (chunkqueue_append_last(cq, mem, len)) return;
+	c = chunkqueue_push(cq);
+	chunk_copy_mem(c, mem, len);
+	cq->length += len;
+	cq->bytes_in += len;
+	cqlimit_update(cq, len);
 }
 
 /* increases reference for cf (if length > 0) */
 void li_chunkqueue_append_chunkfile(liChunkQueue *cq, liChunkFile *cf, off_t start, off_t length) {
 	if (length) {
-		liChunk *c = chunk_new();
+		liChunk *c = chunkqueue_push(cq);
 		li_chunkfile_acquire(cf);
 
 		c->type = FILE_CHUNK;
@@ -585,20 +1064,18 @@ void li_chunkqueue_append_chunkfile(liChunkQueue *cq, liChunkFile *cf, off_t sta
 		c->data.file.start = start;
 		c->data.file.length = length;
 
-		g_queue_push_tail_link(&cq->queue, &c->cq_link);
 		cq->length += length;
 		cq->bytes_in += length;
 	}
 }
 
 static void __chunkqueue_append_file(liChunkQueue *cq, GString *filename, off_t start, off_t length, int fd, gboolean is_temp) {
-	liChunk *c = chunk_new();
+	liChunk *c = chunkqueue_push(cq);
 	c->type = FILE_CHUNK;
 	c->data.file.file = li_chunkfile_new(filename, fd, is_temp);
 	c->data.file.start = start;
 	c->data.file.length = length;
 
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
 	cq->length += length;
 	cq->bytes_in += length;
 }
@@ -634,55 +1111,58 @@ void li_chunkqueue_append_tempfile_fd(liChunkQueue *cq, GString *filename, off_t
 	}
 }
 
+/* increases reference for cp (if length > 0); the length bytes must already be in the pipe
+ * and no other chunk may reference cp
+ */
+void li_chunkqueue_append_pipe(liChunkQueue *cq, liChunkPipe *cp, goffset length) {
+	liChunk *c;
+	if (!length) return;
+	c = chunkqueue_push(cq);
+	li_chunkpipe_acquire(cp);
+	c->type = PIPE_CHUNK;
+	c->data.pipe.pipe = cp;
+	c->data.pipe.length = length;
+	c->data.pipe.mem_offset = 0;
+	cq->length += length;
+	cq->bytes_in += length;
+	/* the data is kept in kernel memory, but it still counts */
+	cqlimit_update(cq, length);
+}
+
 /* steal up to length bytes from in and put them into out, return number of bytes stolen */
 goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset length) {
 	liChunk *c, *cnew;
-	GList* l;
 	goffset bytes = 0, meminbytes = 0, memoutbytes = 0;
-	goffset we_have;
+	goffset we_have, mem;
 
 	while ( (NULL != (c = li_chunkqueue_first_chunk(in))) && length > 0 ) {
 		we_have = li_chunk_length(c);
 		if (!we_have) { /* remove empty chunks */
-			if (c->type == STRING_CHUNK) meminbytes -= c->data.str->len;
-			else if (c->type == MEM_CHUNK) meminbytes -= c->mem->len;
-			else if (c->type == BUFFER_CHUNK) meminbytes -= c->data.buffer.length;
-			chunk_free(in, c);
+			meminbytes -= chunk_mem_usage(c);
+			chunkqueue_pop(in);
 			continue;
 		}
 		if (we_have <= length) { /* move complete chunk */
-			l = g_queue_pop_head_link(&in->queue);
-			g_queue_push_tail_link(&out->queue, l);
+			mem = chunk_mem_usage(c);
+			chunkqueue_move_first(out, in);
 			bytes += we_have;
-			if (c->type == STRING_CHUNK) {
-				meminbytes -= c->data.str->len;
-				memoutbytes += c->data.str->len;
-			} else if (c->type == MEM_CHUNK) {
-				meminbytes -= c->mem->len;
-				memoutbytes += c->mem->len;
-			} else if (c->type == BUFFER_CHUNK) {
-				meminbytes -= c->data.buffer.length;
-				memoutbytes += c->data.buffer.length;
-			}
+			meminbytes -= mem;
+			memoutbytes += mem;
 			length -= we_have;
 		} else { /* copy first part of a chunk */
-			cnew = chunk_new();
+			/* only one chunk can use the pipe; copy the first part from memory */
+			if (c->type == PIPE_CHUNK && !chunk_pipe_read(c)) break;
+
+			cnew = chunkqueue_push(out); /* doesn't move c, as in != out */
 			switch (c->type) {
 			case UNUSED_CHUNK: /* impossible, has length 0 */
-				/* remove "empty" chunks */
-				chunk_free(in, c);
-				chunk_free(NULL, cnew);
-				continue;
+				break;
 			case STRING_CHUNK: /* change type to MEM_CHUNK, as we copy it anyway */
-				cnew->type = MEM_CHUNK;
-				cnew->mem = g_byte_array_sized_new(length);
-				g_byte_array_append(cnew->mem, (guint8*) c->data.str->str + c->offset, length);
+				chunk_copy_mem(cnew, c->data.str->str + c->offset, length);
 				memoutbytes += length;
 				break;
 			case MEM_CHUNK:
-				cnew->type = MEM_CHUNK;
-				cnew->mem = g_byte_array_sized_new(length);
-				g_byte_array_append(cnew->mem, (guint8*) c->mem->data + c->offset, length);
+				chunk_copy_mem(cnew, c->mem->data + c->offset, length);
 				memoutbytes += length;
 				break;
 			case FILE_CHUNK:
@@ -700,11 +1180,18 @@ goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset len
 				cnew->data.buffer.length = length;
 				memoutbytes += length;
 				break;
+			case PIPE_CHUNK:
+				chunk_copy_mem(cnew, c->mem->data + c->offset - c->data.pipe.mem_offset, length);
+				memoutbytes += length;
+				break;
+			case INLINE_CHUNK:
+				chunk_copy_mem(cnew, c->data.inl.data + c->offset, length);
+				memoutbytes += length;
+				break;
 			}
 			c->offset += length;
 			bytes += length;
 			length = 0;
-			g_queue_push_tail_link(&out->queue, &cnew->cq_link);
 		}
 	}
 
@@ -722,7 +1209,7 @@ goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset len
 goffset li_chunkqueue_steal_all(liChunkQueue *out, liChunkQueue *in) {
 	goffset len;
 
-	/* if in->queue is empty, do nothing */
+	/* if in is empty, do nothing */
 	if (!in->length) return 0;
 
 	if (in->limit != out->limit) {
@@ -733,7 +1220,22 @@ goffset li_chunkqueue_steal_all(liChunkQueue *out, liChunkQueue *in) {
 		in->mem_usage = 0;
 	}
 
-	li_g_queue_merge(&out->queue, &in->queue);
+	if (out->head == out->tail) {
+		/* just swap the rings */
+		liChunk *chunks = out->chunks;
+		guint size = out->size;
+
+		out->chunks = in->chunks;
+		out->size = in->size;
+		out->head = in->head;
+		out->tail = in->tail;
+
+		in->chunks = chunks;
+		in->size = size;
+		in->head = in->tail = 0;
+	} else {
+		while (in->head != in->tail) chunkqueue_move_first(out, in);
+	}
 
 	/* count bytes in chunkqueues */
 	len = in->length;
@@ -748,28 +1250,20 @@ goffset li_chunkqueue_steal_all(liChunkQueue *out, liChunkQueue *in) {
 /* steal the first chunk from in and append it to out, return number of bytes stolen */
 goffset li_chunkqueue_steal_chunk(liChunkQueue *out, liChunkQueue *in) {
 	liChunk *c;
-	goffset length;
-	GList *l = g_queue_pop_head_link(&in->queue);
-	if (!l) return 0;
-	g_queue_push_tail_link(&out->queue, l);
+	goffset length, mem;
+
+	if (in->head == in->tail) return 0;
+	c = chunkqueue_move_first(out, in);
 
-	c = (liChunk*) l->data;
 	length = li_chunk_length(c);
 	in->bytes_out += length;
 	in->length -= length;
 	out->bytes_in += length;
 	out->length += length;
 	if (in->limit != out->limit) {
-		if (c->type == STRING_CHUNK) {
-			cqlimit_update(out, c->data.str->len);
-			cqlimit_update(in, - (goffset)c->data.str->len);
-		} else if (c->type == MEM_CHUNK) {
-			cqlimit_update(out, c->mem->len);
-			cqlimit_update(in, - (goffset)c->mem->len);
-		} else if (c->type == BUFFER_CHUNK) {
-			cqlimit_update(out, c->data.buffer.length);
-			cqlimit_update(in, - (goffset)c->data.buffer.length);
-		}
+		mem = chunk_mem_usage(c);
+		cqlimit_update(out, mem);
+		cqlimit_update(in, -mem);
 	}
 	return length;
 }
@@ -783,16 +1277,15 @@ goffset li_chunkqueue_skip(liChunkQueue *cq, goffset length) {
 	while ( (NULL != (c = li_chunkqueue_first_chunk(cq))) && (0 == (we_have = li_chunk_length(c)) || length > 0) ) {
 		if (we_have <= length) {
 			/* skip (delete) complete chunk */
-			if (c->type == STRING_CHUNK) cqlimit_update(cq, - (goffset)c->data.str->len);
-			else if (c->type == MEM_CHUNK) cqlimit_update(cq, - (goffset)c->mem->len);
-			else if (c->type == BUFFER_CHUNK) cqlimit_update(cq, - (goffset)c->data.buffer.length);
-			chunk_free(cq, c);
+			cqlimit_update(cq, - chunk_mem_usage(c));
+			chunkqueue_pop(cq);
 			bytes += we_have;
 			length -= we_have;
 		} else { /* skip first part of a chunk */
 			c->offset += length;
 			bytes += length;
 			length = 0;
+			if (c->type == PIPE_CHUNK) chunk_pipe_discard(c, FALSE);
 		}
 	}
 
@@ -804,8 +1297,7 @@ goffset li_chunkqueue_skip(liChunkQueue *cq, goffset length) {
 goffset li_chunkqueue_skip_all(liChunkQueue *cq) {
 	goffset bytes = cq->length;
 
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
-	g_queue_init(&cq->queue);
+	chunkqueue_clear(cq);
 
 	cq->bytes_out += bytes;
 	cq->length = 0;
@@ -881,7 +1373,7 @@ error:
 /* returns the liBuffer from the last chunk in cq, if the chunk has type BUFFER_CHUNK,
  * and the buffer has at least min_space bytes free and refcount == 1 (NULL otherwise) */
 liBuffer* li_chunkqueue_get_last_buffer(liChunkQueue *cq, guint min_space) {
-	liChunk *c = g_queue_peek_tail(&cq->queue);
+	liChunk *c = chunkqueue_last(cq);
 	liBuffer *buf;
 
 	if (!c || c->type != BUFFER_CHUNK) return NULL;
@@ -899,7 +1391,7 @@ liBuffer* li_chunkqueue_get_last_buffer(liChunkQueue *cq, guint min_space) {
  * updates the buffer and the cq data
  */
 LI_API void li_chunkqueue_update_last_buffer_size(liChunkQueue *cq, goffset add_length) {
-	liChunk *c = g_queue_peek_tail(&cq->queue);
+	liChunk *c = chunkqueue_last(cq);
 	liBuffer *buf;
 
 	assert(c && c->type == BUFFER_CHUNK);
@@ -911,3 +1403,28 @@ LI_API void li_chunkqueue_update_last_buffer_size(liChunkQueue *cq, goffset add_
 	cq->bytes_in += add_length;
 	cqlimit_update(cq, add_length);
 }
+
+/* helper functions to append to the last PIPE_CHUNK of a chunkqueue */
+
+/* returns the liChunkPipe from the last chunk in cq, if the chunk has type PIPE_CHUNK
+ * and wasn't read into memory (NULL otherwise) */
+liChunkPipe* li_chunkqueue_get_last_pipe(liChunkQueue *cq) {
+	liChunk *c = chunkqueue_last(cq);
+
+	if (!c || c->type != PIPE_CHUNK || c->mem) return NULL;
+	return c->data.pipe.pipe;
+}
+
+/* only call this if li_chunkqueue_get_last_pipe returned a pipe and add_length bytes were
+ * spliced into it; don't modify the chunkqueue between the two calls
+ */
+void li_chunkqueue_update_last_pipe_size(liChunkQueue *cq, goffset add_length) {
+	liChunk *c = chunkqueue_last(cq);
+
+	assert(c && c->type == PIPE_CHUNK && !c->mem);
+	c->data.pipe.length += add_length;
+
+	cq->length += add_length;
+	cq->bytes_in += add_length;
+	cqlimit_update(cq, add_length);
+}
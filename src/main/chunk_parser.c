@@ -8,16 +8,16 @@ void li_chunk_parser_init(liChunkParserCtx *ctx, liChunkQueue *cq) {
 
 void li_chunk_parser_reset(liChunkParserCtx *ctx) {
 	ctx->bytes_in = 0;
-	ctx->curi.element = NULL;
+	ctx->curi.cq = NULL;
 	ctx->start = 0;
 	ctx->length = 0;
 	ctx->buf = NULL;
 }
 
 liHandlerResult li_chunk_parser_prepare(liChunkParserCtx *ctx) {
-	if (NULL == ctx->curi.element) {
+	if (NULL == li_chunkiter_chunk(ctx->curi)) {
 		ctx->curi = li_chunkqueue_iter(ctx->cq);
-		if (NULL == ctx->curi.element) return LI_HANDLER_WAIT_FOR_EVENT;
+		if (NULL == li_chunkiter_chunk(ctx->curi)) return LI_HANDLER_WAIT_FOR_EVENT;
 	}
 	return LI_HANDLER_GO_ON;
 }
@@ -26,7 +26,7 @@ liHandlerResult li_chunk_parser_next(liVRequest *vr, liChunkParserCtx *ctx, char
 	off_t l;
 	liHandlerResult res;
 
-	if (NULL == ctx->curi.element) return LI_HANDLER_WAIT_FOR_EVENT;
+	if (NULL == li_chunkiter_chunk(ctx->curi)) return LI_HANDLER_WAIT_FOR_EVENT;
 
 	while (ctx->start >= (l = li_chunkiter_length(ctx->curi))) {
 		liChunkIter i = ctx->curi;
@@ -36,7 +36,7 @@ liHandlerResult li_chunk_parser_next(liVRequest *vr, liChunkParserCtx *ctx, char
 		ctx->start -= l;
 	}
 
-	if (NULL == ctx->curi.element) return LI_HANDLER_WAIT_FOR_EVENT;
+	if (NULL == li_chunkiter_chunk(ctx->curi)) return LI_HANDLER_WAIT_FOR_EVENT;
 
 	if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(vr, ctx->curi, ctx->start, l - ctx->start, &ctx->buf, &ctx->length))) {
 		return res;
@@ -58,7 +58,7 @@ gboolean li_chunk_extract_to(liVRequest *vr, liChunkParserMark from, liChunkPars
 	g_string_set_size(dest, to.abs_pos - from.abs_pos);
 	li_g_string_clear(dest);
 
-	for ( i = from; i.ci.element != to.ci.element; li_chunkiter_next(&i.ci) ) {
+	for ( i = from; i.ci.ndx != to.ci.ndx; li_chunkiter_next(&i.ci) ) {
 		goffset len = li_chunkiter_length(i.ci);
 		while (i.pos < len) {
 			char *buf;
@@ -50,11 +50,12 @@ static gboolean collect_insert_callback(liWorker *ctx, liCollectInfo *ci) {
 		return TRUE;
 	} else {
 		liWorker *wrk = ci->wrk;
-		collect_job *j = g_slice_new(collect_job);
-		j->type = COLLECT_CB;
-		j->ci = ci;
-		g_async_queue_push(wrk->collect_queue, j);
-		ev_async_send(wrk->loop, &wrk->collect_watcher);
+		collect_job j;
+		j.type = COLLECT_CB;
+		j.ci = ci;
+		if (li_mpsc_ring_push(wrk->collect_queue, &j)) {
+			ev_async_send(wrk->loop, &wrk->collect_watcher);
+		}
 	}
 	return FALSE;
 }
@@ -85,16 +86,21 @@ static gboolean collect_insert_func(liWorker *ctx, liCollectInfo *ci) {
 			g_ptr_array_index(ci->results, wrk->ndx) = ci->func(wrk, ci->fdata);
 			if (collect_send_result(wrk, ci)) return TRUE;
 		} else {
-			collect_job *j = g_slice_new(collect_job);
-			j->type = COLLECT_FUNC;
-			j->ci = ci;
-			g_async_queue_push(wrk->collect_queue, j);
-			ev_async_send(wrk->loop, &wrk->collect_watcher);
+			collect_job j;
+			j.type = COLLECT_FUNC;
+			j.ci = ci;
+			if (li_mpsc_ring_push(wrk->collect_queue, &j)) {
+				ev_async_send(wrk->loop, &wrk->collect_watcher);
+			}
 		}
 	}
 	return FALSE;
 }
 
+liMPSCRing* li_collect_queue_new(void) {
+	return li_mpsc_ring_new(sizeof(collect_job), 64);
+}
+
 liCollectInfo* li_collect_start(liWorker *ctx, liCollectFuncCB func, gpointer fdata, liCollectCB cb, gpointer cbdata) {
 	liCollectInfo *ci = collect_info_new(ctx, func, fdata, cb, cbdata);
 	if (collect_insert_func(ctx, ci)) return NULL; /* collect info is invalid now */
@@ -107,13 +113,15 @@ void li_collect_break(liCollectInfo* ci) {
 
 void li_collect_watcher_cb(struct ev_loop *loop, ev_async *w, int revents) {
 	liWorker *wrk = (liWorker*) w->data;
-	collect_job *j;
+	collect_job j;
 	UNUSED(loop);
 	UNUSED(revents);
 
-	while (NULL != (j = (collect_job*) g_async_queue_try_pop(wrk->collect_queue))) {
-		liCollectInfo *ci = j->ci;
-		switch (j->type) {
+	li_mpsc_ring_wakeup_reset(wrk->collect_queue);
+
+	while (li_mpsc_ring_pop(wrk->collect_queue, &j)) {
+		liCollectInfo *ci = j.ci;
+		switch (j.type) {
 		case COLLECT_FUNC:
 			g_ptr_array_index(ci->results, wrk->ndx) = ci->func(wrk, ci->fdata);
 			collect_send_result(wrk, ci);
@@ -123,7 +131,6 @@ void li_collect_watcher_cb(struct ev_loop *loop, ev_async *w, int revents) {
 			collect_info_free(ci);
 			break;
 		}
-		g_slice_free(collect_job, j);
 	}
 }
 
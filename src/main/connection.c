@@ -5,6 +5,28 @@
 static void li_connection_reset_keep_alive(liConnection *con);
 static G_GNUC_WARN_UNUSED_RESULT gboolean li_connection_internal_error(liConnection *con);
 
+#ifdef USE_IO_URING
+/* the io_uring backend keeps the writes in flight and calls back when they completed */
+static gboolean connection_uring_write(liConnection *con) {
+	return li_network_write_uring == con->srv->network_backend->write && NULL != con->wrk->uring
+		&& 0 == con->srv->network_zerocopy_min;
+}
+
+static void connection_uring_write_cb(liNetworkURingWrite *w) {
+	liConnection *con = (liConnection*) w->data;
+
+	con->can_write = TRUE;
+	connection_handle_io(con);
+}
+
+# define connection_uring_write_busy(con) li_network_uring_write_busy(&(con)->uring_write)
+/* TRUE: the socket is closed when the writes in flight completed, don't close it */
+# define connection_uring_write_release(con) li_network_uring_write_release(&(con)->uring_write, (con)->raw_out, (con)->sock_watcher.fd)
+#else
+# define connection_uring_write_busy(con) FALSE
+# define connection_uring_write_release(con) FALSE
+#endif
+
 static void update_io_events(liConnection *con) {
 	int events = 0;
 
@@ -15,7 +37,7 @@ static void update_io_events(liConnection *con) {
 			events = events | EV_READ;
 		}
 
-		if (!con->can_write && con->raw_out->length > 0) {
+		if (!con->can_write && con->raw_out->length > 0 && !connection_uring_write_busy(con)) {
 			if (!con->mainvr->throttled || con->mainvr->throttle.magazine > 0) {
 				events = events | EV_WRITE;
 			}
@@ -331,7 +353,7 @@ static G_GNUC_WARN_UNUSED_RESULT gboolean connection_try_read(liConnection *con)
 			con->raw_in->is_closed = TRUE;
 			/* shutdown(con->sock_watcher.fd, SHUT_RD); */ /* useless anyway */
 			ev_io_stop(con->wrk->loop, &con->sock_watcher);
-			close(con->sock_watcher.fd);
+			if (!connection_uring_write_release(con)) close(con->sock_watcher.fd);
 			ev_io_set(&con->sock_watcher, -1, 0);
 			connection_close(con);
 			return FALSE;
@@ -365,8 +387,12 @@ static G_GNUC_WARN_UNUSED_RESULT gboolean connection_try_write(liConnection *con
 
 			if (con->srv_sock->write_cb) {
 				res = con->srv_sock->write_cb(con, write_max);
+#ifdef USE_IO_URING
+			} else if (connection_uring_write(con)) {
+				res = li_network_write_uring_async(con->mainvr, con->sock_watcher.fd, con->raw_out, write_max, &con->uring_write);
+#endif
 			} else {
-				res = li_network_write(con->mainvr, con->sock_watcher.fd, con->raw_out, write_max);
+				res = li_network_write_zerocopy(con->mainvr, con->sock_watcher.fd, con->raw_out, write_max, &con->zerocopy);
 			}
 
 			transferred = transferred - con->raw_out->length;
@@ -433,6 +459,10 @@ static void connection_cb(struct ev_loop *loop, ev_io *w, int revents) {
 		return;
 	}
 
+	/* zerocopy completions on the error queue wake us up too */
+	if (con->zerocopy.pending.length > 0)
+		li_network_zerocopy_reap(con->mainvr, con->sock_watcher.fd, &con->zerocopy);
+
 	connection_handle_io(con);
 }
 
@@ -555,6 +585,10 @@ liConnection* li_connection_new(liWorker *wrk) {
 
 	con->raw_in  = li_chunkqueue_new();
 	con->raw_out = li_chunkqueue_new();
+	li_network_zerocopy_init(&con->zerocopy);
+#ifdef USE_IO_URING
+	li_network_uring_write_init(&con->uring_write, connection_uring_write_cb, con);
+#endif
 
 	con->info.callbacks = &con_callbacks;
 
@@ -596,15 +630,22 @@ void li_connection_reset(liConnection *con) {
 	con->info.is_ssl = FALSE;
 
 	ev_io_stop(con->wrk->loop, &con->sock_watcher);
-	if (con->sock_watcher.fd != -1) {
-		if (con->raw_in->is_closed) { /* read already got EOF */
+	if (connection_uring_write_release(con)) {
+		/* closed when the writes in flight completed */
+	} else if (con->sock_watcher.fd != -1) {
+		if (con->zerocopy.pending.length > 0)
+			li_network_zerocopy_reap(con->mainvr, con->sock_watcher.fd, &con->zerocopy);
+
+		if (con->raw_in->is_closed && 0 == con->zerocopy.pending.length) { /* read already got EOF */
 			shutdown(con->sock_watcher.fd, SHUT_RDWR);
 			close(con->sock_watcher.fd);
 		} else {
-			li_worker_add_closing_socket(con->wrk, con->sock_watcher.fd);
+			/* the kernel may still send from the buffers of pending zerocopy sends */
+			li_worker_add_closing_socket(con->wrk, con->sock_watcher.fd, &con->zerocopy);
 		}
 	}
 	ev_io_set(&con->sock_watcher, -1, 0);
+	li_network_zerocopy_reset(&con->zerocopy);
 	ev_set_cb(&con->sock_watcher, connection_cb);
 
 	li_chunkqueue_reset(con->raw_in);
@@ -614,6 +655,7 @@ void li_connection_reset(liConnection *con) {
 	con->raw_in_buffer = NULL;
 
 	li_vrequest_reset(con->mainvr, FALSE);
+	li_arena_trim(&con->mainvr->arena); /* the connection goes back to the pool */
 
 	li_throttle_reset(con->mainvr);
 
@@ -704,6 +746,10 @@ static void li_connection_reset_keep_alive(liConnection *con) {
 
 	li_vrequest_reset(con->mainvr, TRUE);
 	li_http_request_parser_reset(&con->req_parser_ctx);
+	if (0 == con->raw_in->length) {
+		/* idle connections shouldn't hold a block each; the next request gets a new one */
+		li_arena_trim(&con->mainvr->arena);
+	}
 
 	/* restore chunkqueue limits (don't reset, we might still have some data in raw_in) */
 	li_chunkqueue_set_limit(con->raw_in, con->in->limit);
@@ -736,12 +782,15 @@ void li_connection_free(liConnection *con) {
 
 	if (con->wrk)
 		ev_io_stop(con->wrk->loop, &con->sock_watcher);
-	if (con->sock_watcher.fd != -1) {
+	if (connection_uring_write_release(con)) {
+		/* closed when the writes in flight completed */
+	} else if (con->sock_watcher.fd != -1) {
 		/* just close it; _free should only be called on dead connections anyway */
 		shutdown(con->sock_watcher.fd, SHUT_WR);
-		close(con->sock_watcher.fd);
+		li_network_zerocopy_close(con->sock_watcher.fd, &con->zerocopy);
 	}
 	ev_io_set(&con->sock_watcher, -1, 0);
+	li_network_zerocopy_reset(&con->zerocopy);
 	g_string_free(con->info.remote_addr_str, TRUE);
 	li_sockaddr_clear(&con->info.remote_addr);
 	g_string_free(con->info.local_addr_str, TRUE);
@@ -0,0 +1,186 @@
+
+#include <lighttpd/base.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+liContentCache* li_content_cache_new(goffset max_file_size, gsize max_size) {
+	liContentCache *cc = g_slice_new0(liContentCache);
+	guint i;
+
+	cc->max_file_size = max_file_size;
+	cc->max_size = max_size;
+
+	for (i = 0; i < LI_CONTENT_CACHE_SHARDS; i++) {
+		g_static_mutex_init(&cc->shards[i].lock);
+		cc->shards[i].entries = g_hash_table_new((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal);
+		g_queue_init(&cc->shards[i].lru);
+	}
+
+	return cc;
+}
+
+static void content_cache_entry_free(liContentCacheEntry *cce) {
+	li_buffer_release(cce->buf);
+	g_string_free(cce->path, TRUE);
+	g_slice_free(liContentCacheEntry, cce);
+}
+
+void li_content_cache_entry_release(liContentCacheEntry *cce) {
+	if (!cce) return;
+	assert(g_atomic_int_get(&cce->refcount) > 0);
+	if (g_atomic_int_dec_and_test(&cce->refcount)) {
+		content_cache_entry_free(cce);
+	}
+}
+
+/* shard lock must be held */
+static void content_cache_remove(liContentCache *cc, guint ndx, liContentCacheEntry *cce) {
+	g_hash_table_remove(cc->shards[ndx].entries, cce->path);
+	g_queue_unlink(&cc->shards[ndx].lru, &cce->lru_link);
+	cc->shards[ndx].size -= cce->size;
+	li_content_cache_entry_release(cce);
+}
+
+void li_content_cache_free(liContentCache *cc) {
+	guint i;
+
+	if (!cc) return;
+
+	for (i = 0; i < LI_CONTENT_CACHE_SHARDS; i++) {
+		GList *l;
+
+		while (NULL != (l = g_queue_peek_head_link(&cc->shards[i].lru))) {
+			content_cache_remove(cc, i, l->data);
+		}
+
+		g_hash_table_destroy(cc->shards[i].entries);
+		g_static_mutex_free(&cc->shards[i].lock);
+	}
+
+	g_slice_free(liContentCache, cc);
+}
+
+static gboolean content_cache_entry_matches(liContentCacheEntry *cce, struct stat *st) {
+	return cce->dev == st->st_dev && cce->ino == st->st_ino && cce->size == st->st_size && cce->mtime == st->st_mtime;
+}
+
+static guint content_cache_shard(GString *path) {
+	return g_string_hash(path) % LI_CONTENT_CACHE_SHARDS;
+}
+
+/* reads the complete file; fails if it doesn't match st anymore */
+static liContentCacheEntry* content_cache_load(liVRequest *vr, GString *path, struct stat *st, int fd) {
+	liContentCacheEntry *cce;
+	liBuffer *buf;
+	struct stat fst;
+	gboolean own_fd = FALSE;
+	gsize len = 0;
+
+	if (-1 == fd) {
+		while (-1 == (fd = open(path->str, O_RDONLY))) {
+			if (EINTR == errno) continue;
+			if (EMFILE == errno) li_server_out_of_fds(vr->wrk->srv);
+			return NULL;
+		}
+		own_fd = TRUE;
+	}
+
+	/* the cache outlives the request and the worker, so no mempool buffer */
+	buf = li_buffer_new_slice(st->st_size);
+
+	while (len < (gsize) st->st_size) {
+		ssize_t r = pread(fd, buf->addr + len, st->st_size - len, len);
+
+		if (r < 0 && EINTR == errno) continue;
+		if (r <= 0) break; /* error or file shrinked */
+		len += r;
+	}
+
+	if (len != (gsize) st->st_size || -1 == fstat(fd, &fst)
+	    || fst.st_dev != st->st_dev || fst.st_ino != st->st_ino || fst.st_size != st->st_size || fst.st_mtime != st->st_mtime) {
+		/* changed while we were reading it */
+		if (own_fd) close(fd);
+		li_buffer_release(buf);
+		return NULL;
+	}
+
+	if (own_fd) close(fd);
+
+	buf->used = len;
+
+	cce = g_slice_new0(liContentCacheEntry);
+	cce->refcount = 1;
+	cce->path = g_string_new_len(GSTR_LEN(path));
+	cce->buf = buf;
+	cce->dev = st->st_dev;
+	cce->ino = st->st_ino;
+	cce->size = st->st_size;
+	cce->mtime = st->st_mtime;
+	cce->lru_link.data = cce;
+
+	return cce;
+}
+
+liContentCacheEntry* li_content_cache_get(liVRequest *vr, GString *path, struct stat *st, int fd) {
+	liContentCache *cc = vr->wrk->srv->content_cache;
+	guint ndx = content_cache_shard(path);
+	gsize shard_max = cc->max_size / LI_CONTENT_CACHE_SHARDS;
+	liContentCacheEntry *cce, *old;
+
+	if (st->st_size <= 0 || st->st_size > cc->max_file_size) return NULL;
+
+	g_static_mutex_lock(&cc->shards[ndx].lock);
+	if (NULL != (cce = g_hash_table_lookup(cc->shards[ndx].entries, path))) {
+		if (content_cache_entry_matches(cce, st)) {
+			cc->shards[ndx].hits++;
+			g_queue_unlink(&cc->shards[ndx].lru, &cce->lru_link);
+			g_queue_push_tail_link(&cc->shards[ndx].lru, &cce->lru_link);
+			g_atomic_int_inc(&cce->refcount);
+			g_static_mutex_unlock(&cc->shards[ndx].lock);
+			return cce;
+		}
+
+		/* file changed */
+		content_cache_remove(cc, ndx, cce);
+	}
+	cc->shards[ndx].misses++;
+	g_static_mutex_unlock(&cc->shards[ndx].lock);
+
+	/* read without holding the lock; if another worker loads the same file meanwhile, the last one wins */
+	if (NULL == (cce = content_cache_load(vr, path, st, fd))) return NULL;
+
+	if ((gsize) cce->size > shard_max) return cce; /* serve it from memory anyway, but don't keep it */
+
+	g_static_mutex_lock(&cc->shards[ndx].lock);
+	if (NULL != (old = g_hash_table_lookup(cc->shards[ndx].entries, path))) {
+		content_cache_remove(cc, ndx, old);
+	}
+
+	while (cc->shards[ndx].size + cce->size > shard_max) {
+		content_cache_remove(cc, ndx, g_queue_peek_head(&cc->shards[ndx].lru));
+	}
+
+	g_hash_table_insert(cc->shards[ndx].entries, cce->path, cce);
+	g_queue_push_tail_link(&cc->shards[ndx].lru, &cce->lru_link);
+	cc->shards[ndx].size += cce->size;
+	g_atomic_int_inc(&cce->refcount); /* reference for the caller */
+	g_static_mutex_unlock(&cc->shards[ndx].lock);
+
+	return cce;
+}
+
+void li_content_cache_get_stats(liContentCache *cc, liContentCacheStats *stats) {
+	guint i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < LI_CONTENT_CACHE_SHARDS; i++) {
+		g_static_mutex_lock(&cc->shards[i].lock);
+		stats->hits += cc->shards[i].hits;
+		stats->misses += cc->shards[i].misses;
+		stats->bytes += cc->shards[i].size;
+		stats->entries += g_hash_table_size(cc->shards[i].entries);
+		g_static_mutex_unlock(&cc->shards[i].lock);
+	}
+}
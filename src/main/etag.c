@@ -128,37 +128,44 @@ void li_etag_mutate(GString *mut, GString *etag) {
 	g_string_append_len(mut, CONST_STR_LEN("\""));
 }
 
-void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
-	guint flags = CORE_OPTION(LI_CORE_OPTION_ETAG_FLAGS).number;
-	GString *tmp_str = vr->wrk->tmp_str;
+void li_etag_format(GString *dest, struct stat *st, guint flags) {
+	g_string_truncate(dest, 0);
+
+	if (flags & LI_ETAG_USE_INODE) {
+		li_string_append_int(dest, st->st_ino);
+	}
+
+	if (flags & LI_ETAG_USE_SIZE) {
+		if (dest->len != 0) g_string_append_len(dest, CONST_STR_LEN("-"));
+		li_string_append_int(dest, st->st_size);
+	}
+
+	if (flags & LI_ETAG_USE_MTIME) {
+		if (dest->len != 0) g_string_append_len(dest, CONST_STR_LEN("-"));
+		li_string_append_int(dest, st->st_mtime);
+	}
+
+	li_etag_mutate(dest, dest);
+}
+
+gsize li_etag_format_last_modified(gchar *buf, gsize size, time_t mtime) {
 	struct tm tm;
+
+	if (!gmtime_r(&mtime, &tm)) return 0;
+
+	return strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+void li_etag_set_header_strings(liVRequest *vr, GString *etag, GString *last_modified, gboolean *cachable) {
 	liTristate c_able = cachable ? LI_TRIMAYBE : LI_TRIFALSE;
 
-	if (0 == flags) {
+	if (!etag) {
 		li_http_header_remove(vr->response.headers, CONST_STR_LEN("etag"));
 	} else {
-		g_string_truncate(tmp_str, 0);
-	
-		if (flags & LI_ETAG_USE_INODE) {
-			li_string_append_int(tmp_str, st->st_ino);
-		}
-		
-		if (flags & LI_ETAG_USE_SIZE) {
-			if (tmp_str->len != 0) g_string_append_len(tmp_str, CONST_STR_LEN("-"));
-			li_string_append_int(tmp_str, st->st_size);
-		}
-		
-		if (flags & LI_ETAG_USE_MTIME) {
-			if (tmp_str->len != 0) g_string_append_len(tmp_str, CONST_STR_LEN("-"));
-			li_string_append_int(tmp_str, st->st_mtime);
-		}
-	
-		li_etag_mutate(tmp_str, tmp_str);
-	
-		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("ETag"), GSTR_LEN(tmp_str));
+		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("ETag"), GSTR_LEN(etag));
 
 		if (c_able != LI_TRIFALSE) {
-			switch (li_http_response_handle_cachable_etag(vr, tmp_str)) {
+			switch (li_http_response_handle_cachable_etag(vr, etag)) {
 			case LI_TRIFALSE: c_able = LI_TRIFALSE; break;
 			case LI_TRIMAYBE: break;
 			case LI_TRITRUE : c_able = LI_TRITRUE; break;
@@ -166,14 +173,11 @@ void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
 		}
 	}
 
-	if (gmtime_r(&st->st_mtime, &tm)) {
-		g_string_set_size(tmp_str, 256);
-		g_string_set_size(tmp_str, strftime(tmp_str->str, tmp_str->len-1,
-			"%a, %d %b %Y %H:%M:%S GMT", &tm));
-		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Last-Modified"), GSTR_LEN(tmp_str));
+	if (last_modified) {
+		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Last-Modified"), GSTR_LEN(last_modified));
 
 		if (c_able != LI_TRIFALSE) {
-			switch (li_http_response_handle_cachable_modified(vr, tmp_str)) {
+			switch (li_http_response_handle_cachable_modified(vr, last_modified)) {
 			case LI_TRIFALSE: c_able = LI_TRIFALSE; break;
 			case LI_TRIMAYBE: break;
 			case LI_TRITRUE : c_able = LI_TRITRUE; break;
@@ -183,3 +187,18 @@ void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
 
 	if (cachable) *cachable = (c_able == LI_TRITRUE);
 }
+
+void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
+	guint flags = CORE_OPTION(LI_CORE_OPTION_ETAG_FLAGS).number;
+	GString *etag = NULL;
+	gchar buf[LI_ETAG_LAST_MODIFIED_SIZE];
+	gsize len = li_etag_format_last_modified(buf, sizeof(buf), st->st_mtime);
+	GString last_modified = li_const_gstring(buf, len);
+
+	if (0 != flags) {
+		etag = vr->wrk->tmp_str;
+		li_etag_format(etag, st, flags);
+	}
+
+	li_etag_set_header_strings(vr, etag, (len > 0) ? &last_modified : NULL, cachable);
+}
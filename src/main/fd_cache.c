@@ -0,0 +1,157 @@
+
+#include <lighttpd/base.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+static void fd_cache_entry_free(gpointer data) {
+	liFdCacheEntry *fce = data;
+
+	li_chunkfile_release(fce->cf);
+	g_string_free(fce->path, TRUE);
+	g_slice_free(liFdCacheEntry, fce);
+}
+
+static void fd_cache_remove(liFdCache *fdc, liFdCacheEntry *fce) {
+	li_waitqueue_remove(&fdc->lru, &fce->lru_elem);
+	g_hash_table_remove(fdc->entries, fce->path); /* frees fce */
+}
+
+static void fd_cache_idle_cb(liWaitQueue *wq, gpointer data) {
+	liFdCache *fdc = data;
+	liWaitQueueElem *wqe;
+
+	while (NULL != (wqe = li_waitqueue_pop(wq))) {
+		liFdCacheEntry *fce = wqe->data;
+
+		g_hash_table_remove(fdc->entries, fce->path);
+	}
+
+	li_waitqueue_update(wq);
+}
+
+liFdCache* li_fd_cache_new(liWorker *wrk, guint max_open) {
+	liFdCache *fdc;
+
+	if (0 == max_open) return NULL;
+
+	fdc = g_slice_new0(liFdCache);
+	fdc->max_open = max_open;
+	fdc->entries = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, NULL, fd_cache_entry_free);
+
+	li_waitqueue_init(&fdc->lru, wrk->loop, fd_cache_idle_cb, LI_FD_CACHE_IDLE, fdc);
+
+	return fdc;
+}
+
+void li_fd_cache_flush(liFdCache *fdc) {
+	if (!fdc) return;
+
+	while (NULL != li_waitqueue_pop_force(&fdc->lru)) ;
+	g_hash_table_remove_all(fdc->entries);
+}
+
+void li_fd_cache_free(liFdCache *fdc) {
+	if (!fdc) return;
+
+	li_waitqueue_stop(&fdc->lru);
+	li_fd_cache_flush(fdc);
+
+	g_hash_table_destroy(fdc->entries);
+	g_slice_free(liFdCache, fdc);
+}
+
+static gboolean fd_cache_entry_matches(liFdCacheEntry *fce, struct stat *st) {
+	return fce->dev == st->st_dev && fce->ino == st->st_ino && fce->size == st->st_size && fce->mtime == st->st_mtime;
+}
+
+static int fd_cache_open(liVRequest *vr, liFdCache *fdc, GString *path) {
+	gboolean flushed = FALSE;
+	int fd;
+
+	while (-1 == (fd = open(path->str, O_RDONLY))) {
+		switch (errno) {
+		case EINTR:
+			continue;
+		case EMFILE:
+			/* our cached fds are the first to go */
+			if (!flushed && g_hash_table_size(fdc->entries) > 0) {
+				li_fd_cache_flush(fdc);
+				flushed = TRUE;
+				continue;
+			}
+			li_server_out_of_fds(vr->wrk->srv);
+			return -1;
+		default:
+			return -1;
+		}
+	}
+
+#ifdef FD_CLOEXEC
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+	return fd;
+}
+
+liChunkFile* li_fd_cache_get(liVRequest *vr, GString *path, struct stat *st, int *err) {
+	liFdCache *fdc = vr->wrk->fd_cache;
+	liFdCacheEntry *fce;
+	struct stat fst;
+	int fd;
+
+	if (NULL != (fce = g_hash_table_lookup(fdc->entries, path))) {
+		if (fd_cache_entry_matches(fce, st)) {
+			fdc->hits++;
+			li_waitqueue_push(&fdc->lru, &fce->lru_elem);
+			li_chunkfile_acquire(fce->cf);
+			return fce->cf;
+		}
+
+		/* file changed */
+		fd_cache_remove(fdc, fce);
+	}
+
+	fdc->misses++;
+
+	if (-1 == (fd = fd_cache_open(vr, fdc, path))) {
+		*err = errno;
+		return NULL;
+	}
+
+	if (-1 == fstat(fd, &fst)) {
+		*err = errno;
+		close(fd);
+		return NULL;
+	}
+
+	if (!S_ISREG(fst.st_mode)) {
+		/* replaced since the stat() */
+		*err = EACCES;
+		close(fd);
+		return NULL;
+	}
+
+	/* the file may have changed since the stat(); the fd is what we are going to send */
+	*st = fst;
+
+	if (g_hash_table_size(fdc->entries) >= fdc->max_open) {
+		liWaitQueueElem *wqe = li_waitqueue_pop_force(&fdc->lru);
+		if (NULL != wqe) g_hash_table_remove(fdc->entries, ((liFdCacheEntry*) wqe->data)->path);
+	}
+
+	fce = g_slice_new0(liFdCacheEntry);
+	fce->path = g_string_new_len(GSTR_LEN(path));
+	fce->cf = li_chunkfile_new(path, fd, FALSE);
+	fce->dev = fst.st_dev;
+	fce->ino = fst.st_ino;
+	fce->size = fst.st_size;
+	fce->mtime = fst.st_mtime;
+	fce->lru_elem.data = fce;
+
+	g_hash_table_insert(fdc->entries, fce->path, fce);
+	li_waitqueue_push(&fdc->lru, &fce->lru_elem);
+
+	li_chunkfile_acquire(fce->cf);
+	return fce->cf;
+}
@@ -81,6 +81,8 @@ liHandlerResult li_filter_buffer_on_disk(liVRequest *vr, liChunkQueue *out, liCh
 		case STRING_CHUNK:
 		case MEM_CHUNK:
 		case BUFFER_CHUNK:
+		case PIPE_CHUNK:
+		case INLINE_CHUNK:
 			if (!bod_open(vr, state)) return LI_HANDLER_ERROR;
 
 			length = li_chunk_length(c);
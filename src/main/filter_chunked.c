@@ -4,24 +4,22 @@
 /* len != 0 */
 static void http_chunk_append_len(liChunkQueue *cq, size_t len) {
 	size_t i, olen = len, j;
-	GByteArray *a;
-
-	a = g_byte_array_sized_new(sizeof(len) * 2 + 2);
+	gchar a[sizeof(len) * 2 + 2];
 
 	for (i = 0; i < 8 && len; i++) {
 		len >>= 4;
 	}
 
 	/* i is the number of hex digits we have */
-	g_byte_array_set_size(a, i);
-
 	for (j = i-1, len = olen; j+1 > 0; j--) {
-		a->data[j] = (len & 0xf) + (((len & 0xf) <= 9) ? '0' : 'a' - 10);
+		a[j] = (len & 0xf) + (((len & 0xf) <= 9) ? '0' : 'a' - 10);
 		len >>= 4;
 	}
-	g_byte_array_append(a, (guint8*) CONST_STR_LEN("\r\n"));
+	a[i] = '\r';
+	a[i+1] = '\n';
 
-	li_chunkqueue_append_bytearr(cq, a);
+	/* small enough to be stored inline (or appended to the previous "\r\n") */
+	li_chunkqueue_append_mem(cq, a, i + 2);
 }
 
 
@@ -85,7 +83,7 @@ liHandlerResult li_filter_chunked_decode(liVRequest *vr, liChunkQueue *out, liCh
 				digit = c - '0';
 			} else if (c >= 'a' && c <= 'f') {
 				digit = c - 'a' + 10;
-			} else if (c >= 'A' && c >= 'F') {
+			} else if (c >= 'A' && c <= 'F') {
 				digit = c - 'A' + 10;
 			} else if (c == '\r') {
 				if (state->cur_chunklen == -1) {
@@ -22,6 +22,53 @@ static liHttpHeader* _http_header_new(const gchar *key, size_t keylen, const gch
 	return h;
 }
 
+/* header, data and list link in one arena allocation; the string is in the arena too */
+typedef struct http_header_arena http_header_arena;
+struct http_header_arena {
+	liHttpHeader h;
+	GString data;
+	GList link;
+};
+
+static GList* _http_header_new_arena(liArena *arena, const gchar *key, size_t keylen, const gchar *val, size_t valuelen) {
+	http_header_arena *ha = li_arena_new(arena, http_header_arena);
+	gsize len = keylen + valuelen + 2;
+	gchar *s;
+
+	ha->h.keylen = keylen;
+	ha->h.data = &ha->data;
+	ha->data.str = s = li_arena_alloc(arena, len + 1);
+	ha->data.len = len;
+	ha->data.allocated_len = len + 1;
+	ha->link.data = &ha->h;
+	ha->link.prev = ha->link.next = NULL;
+
+	memcpy(s, key, keylen);
+	s += keylen;
+	memcpy(s, ": ", 2);
+	s += 2;
+	memcpy(s, val, valuelen);
+	s[valuelen] = '\0';
+	return &ha->link;
+}
+
+/* like g_string_set_size, but arena strings get moved within the arena */
+static void _http_header_set_size(liHttpHeaders *headers, liHttpHeader *h, gsize len) {
+	if (NULL == headers->arena) {
+		g_string_set_size(h->data, len);
+		return;
+	}
+
+	if (len >= h->data->allocated_len) {
+		gchar *s = li_arena_alloc(headers->arena, len + 1);
+		memcpy(s, h->data->str, h->data->len);
+		h->data->str = s;
+		h->data->allocated_len = len + 1;
+	}
+	h->data->len = len;
+	h->data->str[len] = '\0';
+}
+
 static void _header_queue_free(gpointer data, gpointer userdata) {
 	UNUSED(userdata);
 	_http_header_free((liHttpHeader*) data);
@@ -34,21 +81,34 @@ liHttpHeaders* li_http_headers_new() {
 }
 
 void li_http_headers_reset(liHttpHeaders* headers) {
+	if (headers->arena) {
+		/* memory is released with the arena */
+		g_queue_init(&headers->entries);
+		return;
+	}
 	g_queue_foreach(&headers->entries, _header_queue_free, NULL);
 	g_queue_clear(&headers->entries);
 }
 
 void li_http_headers_free(liHttpHeaders* headers) {
 	if (!headers) return;
-	g_queue_foreach(&headers->entries, _header_queue_free, NULL);
-	g_queue_clear(&headers->entries);
+	li_http_headers_reset(headers);
 	g_slice_free(liHttpHeaders, headers);
 }
 
+void li_http_headers_use_arena(liHttpHeaders* headers, liArena *arena) {
+	assert(0 == headers->entries.length);
+	headers->arena = arena;
+}
+
 /** just insert normal header, allow duplicates */
 void li_http_header_insert(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen) {
-	liHttpHeader *h = _http_header_new(key, keylen, val, valuelen);
-	g_queue_push_tail(&headers->entries, h);
+	if (headers->arena) {
+		g_queue_push_tail_link(&headers->entries, _http_header_new_arena(headers->arena, key, keylen, val, valuelen));
+	} else {
+		liHttpHeader *h = _http_header_new(key, keylen, val, valuelen);
+		g_queue_push_tail(&headers->entries, h);
+	}
 }
 
 GList* li_http_header_find_first(liHttpHeaders *headers, const gchar *key, size_t keylen) {
@@ -96,7 +156,7 @@ void li_http_header_append(liHttpHeaders *headers, const gchar *key, size_t keyl
 		gchar *s;
 		h = (liHttpHeader*) l->data;
 		oldlen = h->data->len;
-		g_string_set_size(h->data, oldlen + 2 + valuelen);
+		_http_header_set_size(headers, h, oldlen + 2 + valuelen);
 		s = h->data->str + oldlen;
 		memcpy(s, ", ", 2);
 		memcpy(s+2, val, valuelen);
@@ -113,13 +173,17 @@ void li_http_header_overwrite(liHttpHeaders *headers, const gchar *key, size_t k
 		li_http_header_insert(headers, key, keylen, val, valuelen);
 	} else {
 		h = (liHttpHeader*) l->data;
-		g_string_set_size(h->data, keylen + 2 + valuelen);
+		_http_header_set_size(headers, h, keylen + 2 + valuelen);
 		/* only overwrite value */
 		memcpy(h->data->str + keylen + 2, val, valuelen);
 	}
 }
 
 void li_http_header_remove_link(liHttpHeaders *headers, GList *l) {
+	if (headers->arena) {
+		g_queue_unlink(&headers->entries, l);
+		return;
+	}
 	_http_header_free(l->data);
 	g_queue_delete_link(&headers->entries, l);
 }
@@ -36,7 +36,31 @@ ssize_t li_net_read(int fd, void *buf, ssize_t nbyte) {
 	return r;
 }
 
+static const liNetworkBackend network_backends[] = {
+	{ "auto", li_network_write_auto, LI_NETWORK_INLINE_FILE_MAX },
+	{ "writev", li_network_write_writev, -1 },
+#ifdef USE_SENDFILE
+	{ "sendfile", li_network_write_sendfile, -1 },
+#endif
+#ifdef USE_IO_URING
+	{ "io_uring", li_network_write_uring, -1 },
+#endif
+
+	{ NULL, NULL, 0 }
+};
+
+const liNetworkBackend* li_network_backend_find(const gchar *name) {
+	const liNetworkBackend *backend;
+
+	for (backend = network_backends; NULL != backend->name; backend++) {
+		if (g_str_equal(backend->name, name)) return backend;
+	}
+
+	return NULL;
+}
+
 liNetworkStatus li_network_write(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max) {
+	const liNetworkBackend *backend = vr->wrk->srv->network_backend;
 	liNetworkStatus res;
 #ifdef TCP_CORK
 	int corked = 0;
@@ -44,20 +68,15 @@ liNetworkStatus li_network_write(liVRequest *vr, int fd, liChunkQueue *cq, goffs
 
 #ifdef TCP_CORK
 	/* Linux: put a cork into the socket as we want to combine the write() calls
-	 * but only if we really have multiple chunks
+	 * but only if we really have multiple chunks that don't fit into a single writev()
 	 */
-	if (cq->queue.length > 1) {
+	if (li_chunkqueue_count(cq) > 1 && !li_network_writev_single(cq, write_max, backend->inline_file_max)) {
 		corked = 1;
 		setsockopt(fd, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
 	}
 #endif
 
-	/* TODO: add setup-option to select the backend */
-#ifdef USE_SENDFILE
-	res = li_network_write_sendfile(vr, fd, cq, &write_max);
-#else
-	res = li_network_write_writev(vr, fd, cq, &write_max);
-#endif
+	res = backend->write(vr, fd, cq, &write_max);
 
 #ifdef TCP_CORK
 	if (corked) {
@@ -155,7 +155,7 @@ static network_sendfile_result lighty_sendfile(liVRequest *vr, int fd, int filef
 
 
 /* first chunk must be a FILE_CHUNK ! */
-static liNetworkStatus network_backend_sendfile(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+liNetworkStatus li_network_backend_sendfile(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
 	off_t file_offset, toSend;
 	ssize_t r;
 	gboolean did_write_something = FALSE;
@@ -177,6 +177,7 @@ static liNetworkStatus network_backend_sendfile(liVRequest *vr, int fd, liChunkQ
 		default:
 			return LI_NETWORK_STATUS_FATAL_ERROR;
 		}
+		li_chunk_readahead(vr, c);
 
 		file_offset = c->offset + c->data.file.start;
 		toSend = c->data.file.length - c->offset;
@@ -230,10 +231,14 @@ liNetworkStatus li_network_write_sendfile(liVRequest *vr, int fd, liChunkQueue *
 		case MEM_CHUNK:
 		case STRING_CHUNK:
 		case BUFFER_CHUNK:
+		case INLINE_CHUNK:
 			LI_NETWORK_FALLBACK(li_network_backend_writev, write_max);
 			break;
 		case FILE_CHUNK:
-			LI_NETWORK_FALLBACK(network_backend_sendfile, write_max);
+			LI_NETWORK_FALLBACK(li_network_backend_sendfile, write_max);
+			break;
+		case PIPE_CHUNK:
+			LI_NETWORK_FALLBACK(li_network_backend_splice, write_max);
 			break;
 		default:
 			return LI_NETWORK_STATUS_FATAL_ERROR;
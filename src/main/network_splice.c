@@ -0,0 +1,154 @@
+
+#include <lighttpd/base.h>
+
+#ifdef USE_SPLICE
+
+/* first chunk must be a PIPE_CHUNK ! */
+liNetworkStatus li_network_backend_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	liChunk *c = li_chunkqueue_first_chunk(cq);
+	liChunkPipe *cp = c->data.pipe.pipe;
+	goffset len;
+	ssize_t r;
+
+	/* already read into memory */
+	if (NULL != c->mem) return li_network_backend_write(vr, fd, cq, write_max);
+
+	len = li_chunk_length(c);
+	if (len > *write_max) len = *write_max;
+	if (0 == len) return LI_NETWORK_STATUS_FATAL_ERROR;
+
+	while (-1 == (r = splice(cp->fd[0], NULL, fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK))) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+		case ECONNRESET:
+		case EPIPE:
+		case ETIMEDOUT:
+			return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+		case EINTR:
+			break; /* try again */
+		case EINVAL:
+		case ENOSYS:
+			/* fd doesn't support splice */
+			return li_network_backend_write(vr, fd, cq, write_max);
+		default:
+			VR_ERROR(vr, "oops, splice to fd=%d failed: %s", fd, g_strerror(errno));
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+	}
+
+	if (0 == r) return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+
+	cp->used -= r;
+	li_chunkqueue_skip(cq, r);
+	*write_max -= r;
+
+	return (r == len) ? LI_NETWORK_STATUS_SUCCESS : LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+}
+
+/* returns a pipe with free space; reuses *pipe if possible */
+static liChunkPipe* network_splice_pipe(liChunkQueue *cq, liChunkPipe **pipe) {
+	liChunkPipe *cp = *pipe;
+
+	if (NULL != cp) {
+		if (cp == li_chunkqueue_get_last_pipe(cq)) {
+			/* append to the last chunk */
+			if (cp->used < cp->size) return cp;
+		} else if (1 == g_atomic_int_get(&cp->refcount) && 0 == cp->used) {
+			/* no chunk uses it anymore */
+			return cp;
+		}
+
+		li_chunkpipe_release(cp);
+		*pipe = NULL;
+	}
+
+	return *pipe = li_chunkpipe_new();
+}
+
+liNetworkStatus li_network_read_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset max_read, liBuffer **buffer, liChunkPipe **pipe) {
+	liChunkPipe *cp;
+	gboolean cq_pipe_append;
+	gboolean retried = FALSE;
+	goffset len;
+	ssize_t r;
+
+	if (max_read < 0 || max_read > 256*1024) max_read = 256*1024; /* 256k */
+
+	if (cq->limit && cq->limit->limit > 0) {
+		if (max_read > cq->limit->limit - cq->limit->current) {
+			max_read = cq->limit->limit - cq->limit->current;
+			if (max_read <= 0) {
+				max_read = 0; /* we still have to read something */
+				VR_ERROR(vr, "%s", "li_network_read_splice: fd should be disabled as chunkqueue is already full");
+			}
+		}
+	}
+
+retry:
+	if (NULL == (cp = network_splice_pipe(cq, pipe))) {
+		if (EMFILE == errno) li_server_out_of_fds(vr->wrk->srv);
+		return li_network_read(vr, fd, cq, buffer);
+	}
+	cq_pipe_append = (cp == li_chunkqueue_get_last_pipe(cq));
+
+	len = MIN(max_read, cp->size - cp->used);
+	if (len <= 0) len = 1;
+
+	while (-1 == (r = splice(fd, NULL, cp->fd[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK))) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			/* the pipe may be full before "size" bytes are in it (it counts pages, not bytes) */
+			if (cp->used > 0 && !retried) {
+				li_chunkpipe_release(cp);
+				*pipe = NULL;
+				retried = TRUE;
+				goto retry;
+			}
+			return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+		case ECONNRESET:
+		case ETIMEDOUT:
+			return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+		case EINTR:
+			break; /* try again */
+		case EINVAL:
+		case ENOSYS:
+			/* fd doesn't support splice */
+			return li_network_read(vr, fd, cq, buffer);
+		default:
+			VR_ERROR(vr, "oops, splice from fd=%d failed: %s", fd, g_strerror(errno));
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+	}
+
+	if (0 == r) return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+
+	cp->used += r;
+	if (cq_pipe_append) {
+		li_chunkqueue_update_last_pipe_size(cq, r);
+	} else {
+		li_chunkqueue_append_pipe(cq, cp, r);
+	}
+
+	return LI_NETWORK_STATUS_SUCCESS;
+}
+
+#else
+
+liNetworkStatus li_network_backend_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	return li_network_backend_write(vr, fd, cq, write_max);
+}
+
+liNetworkStatus li_network_read_splice(liVRequest *vr, int fd, liChunkQueue *cq, goffset max_read, liBuffer **buffer, liChunkPipe **pipe) {
+	UNUSED(max_read);
+	UNUSED(pipe);
+	return li_network_read(vr, fd, cq, buffer);
+}
+
+#endif
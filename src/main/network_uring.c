@@ -0,0 +1,477 @@
+
+#include <lighttpd/base.h>
+
+#ifdef USE_IO_URING
+
+#include <sys/uio.h>
+#include <fcntl.h>
+
+#ifndef RWF_NOWAIT
+# define RWF_NOWAIT 0x00000008
+#endif
+
+#define NETWORK_URING_OPS 32  /* max ops per chain */
+#define NETWORK_URING_IOV 128 /* max iovecs for all writev ops per chain */
+
+typedef enum {
+	NETWORK_URING_WRITEV,     /* mem chunks -> socket */
+	NETWORK_URING_SPLICE_IN,  /* file -> pipe */
+	NETWORK_URING_SPLICE_OUT  /* pipe -> socket */
+} network_uring_op_type;
+
+typedef struct network_uring_op network_uring_op;
+struct network_uring_op {
+	liURingOp op;
+	network_uring_op_type type;
+	gssize len;
+};
+
+typedef struct network_uring_pipe network_uring_pipe;
+struct network_uring_pipe {
+	int fd[2];
+	gssize size;
+};
+
+struct liNetworkURing {
+	GQueue pipes;                /* idle network_uring_pipe; each batch with splice ops needs its own */
+	gboolean nowait_unsupported; /* the kernel rejected writev with RWF_NOWAIT on a socket */
+};
+
+typedef struct network_uring_batch network_uring_batch;
+struct network_uring_batch {
+	liNetworkURing *nu;
+	liNetworkURingWrite *w;      /* NULL after li_network_uring_write_release() */
+
+	guint nops, pending;         /* ops in the chain / not completed yet */
+	network_uring_pipe *pipe;
+
+	liChunkQueue *keep;          /* after release: the chunks the ops still point to */
+	int fd;                      /* after release: the socket, closed when all ops completed */
+
+	network_uring_op ops[NETWORK_URING_OPS];
+	struct iovec iov[NETWORK_URING_IOV];
+	/* INLINE_CHUNK data moves with the chunk when the queue grows, so it is copied */
+	gchar inl[NETWORK_URING_IOV * LI_CHUNK_INLINE_SIZE];
+	gsize inl_used;
+};
+
+static liNetworkURing* network_uring_get(liVRequest *vr) {
+	liNetworkURing *nu = vr->wrk->network_uring;
+
+	if (NULL != nu) return nu;
+
+	nu = g_slice_new0(liNetworkURing);
+	g_queue_init(&nu->pipes);
+
+	vr->wrk->network_uring = nu;
+	return nu;
+}
+
+static network_uring_pipe* network_uring_pipe_get(liVRequest *vr, liNetworkURing *nu) {
+	network_uring_pipe *p;
+	int fds[2];
+
+	if (NULL != (p = g_queue_pop_head(&nu->pipes))) return p;
+
+	if (-1 == pipe(fds)) {
+		VR_ERROR(vr, "Couldn't create pipe: %s", g_strerror(errno));
+		return NULL;
+	}
+	li_fd_init(fds[0]);
+	li_fd_init(fds[1]);
+
+	p = g_slice_new0(network_uring_pipe);
+	p->fd[0] = fds[0];
+	p->fd[1] = fds[1];
+#ifdef F_GETPIPE_SZ
+	p->size = fcntl(fds[1], F_GETPIPE_SZ);
+	if (p->size <= 0)
+#endif
+		p->size = 4096;
+
+	return p;
+}
+
+static void network_uring_pipe_free(network_uring_pipe *p) {
+	close(p->fd[0]);
+	close(p->fd[1]);
+	g_slice_free(network_uring_pipe, p);
+}
+
+/* throw away data spliced into the pipe but not out of it again, then put it back into the pool */
+static void network_uring_pipe_put(liVRequest *vr, liNetworkURing *nu, network_uring_pipe *p, goffset piped) {
+	if (piped > 0) {
+		gchar buf[4096];
+		ssize_t r;
+
+		while ((r = li_net_read(p->fd[0], buf, sizeof(buf))) > 0) ;
+
+		if (-1 == r && EAGAIN != errno && EWOULDBLOCK != errno) {
+			if (NULL != vr) VR_ERROR(vr, "Couldn't drain splice pipe: %s", g_strerror(errno));
+			network_uring_pipe_free(p);
+			return;
+		}
+	}
+
+	g_queue_push_head(&nu->pipes, p);
+}
+
+void li_network_uring_free(liNetworkURing *nu) {
+	network_uring_pipe *p;
+
+	if (!nu) return;
+
+	while (NULL != (p = g_queue_pop_head(&nu->pipes))) {
+		network_uring_pipe_free(p);
+	}
+	g_slice_free(liNetworkURing, nu);
+}
+
+static void network_uring_op_cb(liURingOp *op);
+
+static struct io_uring_sqe* network_uring_sqe(liURing *ring, network_uring_batch *batch, network_uring_op_type type, gssize len) {
+	network_uring_op *op = &batch->ops[batch->nops];
+	struct io_uring_sqe *sqe;
+
+	op->op.callback = network_uring_op_cb;
+	op->op.data = batch;
+	if (NULL == (sqe = li_uring_get_sqe(ring, &op->op))) return NULL;
+
+	batch->nops++;
+	op->type = type;
+	op->len = len;
+	/* one chain per round: an op only starts if all previous ops completed in full */
+	sqe->flags = IOSQE_IO_LINK;
+
+	return sqe;
+}
+
+static liNetworkStatus network_uring_fallback(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+#ifdef USE_SENDFILE
+	return li_network_write_sendfile(vr, fd, cq, write_max);
+#else
+	return li_network_write_writev(vr, fd, cq, write_max);
+#endif
+}
+
+/* returns the bytes sent by the completed chain and the pipe; *stop is the index of the first
+ * failed or short op (nops if all completed in full)
+ */
+static goffset network_uring_batch_reap(liVRequest *vr, network_uring_batch *batch, guint *stop) {
+	goffset sent = 0, piped = 0;
+	guint i;
+
+	/* the chain stops at the first failed or short op, all following ops get -ECANCELED */
+	for (i = 0; i < batch->nops; i++) {
+		network_uring_op *op = &batch->ops[i];
+
+		if (op->op.res < 0) break;
+
+		if (NETWORK_URING_SPLICE_IN == op->type) {
+			piped += op->op.res;
+			if (op->op.res > 0 && op->op.res < op->len) {
+				/* pipe has less capacity than we thought */
+				batch->pipe->size = MAX(op->op.res, 4096);
+			}
+		} else {
+			if (NETWORK_URING_SPLICE_OUT == op->type) piped -= op->op.res;
+			sent += op->op.res;
+		}
+
+		if (op->op.res != op->len) break;
+	}
+	*stop = i;
+
+	if (NULL != batch->pipe) {
+		network_uring_pipe_put(vr, batch->nu, batch->pipe, piped);
+		batch->pipe = NULL;
+	}
+
+	return sent;
+}
+
+static void network_uring_batch_free(network_uring_batch *batch) {
+	guint stop;
+
+	network_uring_batch_reap(NULL, batch, &stop);
+
+	if (NULL != batch->keep) li_chunkqueue_free(batch->keep);
+	if (-1 != batch->fd) close(batch->fd);
+
+	g_slice_free(network_uring_batch, batch);
+}
+
+static void network_uring_op_cb(liURingOp *op) {
+	network_uring_batch *batch = op->data;
+
+	if (--batch->pending > 0) return;
+
+	if (NULL != batch->w) {
+		batch->w->callback(batch->w);
+	} else {
+		network_uring_batch_free(batch);
+	}
+}
+
+/* applies the result of the completed chain to cq */
+static liNetworkStatus network_uring_batch_finish(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max, network_uring_batch *batch) {
+	guint nops = batch->nops, i;
+	goffset sent = network_uring_batch_reap(vr, batch, &i);
+	network_uring_op *op = &batch->ops[i];
+	gint err;
+
+	batch->nops = 0;
+	batch->inl_used = 0;
+
+	li_chunkqueue_skip(cq, sent);
+	*write_max -= sent;
+
+	if (i == nops) {
+		return (0 == sent) ? LI_NETWORK_STATUS_WAIT_FOR_EVENT : LI_NETWORK_STATUS_SUCCESS;
+	}
+
+	err = (op->op.res < 0) ? -op->op.res : 0;
+	switch (err) {
+	case 0:
+		if (NETWORK_URING_SPLICE_IN == op->type) {
+			if (0 == op->op.res) {
+				/* file shrinked, close the connection */
+				VR_ERROR(vr, "%s", "File shrinked, aborting");
+				return LI_NETWORK_STATUS_FATAL_ERROR;
+			}
+			return LI_NETWORK_STATUS_SUCCESS;
+		}
+		return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+	case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+	case EWOULDBLOCK:
+#endif
+	case ECANCELED:
+		return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+	case ECONNRESET:
+	case EPIPE:
+	case ETIMEDOUT:
+		return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+	case EOPNOTSUPP:
+	case EINVAL:
+	case ENOSYS:
+		if (NETWORK_URING_WRITEV == op->type) {
+			/* kernel can't do RWF_NOWAIT on sockets; don't try again */
+			batch->nu->nowait_unsupported = TRUE;
+		}
+		/* splice not supported for this file (or by the kernel) */
+		return network_uring_fallback(vr, fd, cq, write_max);
+	default:
+		VR_ERROR(vr, "oops, write to fd=%d failed: %s", fd, g_strerror(err));
+		return LI_NETWORK_STATUS_FATAL_ERROR;
+	}
+}
+
+/* queues writev for mem chunks and splice() through a pipe for files as one linked chain */
+static liNetworkStatus network_uring_batch_prepare(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, network_uring_batch *batch) {
+	liURing *ring = vr->wrk->uring;
+	liChunkIter ci = li_chunkqueue_iter(cq);
+	liChunk *c;
+	struct io_uring_sqe *sqe = NULL, *s; /* sqe: last queued entry */
+	network_uring_op *op = NULL;
+	guint niov = 0, max_ops;
+	goffset we_have = 0;
+
+	/* the whole chain has to fit into the submission queue */
+	if (0 == (max_ops = li_uring_reserve(ring, NETWORK_URING_OPS))) return LI_NETWORK_STATUS_SUCCESS;
+
+	do {
+		goffset len;
+
+		c = li_chunkiter_chunk(ci);
+		len = li_chunk_length(c);
+		if (len > write_max - we_have) len = write_max - we_have;
+
+		if (STRING_CHUNK == c->type || MEM_CHUNK == c->type || BUFFER_CHUNK == c->type || INLINE_CHUNK == c->type) {
+			struct iovec *v;
+
+			if (niov == NETWORK_URING_IOV) break;
+
+			if (NULL == op || NETWORK_URING_WRITEV != op->type) {
+				if (batch->nops == max_ops) break;
+				if (NULL == (s = network_uring_sqe(ring, batch, NETWORK_URING_WRITEV, 0))) break;
+				sqe = s;
+				op = &batch->ops[batch->nops - 1];
+
+				sqe->opcode = IORING_OP_WRITEV;
+				sqe->fd = fd;
+				sqe->addr = (guint64) (uintptr_t) &batch->iov[niov];
+				/* io_uring would wait for the socket to become writable instead of returning EAGAIN */
+				sqe->rw_flags = RWF_NOWAIT;
+			}
+
+			v = &batch->iov[niov++];
+			if (c->type == STRING_CHUNK) {
+				v->iov_base = c->data.str->str + c->offset;
+			} else if (c->type == MEM_CHUNK) {
+				v->iov_base = c->mem->data + c->offset;
+			} else if (c->type == INLINE_CHUNK) {
+				v->iov_base = batch->inl + batch->inl_used;
+				memcpy(v->iov_base, c->data.inl.data + c->offset, len);
+				batch->inl_used += len;
+			} else { /* if (c->type == BUFFER_CHUNK) */
+				v->iov_base = c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset;
+			}
+			v->iov_len = len;
+			sqe->len++;
+			op->len += len;
+			we_have += len;
+		} else if (FILE_CHUNK == c->type) {
+			goffset file_offset;
+
+			switch (li_chunkfile_open(vr, c->data.file.file)) {
+			case LI_HANDLER_GO_ON:
+				break;
+			default:
+				if (0 == batch->nops) return LI_NETWORK_STATUS_FATAL_ERROR;
+				goto done;
+			}
+			li_chunk_readahead(vr, c);
+
+			if (NULL == batch->pipe && NULL == (batch->pipe = network_uring_pipe_get(vr, batch->nu))) {
+				if (0 == batch->nops) return LI_NETWORK_STATUS_FATAL_ERROR;
+				goto done;
+			}
+
+			file_offset = c->data.file.start + c->offset;
+
+			while (len > 0 && batch->nops + 2 <= max_ops) {
+				gssize seg = MIN(len, batch->pipe->size);
+
+				if (NULL == (s = network_uring_sqe(ring, batch, NETWORK_URING_SPLICE_IN, seg))) goto done;
+				sqe = s;
+				op = &batch->ops[batch->nops - 1];
+				sqe->opcode = IORING_OP_SPLICE;
+				sqe->fd = batch->pipe->fd[1];
+				sqe->off = (guint64) -1;
+				sqe->splice_fd_in = c->data.file.file->fd;
+				sqe->splice_off_in = file_offset;
+				sqe->len = seg;
+				sqe->splice_flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+				if (NULL == (s = network_uring_sqe(ring, batch, NETWORK_URING_SPLICE_OUT, seg))) goto done;
+				sqe = s;
+				op = &batch->ops[batch->nops - 1];
+				sqe->opcode = IORING_OP_SPLICE;
+				sqe->fd = fd;
+				sqe->off = (guint64) -1;
+				sqe->splice_fd_in = batch->pipe->fd[0];
+				sqe->splice_off_in = (guint64) -1;
+				sqe->len = seg;
+				sqe->splice_flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+				file_offset += seg;
+				len -= seg;
+				we_have += seg;
+			}
+
+			if (len > 0) break; /* out of ops */
+		} else {
+			if (0 == batch->nops) return LI_NETWORK_STATUS_FATAL_ERROR;
+			break;
+		}
+	} while (we_have < write_max && li_chunkiter_next(&ci));
+
+done:
+	if (NULL != sqe) sqe->flags &= ~IOSQE_IO_LINK;
+	batch->pending = batch->nops;
+
+	return LI_NETWORK_STATUS_SUCCESS;
+}
+
+void li_network_uring_write_init(liNetworkURingWrite *w, void (*callback)(liNetworkURingWrite *w), gpointer data) {
+	w->batch = NULL;
+	w->callback = callback;
+	w->data = data;
+}
+
+gboolean li_network_uring_write_busy(liNetworkURingWrite *w) {
+	network_uring_batch *batch = w->batch;
+
+	return NULL != batch && batch->pending > 0;
+}
+
+gboolean li_network_uring_write_release(liNetworkURingWrite *w, liChunkQueue *cq, int fd) {
+	network_uring_batch *batch = w->batch;
+
+	if (NULL == batch) return FALSE;
+	w->batch = NULL;
+
+	if (0 == batch->pending || -1 == fd) {
+		network_uring_batch_free(batch);
+		return FALSE;
+	}
+
+	/* the kernel looks up the fd of a linked op only when it starts, so the number must not be reused
+	 * before the chain completed; the iovecs point into the chunks */
+	batch->w = NULL;
+	batch->fd = fd;
+	batch->keep = li_chunkqueue_new();
+	li_chunkqueue_steal_all(batch->keep, cq);
+	/* let the remaining ops fail instead of waiting for the peer */
+	shutdown(fd, SHUT_RDWR);
+
+	return TRUE;
+}
+
+liNetworkStatus li_network_write_uring_async(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, liNetworkURingWrite *w) {
+	network_uring_batch *batch = w->batch;
+	liNetworkURing *nu;
+	liNetworkStatus status;
+
+	if (NULL != batch && batch->pending > 0) return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+
+	if (NULL != batch && batch->nops > 0) {
+		status = network_uring_batch_finish(vr, fd, cq, &write_max, batch);
+		if (LI_NETWORK_STATUS_SUCCESS != status) return status;
+	}
+
+	if (0 == cq->length || write_max <= 0) return LI_NETWORK_STATUS_SUCCESS;
+
+	if (NULL == vr->wrk->uring || NULL == (nu = network_uring_get(vr)) || nu->nowait_unsupported) {
+		return network_uring_fallback(vr, fd, cq, &write_max);
+	}
+
+	/* data from a backend pipe: a non-blocking splice() is fine */
+	while (PIPE_CHUNK == li_chunkqueue_first_chunk(cq)->type) {
+		LI_NETWORK_FALLBACK(li_network_backend_splice, &write_max);
+		if (0 == cq->length || write_max <= 0) return LI_NETWORK_STATUS_SUCCESS;
+	}
+
+	if (NULL == batch) {
+		batch = g_slice_new0(network_uring_batch);
+		batch->nu = nu;
+		batch->w = w;
+		batch->fd = -1;
+		w->batch = batch;
+	}
+
+	status = network_uring_batch_prepare(vr, fd, cq, write_max, batch);
+
+	if (0 == batch->nops) {
+		if (NULL != batch->pipe) {
+			network_uring_pipe_put(vr, nu, batch->pipe, 0);
+			batch->pipe = NULL;
+		}
+		if (LI_NETWORK_STATUS_SUCCESS != status) return status;
+		return network_uring_fallback(vr, fd, cq, &write_max);
+	}
+
+	/* the ev_prepare watcher of the ring submits the chains of all connections together;
+	 * w->callback runs when this one completed */
+	return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+}
+
+/* the generic backend has no place to keep a chain in flight between calls */
+liNetworkStatus li_network_write_uring(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	if (0 == cq->length) return LI_NETWORK_STATUS_FATAL_ERROR;
+
+	return network_uring_fallback(vr, fd, cq, write_max);
+}
+
+#endif
@@ -24,8 +24,38 @@
 # endif
 #endif
 
-/* first chunk must be a STRING_CHUNK ! */
-liNetworkStatus li_network_backend_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+/* whether c can be part of a writev(); FILE_CHUNKs up to inline_file_max bytes are read into memory */
+static gboolean network_writev_chunk(liChunk *c, goffset inline_file_max) {
+	switch (c->type) {
+	case STRING_CHUNK:
+	case MEM_CHUNK:
+	case BUFFER_CHUNK:
+	case INLINE_CHUNK:
+		return TRUE;
+	case FILE_CHUNK:
+		return li_chunk_length(c) <= inline_file_max;
+	default:
+		return FALSE;
+	}
+}
+
+gboolean li_network_writev_single(liChunkQueue *cq, goffset write_max, goffset inline_file_max) {
+	liChunkIter ci = li_chunkqueue_iter(cq);
+	goffset we_have = 0;
+	guint n = 0;
+
+	if (0 == cq->length) return TRUE;
+
+	do {
+		if (!network_writev_chunk(li_chunkiter_chunk(ci), inline_file_max)) return FALSE;
+		if (++n > UIO_MAXIOV) return FALSE;
+		we_have += li_chunkiter_length(ci);
+	} while (we_have < write_max && li_chunkiter_next(&ci));
+
+	return TRUE;
+}
+
+static liNetworkStatus network_backend_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max, goffset inline_file_max) {
 	off_t we_have;
 	ssize_t r;
 	gboolean did_write_something = FALSE;
@@ -40,7 +70,7 @@ liNetworkStatus li_network_backend_writev(liVRequest *vr, int fd, liChunkQueue *
 	do {
 		ci = li_chunkqueue_iter(cq);
 
-		if (STRING_CHUNK != (c = li_chunkiter_chunk(ci))->type && MEM_CHUNK != c->type && BUFFER_CHUNK != c->type) {
+		if (!network_writev_chunk(c = li_chunkiter_chunk(ci), inline_file_max)) {
 			res = did_write_something ? LI_NETWORK_STATUS_SUCCESS : LI_NETWORK_STATUS_FATAL_ERROR;
 			goto cleanup;
 		}
@@ -50,21 +80,40 @@ liNetworkStatus li_network_backend_writev(liVRequest *vr, int fd, liChunkQueue *
 			guint i = chunks->len;
 			off_t len = li_chunk_length(c);
 			struct iovec *v;
+			if (len > *write_max - we_have) len = *write_max - we_have;
+			if (c->type == FILE_CHUNK) {
+				char *data;
+				off_t data_len;
+
+				/* small file: pread() it and send it together with the other chunks */
+				if (LI_HANDLER_GO_ON != li_chunkiter_read(vr, ci, 0, len, &data, &data_len)) {
+					if (0 == i) goto cleanup; /* FATAL ERROR */
+					break;
+				}
+				g_array_set_size(chunks, i + 1);
+				v = &g_array_index(chunks, struct iovec, i);
+				v->iov_base = data;
+				v->iov_len = data_len;
+				we_have += data_len;
+				if (data_len != len) break; /* short read */
+				continue;
+			}
 			g_array_set_size(chunks, i + 1);
 			v = &g_array_index(chunks, struct iovec, i);
 			if (c->type == STRING_CHUNK) {
 				v->iov_base = c->data.str->str + c->offset;
 			} else if (c->type == MEM_CHUNK) {
 				v->iov_base = c->mem->data + c->offset;
+			} else if (c->type == INLINE_CHUNK) {
+				v->iov_base = c->data.inl.data + c->offset;
 			} else { /* if (c->type == BUFFER_CHUNK) */
 				v->iov_base = c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset;
 			}
-			if (len > *write_max - we_have) len = *write_max - we_have;
 			v->iov_len = len;
 			we_have += len;
 		} while (we_have < *write_max &&
 		         li_chunkiter_next(&ci) &&
-		         (STRING_CHUNK == (c = li_chunkiter_chunk(ci))->type || MEM_CHUNK == c->type || BUFFER_CHUNK == c->type) &&
+		         network_writev_chunk(c = li_chunkiter_chunk(ci), inline_file_max) &&
 		         chunks->len < UIO_MAXIOV);
 
 		while (-1 == (r = writev(fd, (struct iovec*) chunks->data, chunks->len))) {
@@ -115,6 +164,49 @@ cleanup:
 	return res;
 }
 
+/* first chunk must be a STRING_CHUNK ! */
+liNetworkStatus li_network_backend_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	return network_backend_writev(vr, fd, cq, write_max, -1);
+}
+
+static liNetworkStatus network_backend_writev_inline(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	return network_backend_writev(vr, fd, cq, write_max, LI_NETWORK_INLINE_FILE_MAX);
+}
+
+liNetworkStatus li_network_write_auto(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
+	liChunk *c;
+
+	if (cq->length == 0) return LI_NETWORK_STATUS_FATAL_ERROR;
+	do {
+		switch ((c = li_chunkqueue_first_chunk(cq))->type) {
+		case STRING_CHUNK:
+		case MEM_CHUNK:
+		case BUFFER_CHUNK:
+		case INLINE_CHUNK:
+			LI_NETWORK_FALLBACK(network_backend_writev_inline, write_max);
+			break;
+		case FILE_CHUNK:
+			if (li_chunk_length(c) <= LI_NETWORK_INLINE_FILE_MAX) {
+				LI_NETWORK_FALLBACK(network_backend_writev_inline, write_max);
+			} else {
+#ifdef USE_SENDFILE
+				LI_NETWORK_FALLBACK(li_network_backend_sendfile, write_max);
+#else
+				LI_NETWORK_FALLBACK(li_network_backend_write, write_max);
+#endif
+			}
+			break;
+		case PIPE_CHUNK:
+			LI_NETWORK_FALLBACK(li_network_backend_splice, write_max);
+			break;
+		default:
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+		if (cq->length == 0) return LI_NETWORK_STATUS_SUCCESS;
+	} while (*write_max > 0);
+	return LI_NETWORK_STATUS_SUCCESS;
+}
+
 liNetworkStatus li_network_write_writev(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max) {
 	if (cq->length == 0) return LI_NETWORK_STATUS_FATAL_ERROR;
 	do {
@@ -122,11 +214,15 @@ liNetworkStatus li_network_write_writev(liVRequest *vr, int fd, liChunkQueue *cq
 		case STRING_CHUNK:
 		case MEM_CHUNK:
 		case BUFFER_CHUNK:
+		case INLINE_CHUNK:
 			LI_NETWORK_FALLBACK(li_network_backend_writev, write_max);
 			break;
 		case FILE_CHUNK:
 			LI_NETWORK_FALLBACK(li_network_backend_write, write_max);
 			break;
+		case PIPE_CHUNK:
+			LI_NETWORK_FALLBACK(li_network_backend_splice, write_max);
+			break;
 		default:
 			return LI_NETWORK_STATUS_FATAL_ERROR;
 		}
@@ -0,0 +1,235 @@
+
+#include <lighttpd/base.h>
+
+#ifdef USE_MSG_ZEROCOPY
+# include <netinet/in.h>
+# include <linux/errqueue.h>
+#endif
+
+typedef struct network_zerocopy_send network_zerocopy_send;
+struct network_zerocopy_send {
+	guint32 seq;
+	liBuffer *buffer;
+};
+
+void li_network_zerocopy_init(liNetworkZeroCopy *zc) {
+	zc->state = 0;
+	zc->next_seq = 0;
+	g_queue_init(&zc->pending);
+}
+
+void li_network_zerocopy_reset(liNetworkZeroCopy *zc) {
+	network_zerocopy_send *zs;
+
+	while (NULL != (zs = g_queue_pop_head(&zc->pending))) {
+		li_buffer_release(zs->buffer);
+		g_slice_free(network_zerocopy_send, zs);
+	}
+
+	zc->state = 0;
+	zc->next_seq = 0;
+}
+
+void li_network_zerocopy_move(liNetworkZeroCopy *dest, liNetworkZeroCopy *src) {
+	*dest = *src;
+	li_network_zerocopy_init(src);
+}
+
+void li_network_zerocopy_close(int fd, liNetworkZeroCopy *zc) {
+	if (zc->pending.length > 0) li_network_zerocopy_reap(NULL, fd, zc);
+	if (zc->pending.length > 0) {
+		/* the send queue is purged on close, the pages aren't used anymore */
+		struct linger l;
+		l.l_onoff = 1;
+		l.l_linger = 0;
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	}
+	close(fd);
+	li_network_zerocopy_reset(zc);
+}
+
+#ifdef USE_MSG_ZEROCOPY
+
+/* the kernel doesn't need the buffers of the sends lo..hi anymore */
+static void network_zerocopy_complete(liNetworkZeroCopy *zc, guint32 lo, guint32 hi) {
+	GList *iter, *next;
+
+	for (iter = zc->pending.head; NULL != iter; iter = next) {
+		network_zerocopy_send *zs = iter->data;
+		next = iter->next;
+
+		if ((guint32) (zs->seq - lo) <= (guint32) (hi - lo)) {
+			li_buffer_release(zs->buffer);
+			g_slice_free(network_zerocopy_send, zs);
+			g_queue_delete_link(&zc->pending, iter);
+		}
+	}
+}
+
+void li_network_zerocopy_reap(liVRequest *vr, int fd, liNetworkZeroCopy *zc) {
+	while (zc->pending.length > 0) {
+		struct msghdr msg;
+		struct cmsghdr *cm;
+		union { struct cmsghdr cm; gchar buf[128]; } control;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof(control);
+
+		if (-1 == recvmsg(fd, &msg, MSG_ERRQUEUE)) {
+			switch (errno) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				return;
+			default:
+				if (vr) VR_ERROR(vr, "reading zerocopy notifications from fd=%d failed: %s", fd, g_strerror(errno));
+				return;
+			}
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); NULL != cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *serr;
+
+			if (!(IPPROTO_IP == cm->cmsg_level && IP_RECVERR == cm->cmsg_type)
+			    && !(IPPROTO_IPV6 == cm->cmsg_level && IPV6_RECVERR == cm->cmsg_type)) continue;
+
+			serr = (struct sock_extended_err*) CMSG_DATA(cm);
+			if (0 != serr->ee_errno || SO_EE_ORIGIN_ZEROCOPY != serr->ee_origin) continue;
+
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				/* the kernel had to copy the data anyway (e.g. no scatter-gather support);
+				 * a deferred copy is more expensive than a normal send, so stop using zerocopy
+				 */
+				zc->state = -1;
+			}
+
+			network_zerocopy_complete(zc, serr->ee_info, serr->ee_data);
+		}
+	}
+}
+
+/* first chunk must be a BUFFER_CHUNK ! */
+static liNetworkStatus network_zerocopy_send_buffer(liVRequest *vr, int fd, liChunkQueue *cq, goffset *write_max, liNetworkZeroCopy *zc) {
+	liChunk *c = li_chunkqueue_first_chunk(cq);
+	liBuffer *buffer = c->data.buffer.buffer;
+	goffset len = li_chunk_length(c);
+	network_zerocopy_send *zs;
+	ssize_t r;
+
+	if (len > *write_max) len = *write_max;
+
+	while (-1 == (r = send(fd, buffer->addr + c->data.buffer.offset + c->offset, len, MSG_ZEROCOPY))) {
+		switch (errno) {
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+		case ECONNRESET:
+		case EPIPE:
+		case ETIMEDOUT:
+			return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+		case EINTR:
+			break; /* try again */
+		case ENOBUFS: {
+			/* too many pages pinned for this socket (optmem limit): send the normal way from now on */
+			goffset before = cq->length;
+			liNetworkStatus res;
+
+			zc->state = -1;
+			res = li_network_write(vr, fd, cq, len);
+			*write_max -= before - cq->length;
+			return res;
+		}
+		default:
+			VR_ERROR(vr, "oops, write to fd=%d failed: %s", fd, g_strerror(errno));
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+	}
+
+	/* each successful MSG_ZEROCOPY send gets the next sequence number;
+	 * keep the buffer until its notification arrives, li_chunkqueue_skip only drops the chunk's reference
+	 */
+	zs = g_slice_new(network_zerocopy_send);
+	zs->seq = zc->next_seq++;
+	zs->buffer = buffer;
+	li_buffer_acquire(buffer);
+	g_queue_push_tail(&zc->pending, zs);
+
+	li_chunkqueue_skip(cq, r);
+	*write_max -= r;
+
+	return (r == len) ? LI_NETWORK_STATUS_SUCCESS : LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+}
+
+static gboolean network_zerocopy_chunk(liChunk *c, goffset min) {
+	return BUFFER_CHUNK == c->type && li_chunk_length(c) >= min;
+}
+
+/* length of the data before the first chunk we send with MSG_ZEROCOPY */
+static goffset network_zerocopy_plain_length(liChunkQueue *cq, goffset min, goffset write_max) {
+	liChunkIter ci = li_chunkqueue_iter(cq);
+	goffset len = 0;
+
+	do {
+		if (network_zerocopy_chunk(li_chunkiter_chunk(ci), min)) break;
+		len += li_chunkiter_length(ci);
+	} while (len < write_max && li_chunkiter_next(&ci));
+
+	return MIN(len, write_max);
+}
+
+liNetworkStatus li_network_write_zerocopy(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, liNetworkZeroCopy *zc) {
+	goffset min = vr->wrk->srv->network_zerocopy_min;
+	liNetworkStatus res;
+
+	if (NULL == zc || 0 == min || zc->state < 0 || 0 == cq->length) return li_network_write(vr, fd, cq, write_max);
+
+	if (zc->pending.length > 0) li_network_zerocopy_reap(vr, fd, zc);
+
+	if (0 == zc->state) {
+		int on = 1;
+		zc->state = (0 == setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on))) ? 1 : -1;
+		if (zc->state < 0) return li_network_write(vr, fd, cq, write_max);
+	}
+
+	do {
+		goffset plain = network_zerocopy_plain_length(cq, min, write_max);
+
+		if (plain > 0) {
+			goffset before = cq->length;
+
+			res = li_network_write(vr, fd, cq, plain);
+			write_max -= before - cq->length;
+			if (LI_NETWORK_STATUS_SUCCESS != res) return res;
+			if (before - cq->length < plain) return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+			if (0 == cq->length || write_max <= 0) return LI_NETWORK_STATUS_SUCCESS;
+		}
+
+		if (zc->state < 0) return li_network_write(vr, fd, cq, write_max);
+
+		res = network_zerocopy_send_buffer(vr, fd, cq, &write_max, zc);
+		if (LI_NETWORK_STATUS_SUCCESS != res) return res;
+	} while (cq->length > 0 && write_max > 0);
+
+	return LI_NETWORK_STATUS_SUCCESS;
+}
+
+#else
+
+void li_network_zerocopy_reap(liVRequest *vr, int fd, liNetworkZeroCopy *zc) {
+	UNUSED(vr);
+	UNUSED(fd);
+	UNUSED(zc);
+}
+
+liNetworkStatus li_network_write_zerocopy(liVRequest *vr, int fd, liChunkQueue *cq, goffset write_max, liNetworkZeroCopy *zc) {
+	UNUSED(zc);
+	return li_network_write(vr, fd, cq, write_max);
+}
+
+#endif
@@ -548,6 +548,16 @@ static liAction* core_index(liServer *srv, liWorker *wrk, liPlugin* p, liValue *
 }
 
 
+/* the content comes from the content cache if cce is set, from the file otherwise */
+static void core_static_append(liVRequest *vr, liChunkFile *cf, liContentCacheEntry *cce, goffset start, goffset length) {
+	if (NULL != cce) {
+		li_buffer_acquire(cce->buf);
+		li_chunkqueue_append_buffer2(vr->out, cce->buf, start, length);
+	} else {
+		li_chunkqueue_append_chunkfile(vr->out, cf, start, length);
+	}
+}
+
 static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpointer *context) {
 	int fd = -1;
 	struct stat st;
@@ -601,7 +611,8 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		}
 	}
 
-	res = li_stat_cache_get(vr, vr->physical.path, &st, &err, &fd);
+	/* with the fd cache we only need the stat info here, the file may already be open */
+	res = li_stat_cache_get(vr, vr->physical.path, &st, &err, (NULL != vr->wrk->fd_cache) ? NULL : &fd);
 	if (res == LI_HANDLER_WAIT_FOR_EVENT)
 		return res;
 
@@ -657,30 +668,70 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		gboolean cachable;
 		gboolean ranged_response = FALSE;
 		liHttpHeader *hh_range;
-		liChunkFile *cf;
+		liChunkFile *cf = NULL;
+		liContentCacheEntry *cce = NULL;
+		liStatCacheStaticHeaders *sh;
 		static const GString default_mime_str = { CONST_STR_LEN("application/octet-stream"), 0 };
 
+		if (NULL != vr->wrk->srv->content_cache) {
+			cce = li_content_cache_get(vr, vr->physical.path, &st, fd);
+		}
+
+		/* get the file first: the fd cache may open a newer file than the one stat'ed and update st */
+		if (NULL != cce) {
+			/* served from memory */
+			if (fd != -1)
+				close(fd);
+		} else if (fd != -1) {
 #ifdef FD_CLOEXEC
-		fcntl(fd, F_SETFD, FD_CLOEXEC);
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
 #endif
+			cf = li_chunkfile_new(NULL, fd, FALSE);
+		} else if (NULL == (cf = li_fd_cache_get(vr, vr->physical.path, &st, &err))) {
+			/* the file vanished or changed since the stat */
+			if (no_fail) return LI_HANDLER_GO_ON;
+
+			if (!li_vrequest_handle_direct(vr)) {
+				return LI_HANDLER_ERROR;
+			}
+
+			switch (err) {
+			case ENOENT:
+			case ENOTDIR:
+				vr->response.http_status = 404;
+				return LI_HANDLER_GO_ON;
+			case EACCES:
+				vr->response.http_status = 403;
+				return LI_HANDLER_GO_ON;
+			default:
+				VR_ERROR(vr, "open() for '%s' failed: %s", vr->physical.path->str, g_strerror(err));
+				return LI_HANDLER_ERROR;
+			}
+		}
 
 		if (!li_vrequest_handle_direct(vr)) {
-			close(fd);
+			li_chunkfile_release(cf);
+			li_content_cache_entry_release(cce);
 			return LI_HANDLER_ERROR;
 		}
 
-		li_etag_set_header(vr, &st, &cachable);
+		/* the cached headers are only used if dev, inode, size and mtime still match st */
+		if (NULL != (sh = li_stat_cache_get_static_headers(vr, vr->physical.path, &st))) {
+			li_etag_set_header_strings(vr, sh->etag, sh->last_modified, &cachable);
+			mime_str = sh->content_type;
+		} else {
+			li_etag_set_header(vr, &st, &cachable);
+			mime_str = li_mimetype_get(vr, vr->physical.path);
+		}
+		if (!mime_str) mime_str = &default_mime_str;
+
 		if (cachable) {
 			vr->response.http_status = 304;
-			close(fd);
+			li_chunkfile_release(cf);
+			li_content_cache_entry_release(cce);
 			return LI_HANDLER_GO_ON;
 		}
 
-		cf = li_chunkfile_new(NULL, fd, FALSE);
-
-		mime_str = li_mimetype_get(vr, vr->physical.path);
-		if (!mime_str) mime_str = &default_mime_str;
-
 		if (CORE_OPTION(LI_CORE_OPTION_STATIC_RANGE_REQUESTS).boolean) {
 			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Accept-Ranges"), CONST_STR_LEN("bytes"));
 
@@ -703,10 +754,10 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 							GString *subheader = g_string_sized_new(1023);
 							g_string_append_printf(subheader, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: %s\r\n\r\n", boundary, mime_str->str, vr->wrk->tmp_str->str);
 							li_chunkqueue_append_string(vr->out, subheader);
-							li_chunkqueue_append_chunkfile(vr->out, cf, rs.range_start, rs.range_length);
+							core_static_append(vr, cf, cce, rs.range_start, rs.range_length);
 						} else {
 							li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Range"), GSTR_LEN(vr->wrk->tmp_str));
-							li_chunkqueue_append_chunkfile(vr->out, cf, rs.range_start, rs.range_length);
+							core_static_append(vr, cf, cce, rs.range_start, rs.range_length);
 						}
 						break;
 					case LI_PARSE_HTTP_RANGE_DONE:
@@ -745,10 +796,11 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		if (!ranged_response) {
 			vr->response.http_status = 200;
 			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Type"), GSTR_LEN(mime_str));
-			li_chunkqueue_append_chunkfile(vr->out, cf, 0, st.st_size);
+			core_static_append(vr, cf, cce, 0, st.st_size);
 		}
 
 		li_chunkfile_release(cf);
+		li_content_cache_entry_release(cce);
 	}
 
 	return LI_HANDLER_GO_ON;
@@ -1153,6 +1205,25 @@ static gboolean core_listen(liServer *srv, liPlugin* p, liValue *val, gpointer u
 	return TRUE;
 }
 
+static gboolean core_listen_reuseport(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (val->type != LI_VALUE_STRING) {
+		ERROR(srv, "%s", "listen.reuseport expects a string as parameter");
+		return FALSE;
+	}
+
+#ifdef SO_REUSEPORT
+	/* the sockets are requested when the workers are created */
+	g_ptr_array_add(srv->reuseport_addrs, g_string_new_len(GSTR_LEN(val->data.string)));
+
+	return TRUE;
+#else
+	ERROR(srv, "%s", "listen.reuseport is not supported on this platform");
+	return FALSE;
+#endif
+}
+
 
 static gboolean core_workers(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
 	gint workers;
@@ -1294,6 +1365,72 @@ static gboolean core_stat_cache_ttl(liServer *srv, liPlugin* p, liValue *val, gp
 	return TRUE;
 }
 
+static gboolean core_fd_cache_max_open(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_NUMBER || val->data.number < 0 || val->data.number > G_MAXUINT) {
+		ERROR(srv, "%s", "fd_cache.max_open expects a positive number (0 to disable) as parameter");
+		return FALSE;
+	}
+
+	srv->fd_cache_max_open = val->data.number;
+
+	return TRUE;
+}
+
+static gboolean core_content_cache_max_file_size(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_NUMBER || val->data.number < 0) {
+		ERROR(srv, "%s", "content_cache.max_file_size expects a positive number (0 to disable) as parameter");
+		return FALSE;
+	}
+
+	if (0 == val->data.number) {
+		li_content_cache_free(srv->content_cache);
+		srv->content_cache = NULL;
+	} else if (NULL == srv->content_cache) {
+		srv->content_cache = li_content_cache_new(val->data.number, srv->content_cache_max_size);
+	} else {
+		srv->content_cache->max_file_size = val->data.number;
+	}
+
+	return TRUE;
+}
+
+static gboolean core_content_cache_max_size(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_NUMBER || val->data.number <= 0) {
+		ERROR(srv, "%s", "content_cache.max_size expects a positive number as parameter");
+		return FALSE;
+	}
+
+	srv->content_cache_max_size = val->data.number;
+	if (NULL != srv->content_cache) srv->content_cache->max_size = val->data.number;
+
+	return TRUE;
+}
+
+static gboolean core_stat_cache_shared(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_BOOLEAN) {
+		ERROR(srv, "%s", "stat_cache.shared expects a boolean as parameter");
+		return FALSE;
+	}
+
+	if (!val->data.boolean) {
+		li_stat_cache_shared_free(srv, srv->stat_cache_shared);
+		srv->stat_cache_shared = NULL;
+	} else if (NULL == srv->stat_cache_shared) {
+		/* not fatal: we still have the per-worker caches */
+		srv->stat_cache_shared = li_stat_cache_shared_new(srv);
+	}
+
+	return TRUE;
+}
+
 static gboolean core_tasklet_pool_threads(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
 	UNUSED(p); UNUSED(userdata);
 
@@ -1308,6 +1445,44 @@ static gboolean core_tasklet_pool_threads(liServer *srv, liPlugin* p, liValue *v
 	return TRUE;
 }
 
+static gboolean core_network_backend(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	const liNetworkBackend *backend;
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_STRING) {
+		ERROR(srv, "%s", "network.backend expects a string as parameter");
+		return FALSE;
+	}
+
+	if (NULL == (backend = li_network_backend_find(val->data.string->str))) {
+		ERROR(srv, "unknown or unsupported network backend '%s'", val->data.string->str);
+		return FALSE;
+	}
+
+	srv->network_backend = backend;
+
+	return TRUE;
+}
+
+static gboolean core_network_zerocopy(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_NUMBER || val->data.number < 0) {
+		ERROR(srv, "%s", "network.zerocopy expects a positive number (minimum chunk size, 0 to disable) as parameter");
+		return FALSE;
+	}
+
+#ifndef USE_MSG_ZEROCOPY
+	if (val->data.number > 0) {
+		WARNING(srv, "%s", "network.zerocopy: MSG_ZEROCOPY is not supported on this platform, ignored");
+	}
+#endif
+
+	srv->network_zerocopy_min = val->data.number;
+
+	return TRUE;
+}
+
 /*
  * OPTIONS
  */
@@ -1522,6 +1697,42 @@ static gboolean core_option_etag_use_parse(liServer *srv, liWorker *wrk, liPlugi
 	return TRUE;
 }
 
+static gboolean core_option_stat_async_parse(liServer *srv, liWorker *wrk, liPlugin *p, size_t ndx, liValue *val, liOptionValue *oval) {
+	UNUSED(p);
+	UNUSED(ndx);
+	UNUSED(wrk);
+
+	/* default value */
+	if (!val) {
+		oval->number = LI_STAT_ASYNC_THREADS;
+		return TRUE;
+	}
+
+	switch (val->type) {
+	case LI_VALUE_BOOLEAN:
+		oval->number = val->data.boolean ? LI_STAT_ASYNC_THREADS : LI_STAT_ASYNC_OFF;
+		return TRUE;
+	case LI_VALUE_STRING:
+		if (0 == strcmp(val->data.string->str, "threads")) {
+			oval->number = LI_STAT_ASYNC_THREADS;
+		} else if (0 == strcmp(val->data.string->str, "io_uring")) {
+#ifdef USE_IO_URING
+			oval->number = LI_STAT_ASYNC_IO_URING;
+#else
+			WARNING(srv, "%s", "stat.async: io_uring is not supported on this platform, using threads");
+			oval->number = LI_STAT_ASYNC_THREADS;
+#endif
+		} else {
+			ERROR(srv, "stat.async option expects a boolean, \"threads\" or \"io_uring\", got \"%s\"", val->data.string->str);
+			return FALSE;
+		}
+		return TRUE;
+	default:
+		ERROR(srv, "stat.async option expects a boolean or a string, parameter is of type %s", li_value_type_string(val->type));
+		return FALSE;
+	}
+}
+
 typedef void (*header_cb)(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen);
 
 typedef struct header_ctx header_ctx;
@@ -1900,7 +2111,11 @@ static const liPluginOption options[] = {
 
 	{ "etag.use", LI_VALUE_NONE, 0, core_option_etag_use_parse }, /* type in config is list, internal type is number for flags */
 
-	{ "stat.async", LI_VALUE_BOOLEAN, TRUE, NULL },
+	{ "stat.async", LI_VALUE_NONE, 0, core_option_stat_async_parse }, /* type in config is boolean or string, internal type is number */
+
+	{ "static.readahead", LI_VALUE_NUMBER, 1024*1024, NULL },
+	{ "static.readahead_min_size", LI_VALUE_NUMBER, 8*1024*1024, NULL },
+	{ "static.drop_behind", LI_VALUE_BOOLEAN, FALSE, NULL },
 
 	{ NULL, 0, 0, NULL }
 };
@@ -1959,12 +2174,19 @@ static const liPluginAction actions[] = {
 static const liPluginSetup setups[] = {
 	{ "set_default", core_setup_set, NULL },
 	{ "listen", core_listen, NULL },
+	{ "listen.reuseport", core_listen_reuseport, NULL },
 	{ "workers", core_workers, NULL },
 	{ "workers.cpu_affinity", core_workers_cpu_affinity, NULL },
 	{ "module_load", core_module_load, NULL },
 	{ "io.timeout", core_io_timeout, NULL },
 	{ "stat_cache.ttl", core_stat_cache_ttl, NULL },
+	{ "stat_cache.shared", core_stat_cache_shared, NULL },
+	{ "fd_cache.max_open", core_fd_cache_max_open, NULL },
+	{ "content_cache.max_file_size", core_content_cache_max_file_size, NULL },
+	{ "content_cache.max_size", core_content_cache_max_size, NULL },
 	{ "tasklet_pool.threads", core_tasklet_pool_threads, NULL },
+	{ "network.backend", core_network_backend, NULL },
+	{ "network.zerocopy", core_network_zerocopy, NULL },
 
 	{ NULL, NULL, NULL }
 };
@@ -24,6 +24,7 @@ void li_response_clear(liResponse *resp) {
 
 gboolean li_response_send_headers(liConnection *con) {
 	GString *head;
+	liBuffer *buf;
 	liVRequest *vr = con->mainvr;
 
 	if (vr->response.http_status < 100 || vr->response.http_status > 999) {
@@ -31,8 +32,6 @@ gboolean li_response_send_headers(liConnection *con) {
 		return FALSE;
 	}
 
-	head = g_string_sized_new(8*1024-1);
-
 	if (0 == con->out->length && con->mainvr->backend == NULL
 		&& vr->response.http_status >= 400 && vr->response.http_status < 600) {
 		li_response_send_error_page(con);
@@ -49,8 +48,9 @@ gboolean li_response_send_headers(liConnection *con) {
 	} else if (con->out->is_closed) {
 		if (vr->request.http_method != LI_HTTP_METHOD_HEAD || con->out->length > 0) {
 			/* do not send content-length: 0 if backend already skipped content generation for HEAD */
-			g_string_printf(con->wrk->tmp_str, "%"L_GOFFSET_FORMAT, con->out->length);
-			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Length"), GSTR_LEN(con->wrk->tmp_str));
+			gchar len_str[32];
+			gint len = g_snprintf(len_str, sizeof(len_str), "%"L_GOFFSET_FORMAT, con->out->length);
+			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Length"), len_str, len);
 		}
 	} else if (con->info.keep_alive && vr->request.http_version == LI_HTTP_VERSION_1_1) {
 		/* TODO: maybe someone set a content length header? */
@@ -70,6 +70,10 @@ gboolean li_response_send_headers(liConnection *con) {
 		con->raw_out->is_closed = TRUE;
 	}
 
+	/* the error page and header handling above may use tmp_str too */
+	head = con->wrk->tmp_str;
+	g_string_truncate(head, 0);
+
 	/* Status line */
 	if (vr->request.http_version == LI_HTTP_VERSION_1_1) {
 		g_string_append_len(head, CONST_STR_LEN("HTTP/1.1 "));
@@ -128,7 +132,12 @@ gboolean li_response_send_headers(liConnection *con) {
 	}
 
 	g_string_append_len(head, CONST_STR_LEN("\r\n"));
-	li_chunkqueue_append_string(con->raw_out, head);
+
+	/* pooled buffer; small appends (like the first chunk header) use its free space */
+	buf = li_buffer_new(head->len);
+	memcpy(buf->addr, head->str, head->len);
+	buf->used = head->len;
+	li_chunkqueue_append_buffer(con->raw_out, buf);
 
 	return TRUE;
 }
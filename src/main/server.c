@@ -116,6 +116,7 @@ liServer* li_server_new(const gchar *module_dir, gboolean module_resident) {
 	srv->worker_count = 0;
 
 	srv->sockets = g_ptr_array_new();
+	srv->reuseport_addrs = g_ptr_array_new();
 
 	srv->modules = li_modules_new(srv, module_dir, module_resident);
 
@@ -184,6 +185,9 @@ liServer* li_server_new(const gchar *module_dir, gboolean module_resident) {
 	srv->keep_alive_queue_timeout = 5;
 	srv->stat_cache_ttl = 10.0; /* default stat cache ttl */
 	srv->tasklet_pool_threads = 4; /* default per-worker tasklet_pool threads */
+	srv->network_backend = li_network_backend_find("auto");
+	srv->network_zerocopy_min = 0;
+	srv->content_cache_max_size = 64*1024*1024; /* default content cache size */
 
 	return srv;
 }
@@ -231,6 +235,12 @@ void li_server_free(liServer* srv) {
 		srv->acon = NULL;
 	}
 
+	li_stat_cache_shared_free(srv, srv->stat_cache_shared);
+	srv->stat_cache_shared = NULL;
+
+	li_content_cache_free(srv->content_cache);
+	srv->content_cache = NULL;
+
 	/* free all workers */
 	{
 		guint i;
@@ -258,6 +268,13 @@ void li_server_free(liServer* srv) {
 		g_ptr_array_free(srv->sockets, TRUE);
 	}
 
+	{
+		guint i; for (i = 0; i < srv->reuseport_addrs->len; i++) {
+			g_string_free(g_ptr_array_index(srv->reuseport_addrs, i), TRUE);
+		}
+		g_ptr_array_free(srv->reuseport_addrs, TRUE);
+	}
+
 	/* release modules */
 	li_modules_free(srv->modules);
 
@@ -332,17 +349,26 @@ static void li_server_1sec_timer(struct ev_loop *loop, ev_timer *w, int revents)
 	UNUSED(loop);
 	UNUSED(revents);
 
-	if (srv->connection_limit_hit) {
+	if (g_atomic_int_get(&srv->connection_limit_hit)) {
 		guint srv_cur_load = g_atomic_int_get(&srv->connection_load);
 		guint srv_max_load = g_atomic_int_get(&srv->max_connections);
 		if (srv_cur_load <= (srv_max_load - srv_max_load/8)) { /* cur_load <= 7/8 * max_load */
 			guint i;
 
-			for (i = 0; i < srv->sockets->len; i++) {
-				liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
-				ev_io_start(srv->main_worker->loop, &sock->watcher);
+			g_atomic_int_set(&srv->connection_limit_hit, FALSE);
+
+			if (LI_SERVER_RUNNING == srv->state || LI_SERVER_WARMUP == srv->state) {
+				for (i = 0; i < srv->sockets->len; i++) {
+					liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
+					if (NULL == sock->wrk) ev_io_start(srv->main_worker->loop, &sock->watcher);
+				}
+
+				/* restart the worker sockets stopped by the workers themselves */
+				for (i = 0; i < srv->worker_count; i++) {
+					liWorker *wrk = g_array_index(srv->workers, liWorker*, i);
+					li_worker_listen(srv->main_worker, wrk, g_atomic_int_get(&wrk->listen_active));
+				}
 			}
-			srv->connection_limit_hit = FALSE;
 		}
 	}
 }
@@ -398,55 +424,90 @@ static void li_server_worker_run(liServer *srv) {
 	}
 }
 
-static void server_connection_limit_hit(liServer *srv) {
+/* context: main worker for shared sockets, the owning worker for SO_REUSEPORT sockets */
+static void server_connection_limit_hit(liServer *srv, liWorker *context) {
 	guint i;
 
-	for (i = 0; i < srv->sockets->len; i++) {
-		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
-		ev_io_stop(srv->main_worker->loop, &sock->watcher);
+	if (context == srv->main_worker) {
+		for (i = 0; i < srv->sockets->len; i++) {
+			liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
+			if (NULL == sock->wrk) ev_io_stop(srv->main_worker->loop, &sock->watcher);
+		}
+	}
+
+	/* only stop the watchers, wrk->listen_active stays: li_server_1sec_timer restarts them */
+	for (i = 0; i < context->listen_sockets->len; i++) {
+		liServerSocket *sock = g_ptr_array_index(context->listen_sockets, i);
+		ev_io_stop(context->loop, &sock->watcher);
 	}
 
-	srv->connection_limit_hit = TRUE;
+	g_atomic_int_set(&srv->connection_limit_hit, TRUE);
 }
 
+/* max. number of connections accepted per wakeup; the rest stays in the backlog for the next loop iteration */
+#define LI_SERVER_ACCEPT_BATCH 64
+
 static void li_server_listen_cb(struct ev_loop *loop, ev_io *w, int revents) {
 	liServerSocket *sock = (liServerSocket*) w->data;
 	liServer *srv = sock->srv;
+	liWorker *ctx = sock->wrk ? sock->wrk : srv->main_worker;
 	int s;
 	liSocketAddress remote_addr;
 	liSockAddr sa;
 	socklen_t l;
+	guint n, i;
 	UNUSED(loop);
 	UNUSED(revents);
 
-	for ( ;; ) {
+	for (n = 0; n < LI_SERVER_ACCEPT_BATCH; n++) {
 		liWorker *wrk;
-		guint i, min_load, srv_cur_load, srv_max_load;
+		guint min_load, srv_cur_load, srv_max_load;
 
 		srv_cur_load = g_atomic_int_get(&srv->connection_load);
 		srv_max_load = g_atomic_int_get(&srv->max_connections);
 		if (srv_cur_load >= srv_max_load) {
-			server_connection_limit_hit(srv);
-			return;
+			server_connection_limit_hit(srv, ctx);
+			goto flush;
 		}
 
 		l = sizeof(sa);
 
 #ifdef HAVE_ACCEPT4
 		if (-1 == (s = accept4(w->fd, &sa.plain, &l, SOCK_NONBLOCK))) {
-			if (ENOSYS != errno) break;
+			if (ENOSYS != errno) goto accept_failed;
 
 			/* fallback */
-			if (-1 == (s = accept(w->fd, &sa.plain, &l))) break;
+			if (-1 == (s = accept(w->fd, &sa.plain, &l))) goto accept_failed;
 			li_fd_no_block(s); /* we don't fork, don't care about FD_CLOEXEC */
 		}
 #else
-		if (-1 == (s = accept(w->fd, &sa.plain, &l))) break;
+		if (-1 == (s = accept(w->fd, &sa.plain, &l))) goto accept_failed;
 		li_fd_no_block(s); /* we don't fork, don't care about FD_CLOEXEC */
 #endif
 
-		wrk = srv->main_worker;
-		min_load = g_atomic_int_get(&wrk->connection_load);
+		if (NULL != sock->wrk) {
+			/* SO_REUSEPORT: the kernel already balanced the connection to this worker */
+			wrk = sock->wrk;
+		} else {
+			wrk = srv->main_worker;
+			min_load = g_atomic_int_get(&wrk->connection_load);
+
+			for (i = 1; i < srv->worker_count; i++) {
+				liWorker *wt = g_array_index(srv->workers, liWorker*, i);
+				guint load = g_atomic_int_get(&wt->connection_load);
+				if (load < min_load) {
+					wrk = wt;
+					min_load = load;
+				}
+			}
+		}
+
+		g_atomic_int_inc((gint*) &wrk->connection_load);
+		g_atomic_int_inc((gint*) &srv->connection_load);
+		li_server_socket_acquire(sock);
+
+		/* other workers: copy the address into their ring and wake them up once for the whole batch */
+		if (ctx != wrk && l <= sizeof(sa) && li_worker_new_con_push(wrk, &sa, l, s, sock)) continue;
 
 		if (l <= sizeof(sa)) {
 			remote_addr.addr = g_slice_alloc(l);
@@ -456,21 +517,12 @@ static void li_server_listen_cb(struct ev_loop *loop, ev_io *w, int revents) {
 			remote_addr = li_sockaddr_remote_from_socket(s);
 		}
 
-		for (i = 1; i < srv->worker_count; i++) {
-			liWorker *wt = g_array_index(srv->workers, liWorker*, i);
-			guint load = g_atomic_int_get(&wt->connection_load);
-			if (load < min_load) {
-				wrk = wt;
-				min_load = load;
-			}
-		}
-
-		g_atomic_int_inc((gint*) &wrk->connection_load);
-		g_atomic_int_inc((gint*) &srv->connection_load);
-		li_server_socket_acquire(sock);
-		li_worker_new_con(srv->main_worker, wrk, remote_addr, s, sock);
+		li_worker_new_con(ctx, wrk, remote_addr, s, sock);
 	}
 
+	goto flush;
+
+accept_failed:
 #ifdef _WIN32
 	errno = WSAGetLastError();
 #endif
@@ -494,6 +546,13 @@ static void li_server_listen_cb(struct ev_loop *loop, ev_io *w, int revents) {
 		ERROR(srv, "accept failed on fd=%d with error: %s", w->fd, g_strerror(errno));
 		break;
 	}
+
+flush:
+	if (NULL == sock->wrk) {
+		for (i = 1; i < srv->worker_count; i++) {
+			li_worker_new_con_flush(g_array_index(srv->workers, liWorker*, i));
+		}
+	}
 }
 
 /* main worker only */
@@ -508,12 +567,66 @@ liServerSocket* li_server_listen(liServer *srv, int fd) {
 	return sock;
 }
 
+/* main worker only */
+liServerSocket* li_server_listen_worker(liServer *srv, liWorker *wrk, int fd) {
+	liServerSocket *sock = server_socket_new(fd);
+
+	sock->srv = srv;
+	sock->wrk = wrk;
+	g_ptr_array_add(srv->sockets, sock);
+	g_ptr_array_add(wrk->listen_sockets, sock);
+
+	if (g_atomic_int_get(&wrk->listen_active)) li_worker_listen(srv->main_worker, wrk, TRUE);
+
+	return sock;
+}
+
+typedef struct server_reuseport_ctx server_reuseport_ctx;
+struct server_reuseport_ctx {
+	liServerStateWait sw;
+	liWorker *wrk;
+};
+
+static void server_reuseport_listen_cb(liServer *srv, int fd, gpointer data) {
+	server_reuseport_ctx *ctx = data;
+
+	if (-1 != fd) {
+		li_server_listen_worker(srv, ctx->wrk, fd);
+	}
+
+	li_server_state_ready(srv, &ctx->sw);
+	g_slice_free(server_reuseport_ctx, ctx);
+}
+
+/* request one SO_REUSEPORT socket per worker and address; the workers must exist,
+ * and the sockets must be there before the worker threads are started */
+static void li_server_listen_reuseport(liServer *srv) {
+	guint i, j;
+
+	for (i = 0; i < srv->reuseport_addrs->len; i++) {
+		GString *addr = g_ptr_array_index(srv->reuseport_addrs, i);
+
+		for (j = 0; j < srv->worker_count; j++) {
+			server_reuseport_ctx *ctx = g_slice_new0(server_reuseport_ctx);
+			ctx->wrk = g_array_index(srv->workers, liWorker*, j);
+
+			li_server_state_wait(srv, &ctx->sw);
+			li_angel_listen_reuseport(srv, addr, server_reuseport_listen_cb, ctx);
+		}
+	}
+}
+
 static void li_server_start_listen(liServer *srv) {
 	guint i;
 
 	for (i = 0; i < srv->sockets->len; i++) {
 		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
-		ev_io_start(srv->main_worker->loop, &sock->watcher);
+		if (NULL == sock->wrk) ev_io_start(srv->main_worker->loop, &sock->watcher);
+	}
+
+	for (i = 0; i < srv->worker_count; i++) {
+		liWorker *wrk = g_array_index(srv->workers, liWorker*, i);
+		li_worker_listen(srv->main_worker, wrk, TRUE);
 	}
 }
 
@@ -522,14 +635,15 @@ static void li_server_stop_listen(liServer *srv) {
 
 	for (i = 0; i < srv->sockets->len; i++) {
 		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
-		ev_io_stop(srv->main_worker->loop, &sock->watcher);
+		if (NULL == sock->wrk) ev_io_stop(srv->main_worker->loop, &sock->watcher);
 	}
-	srv->connection_limit_hit = FALSE; /* reset flag */
+	g_atomic_int_set(&srv->connection_limit_hit, FALSE); /* reset flag */
 
-	/* suspend all workers (close keep-alive connections) */
+	/* suspend all workers (stop SO_REUSEPORT sockets, close keep-alive connections) */
 	for (i = 0; i < srv->worker_count; i++) {
 		liWorker *wrk;
 		wrk = g_array_index(srv->workers, liWorker*, i);
+		li_worker_listen(srv->main_worker, wrk, FALSE);
 		li_worker_suspend(srv->main_worker, wrk);
 	}
 }
@@ -539,11 +653,11 @@ static void li_server_stop(liServer *srv) {
 
 	for (i = 0; i < srv->sockets->len; i++) {
 		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
-		ev_io_stop(srv->main_worker->loop, &sock->watcher);
+		if (NULL == sock->wrk) ev_io_stop(srv->main_worker->loop, &sock->watcher);
 	}
-	srv->connection_limit_hit = FALSE; /* reset flag */
+	g_atomic_int_set(&srv->connection_limit_hit, FALSE); /* reset flag */
 
-	/* stop all workers */
+	/* stop all workers (li_worker_stop stops the SO_REUSEPORT sockets too) */
 	for (i = 0; i < srv->worker_count; i++) {
 		liWorker *wrk;
 		wrk = g_array_index(srv->workers, liWorker*, i);
@@ -720,6 +834,7 @@ static void li_server_start_transition(liServer *srv, liServerState state) {
 	case LI_SERVER_SUSPENDED:
 		if (srv->state == LI_SERVER_LOADING) {
 			li_plugins_prepare(srv);
+			li_server_listen_reuseport(srv);
 		}
 		break;
 	case LI_SERVER_WARMUP:
@@ -4,7 +4,18 @@
 
 #include <lighttpd/plugin_core.h>
 
+#ifdef USE_INOTIFY
+# include <sys/inotify.h>
+#endif
+
+#ifdef USE_IO_URING
+# include <sys/sysmacros.h>
+# include <linux/stat.h>
+#endif
+
 static void stat_cache_delete_cb(liWaitQueue *wq, gpointer daa);
+static void stat_cache_static_headers_cb(liWaitQueue *wq, gpointer data);
+static void stat_cache_static_headers_free(gpointer data);
 
 static void stat_cache_entry_release(liStatCacheEntry *sce);
 static void stat_cache_entry_acquire(liStatCacheEntry *sce);
@@ -25,7 +36,10 @@ liStatCache* li_stat_cache_new(liWorker *wrk, gdouble ttl) {
 	sc->entries = g_hash_table_new_full((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal, NULL, NULL);
 	sc->dirlists = g_hash_table_new_full((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal, NULL, NULL);
 
+	sc->static_headers = g_hash_table_new_full((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal, NULL, stat_cache_static_headers_free);
+
 	li_waitqueue_init(&sc->delete_queue, wrk->loop, stat_cache_delete_cb, ttl, sc);
+	li_waitqueue_init(&sc->static_headers_queue, wrk->loop, stat_cache_static_headers_cb, ttl, sc);
 
 	return sc;
 }
@@ -57,8 +71,12 @@ void li_stat_cache_free(liStatCache *sc) {
 		stat_cache_remove_from_cache(sc, sce);
 	}
 
+	li_waitqueue_stop(&sc->static_headers_queue);
+	while (NULL != li_waitqueue_pop_force(&sc->static_headers_queue)) ;
+
 	g_hash_table_destroy(sc->entries);
 	g_hash_table_destroy(sc->dirlists);
+	g_hash_table_destroy(sc->static_headers);
 	g_slice_free(liStatCache, sc);
 }
 
@@ -76,20 +94,114 @@ static void stat_cache_delete_cb(liWaitQueue *wq, gpointer data) {
 	li_waitqueue_update(wq);
 }
 
+static void stat_cache_static_headers_free(gpointer data) {
+	liStatCacheStaticHeaders *sh = data;
+
+	g_string_free(sh->path, TRUE);
+	if (sh->etag) g_string_free(sh->etag, TRUE);
+	if (sh->last_modified) g_string_free(sh->last_modified, TRUE);
+	g_slice_free(liStatCacheStaticHeaders, sh);
+}
+
+static void stat_cache_static_headers_cb(liWaitQueue *wq, gpointer data) {
+	liStatCache *sc = data;
+	liWaitQueueElem *wqe;
+
+	while ((wqe = li_waitqueue_pop(wq)) != NULL) {
+		liStatCacheStaticHeaders *sh = wqe->data;
+
+		g_hash_table_remove(sc->static_headers, sh->path); /* frees sh */
+	}
+
+	li_waitqueue_update(wq);
+}
+
+liStatCacheStaticHeaders* li_stat_cache_get_static_headers(liVRequest *vr, GString *path, struct stat *st) {
+	liStatCache *sc = vr->wrk->stat_cache;
+	liStatCacheStaticHeaders *sh;
+	guint etag_flags = CORE_OPTION(LI_CORE_OPTION_ETAG_FLAGS).number;
+	gconstpointer mime_types = CORE_OPTIONPTR(LI_CORE_OPTION_MIME_TYPES).ptr;
+	gchar lm[LI_ETAG_LAST_MODIFIED_SIZE];
+	gsize lm_len;
+
+	if (!sc)
+		return NULL;
+
+	if (NULL != (sh = g_hash_table_lookup(sc->static_headers, path))) {
+		if (sh->dev == st->st_dev && sh->ino == st->st_ino && sh->size == st->st_size && sh->mtime == st->st_mtime
+		    && sh->etag_flags == etag_flags && sh->mime_types == mime_types) {
+			return sh;
+		}
+
+		/* file changed or other options for this request */
+		li_waitqueue_remove(&sc->static_headers_queue, &sh->queue_elem);
+		g_hash_table_remove(sc->static_headers, path);
+	}
+
+	sh = g_slice_new0(liStatCacheStaticHeaders);
+	sh->path = g_string_new_len(GSTR_LEN(path));
+	sh->dev = st->st_dev;
+	sh->ino = st->st_ino;
+	sh->size = st->st_size;
+	sh->mtime = st->st_mtime;
+	sh->etag_flags = etag_flags;
+	sh->mime_types = mime_types;
+	sh->queue_elem.data = sh;
+
+	if (0 != etag_flags) {
+		sh->etag = g_string_sized_new(15);
+		li_etag_format(sh->etag, st, etag_flags);
+	}
+
+	if (0 != (lm_len = li_etag_format_last_modified(lm, sizeof(lm), st->st_mtime))) {
+		sh->last_modified = g_string_new_len(lm, lm_len);
+	}
+
+	sh->content_type = li_mimetype_get(vr, path);
+
+	g_hash_table_insert(sc->static_headers, sh->path, sh);
+	li_waitqueue_push(&sc->static_headers_queue, &sh->queue_elem);
+
+	return sh;
+}
+
+/* the dirlist of an entry is collected in two steps: one tasklet reads the names, then the stat()s
+ * are split into batches of STAT_CACHE_DIRLIST_BATCH entries, each batch is a tasklet of its own
+ */
+#define STAT_CACHE_DIRLIST_BATCH 1024
+
+typedef struct stat_cache_dirlist_job stat_cache_dirlist_job;
+struct stat_cache_dirlist_job {
+	liTaskletPool *tasklets;
+	DIR *dirp;                        /* set by the reading tasklet if there is something to stat() */
+	guint batches, pending;
+	gboolean *done;                   /* per batch */
+	guint next;                       /* first batch not done */
+};
+
+typedef struct stat_cache_dirlist_batch stat_cache_dirlist_batch;
+struct stat_cache_dirlist_batch {
+	liStatCacheEntry *sce;
+	guint ndx;
+};
+
+static void stat_cache_wakeup(liStatCacheEntry *sce) {
+	guint i;
+
+	for (i = 0; i < sce->vrequests->len; i++) {
+		li_vrequest_joblist_append(g_ptr_array_index(sce->vrequests, i));
+	}
+}
+
 static void stat_cache_finished(gpointer data) {
 	liStatCacheEntry *sce = data;
-	guint i;
-	liVRequest *vr;
 
 	if (sce->data.failed) {
 		if (NULL != sce->sc) sce->sc->errors++;
 	}
 
 	/* queue pending vrequests */
-	for (i = 0; i < sce->vrequests->len; i++) {
-		vr = g_ptr_array_index(sce->vrequests, i);
-		li_vrequest_joblist_append(vr);
-	}
+	stat_cache_wakeup(sce);
 
 	/* release tasklet reference */
 	stat_cache_entry_release(sce);
@@ -106,14 +218,14 @@ static void stat_cache_run(gpointer data) {
 	}
 
 	if (!sce->data.failed && sce->type == STAT_CACHE_ENTRY_DIR) {
-		/* dirlisting */
+		/* dirlisting: only the names, see stat_cache_dirlist_run for the stat()s */
+		stat_cache_dirlist_job *job = sce->dirlist_job;
 		DIR *dirp;
 		gsize size;
 		struct dirent *entry;
 		struct dirent *result;
 		gint error;
 		liStatCacheEntryData sced;
-		GString *str;
 
 		dirp = opendir(sce->data.path->str);
 		if (dirp == NULL) {
@@ -126,9 +238,6 @@ static void stat_cache_run(gpointer data) {
 
 			sce->dirlist = g_array_sized_new(FALSE, FALSE, sizeof(liStatCacheEntryData), 32);
 
-			str = g_string_sized_new(sce->data.path->len + 64);
-			g_string_append_len(str, GSTR_LEN(sce->data.path));
-
 			while ((error = readdir_r(dirp, entry, &result)) == 0 && result != NULL) {
 				/* hide "." and ".." */
 				if (result->d_name[0] == '.' && (result->d_name[1] == '\0' ||
@@ -138,19 +247,8 @@ static void stat_cache_run(gpointer data) {
 
 				sced.path = g_string_sized_new(63);
 				g_string_assign(sced.path, result->d_name);
-
-				g_string_truncate(str, sce->data.path->len);
-				/* make sure the path ends with / (or whatever) */
-				if (!sce->data.path->len || sce->data.path->str[sce->data.path->len-1] != G_DIR_SEPARATOR)
-					g_string_append_c(str, G_DIR_SEPARATOR);
-				g_string_append_len(str, GSTR_LEN(sced.path));
-
-				if (stat(str->str, &sced.st) == -1) {
-					sced.failed = TRUE;
-					sced.err = errno;
-				} else {
-					sced.failed = FALSE;
-				}
+				sced.failed = TRUE;
+				sced.err = 0;
 
 				g_array_append_val(sce->dirlist, sced);
 			}
@@ -160,20 +258,227 @@ static void stat_cache_run(gpointer data) {
 				sce->data.err = error;
 			}
 
-			g_string_free(str, TRUE);
 			g_slice_free1(size, entry);
-			closedir(dirp);
+
+			if (!error && sce->dirlist->len > 0) {
+				job->dirp = dirp; /* closed when all stat()s are done */
+			} else {
+				closedir(dirp);
+			}
+		}
+	}
+
+	if (sce->type != STAT_CACHE_ENTRY_DIR || NULL == ((stat_cache_dirlist_job*) sce->dirlist_job)->dirp)
+		g_atomic_int_set(&sce->state, STAT_CACHE_ENTRY_FINISHED);
+}
+
+static void stat_cache_dirlist_run(gpointer data) {
+	stat_cache_dirlist_batch *batch = data;
+	liStatCacheEntry *sce = batch->sce;
+	guint i, end;
+#ifdef HAVE_FSTATAT
+	int dfd = dirfd(((stat_cache_dirlist_job*) sce->dirlist_job)->dirp);
+#else
+	GString *str = g_string_sized_new(sce->data.path->len + 64);
+	gsize dirlen;
+
+	g_string_append_len(str, GSTR_LEN(sce->data.path));
+	/* make sure the path ends with / (or whatever) */
+	if (!str->len || str->str[str->len-1] != G_DIR_SEPARATOR)
+		g_string_append_c(str, G_DIR_SEPARATOR);
+	dirlen = str->len;
+#endif
+
+	end = MIN((batch->ndx + 1) * STAT_CACHE_DIRLIST_BATCH, sce->dirlist->len);
+
+	for (i = batch->ndx * STAT_CACHE_DIRLIST_BATCH; i < end; i++) {
+		liStatCacheEntryData *sced = &g_array_index(sce->dirlist, liStatCacheEntryData, i);
+
+#ifdef HAVE_FSTATAT
+		if (fstatat(dfd, sced->path->str, &sced->st, 0) == -1) {
+#else
+		g_string_truncate(str, dirlen);
+		g_string_append_len(str, GSTR_LEN(sced->path));
+
+		if (stat(str->str, &sced->st) == -1) {
+#endif
+			sced->failed = TRUE;
+			sced->err = errno;
+		} else {
+			sced->failed = FALSE;
 		}
 	}
 
+#ifndef HAVE_FSTATAT
+	g_string_free(str, TRUE);
+#endif
+}
+
+static void stat_cache_dirlist_job_free(liStatCacheEntry *sce) {
+	stat_cache_dirlist_job *job = sce->dirlist_job;
+
+	if (NULL == job) return;
+
+	if (NULL != job->dirp) closedir(job->dirp);
+	g_free(job->done);
+	g_slice_free(stat_cache_dirlist_job, job);
+	sce->dirlist_job = NULL;
+}
+
+static void stat_cache_dirlist_finished(gpointer data) {
+	stat_cache_dirlist_batch *batch = data;
+	liStatCacheEntry *sce = batch->sce;
+	stat_cache_dirlist_job *job = sce->dirlist_job;
+	gboolean advanced = FALSE;
+
+	job->done[batch->ndx] = TRUE;
+	g_slice_free(stat_cache_dirlist_batch, batch);
+
+	/* entries are handed out in order, so a slow batch holds back the ones behind it */
+	while (job->next < job->batches && job->done[job->next]) {
+		job->next++;
+		advanced = TRUE;
+	}
+	if (advanced) sce->dirlist_ready = MIN(job->next * STAT_CACHE_DIRLIST_BATCH, sce->dirlist->len);
+
+	if (0 == --job->pending) {
+		stat_cache_dirlist_job_free(sce);
+		g_atomic_int_set(&sce->state, STAT_CACHE_ENTRY_FINISHED);
+		stat_cache_finished(sce);
+		return;
+	}
+
+	if (advanced) stat_cache_wakeup(sce);
+
+	/* release tasklet reference */
+	stat_cache_entry_release(sce);
+}
+
+static void stat_cache_dirlist_read_finished(gpointer data) {
+	liStatCacheEntry *sce = data;
+	stat_cache_dirlist_job *job = sce->dirlist_job;
+	guint i;
+
+	if (NULL == job->dirp) {
+		/* failed or empty */
+		stat_cache_dirlist_job_free(sce);
+		if (NULL != sce->dirlist) sce->dirlist_ready = sce->dirlist->len;
+		stat_cache_finished(sce);
+		return;
+	}
+
+	job->batches = (sce->dirlist->len + STAT_CACHE_DIRLIST_BATCH - 1) / STAT_CACHE_DIRLIST_BATCH;
+	job->pending = job->batches;
+	job->done = g_new0(gboolean, job->batches);
+
+	for (i = 0; i < job->batches; i++) {
+		stat_cache_dirlist_batch *batch = g_slice_new(stat_cache_dirlist_batch);
+
+		batch->sce = sce;
+		batch->ndx = i;
+		sce->refcount++;
+		li_tasklet_push(job->tasklets, stat_cache_dirlist_run, stat_cache_dirlist_finished, batch);
+	}
+
+	/* release reference of the reading tasklet */
+	stat_cache_entry_release(sce);
+}
+
+#ifdef USE_IO_URING
+
+typedef struct stat_cache_uring_op stat_cache_uring_op;
+struct stat_cache_uring_op {
+	liURingOp op;
+	liStatCacheEntry *sce;
+	struct statx stx;
+};
+
+static void stat_cache_statx_to_stat(struct statx *stx, struct stat *st) {
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atime = stx->stx_atime.tv_sec;
+	st->st_mtime = stx->stx_mtime.tv_sec;
+	st->st_ctime = stx->stx_ctime.tv_sec;
+}
+
+static void stat_cache_uring_cb(liURingOp *op) {
+	stat_cache_uring_op *sop = op->data;
+	liStatCacheEntry *sce = sop->sce;
+
+	if (op->res < 0) {
+		sce->data.failed = TRUE;
+		sce->data.err = -op->res;
+
+		/* kernel has io_uring but no IORING_OP_STATX */
+		if ((EINVAL == sce->data.err || EOPNOTSUPP == sce->data.err) && NULL != sce->sc) sce->sc->uring_failed = TRUE;
+	} else {
+		sce->data.failed = FALSE;
+		stat_cache_statx_to_stat(&sop->stx, &sce->data.st);
+	}
+
+	g_slice_free(stat_cache_uring_op, sop);
+
 	g_atomic_int_set(&sce->state, STAT_CACHE_ENTRY_FINISHED);
+	stat_cache_finished(sce);
+}
+
+/* returns FALSE if the stat has to be done by the tasklets */
+static gboolean stat_cache_uring_push(liWorker *wrk, liStatCache *sc, liStatCacheEntry *sce) {
+	stat_cache_uring_op *sop;
+	struct io_uring_sqe *sqe;
+
+	if (sc->uring_failed) return FALSE;
+
+	if (NULL == wrk->uring && NULL == (wrk->uring = li_uring_new(wrk->loop, 256))) {
+		ERROR(wrk->srv, "Couldn't setup io_uring (%s), using threads for stat.async", g_strerror(errno));
+		sc->uring_failed = TRUE;
+		return FALSE;
+	}
+
+	sop = g_slice_new(stat_cache_uring_op);
+	sop->op.callback = stat_cache_uring_cb;
+	sop->op.data = sop;
+	sop->sce = sce;
+
+	if (NULL == (sqe = li_uring_get_sqe(wrk->uring, &sop->op))) {
+		g_slice_free(stat_cache_uring_op, sop);
+		return FALSE;
+	}
+
+	/* submitted together with the other entries before the loop blocks next time */
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (guint64) (uintptr_t) sce->data.path->str;
+	sqe->len = STATX_BASIC_STATS;
+	sqe->off = (guint64) (uintptr_t) &sop->stx;
+
+	return TRUE;
 }
 
+#else
+
+static gboolean stat_cache_uring_push(liWorker *wrk, liStatCache *sc, liStatCacheEntry *sce) {
+	UNUSED(wrk); UNUSED(sc); UNUSED(sce);
+	return FALSE;
+}
+
+#endif
+
 static liStatCacheEntry *stat_cache_entry_new(liStatCache *sc, GString *path) {
 	liStatCacheEntry *sce;
 
 	sce = g_slice_new0(liStatCacheEntry);
 	sce->sc = sc;
+	sce->id = ++sc->last_id;
 	sce->data.path = g_string_new_len(GSTR_LEN(path));
 	sce->vrequests = g_ptr_array_sized_new(8);
 	sce->state = STAT_CACHE_ENTRY_WAITING;
@@ -188,6 +493,7 @@ static void stat_cache_entry_free(liStatCacheEntry *sce) {
 	guint i;
 
 	assert(sce->vrequests->len == 0);
+	assert(NULL == sce->dirlist_job);
 
 	g_string_free(sce->data.path, TRUE);
 	g_ptr_array_free(sce->vrequests, TRUE);
@@ -223,6 +529,307 @@ void li_stat_cache_entry_release(liVRequest *vr, liStatCacheEntry *sce) {
 	stat_cache_entry_release(sce);
 }
 
+#ifdef USE_INOTIFY
+
+#define STAT_CACHE_SHARD_MAX_ENTRIES 4096
+
+#define STAT_CACHE_INOTIFY_MASK \
+	(IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct stat_cache_shared_entry stat_cache_shared_entry;
+struct stat_cache_shared_entry {
+	GString *path;
+	struct stat st;
+	gint err;                         /* 0: st is valid */
+	ev_tstamp ts;                     /* expires after stat_cache.ttl like the per-worker entries */
+};
+
+static void stat_cache_shared_entry_free(gpointer data) {
+	stat_cache_shared_entry *e = data;
+
+	g_string_free(e->path, TRUE);
+	g_slice_free(stat_cache_shared_entry, e);
+}
+
+static guint stat_cache_shared_shard(GString *path) {
+	return g_string_hash(path) % LI_STAT_CACHE_SHARDS;
+}
+
+/* returns TRUE on a hit; *err is 0 if the stat() was successful.
+ * only the directory of path is watched: renamed parents or replaced symlinks are noticed after the ttl
+ */
+static gboolean stat_cache_shared_lookup(liStatCacheShared *shared, GString *path, struct stat *st, int *err, ev_tstamp now) {
+	guint ndx = stat_cache_shared_shard(path);
+	stat_cache_shared_entry *e;
+	gboolean hit = FALSE;
+
+	g_static_mutex_lock(&shared->shards[ndx].lock);
+	if (NULL != (e = g_hash_table_lookup(shared->shards[ndx].entries, path))) {
+		if (e->ts + shared->srv->stat_cache_ttl > now) {
+			if (0 == e->err) *st = e->st;
+			*err = e->err;
+			hit = TRUE;
+		} else {
+			g_hash_table_remove(shared->shards[ndx].entries, path);
+		}
+	}
+	g_static_mutex_unlock(&shared->shards[ndx].lock);
+
+	return hit;
+}
+
+/* length of the directory part of an absolute path (trailing slashes ignored), 0 if there is none */
+static gsize stat_cache_shared_dirlen(GString *path) {
+	gsize len = path->len;
+
+	if (0 == len || '/' != path->str[0]) return 0;
+
+	while (len > 1 && '/' == path->str[len-1]) len--;
+	while (len > 0 && '/' != path->str[len-1]) len--;
+	if (len > 1) len--; /* keep the slash only for the root */
+
+	return len;
+}
+
+/* makes sure the directory of path is watched; has to be called before the stat(),
+ * the result may only be cached if no invalidation happened in between (see *generation)
+ */
+static gboolean stat_cache_shared_watch(liStatCacheShared *shared, GString *path, gint *generation) {
+	gsize dirlen = stat_cache_shared_dirlen(path);
+	GString dir = li_const_gstring(path->str, dirlen);
+	gboolean watched;
+
+	if (0 == dirlen || g_atomic_int_get(&shared->disabled)) return FALSE;
+
+	*generation = g_atomic_int_get(&shared->generation);
+
+	g_static_mutex_lock(&shared->watch_lock);
+	watched = (NULL != g_hash_table_lookup(shared->watch_dirs, &dir));
+	if (!watched) {
+		GString *d = g_string_new_len(path->str, dirlen);
+		int wd = inotify_add_watch(shared->inotify_fd, d->str, STAT_CACHE_INOTIFY_MASK);
+
+		if (-1 == wd || NULL != g_hash_table_lookup(shared->watch_wds, GINT_TO_POINTER(wd))) {
+			/* not watchable (missing, watch limit reached) or already watched with another name */
+			g_string_free(d, TRUE);
+		} else {
+			g_hash_table_insert(shared->watch_dirs, d, GINT_TO_POINTER(wd));
+			g_hash_table_insert(shared->watch_wds, GINT_TO_POINTER(wd), d);
+			watched = TRUE;
+		}
+	}
+	g_static_mutex_unlock(&shared->watch_lock);
+
+	return watched;
+}
+
+static void stat_cache_shared_insert(liStatCacheShared *shared, GString *path, struct stat *st, int err, gint generation, ev_tstamp now) {
+	guint ndx = stat_cache_shared_shard(path);
+	stat_cache_shared_entry *e;
+
+	/* other errors may depend on things we don't watch (like permissions of parent directories) */
+	if (0 != err && ENOENT != err) return;
+
+	g_static_mutex_lock(&shared->shards[ndx].lock);
+	if (generation == g_atomic_int_get(&shared->generation)) {
+		if (g_hash_table_size(shared->shards[ndx].entries) >= STAT_CACHE_SHARD_MAX_ENTRIES) {
+			g_hash_table_remove_all(shared->shards[ndx].entries);
+		}
+
+		e = g_slice_new(stat_cache_shared_entry);
+		e->path = g_string_new_len(GSTR_LEN(path));
+		if (0 == err) e->st = *st;
+		e->err = err;
+		e->ts = now;
+		g_hash_table_replace(shared->shards[ndx].entries, e->path, e);
+	}
+	g_static_mutex_unlock(&shared->shards[ndx].lock);
+}
+
+static void stat_cache_shared_remove(liStatCacheShared *shared, GString *path) {
+	guint ndx = stat_cache_shared_shard(path);
+
+	g_static_mutex_lock(&shared->shards[ndx].lock);
+	g_hash_table_remove(shared->shards[ndx].entries, path);
+	g_static_mutex_unlock(&shared->shards[ndx].lock);
+}
+
+static void stat_cache_shared_flush(liStatCacheShared *shared) {
+	guint i;
+
+	for (i = 0; i < LI_STAT_CACHE_SHARDS; i++) {
+		g_static_mutex_lock(&shared->shards[i].lock);
+		g_hash_table_remove_all(shared->shards[i].entries);
+		g_static_mutex_unlock(&shared->shards[i].lock);
+	}
+}
+
+/* remove path and path with trailing slash */
+static void stat_cache_shared_remove_both(liStatCacheShared *shared, GString *path) {
+	stat_cache_shared_remove(shared, path);
+	g_string_append_c(path, '/');
+	stat_cache_shared_remove(shared, path);
+	g_string_truncate(path, path->len - 1);
+}
+
+static void stat_cache_shared_event(liStatCacheShared *shared, struct inotify_event *ev, GString *path) {
+	GString *dir;
+	gboolean dir_gone = FALSE;
+
+	g_atomic_int_inc(&shared->generation);
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		/* lost events */
+		stat_cache_shared_flush(shared);
+		return;
+	}
+
+	g_static_mutex_lock(&shared->watch_lock);
+	if (NULL != (dir = g_hash_table_lookup(shared->watch_wds, GINT_TO_POINTER(ev->wd)))) {
+		g_string_truncate(path, 0);
+		g_string_append_len(path, GSTR_LEN(dir));
+
+		if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+			/* the watch doesn't belong to this name anymore */
+			if (!(ev->mask & IN_IGNORED)) inotify_rm_watch(shared->inotify_fd, ev->wd);
+			g_hash_table_remove(shared->watch_wds, GINT_TO_POINTER(ev->wd));
+			g_hash_table_remove(shared->watch_dirs, dir);
+			dir_gone = TRUE;
+		}
+	}
+	g_static_mutex_unlock(&shared->watch_lock);
+
+	if (NULL == dir) return;
+
+	if (dir_gone) {
+		/* everything below it is stale; rare enough to not search for it */
+		stat_cache_shared_flush(shared);
+		return;
+	}
+
+	/* a change of the content changes the mtime of the directory */
+	stat_cache_shared_remove_both(shared, path);
+
+	if (ev->len > 0) {
+		if ('/' != path->str[path->len-1]) g_string_append_c(path, '/');
+		g_string_append(path, ev->name);
+		stat_cache_shared_remove_both(shared, path);
+	}
+}
+
+static void stat_cache_shared_inotify_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	liStatCacheShared *shared = w->data;
+	union {
+		struct inotify_event ev;
+		gchar buf[4096];
+	} events;
+	GString *path = g_string_sized_new(127);
+	gssize r;
+
+	UNUSED(revents);
+
+	while ((r = read(shared->inotify_fd, &events, sizeof(events))) > 0) {
+		gchar *p = events.buf;
+
+		while (p < events.buf + r) {
+			struct inotify_event *ev = (struct inotify_event*) p;
+
+			stat_cache_shared_event(shared, ev, path);
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+
+	if (-1 == r && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+		ERROR(shared->srv, "reading inotify events failed: %s", g_strerror(errno));
+		/* without events we can't trust the cache anymore */
+		li_ev_safe_ref_and_stop(ev_io_stop, loop, w);
+		g_atomic_int_set(&shared->disabled, TRUE);
+		g_atomic_int_inc(&shared->generation);
+		stat_cache_shared_flush(shared);
+	}
+
+	g_string_free(path, TRUE);
+}
+
+liStatCacheShared* li_stat_cache_shared_new(liServer *srv) {
+	liStatCacheShared *shared;
+	guint i;
+	int fd;
+
+	if (-1 == (fd = inotify_init())) {
+		ERROR(srv, "inotify_init failed: %s", g_strerror(errno));
+		return NULL;
+	}
+	li_fd_init(fd);
+
+	shared = g_slice_new0(liStatCacheShared);
+	shared->srv = srv;
+
+	for (i = 0; i < LI_STAT_CACHE_SHARDS; i++) {
+		g_static_mutex_init(&shared->shards[i].lock);
+		shared->shards[i].entries = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, NULL, stat_cache_shared_entry_free);
+	}
+
+	shared->inotify_fd = fd;
+	g_static_mutex_init(&shared->watch_lock);
+	shared->watch_dirs = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, li_string_destroy_notify, NULL);
+	shared->watch_wds = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	ev_io_init(&shared->inotify_watcher, stat_cache_shared_inotify_cb, fd, EV_READ);
+	shared->inotify_watcher.data = shared;
+	li_ev_safe_unref_and_start(ev_io_start, srv->main_worker->loop, &shared->inotify_watcher);
+
+	return shared;
+}
+
+void li_stat_cache_shared_free(liServer *srv, liStatCacheShared *shared) {
+	guint i;
+
+	if (!shared) return;
+
+	li_ev_safe_ref_and_stop(ev_io_stop, srv->main_worker->loop, &shared->inotify_watcher);
+	close(shared->inotify_fd);
+
+	for (i = 0; i < LI_STAT_CACHE_SHARDS; i++) {
+		g_hash_table_destroy(shared->shards[i].entries);
+		g_static_mutex_free(&shared->shards[i].lock);
+	}
+
+	g_hash_table_destroy(shared->watch_wds);
+	g_hash_table_destroy(shared->watch_dirs);
+	g_static_mutex_free(&shared->watch_lock);
+
+	g_slice_free(liStatCacheShared, shared);
+}
+
+#else
+
+static gboolean stat_cache_shared_lookup(liStatCacheShared *shared, GString *path, struct stat *st, int *err, ev_tstamp now) {
+	UNUSED(shared); UNUSED(path); UNUSED(st); UNUSED(err); UNUSED(now);
+	return FALSE;
+}
+
+static gboolean stat_cache_shared_watch(liStatCacheShared *shared, GString *path, gint *generation) {
+	UNUSED(shared); UNUSED(path); UNUSED(generation);
+	return FALSE;
+}
+
+static void stat_cache_shared_insert(liStatCacheShared *shared, GString *path, struct stat *st, int err, gint generation, ev_tstamp now) {
+	UNUSED(shared); UNUSED(path); UNUSED(st); UNUSED(err); UNUSED(generation); UNUSED(now);
+}
+
+liStatCacheShared* li_stat_cache_shared_new(liServer *srv) {
+	ERROR(srv, "%s", "stat_cache.shared: inotify is not supported on this platform");
+	return NULL;
+}
+
+void li_stat_cache_shared_free(liServer *srv, liStatCacheShared *shared) {
+	UNUSED(srv);
+	UNUSED(shared);
+}
+
+#endif
+
 liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatCacheEntry **result) {
 	liStatCache *sc;
 	liStatCacheEntry *sce;
@@ -234,6 +841,8 @@ liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatC
 	if (sce) {
 		/* cache hit, check state */
 		if (g_atomic_int_get(&sce->state) == STAT_CACHE_ENTRY_WAITING) {
+			/* the entries collected so far may be used already */
+			*result = sce;
 			/* already waiting for it? */
 			for (i = 0; i < vr->stat_cache_entries->len; i++) {
 				if (g_ptr_array_index(vr->stat_cache_entries, i) == sce)
@@ -253,8 +862,13 @@ liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatC
 		return LI_HANDLER_GO_ON;
 	} else {
 		/* cache miss, allocate new entry */
+		stat_cache_dirlist_job *job = g_slice_new0(stat_cache_dirlist_job);
+
 		sce = stat_cache_entry_new(sc, path);
 		sce->type = STAT_CACHE_ENTRY_DIR;
+		job->tasklets = vr->wrk->tasklets;
+		sce->dirlist_job = job;
+		*result = sce;
 
 		li_stat_cache_entry_acquire(vr, sce); /* assign sce to vr */
 
@@ -263,7 +877,7 @@ liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatC
 		g_hash_table_insert(sc->dirlists, sce->data.path, sce);
 
 		sce->refcount++;
-		li_tasklet_push(vr->wrk->tasklets, stat_cache_run, stat_cache_finished, sce);
+		li_tasklet_push(vr->wrk->tasklets, stat_cache_run, stat_cache_dirlist_read_finished, sce);
 
 		sc->misses++;
 		return LI_HANDLER_WAIT_FOR_EVENT;
@@ -273,10 +887,24 @@ liHandlerResult li_stat_cache_get_dirlist(liVRequest *vr, GString *path, liStatC
 static liHandlerResult stat_cache_get(liVRequest *vr, GString *path, struct stat *st, int *err, int *fd, gboolean async) {
 	liStatCache *sc;
 	liStatCacheEntry *sce;
+	liStatCacheShared *shared = NULL;
+	liStatAsyncMode async_mode = LI_STAT_ASYNC_OFF;
+	gboolean shared_watched = FALSE;
+	gint shared_generation = 0;
+	ev_tstamp now = 0;
 	guint i;
 
+	if (vr && NULL != (shared = vr->wrk->srv->stat_cache_shared)) {
+		now = ev_now(vr->wrk->loop);
+		/* we need the fd anyway, so only plain stat()s are answered from the shared cache */
+		if (!fd && stat_cache_shared_lookup(shared, path, st, err, now)) {
+			if (NULL != vr->wrk->stat_cache) vr->wrk->stat_cache->hits++;
+			return (0 == *err) ? LI_HANDLER_GO_ON : LI_HANDLER_ERROR;
+		}
+	}
+
 	/* force blocking call if we are not in a vrequest context or stat cache is disabled */
-	if (!vr || !(sc = vr->wrk->stat_cache) || !CORE_OPTION(LI_CORE_OPTION_ASYNC_STAT).boolean)
+	if (!vr || !(sc = vr->wrk->stat_cache) || LI_STAT_ASYNC_OFF == (async_mode = CORE_OPTION(LI_CORE_OPTION_ASYNC_STAT).number))
 		async = FALSE;
 
 	if (async) {
@@ -308,13 +936,18 @@ static liHandlerResult stat_cache_get(liVRequest *vr, GString *path, struct stat
 			g_hash_table_insert(sc->entries, sce->data.path, sce);
 
 			sce->refcount++;
-			li_tasklet_push(vr->wrk->tasklets, stat_cache_run, stat_cache_finished, sce);
+			if (LI_STAT_ASYNC_IO_URING != async_mode || !stat_cache_uring_push(vr->wrk, sc, sce)) {
+				li_tasklet_push(vr->wrk->tasklets, stat_cache_run, stat_cache_finished, sce);
+			}
 
 			sc->misses++;
 			return LI_HANDLER_WAIT_FOR_EVENT;
 		}
 	}
 
+	/* the watch has to exist before the stat(), so every later change invalidates the result */
+	if (NULL != shared) shared_watched = stat_cache_shared_watch(shared, path, &shared_generation);
+
 	if (fd) {
 		/* open + fstat */
 		while (-1 == (*fd = open(path->str, O_RDONLY))) {
@@ -322,6 +955,7 @@ static liHandlerResult stat_cache_get(liVRequest *vr, GString *path, struct stat
 				continue;
 
 			*err = errno;
+			if (shared_watched) stat_cache_shared_insert(shared, path, NULL, *err, shared_generation, now);
 			return LI_HANDLER_ERROR;
 		}
 		if (-1 == fstat(*fd, st)) {
@@ -334,10 +968,13 @@ static liHandlerResult stat_cache_get(liVRequest *vr, GString *path, struct stat
 		/* stat */
 		if (-1 == stat(path->str, st)) {
 			*err = errno;
+			if (shared_watched) stat_cache_shared_insert(shared, path, NULL, *err, shared_generation, now);
 			return LI_HANDLER_ERROR;
 		}
 	}
 
+	if (shared_watched) stat_cache_shared_insert(shared, path, st, 0, shared_generation, now);
+
 	return LI_HANDLER_GO_ON;
 }
 
@@ -149,6 +149,8 @@ liVRequest* li_vrequest_new(liWorker *wrk, liConInfo *coninfo) {
 	vr->wrk = wrk;
 	vr->state = LI_VRS_CLEAN;
 
+	li_arena_init(&vr->arena, wrk->request_arena_stats);
+
 	vr->plugin_ctx = g_ptr_array_new();
 	g_ptr_array_set_size(vr->plugin_ctx, g_hash_table_size(srv->plugins));
 	vr->options = g_slice_copy(srv->option_def_values->len * sizeof(liOptionValue), srv->option_def_values->data);
@@ -165,6 +167,7 @@ liVRequest* li_vrequest_new(liWorker *wrk, liConInfo *coninfo) {
 	li_request_init(&vr->request);
 	li_physical_init(&vr->physical);
 	li_response_init(&vr->response);
+	li_http_headers_use_arena(vr->response.headers, &vr->arena);
 	li_environment_init(&vr->env);
 
 	filters_init(&vr->filters_in);
@@ -210,6 +213,7 @@ void li_vrequest_free(liVRequest* vr) {
 	li_physical_clear(&vr->physical);
 	li_response_clear(&vr->response);
 	li_environment_clear(&vr->env);
+	li_arena_clear(&vr->arena);
 
 	filters_clean(vr, &vr->filters_in);
 	filters_clean(vr, &vr->filters_out);
@@ -259,6 +263,7 @@ void li_vrequest_reset(liVRequest *vr, gboolean keepalive) {
 	li_physical_reset(&vr->physical);
 	li_response_reset(&vr->response);
 	li_environment_reset(&vr->env);
+	li_arena_reset(&vr->arena); /* after everything using it */
 
 	filters_reset(vr, &vr->filters_in);
 	filters_reset(vr, &vr->filters_out);
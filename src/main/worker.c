@@ -20,13 +20,15 @@ struct worker_closing_socket {
 	GList *link;
 	int fd;
 	ev_tstamp close_timeout;
+	gboolean read_done; /** got eof or an error, only waiting for zerocopy notifications */
+	liNetworkZeroCopy zerocopy; /** MSG_ZEROCOPY sends the kernel may still read from */
 };
 
 static void worker_close_socket_now(worker_closing_socket *scs) {
 	liWorker *wrk = scs->wrk;
 
 	/* shutdown(scs->fd, SHUT_RD); */ /* useless anyway */
-	close(scs->fd);
+	li_network_zerocopy_close(scs->fd, &scs->zerocopy);
 	g_queue_delete_link(&wrk->closing_sockets, scs->link);
 	g_slice_free(worker_closing_socket, scs);
 }
@@ -39,7 +41,7 @@ static void worker_closing_socket_cb(int revents, void* arg) {
 
 	/* empty the input buffer, wait for EOF or timeout or a socket error to close it */
 	g_string_set_size(wrk->tmp_str, 1024);
-	for (;;) {
+	while (!scs->read_done) {
 		r = read(scs->fd, wrk->tmp_str->str, wrk->tmp_str->len);
 		if (0 == r) break; /* got EOF */
 		if (0 > r) { /* error */
@@ -67,24 +69,41 @@ static void worker_closing_socket_cb(int revents, void* arg) {
 			break; /* end loop */
 		}
 	}
+	scs->read_done = TRUE;
+
+	/* the notifications can't be read after close: poll for them until the timeout */
+	if (scs->zerocopy.pending.length > 0) li_network_zerocopy_reap(NULL, scs->fd, &scs->zerocopy);
+	if (scs->zerocopy.pending.length > 0 && remaining > 0) {
+		ev_once(wrk->loop, -1, 0, MIN(remaining, 0.1), worker_closing_socket_cb, scs);
+		return;
+	}
 
 	worker_close_socket_now(scs);
 }
 
-void li_worker_add_closing_socket(liWorker *wrk, int fd) {
+void li_worker_add_closing_socket(liWorker *wrk, int fd, liNetworkZeroCopy *zerocopy) {
 	worker_closing_socket *scs;
 	liServerState state = g_atomic_int_get(&wrk->srv->state);
 
 	shutdown(fd, SHUT_WR);
 	if (LI_SERVER_RUNNING != state && LI_SERVER_WARMUP != state) {
 		shutdown(fd, SHUT_RD);
-		close(fd);
+		if (zerocopy) {
+			li_network_zerocopy_close(fd, zerocopy);
+		} else {
+			close(fd);
+		}
 		return;
 	}
 
 	scs = g_slice_new0(worker_closing_socket);
 	scs->wrk = wrk;
 	scs->fd = fd;
+	if (zerocopy) {
+		li_network_zerocopy_move(&scs->zerocopy, zerocopy);
+	} else {
+		li_network_zerocopy_init(&scs->zerocopy);
+	}
 	g_queue_push_tail(&wrk->closing_sockets, scs);
 	scs->link = g_queue_peek_tail_link(&wrk->closing_sockets);
 	scs->close_timeout = ev_now(wrk->loop) + 10.0;
@@ -258,9 +277,45 @@ static void li_worker_exit_cb(struct ev_loop *loop, ev_async *w, int revents) {
 	li_worker_exit(wrk, wrk);
 }
 
+/* listen watcher */
+static void worker_listen_update(liWorker *wrk) {
+	gboolean active = g_atomic_int_get(&wrk->listen_active);
+	guint i;
+
+	for (i = 0; i < wrk->listen_sockets->len; i++) {
+		liServerSocket *sock = g_ptr_array_index(wrk->listen_sockets, i);
+		if (active) {
+			ev_io_start(wrk->loop, &sock->watcher);
+		} else {
+			ev_io_stop(wrk->loop, &sock->watcher);
+		}
+	}
+}
+
+static void li_worker_listen_cb(struct ev_loop *loop, ev_async *w, int revents) {
+	liWorker *wrk = (liWorker*) w->data;
+	UNUSED(loop);
+	UNUSED(revents);
+
+	worker_listen_update(wrk);
+}
+
+void li_worker_listen(liWorker *context, liWorker *wrk, gboolean active) {
+	g_atomic_int_set(&wrk->listen_active, active);
+
+	if (0 == wrk->listen_sockets->len) return;
+
+	if (context == wrk) {
+		worker_listen_update(wrk);
+	} else {
+		ev_async_send(wrk->loop, &wrk->listen_watcher);
+	}
+}
+
 typedef struct li_worker_new_con_data li_worker_new_con_data;
 struct li_worker_new_con_data {
-	liSocketAddress remote_addr;
+	liSockAddr sa; /* the address is allocated in the target worker */
+	socklen_t sa_len;
 	int s;
 	liServerSocket *srv_sock;
 };
@@ -272,24 +327,57 @@ void li_worker_new_con(liWorker *ctx, liWorker *wrk, liSocketAddress remote_addr
 
 		li_connection_start(con, remote_addr, s, srv_sock);
 	} else {
-		li_worker_new_con_data *d = g_slice_new(li_worker_new_con_data);
-		d->remote_addr = remote_addr;
-		d->s = s;
-		d->srv_sock = srv_sock;
-		g_async_queue_push(wrk->new_con_queue, d);
-		ev_async_send(wrk->loop, &wrk->new_con_watcher);
+		li_worker_new_con_data d;
+		assert(remote_addr.len <= sizeof(d.sa));
+		memcpy(&d.sa, remote_addr.addr, remote_addr.len);
+		d.sa_len = remote_addr.len;
+		d.s = s;
+		d.srv_sock = srv_sock;
+		li_sockaddr_clear(&remote_addr);
+		if (li_mpsc_ring_push(wrk->new_con_queue, &d)) {
+			ev_async_send(wrk->loop, &wrk->new_con_watcher);
+		}
 	}
 }
 
+gboolean li_worker_new_con_push(liWorker *wrk, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock) {
+	li_worker_new_con_data d;
+
+	if (remote_addr_len > sizeof(d.sa)) return FALSE;
+
+	memcpy(&d.sa, remote_addr, remote_addr_len);
+	d.sa_len = remote_addr_len;
+	d.s = s;
+	d.srv_sock = srv_sock;
+
+	if (li_mpsc_ring_push(wrk->new_con_queue, &d)) wrk->new_con_pending = TRUE;
+
+	return TRUE;
+}
+
+void li_worker_new_con_flush(liWorker *wrk) {
+	if (!wrk->new_con_pending) return;
+
+	wrk->new_con_pending = FALSE;
+	ev_async_send(wrk->loop, &wrk->new_con_watcher);
+}
+
 static void li_worker_new_con_cb(struct ev_loop *loop, ev_async *w, int revents) {
 	liWorker *wrk = (liWorker*) w->data;
-	li_worker_new_con_data *d;
+	li_worker_new_con_data d;
 	UNUSED(loop);
 	UNUSED(revents);
 
-	while (NULL != (d = g_async_queue_try_pop(wrk->new_con_queue))) {
-		li_worker_new_con(wrk, wrk, d->remote_addr, d->s, d->srv_sock);
-		g_slice_free(li_worker_new_con_data, d);
+	li_mpsc_ring_wakeup_reset(wrk->new_con_queue);
+
+	while (li_mpsc_ring_pop(wrk->new_con_queue, &d)) {
+		liSocketAddress remote_addr;
+
+		remote_addr.len = d.sa_len;
+		remote_addr.addr = g_slice_alloc(d.sa_len);
+		memcpy(remote_addr.addr, &d.sa, d.sa_len);
+
+		li_worker_new_con(wrk, wrk, remote_addr, d.s, d.srv_sock);
 	}
 }
 
@@ -363,6 +451,8 @@ liWorker* li_worker_new(liServer *srv, struct ev_loop *loop) {
 
 	wrk->tmp_str = g_string_sized_new(255);
 
+	wrk->request_arena_stats = li_arena_stats_new("request arena");
+
 	wrk->timestamps_gmt = g_array_sized_new(FALSE, TRUE, sizeof(liWorkerTS), srv->ts_formats->len);
 	g_array_set_size(wrk->timestamps_gmt, srv->ts_formats->len);
 	{
@@ -400,10 +490,16 @@ liWorker* li_worker_new(liServer *srv, struct ev_loop *loop) {
 	wrk->worker_suspend_watcher.data = wrk;
 	ev_async_start(wrk->loop, &wrk->worker_suspend_watcher);
 
+	wrk->listen_sockets = g_ptr_array_new();
+	ev_init(&wrk->listen_watcher, li_worker_listen_cb);
+	wrk->listen_watcher.data = wrk;
+	ev_async_start(wrk->loop, &wrk->listen_watcher);
+	ev_unref(wrk->loop); /* this watcher shouldn't keep the loop alive */
+
 	ev_init(&wrk->new_con_watcher, li_worker_new_con_cb);
 	wrk->new_con_watcher.data = wrk;
 	ev_async_start(wrk->loop, &wrk->new_con_watcher);
-	wrk->new_con_queue = g_async_queue_new();
+	wrk->new_con_queue = li_mpsc_ring_new(sizeof(li_worker_new_con_data), 256);
 
 	ev_timer_init(&wrk->stats_watcher, worker_stats_watcher_cb, 1, 1);
 	wrk->stats_watcher.data = wrk;
@@ -413,7 +509,7 @@ liWorker* li_worker_new(liServer *srv, struct ev_loop *loop) {
 	ev_init(&wrk->collect_watcher, li_collect_watcher_cb);
 	wrk->collect_watcher.data = wrk;
 	ev_async_start(wrk->loop, &wrk->collect_watcher);
-	wrk->collect_queue = g_async_queue_new();
+	wrk->collect_queue = li_collect_queue_new();
 	ev_unref(wrk->loop); /* this watcher shouldn't keep the loop alive */
 
 	/* io timeout timer */
@@ -471,19 +567,33 @@ void li_worker_free(liWorker *wrk) {
 
 	li_ev_safe_ref_and_stop(ev_async_stop, wrk->loop, &wrk->worker_exit_watcher);
 
-	g_async_queue_unref(wrk->new_con_queue);
+	li_ev_safe_ref_and_stop(ev_async_stop, wrk->loop, &wrk->listen_watcher);
+	{ /* sockets are closed and released by the server */
+		guint i;
+		for (i = 0; i < wrk->listen_sockets->len; i++) {
+			liServerSocket *sock = g_ptr_array_index(wrk->listen_sockets, i);
+			ev_io_stop(wrk->loop, &sock->watcher);
+		}
+		g_ptr_array_free(wrk->listen_sockets, TRUE);
+	}
+
+	li_mpsc_ring_free(wrk->new_con_queue);
 
 	li_ev_safe_ref_and_stop(ev_timer_stop, wrk->loop, &wrk->stats_watcher);
 
 	li_ev_safe_ref_and_stop(ev_async_stop, wrk->loop, &wrk->collect_watcher);
 	li_collect_watcher_cb(wrk->loop, &wrk->collect_watcher, 0);
-	g_async_queue_unref(wrk->collect_queue);
+	li_mpsc_ring_free(wrk->collect_queue);
 
 	li_ev_safe_ref_and_stop(ev_prepare_stop, wrk->loop, &wrk->loop_prepare);
 
 	g_string_free(wrk->tmp_str, TRUE);
 
+	li_arena_stats_free(wrk->request_arena_stats);
+
 	li_stat_cache_free(wrk->stat_cache);
+	li_fd_cache_free(wrk->fd_cache);
+	li_backend_worker_free(wrk);
 
 	li_tasklet_pool_free(wrk->tasklets);
 
@@ -494,6 +604,12 @@ void li_worker_free(liWorker *wrk) {
 
 	li_buffer_release(wrk->network_read_buf);
 
+#ifdef USE_IO_URING
+	/* completions of released writes put their pipes back into network_uring */
+	li_uring_free(wrk->uring);
+	li_network_uring_free(wrk->network_uring);
+#endif
+
 	g_slice_free(liWorker, wrk);
 }
 
@@ -519,6 +635,18 @@ void li_worker_run(liWorker *wrk) {
 	if (wrk->srv->stat_cache_ttl && !wrk->stat_cache)
 		wrk->stat_cache = li_stat_cache_new(wrk, wrk->srv->stat_cache_ttl);
 
+	if (wrk->srv->fd_cache_max_open && !wrk->fd_cache)
+		wrk->fd_cache = li_fd_cache_new(wrk, wrk->srv->fd_cache_max_open);
+
+#ifdef USE_IO_URING
+	/* setup io_uring if necessary */
+	if (li_network_write_uring == wrk->srv->network_backend->write && !wrk->uring) {
+		if (NULL == (wrk->uring = li_uring_new(wrk->loop, 256))) {
+			ERROR(wrk->srv, "Couldn't setup io_uring (%s), falling back to the default network backend", g_strerror(errno));
+		}
+	}
+#endif
+
 	ev_loop(wrk->loop, 0);
 }
 
@@ -532,10 +660,19 @@ void li_worker_stop(liWorker *context, liWorker *wrk) {
 		ev_async_stop(wrk->loop, &wrk->worker_stopping_watcher);
 		ev_async_stop(wrk->loop, &wrk->worker_suspend_watcher);
 		ev_async_stop(wrk->loop, &wrk->new_con_watcher);
+		g_atomic_int_set(&wrk->listen_active, FALSE);
+		worker_listen_update(wrk);
 		li_waitqueue_stop(&wrk->io_timeout_queue);
 		li_waitqueue_stop(&wrk->throttle_queue);
-		if (wrk->stat_cache)
+		if (wrk->stat_cache) {
 			li_waitqueue_stop(&wrk->stat_cache->delete_queue);
+			li_waitqueue_stop(&wrk->stat_cache->static_headers_queue);
+		}
+		if (wrk->fd_cache) {
+			li_waitqueue_stop(&wrk->fd_cache->lru);
+			li_fd_cache_flush(wrk->fd_cache);
+		}
+		li_backend_worker_stop(wrk);
 		li_worker_new_con_cb(wrk->loop, &wrk->new_con_watcher, 0); /* handle remaining new connections */
 
 		/* close keep alive connections */
@@ -11,12 +11,26 @@
  * Actions:
  *     balance.rr <actions> - balance between actions (list or single action) with RoundRobin
  *     balance.sqf <actions> - balance between actions (list or single action) with SQF
+ *     balance.hash <actions> - select the action by a consistent hash of the url path
+ *     balance.hash <options> - same, with a hash of following parameters:
+ *         backends - (mandatory) the actions
+ *         key      - "path" (default), "host" or a pattern like "%{req.host}%{req.path}"
+ *         max_load - bounded load: a backend takes at most this percentage of its fair share of the
+ *                    running requests, the others go to the next backend for their key (default 125, 0: unbounded)
+ *
+ *     Each action may be given as (action, weight) instead, weight a number from 1 to 1000 (default 1):
+ *     rr selects it more often, sqf allows it more concurrent requests and hash maps more keys to it.
+ *
+ *     balance.hash uses jump consistent hashing: if a backend is down or full its keys are spread over the
+ *     other backends, and they return to it when it is back; the other keys keep their backend.
  *
  * Be careful: these actions may get executed more than once (until one is successful!),
  *             so don't loop rewrites in them or something similar
  *
  * Example config:
  *     balance.sqf ( ${ fastcgi "127.0.0.1:9090"; }, ${ fastcgi "127.0.0.1:9091"; } );
+ *     balance.rr ( ( ${ proxy "10.0.0.1:80"; }, 3 ), ${ proxy "10.0.0.2:80"; } );
+ *     balance.hash [ "key" => "%{req.host}%{req.path}", "backends" => ( ${ proxy "10.0.0.1:80"; }, ${ proxy "10.0.0.2:80"; } ) ];
  *
  * Author:
  *     Copyright (c) 2009-2010 Stefan Bühler
@@ -25,6 +39,7 @@
 
 #include <lighttpd/base.h>
 #include <lighttpd/plugin_core.h>
+#include <lighttpd/pattern.h>
 
 LI_API gboolean mod_balance_init(liModules *mods, liModule *mod);
 LI_API gboolean mod_balance_free(liModules *mods, liModule *mod);
@@ -43,9 +58,18 @@ typedef enum {
 
 typedef enum {
 	BM_SQF,
-	BM_ROUNDROBIN
+	BM_ROUNDROBIN,
+	BM_HASH
 } balancer_method;
 
+typedef enum {
+	BK_PATH,
+	BK_HOST,
+	BK_PATTERN
+} balancer_key;
+
+#define BALANCER_MAX_WEIGHT 1000
+
 typedef struct backend backend;
 typedef struct balancer balancer;
 typedef struct bcontext bcontext;
@@ -55,6 +79,9 @@ struct backend {
 	guint load;
 	backend_state state;
 	ev_tstamp wake;
+
+	guint weight;
+	gint current_weight; /* smooth weighted round robin */
 };
 
 struct balancer {
@@ -64,7 +91,12 @@ struct balancer {
 	GArray *backends;
 	balancer_state state;
 	balancer_method method;
-	gint next_ndx;
+
+	/* BM_HASH */
+	GArray *buckets; /* backend index per weight unit */
+	balancer_key key;
+	liPattern *key_pattern;
+	guint max_load; /* percent of the fair share, 0: unbounded */
 
 	ev_tstamp wake;
 
@@ -99,6 +131,10 @@ static balancer* balancer_new(liWorker *wrk, liPlugin *p, balancer_method method
 	b->state = BAL_ALIVE;
 	b->p = p;
 
+	b->buckets = g_array_new(FALSE, FALSE, sizeof(guint));
+	b->key = BK_PATH;
+	b->max_load = 125;
+
 	b->backlog_limit = -1;
 
 	ev_init(&b->backlog_timer, balancer_timer_cb);
@@ -125,16 +161,57 @@ static void balancer_free(liServer *srv, balancer *b) {
 		li_action_release(srv, be->act);
 	}
 	g_array_free(b->backends, TRUE);
+	g_array_free(b->buckets, TRUE);
+	if (b->key_pattern) li_pattern_free(b->key_pattern);
 	g_slice_free(balancer, b);
 }
 
-static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val) {
+static void balancer_add_backend(balancer *b, liAction *act, guint weight) {
+	backend be = { act, 0, BE_ALIVE, 0, weight, 0 };
+	guint ndx = b->backends->len, i;
+
+	li_action_acquire(be.act);
+	g_array_append_val(b->backends, be);
+
+	for (i = 0; i < weight; i++) {
+		g_array_append_val(b->buckets, ndx);
+	}
+}
+
+/* entry is an action or a list (action, weight) */
+static gboolean balancer_fill_backend(balancer *b, liServer *srv, liValue *val, guint ndx) {
+	liValue *act, *weight;
+
 	if (val->type == LI_VALUE_ACTION) {
-		backend be = { val->data.val_action.action, 0, BE_ALIVE, 0 };
 		assert(srv == val->data.val_action.srv);
-		li_action_acquire(be.act);
-		g_array_append_val(b->backends, be);
+		balancer_add_backend(b, val->data.val_action.action, 1);
 		return TRUE;
+	}
+
+	if (val->type != LI_VALUE_LIST || val->data.list->len != 2) {
+		ERROR(srv, "expected action or (action, weight) at entry %u of list, got %s", ndx, li_value_type_string(val->type));
+		return FALSE;
+	}
+
+	act = g_array_index(val->data.list, liValue*, 0);
+	weight = g_array_index(val->data.list, liValue*, 1);
+	if (act->type != LI_VALUE_ACTION || weight->type != LI_VALUE_NUMBER) {
+		ERROR(srv, "expected (action, weight) at entry %u of list", ndx);
+		return FALSE;
+	}
+	if (weight->data.number < 1 || weight->data.number > BALANCER_MAX_WEIGHT) {
+		ERROR(srv, "weight at entry %u of list has to be between 1 and %i", ndx, BALANCER_MAX_WEIGHT);
+		return FALSE;
+	}
+
+	assert(srv == act->data.val_action.srv);
+	balancer_add_backend(b, act->data.val_action.action, weight->data.number);
+	return TRUE;
+}
+
+static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val) {
+	if (val->type == LI_VALUE_ACTION) {
+		return balancer_fill_backend(b, srv, val, 0);
 	} else if (val->type == LI_VALUE_LIST) {
 		guint i;
 		if (val->data.list->len == 0) {
@@ -142,17 +219,7 @@ static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val)
 			return FALSE;
 		}
 		for (i = 0; i < val->data.list->len; i++) {
-			liValue *oa = g_array_index(val->data.list, liValue*, i);
-			if (oa->type != LI_VALUE_ACTION) {
-				ERROR(srv, "expected action at entry %u of list, got %s", i, li_value_type_string(oa->type));
-				return FALSE;
-			}
-			assert(srv == oa->data.val_action.srv);
-			{
-				backend be = { oa->data.val_action.action, 0, BE_ALIVE, 0 };
-				li_action_acquire(be.act);
-				g_array_append_val(b->backends, be);
-			}
+			if (!balancer_fill_backend(b, srv, g_array_index(val->data.list, liValue*, i), i)) return FALSE;
 		}
 		return TRUE;
 	} else {
@@ -161,6 +228,58 @@ static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val)
 	}
 }
 
+/* balance.hash options; everything else is the list of backends */
+static gboolean balancer_hash_options(balancer *b, liServer *srv, liValue *val) {
+	GHashTableIter hti;
+	gpointer hkey, hvalue;
+	liValue *backends = NULL;
+
+	if (val->type != LI_VALUE_HASH) return balancer_fill_backends(b, srv, val);
+
+	g_hash_table_iter_init(&hti, val->data.hash);
+	while (g_hash_table_iter_next(&hti, &hkey, &hvalue)) {
+		GString *htkey = hkey;
+		liValue *htval = hvalue;
+
+		if (g_str_equal(htkey->str, "backends")) {
+			backends = htval;
+		} else if (g_str_equal(htkey->str, "key")) {
+			if (htval->type != LI_VALUE_STRING) {
+				ERROR(srv, "%s", "balance.hash key expects a string as parameter");
+				return FALSE;
+			}
+			if (g_str_equal(htval->data.string->str, "path")) {
+				b->key = BK_PATH;
+			} else if (g_str_equal(htval->data.string->str, "host")) {
+				b->key = BK_HOST;
+			} else {
+				if (b->key_pattern) li_pattern_free(b->key_pattern);
+				if (NULL == (b->key_pattern = li_pattern_new(srv, htval->data.string->str))) {
+					ERROR(srv, "balance.hash: parsing key pattern '%s' failed", htval->data.string->str);
+					return FALSE;
+				}
+				b->key = BK_PATTERN;
+			}
+		} else if (g_str_equal(htkey->str, "max_load")) {
+			if (htval->type != LI_VALUE_NUMBER || (htval->data.number != 0 && htval->data.number < 100)) {
+				ERROR(srv, "%s", "balance.hash max_load expects 0 or a percentage of at least 100 as parameter");
+				return FALSE;
+			}
+			b->max_load = htval->data.number;
+		} else {
+			ERROR(srv, "unknown option for balance.hash '%s'", htkey->str);
+			return FALSE;
+		}
+	}
+
+	if (NULL == backends) {
+		ERROR(srv, "%s", "balance.hash needs a backends parameter");
+		return FALSE;
+	}
+
+	return balancer_fill_backends(b, srv, backends);
+}
+
 static void _balancer_context_backlog_unlink(balancer *b, bcontext *bc) {
 	if (NULL != bc->backlog_link.data) {
 		g_queue_unlink(&b->backlog, &bc->backlog_link);
@@ -324,15 +443,111 @@ static void _balancer_context_select_backend(balancer *b, gpointer *context, gin
 	if (bc->selected >= 0) {
 		backend *be = &g_array_index(b->backends, backend, bc->selected);
 		be->load++;
-		b->next_ndx = ndx + 1;
 	}
 }
 
+/* (a->load + 1) / a->weight < (b->load + 1) / b->weight */
+static gboolean backend_less_loaded(backend *a, backend *b) {
+	return (guint64) (a->load + 1) * b->weight < (guint64) (b->load + 1) * a->weight;
+}
+
+/* FNV-1a */
+static guint64 balancer_hash_string(const GString *str) {
+	guint64 h = G_GUINT64_CONSTANT(14695981039346656037);
+	gsize i;
+
+	for (i = 0; i < str->len; i++) {
+		h ^= (guchar) str->str[i];
+		h *= G_GUINT64_CONSTANT(1099511628211);
+	}
+
+	return h;
+}
+
+/* splitmix64 finalizer: a different, independent key for each probe */
+static guint64 balancer_hash_probe(guint64 key, guint probe) {
+	key += (guint64) probe * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+	key = (key ^ (key >> 30)) * G_GUINT64_CONSTANT(0xBF58476D1CE4E5B9);
+	key = (key ^ (key >> 27)) * G_GUINT64_CONSTANT(0x94D049BB133111EB);
+	return key ^ (key >> 31);
+}
+
+/* jump consistent hash (Lamping, Veach): only 1/n of the keys move if a bucket gets added */
+static guint balancer_jump_hash(guint64 key, guint buckets) {
+	gint64 b = -1, j = 0;
+
+	while (j < (gint64) buckets) {
+		b = j;
+		key = key * G_GUINT64_CONSTANT(2862933555777941757) + 1;
+		j = (gint64) ((b + 1) * ((gdouble) (G_GINT64_CONSTANT(1) << 31) / (gdouble) ((key >> 33) + 1)));
+	}
+
+	return b;
+}
+
+static guint64 balancer_key_hash(liVRequest *vr, balancer *b) {
+	GString *key;
+
+	switch (b->key) {
+	case BK_HOST:
+		key = vr->request.uri.host;
+		break;
+	case BK_PATTERN: {
+			GMatchInfo *match_info = NULL;
+
+			if (vr->action_stack.regex_stack->len) {
+				GArray *rs = vr->action_stack.regex_stack;
+				match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+			}
+
+			key = vr->wrk->tmp_str;
+			g_string_truncate(key, 0);
+			li_pattern_eval(vr, key, b->key_pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+		}
+		break;
+	case BK_PATH:
+	default:
+		key = vr->request.uri.path;
+		break;
+	}
+
+	return balancer_hash_string(key);
+}
+
+/* the first backend in the probe sequence of the key that is alive and below its bounded load;
+ * if all are down or full the least loaded alive one
+ */
+static gint _balancer_hash_select(balancer *b, guint64 key, guint total_load, guint total_weight) {
+	guint probe, i;
+	gint be_ndx = -1;
+	backend *be;
+
+	for (probe = 0; probe < b->buckets->len; probe++) {
+		guint ndx = g_array_index(b->buckets, guint, balancer_jump_hash(balancer_hash_probe(key, probe), b->buckets->len));
+		be = &g_array_index(b->backends, backend, ndx);
+
+		if (be->state != BE_ALIVE) continue;
+		if (0 == b->max_load) return ndx;
+
+		/* capacity: max_load percent of the weighted share of all running requests including this one, rounded up */
+		if ((guint64) be->load * total_weight * 100 < (guint64) (total_load + 1) * be->weight * b->max_load) return ndx;
+	}
+
+	for (i = 0; i < b->backends->len; i++) {
+		be = &g_array_index(b->backends, backend, i);
+		if (be->state != BE_ALIVE) continue;
+		if (-1 == be_ndx || backend_less_loaded(be, &g_array_index(b->backends, backend, be_ndx))) be_ndx = i;
+	}
+
+	return be_ndx;
+}
+
 static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_provided, gpointer param, gpointer *context) {
 	balancer *b = param;
 	bcontext *bc = *context;
-	gint be_ndx, load;
-	guint i, j;
+	gint be_ndx, total;
+	guint i, total_load, total_weight;
+	guint64 key = 0;
 	backend *be;
 	ev_tstamp now = ev_now(vr->wrk->loop);
 	gboolean all_dead = TRUE;
@@ -340,6 +555,8 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 
 	be_ndx = -1;
 
+	if (b->method == BM_HASH) key = balancer_key_hash(vr, b);
+
 	g_mutex_lock(b->lock);
 
 	if (b->state != BAL_ALIVE && backlog_provided) {
@@ -376,8 +593,6 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 
 	switch (b->method) {
 	case BM_SQF:
-		load = -1;
-
 		for (i = 0; i < b->backends->len; i++) {
 			be = &g_array_index(b->backends, backend, i);
 
@@ -385,25 +600,45 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 			if (be->state != BE_DOWN) all_dead = FALSE;
 			if (be->state != BE_ALIVE) continue;
 
-			if (load == -1 || load > (gint) be->load) {
+			/* lowest load relative to the weight */
+			if (be_ndx == -1 || backend_less_loaded(be, &g_array_index(b->backends, backend, be_ndx))) {
 				be_ndx = i;
-				load = be->load;
 			}
 		}
 
 		break;
 	case BM_ROUNDROBIN:
-		for (j = 0; j < b->backends->len; j++) {
-			i = (b->next_ndx + j) % b->backends->len;
+		/* smooth weighted round robin; with equal weights the alive backends take turns */
+		total = 0;
+		for (i = 0; i < b->backends->len; i++) {
+			be = &g_array_index(b->backends, backend, i);
+
+			if (now >= be->wake) be->state = BE_ALIVE;
+			if (be->state != BE_DOWN) all_dead = FALSE;
+			if (be->state != BE_ALIVE) continue;
+
+			be->current_weight += be->weight;
+			total += be->weight;
+			if (be_ndx == -1 || be->current_weight > g_array_index(b->backends, backend, be_ndx).current_weight) {
+				be_ndx = i;
+			}
+		}
+		if (be_ndx != -1) g_array_index(b->backends, backend, be_ndx).current_weight -= total;
+
+		break;
+	case BM_HASH:
+		total_load = total_weight = 0;
+		for (i = 0; i < b->backends->len; i++) {
 			be = &g_array_index(b->backends, backend, i);
 
 			if (now >= be->wake) be->state = BE_ALIVE;
 			if (be->state != BE_DOWN) all_dead = FALSE;
 			if (be->state != BE_ALIVE) continue;
 
-			be_ndx = i;
-			break; /* use first alive backend */
+			total_load += be->load;
+			total_weight += be->weight;
 		}
+		if (total_weight > 0) be_ndx = _balancer_hash_select(b, key, total_load, total_weight);
 
 		break;
 	}
@@ -534,7 +769,7 @@ static liAction* balancer_create(liServer *srv, liWorker *wrk, liPlugin* p, liVa
 
 	/* userdata contains the method */
 	b = balancer_new(wrk, p, GPOINTER_TO_INT(userdata));
-	if (!balancer_fill_backends(b, srv, val)) {
+	if (!(b->method == BM_HASH ? balancer_hash_options(b, srv, val) : balancer_fill_backends(b, srv, val))) {
 		balancer_free(srv, b);
 		return NULL;
 	}
@@ -551,6 +786,7 @@ static const liPluginOption options[] = {
 static const liPluginAction actions[] = {
 	{ "balance.rr", balancer_create, GINT_TO_POINTER(BM_ROUNDROBIN) },
 	{ "balance.sqf", balancer_create, GINT_TO_POINTER(BM_SQF) },
+	{ "balance.hash", balancer_create, GINT_TO_POINTER(BM_HASH) },
 	{ NULL, NULL, NULL }
 };
 
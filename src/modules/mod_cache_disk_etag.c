@@ -163,7 +163,12 @@ static liHandlerResult cache_etag_filter_miss(liVRequest *vr, liFilter *f) {
 		return LI_HANDLER_GO_ON;
 	}
 
-	if (LI_HANDLER_GO_ON != li_chunkiter_read(vr, citer, 0, 64*1024, &buf, &buflen)) {
+	switch (li_chunkiter_read_async(vr, citer, 0, 64*1024, &buf, &buflen)) {
+	case LI_HANDLER_GO_ON:
+		break;
+	case LI_HANDLER_WAIT_FOR_EVENT:
+		return LI_HANDLER_WAIT_FOR_EVENT;
+	default:
 		VR_ERROR(vr, "%s", "Couldn't read data from chunkqueue");
 		cache_etag_file_free(cfile);
 		f->param = NULL;
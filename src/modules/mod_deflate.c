@@ -222,7 +222,7 @@ static liHandlerResult deflate_filter_zlib(liVRequest *vr, liFilter *f) {
 
 		ci = li_chunkqueue_iter(f->in);
 
-		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(vr, ci, 0, blocksize, &data, &len)))
+		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read_async(vr, ci, 0, blocksize, &data, &len)))
 			return res;
 
 		if (ctx->is_gzip) {
@@ -411,7 +411,7 @@ static liHandlerResult deflate_filter_bzip2(liVRequest *vr, liFilter *f) {
 
 		ci = li_chunkqueue_iter(f->in);
 
-		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(vr, ci, 0, blocksize, &data, &len)))
+		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read_async(vr, ci, 0, blocksize, &data, &len)))
 			return res;
 
 		bz->next_in = data;
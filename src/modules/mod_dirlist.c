@@ -6,7 +6,8 @@
  *     The output can be customized in various ways from style via css to excluding certain entries.
  *
  * Setups:
- *     none
+ *     dirlist.cache_size bytes - memory per worker for rendered listings, 0 disables the cache, default: 4 MiB
+ *         a listing is rendered again when the directory is stat()ed again (see stat_cache.ttl)
  * Options:
  *     none
  * Actions:
@@ -43,7 +44,6 @@
  *     xyz
  *
  * Todo:
- *     - make output generating "async", give up control every N entries
  *     - filters for entries (pattern, regex)
  *     - include-* parameters
  *     - javascript for sorting
@@ -238,60 +238,62 @@ struct dirlist_data {
 };
 typedef struct dirlist_data dirlist_data;
 
+/* rendered listings, per worker; an entry is valid as long as the stat cache entry it was rendered from */
+typedef struct dirlist_cache_entry dirlist_cache_entry;
+struct dirlist_cache_entry {
+	GString *key;                     /* action, physical path and url path */
+	guint64 sce_id;
+	gconstpointer mime_types, server_tag;
+	liBuffer *buf;
+	GList lru_link;
+};
+
+typedef struct dirlist_cache dirlist_cache;
+struct dirlist_cache {
+	GHashTable *entries;              /* key -> dirlist_cache_entry */
+	GQueue lru;                       /* least recently used first */
+	gsize size;
+};
+
 struct dirlist_plugin_data {
-	void *unused;
+	gsize cache_size;                 /* max bytes per worker, dirlist.cache_size setup; 0 disables the cache */
+	dirlist_cache *caches;            /* one per worker */
+	guint worker_count;
 };
 typedef struct dirlist_plugin_data dirlist_plugin_data;
 
+#define DIRLIST_CACHE_DEFAULT_SIZE (4*1024*1024)
+
 /** uses/modifies wrk->tmp_str */
-static void try_append_file(liVRequest *vr, GString **curbuf, const gchar *filename, gboolean encode_html) {
+static void try_append_file(liVRequest *vr, GString *buf, const gchar *filename, gboolean encode_html) {
 	GString *f = vr->wrk->tmp_str;
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+
 	g_string_truncate(f, 0);
 	g_string_append_len(f, GSTR_LEN(vr->physical.path));
 	li_path_append_slash(f);
 	g_string_append(f, filename);
 
-	if (!encode_html) {
-		int fd;
-		struct stat st;
-
-		while (-1 == (fd = open(f->str, O_RDONLY))) {
-			if (errno == EINTR)
-				continue;
-			return; /* failed to open, ignore */
-		}
-		if (-1 == fstat(fd, &st)) {
-			close(fd);
-			return; /* failed to open, ignore */
-		}
-		if (st.st_size > MAX_INCLUDE_FILE_SIZE) {
-			close(fd);
-			return; /* file too big, ignore */
-		}
+	/* read into the listing even if it isn't encoded, so the listing can be cached as a whole */
+	if (!g_file_get_contents(f->str, &contents, &length, &error)) {
+		g_error_free(error);
+		return; /* ignore errors */
+	}
+	if (length > MAX_INCLUDE_FILE_SIZE) {
+		g_free(contents);
+		return; /* file too big, ignore */
+	}
 
-		/* flush current buffer and append file */
-		li_chunkqueue_append_string(vr->out, *curbuf);
-		*curbuf = g_string_sized_new(4*1024-1);
-		li_chunkqueue_append_file_fd(vr->out, NULL, 0, st.st_size, fd);
+	if (encode_html) {
+		g_string_append_len(buf, CONST_STR_LEN("<pre>"));
+		li_string_encode_append(contents, buf, LI_ENCODING_HTML);
+		g_string_append_len(buf, CONST_STR_LEN("</pre>"));
 	} else {
-		GError *error = NULL;
-		gchar *contents;
-		gsize length;
-
-		if (!g_file_get_contents(f->str, &contents, &length, &error)) {
-			g_error_free(error);
-			return; /* ignore errors */
-		}
-		if (length > MAX_INCLUDE_FILE_SIZE) {
-			g_free(contents);
-			return; /* file too big, ignore */
-		}
-
-		g_string_append_len(*curbuf, CONST_STR_LEN("<pre>"));
-		li_string_encode_append(contents, *curbuf, LI_ENCODING_HTML);
-		g_string_append_len(*curbuf, CONST_STR_LEN("</pre>"));
-		g_free(contents);
+		g_string_append_len(buf, contents, length);
 	}
+	g_free(contents);
 }
 
 static void dirlist_format_size(gchar *buf, goffset size) {
@@ -334,12 +336,239 @@ static void dirlist_format_size(gchar *buf, goffset size) {
 	*buf = '\0';
 }
 
+static void dirlist_cache_entry_free(gpointer data) {
+	dirlist_cache_entry *dce = data;
+
+	li_buffer_release(dce->buf);
+	g_string_free(dce->key, TRUE);
+	g_slice_free(dirlist_cache_entry, dce);
+}
+
+static void dirlist_cache_remove(dirlist_cache *dc, dirlist_cache_entry *dce) {
+	g_queue_unlink(&dc->lru, &dce->lru_link);
+	dc->size -= dce->buf->used;
+	g_hash_table_remove(dc->entries, dce->key); /* frees dce */
+}
+
+static void dirlist_cache_key(liVRequest *vr, dirlist_data *dd, GString *key) {
+	/* the action instance stands for the dirlist options */
+	g_string_truncate(key, 0);
+	g_string_append_len(key, (const gchar*) &dd, sizeof(dd));
+	g_string_append_len(key, GSTR_LEN(vr->physical.path));
+	g_string_append_len(key, "", 1);
+	g_string_append_len(key, GSTR_LEN(vr->request.uri.path));
+}
+
+/** uses/modifies wrk->tmp_str; returns a new reference */
+static liBuffer* dirlist_cache_get(liVRequest *vr, dirlist_data *dd, liStatCacheEntry *sce) {
+	dirlist_plugin_data *pd = dd->plugin->data;
+	dirlist_cache *dc;
+	dirlist_cache_entry *dce;
+
+	if (NULL == pd->caches) return NULL;
+	dc = &pd->caches[vr->wrk->ndx];
+
+	dirlist_cache_key(vr, dd, vr->wrk->tmp_str);
+	if (NULL == (dce = g_hash_table_lookup(dc->entries, vr->wrk->tmp_str))) return NULL;
+
+	if (dce->sce_id != sce->id || dce->mime_types != CORE_OPTIONPTR(LI_CORE_OPTION_MIME_TYPES).ptr
+		|| dce->server_tag != CORE_OPTIONPTR(LI_CORE_OPTION_SERVER_TAG).string) {
+		/* directory was stat()ed again or other options */
+		dirlist_cache_remove(dc, dce);
+		return NULL;
+	}
+
+	g_queue_unlink(&dc->lru, &dce->lru_link);
+	g_queue_push_tail_link(&dc->lru, &dce->lru_link);
+
+	li_buffer_acquire(dce->buf);
+	return dce->buf;
+}
+
+/* takes a reference of buf */
+static void dirlist_cache_insert(liVRequest *vr, dirlist_data *dd, liStatCacheEntry *sce, liBuffer *buf) {
+	dirlist_plugin_data *pd = dd->plugin->data;
+	dirlist_cache *dc = &pd->caches[vr->wrk->ndx];
+	dirlist_cache_entry *dce;
+	GString *key = g_string_sized_new(sizeof(dd) + vr->physical.path->len + vr->request.uri.path->len + 1);
+
+	dirlist_cache_key(vr, dd, key);
+	if (NULL != (dce = g_hash_table_lookup(dc->entries, key))) {
+		dirlist_cache_remove(dc, dce);
+	}
+
+	while (dc->size + buf->used > pd->cache_size) {
+		dirlist_cache_remove(dc, g_queue_peek_head(&dc->lru));
+	}
+
+	dce = g_slice_new0(dirlist_cache_entry);
+	dce->key = key;
+	dce->sce_id = sce->id;
+	dce->mime_types = CORE_OPTIONPTR(LI_CORE_OPTION_MIME_TYPES).ptr;
+	dce->server_tag = CORE_OPTIONPTR(LI_CORE_OPTION_SERVER_TAG).string;
+	dce->buf = buf;
+	dce->lru_link.data = dce;
+
+	g_hash_table_insert(dc->entries, dce->key, dce);
+	g_queue_push_tail_link(&dc->lru, &dce->lru_link);
+	dc->size += buf->used;
+}
+
+/* rows are rendered as soon as the stat cache has the entries, see li_stat_cache_get_dirlist */
+typedef struct dirlist_context dirlist_context;
+struct dirlist_context {
+	liStatCacheEntry *sce;            /* the entry the rows belong to */
+	guint pos;                        /* dirlist entries before pos are rendered */
+	GString *directories, *files;     /* rendered table rows */
+};
+
+static dirlist_context* dirlist_context_get(gpointer *context, liStatCacheEntry *sce) {
+	dirlist_context *ctx = *context;
+
+	if (NULL == ctx) {
+		ctx = g_slice_new0(dirlist_context);
+		ctx->directories = g_string_sized_new(1024-1);
+		ctx->files = g_string_sized_new(4*1024-1);
+		*context = ctx;
+	} else if (ctx->sce != sce) {
+		/* the stat cache entry got replaced while we were waiting */
+		ctx->pos = 0;
+		g_string_truncate(ctx->directories, 0);
+		g_string_truncate(ctx->files, 0);
+	}
+
+	ctx->sce = sce;
+	return ctx;
+}
+
+static void dirlist_context_free(dirlist_context *ctx) {
+	if (!ctx) return;
+
+	if (ctx->directories) g_string_free(ctx->directories, TRUE);
+	if (ctx->files) g_string_free(ctx->files, TRUE);
+	g_slice_free(dirlist_context, ctx);
+}
+
+/* renders the rows for the dirlist entries [ctx->pos, end) */
+static void dirlist_render_rows(liVRequest *vr, dirlist_data *dd, dirlist_context *ctx, guint end) {
+	liStatCacheEntry *sce = ctx->sce;
+	liStatCacheEntryData *sced;
+	const GString *mime_str;
+	GString *encoded;
+	gchar sizebuf[sizeof("999.9K")+1];
+	gchar datebuf[sizeof("2005-Jan-01 22:23:24")+1];
+	guint datebuflen;
+	struct tm tm;
+	gboolean hide;
+	guint i, j;
+
+	/* temporary string for encoded names */
+	encoded = g_string_sized_new(64-1);
+
+	for (i = ctx->pos; i < end; i++) {
+		sced = &g_array_index(sce->dirlist, liStatCacheEntryData, i);
+		hide = FALSE;
+
+		/* ingore entries where the stat() failed */
+		if (sced->failed)
+			continue;
+
+		if (dd->hide_dotfiles && sced->path->str[0] == '.')
+			continue;
+
+		if (dd->hide_tildefiles && sced->path->str[sced->path->len-1] == '~')
+			continue;
+
+		for (j = 0; j < dd->exclude_suffix->len; j++) {
+			if (li_string_suffix(sced->path, GSTR_LEN((GString*)g_ptr_array_index(dd->exclude_suffix, j)))) {
+				hide = TRUE;
+				break;
+			}
+		}
+
+		if (hide)
+			continue;
+
+		for (j = 0; j < dd->exclude_prefix->len; j++) {
+			if (li_string_prefix(sced->path, GSTR_LEN((GString*)g_ptr_array_index(dd->exclude_prefix, j)))) {
+				hide = TRUE;
+				break;
+			}
+		}
+
+		if (hide)
+			continue;
+
+		localtime_r(&(sced->st.st_mtime), &tm);
+		datebuflen = strftime(datebuf, sizeof(datebuf), "%Y-%b-%d %H:%M:%S", &tm);
+		datebuf[datebuflen] = '\0';
+
+		if (S_ISDIR(sced->st.st_mode)) {
+			GString *listing = ctx->directories;
+
+			if (dd->hide_directories) continue;
+
+			g_string_append_len(listing, CONST_STR_LEN("				<tr group=\"1\"><td><a href=\""));
+			li_string_encode(sced->path->str, encoded, LI_ENCODING_URI);
+			g_string_append_len(listing, GSTR_LEN(encoded));
+			g_string_append_len(listing, CONST_STR_LEN("/\">"));
+			li_string_encode(sced->path->str, encoded, LI_ENCODING_HTML);
+			g_string_append_len(listing, GSTR_LEN(encoded));
+			g_string_append_len(listing, CONST_STR_LEN("</a></td><td class=\"modified\" val=\""));
+			li_string_append_int(listing, sced->st.st_mtime);
+			g_string_append_len(listing, CONST_STR_LEN("\">"));
+			g_string_append_len(listing, datebuf, datebuflen);
+			g_string_append_len(listing, CONST_STR_LEN("</td>"
+				"<td class=\"size\" val=\"0\">-</td>"
+				"<td class=\"type\">Directory</td></tr>\n"));
+		} else {
+			GString *listing = ctx->files;
+
+			if ((dd->include_header || dd->hide_header) && g_str_equal(sced->path, "HEADER.txt")) {
+				if (dd->hide_header) continue;
+			} else if ((dd->include_readme || dd->hide_readme) && g_str_equal(sced->path, "README.txt")) {
+				if (dd->hide_readme) continue;
+			}
+
+			mime_str = li_mimetype_get(vr, sced->path);
+
+			dirlist_format_size(sizebuf, sced->st.st_size);
+
+			g_string_append_len(listing, CONST_STR_LEN("				<tr group=\"2\"><td><a href=\""));
+			li_string_encode(sced->path->str, encoded, LI_ENCODING_URI);
+			g_string_append_len(listing, GSTR_LEN(encoded));
+			g_string_append_len(listing, CONST_STR_LEN("\">"));
+			li_string_encode(sced->path->str, encoded, LI_ENCODING_HTML);
+			g_string_append_len(listing, GSTR_LEN(encoded));
+			g_string_append_len(listing, CONST_STR_LEN(
+				"</a></td>"
+				"<td class=\"modified\" val=\""));
+			li_string_append_int(listing, sced->st.st_mtime);
+			g_string_append_len(listing, CONST_STR_LEN("\">"));
+			g_string_append_len(listing, datebuf, datebuflen);
+			g_string_append_len(listing, CONST_STR_LEN("</td><td class=\"size\" val=\""));
+			li_string_append_int(listing, sced->st.st_size);
+			g_string_append_len(listing, CONST_STR_LEN("\">"));
+			g_string_append(listing, sizebuf);
+			g_string_append_len(listing, CONST_STR_LEN("</td><td class=\"type\">"));
+			if (mime_str) {
+				g_string_append_len(listing, GSTR_LEN(mime_str));
+			} else {
+				g_string_append_len(listing, CONST_STR_LEN("application/octet-stream"));
+			}
+			g_string_append_len(listing, CONST_STR_LEN("</td></tr>\n"));
+		}
+	}
+
+	g_string_free(encoded, TRUE);
+	ctx->pos = end;
+}
+
 static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context) {
-	GString *listing;
-	liStatCacheEntry *sce;
+	GString *listing, *listing_end;
+	liStatCacheEntry *sce = NULL;
 	dirlist_data *dd;
-
-	UNUSED(context);
+	dirlist_context *ctx;
 
 	switch (vr->request.http_method) {
 	case LI_HTTP_METHOD_GET:
@@ -353,14 +582,21 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 
 	if (vr->physical.path->len == 0) return LI_HANDLER_GO_ON;
 
+	dd = param;
+
 	switch (li_stat_cache_get_dirlist(vr, vr->physical.path, &sce)) {
 	case LI_HANDLER_GO_ON: break;
-	case LI_HANDLER_WAIT_FOR_EVENT: return LI_HANDLER_WAIT_FOR_EVENT;
+	case LI_HANDLER_WAIT_FOR_EVENT:
+		/* render what we have already; a redirect gets no rows */
+		if (NULL != sce && sce->dirlist_ready > 0 && S_ISDIR(sce->data.st.st_mode)
+			&& vr->request.uri.path->len > 0 && vr->request.uri.path->str[vr->request.uri.path->len-1] == '/') {
+			ctx = dirlist_context_get(context, sce);
+			if (ctx->pos < sce->dirlist_ready) dirlist_render_rows(vr, dd, ctx, sce->dirlist_ready);
+		}
+		return LI_HANDLER_WAIT_FOR_EVENT;
 	default: return LI_HANDLER_ERROR;
 	}
 
-	dd = param;
-
 	if (sce->data.failed) {
 		/* stat failed */
 		int e = sce->data.err;
@@ -388,16 +624,10 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 		return LI_HANDLER_GO_ON;
 	} else {
 		/* everything ok, we have the directory listing */
+		dirlist_plugin_data *pd = dd->plugin->data;
 		gboolean cachable;
-		guint i, j;
-		liStatCacheEntryData *sced;
-		GString *mime_str, *encoded;
-		GArray *directories, *files;
-		gchar sizebuf[sizeof("999.9K")+1];
-		gchar datebuf[sizeof("2005-Jan-01 22:23:24")+1];
-		guint datebuflen;
-		struct tm tm;
-		gboolean hide;
+		liBuffer *buf;
+		gsize len;
 
 		if (!li_vrequest_handle_direct(vr)) {
 			li_stat_cache_entry_release(vr, sce);
@@ -416,59 +646,18 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 			return LI_HANDLER_GO_ON;
 		}
 
-		/* temporary string for encoded names */
-		encoded = g_string_sized_new(64-1);
-
-		/* seperate directories from other files */
-		directories = g_array_sized_new(FALSE, FALSE, sizeof(guint), 16);
-		files = g_array_sized_new(FALSE, FALSE, sizeof(guint), sce->dirlist->len);
-		for (i = 0; i < sce->dirlist->len; i++) {
-			sced = &g_array_index(sce->dirlist, liStatCacheEntryData, i);
-			hide = FALSE;
-
-			/* ingore entries where the stat() failed */
-			if (sced->failed)
-				continue;
-
-			if (dd->hide_dotfiles && sced->path->str[0] == '.')
-				continue;
-
-			if (dd->hide_tildefiles && sced->path->str[sced->path->len-1] == '~')
-				continue;
-
-			for (j = 0; j < dd->exclude_suffix->len; j++) {
-				if (li_string_suffix(sced->path, GSTR_LEN((GString*)g_ptr_array_index(dd->exclude_suffix, j)))) {
-					hide = TRUE;
-					break;
-				}
-			}
-
-			if (hide)
-				continue;
+		if (NULL != (buf = dirlist_cache_get(vr, dd, sce))) {
+			if (dd->debug)
+				VR_DEBUG(vr, "dirlist for \"%s\" from cache", sce->data.path->str);
 
-			for (j = 0; j < dd->exclude_prefix->len; j++) {
-				if (li_string_prefix(sced->path, GSTR_LEN((GString*)g_ptr_array_index(dd->exclude_prefix, j)))) {
-					hide = TRUE;
-					break;
-				}
-			}
-
-			if (hide)
-				continue;
-
-			if (S_ISDIR(sced->st.st_mode)) {
-				if (dd->hide_directories) continue;
-				g_array_append_val(directories, i);
-			} else {
-				if ((dd->include_header || dd->hide_header) && g_str_equal(sced->path, "HEADER.txt")) {
-					if (dd->hide_header) continue;
-				} else if ((dd->include_readme || dd->hide_readme) && g_str_equal(sced->path, "README.txt")) {
-					if (dd->hide_readme) continue;
-				}
-				g_array_append_val(files, i);
-			}
+			li_chunkqueue_append_buffer(vr->out, buf);
+			li_stat_cache_entry_release(vr, sce);
+			return LI_HANDLER_GO_ON;
 		}
 
+		ctx = dirlist_context_get(context, sce);
+		dirlist_render_rows(vr, dd, ctx, sce->dirlist->len);
+
 		listing = g_string_sized_new(4*1024-1);
 		g_string_append_printf(listing, html_header_start, vr->request.uri.path->str);
 
@@ -483,7 +672,7 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 		}
 		g_string_append_len(listing, CONST_STR_LEN(html_header_end));
 
-		try_append_file(vr, &listing, "HEADER.txt", dd->encode_header);
+		try_append_file(vr, listing, "HEADER.txt", dd->encode_header);
 
 		g_string_append_printf(listing, html_table_start, vr->request.uri.path->str);
 
@@ -492,91 +681,47 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 				"Parent Directory", (gint64)0, "", (gint64)0, "-", "Directory");
 		}
 
-		/* list directories */
-		if (!dd->hide_directories) {
-			for (i = 0; i < directories->len; i++) {
-				sced = &g_array_index(sce->dirlist, liStatCacheEntryData, g_array_index(directories, guint, i));
-
-				localtime_r(&(sced->st.st_mtime), &tm);
-				datebuflen = strftime(datebuf, sizeof(datebuf), "%Y-%b-%d %H:%M:%S", &tm);
-				datebuf[datebuflen] = '\0';
-
-				g_string_append_len(listing, CONST_STR_LEN("				<tr group=\"1\"><td><a href=\""));
-				li_string_encode(sced->path->str, encoded, LI_ENCODING_URI);
-				g_string_append_len(listing, GSTR_LEN(encoded));
-				g_string_append_len(listing, CONST_STR_LEN("/\">"));
-				li_string_encode(sced->path->str, encoded, LI_ENCODING_HTML);
-				g_string_append_len(listing, GSTR_LEN(encoded));
-				g_string_append_len(listing, CONST_STR_LEN("</a></td><td class=\"modified\" val=\""));
-				li_string_append_int(listing, sced->st.st_mtime);
-				g_string_append_len(listing, CONST_STR_LEN("\">"));
-				g_string_append_len(listing, datebuf, datebuflen);
-				g_string_append_len(listing, CONST_STR_LEN("</td>"
-					"<td class=\"size\" val=\"0\">-</td>"
-					"<td class=\"type\">Directory</td></tr>\n"));
-			}
-		}
-
-		/*g_string_append_len(listing, CONST_STR_LEN("<tr><td colspan=\"4\">&nbsp;</td></tr>\n"));*/
-
-		/* list files */
-		for (i = 0; i < files->len; i++) {
-			sced = &g_array_index(sce->dirlist, liStatCacheEntryData, g_array_index(files, guint, i));
-			mime_str = li_mimetype_get(vr, sced->path);
-
-			localtime_r(&(sced->st.st_mtime), &tm);
-			datebuflen = strftime(datebuf, sizeof(datebuf), "%Y-%b-%d %H:%M:%S", &tm);
-			datebuf[datebuflen] = '\0';
+		listing_end = g_string_sized_new(4*1024-1);
+		g_string_append_len(listing_end, CONST_STR_LEN(html_table_end));
 
-			dirlist_format_size(sizebuf, sced->st.st_size);
-
-			g_string_append_len(listing, CONST_STR_LEN("				<tr group=\"2\"><td><a href=\""));
-			li_string_encode(sced->path->str, encoded, LI_ENCODING_URI);
-			g_string_append_len(listing, GSTR_LEN(encoded));
-			g_string_append_len(listing, CONST_STR_LEN("\">"));
-			li_string_encode(sced->path->str, encoded, LI_ENCODING_HTML);
-			g_string_append_len(listing, GSTR_LEN(encoded));
-			g_string_append_len(listing, CONST_STR_LEN(
-				"</a></td>"
-				"<td class=\"modified\" val=\""));
-			li_string_append_int(listing, sced->st.st_mtime);
-			g_string_append_len(listing, CONST_STR_LEN("\">"));
-			g_string_append_len(listing, datebuf, datebuflen);
-			g_string_append_len(listing, CONST_STR_LEN("</td><td class=\"size\" val=\""));
-			li_string_append_int(listing, sced->st.st_size);
-			g_string_append_len(listing, CONST_STR_LEN("\">"));
-			g_string_append(listing, sizebuf);
-			g_string_append_len(listing, CONST_STR_LEN("</td><td class=\"type\">"));
-			if (mime_str) {
-				g_string_append_len(listing, GSTR_LEN(mime_str));
-			} else {
-				g_string_append_len(listing, CONST_STR_LEN("application/octet-stream"));
-			}
-			g_string_append_len(listing, CONST_STR_LEN("</td></tr>\n"));
-
-			/*
-			g_string_append_printf(listing, html_table_row,
-				sced->path->str, sced->path->str,
-				(gint64)sced->st.st_mtime, datebuf,
-				sced->st.st_size, sizebuf,
-				mime_str ? mime_str->str : "application/octet-stream");
-			*/
-		}
-
-		g_string_append_len(listing, CONST_STR_LEN(html_table_end));
-
-		try_append_file(vr, &listing, "README.txt", dd->encode_readme);
+		try_append_file(vr, listing_end, "README.txt", dd->encode_readme);
 
 		if (dd->include_sort) {
-			g_string_append_len(listing, CONST_STR_LEN(javascript_sort));
+			g_string_append_len(listing_end, CONST_STR_LEN(javascript_sort));
 		}
 
-		g_string_append_printf(listing, html_footer, CORE_OPTIONPTR(LI_CORE_OPTION_SERVER_TAG).string->str);
+		g_string_append_printf(listing_end, html_footer, CORE_OPTIONPTR(LI_CORE_OPTION_SERVER_TAG).string->str);
+
+		/* directories first, then the other files */
+		len = listing->len + ctx->directories->len + ctx->files->len + listing_end->len;
+		if (NULL != pd->caches && len <= pd->cache_size) {
+			buf = li_buffer_new_slice(len);
+			memcpy(buf->addr, listing->str, listing->len);
+			buf->used = listing->len;
+			memcpy(buf->addr + buf->used, ctx->directories->str, ctx->directories->len);
+			buf->used += ctx->directories->len;
+			memcpy(buf->addr + buf->used, ctx->files->str, ctx->files->len);
+			buf->used += ctx->files->len;
+			memcpy(buf->addr + buf->used, listing_end->str, listing_end->len);
+			buf->used += listing_end->len;
+
+			g_string_free(listing, TRUE);
+			g_string_free(listing_end, TRUE);
+
+			li_buffer_acquire(buf);
+			dirlist_cache_insert(vr, dd, sce, buf);
+			li_chunkqueue_append_buffer(vr->out, buf);
+		} else {
+			/* the row strings are handed over to the chunkqueue */
+			li_chunkqueue_append_string(vr->out, listing);
+			li_chunkqueue_append_string(vr->out, ctx->directories);
+			li_chunkqueue_append_string(vr->out, ctx->files);
+			li_chunkqueue_append_string(vr->out, listing_end);
+			ctx->directories = ctx->files = NULL;
+		}
 
-		li_chunkqueue_append_string(vr->out, listing);
-		g_string_free(encoded, TRUE);
-		g_array_free(directories, TRUE);
-		g_array_free(files, TRUE);
+		dirlist_context_free(ctx);
+		*context = NULL;
 	}
 
 	li_stat_cache_entry_release(vr, sce);
@@ -584,6 +729,15 @@ static liHandlerResult dirlist(liVRequest *vr, gpointer param, gpointer *context
 	return LI_HANDLER_GO_ON;
 }
 
+static liHandlerResult dirlist_cleanup(liVRequest *vr, gpointer param, gpointer context) {
+	UNUSED(vr);
+	UNUSED(param);
+
+	dirlist_context_free(context);
+
+	return LI_HANDLER_GO_ON;
+}
+
 static void dirlist_free(liServer *srv, gpointer param) {
 	guint i;
 	dirlist_data *data = param;
@@ -774,7 +928,7 @@ static liAction* dirlist_create(liServer *srv, liWorker *wrk, liPlugin* p, liVal
 		}
 	}
 
-	return li_action_new_function(dirlist, NULL, dirlist_free, data);
+	return li_action_new_function(dirlist, dirlist_cleanup, dirlist_free, data);
 }
 
 static const liPluginOption options[] = {
@@ -789,10 +943,40 @@ static const liPluginAction actions[] = {
 	{ NULL, NULL, NULL }
 };
 
+static gboolean dirlist_cache_size(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	dirlist_plugin_data *pd = p->data;
+	UNUSED(userdata);
+
+	if (!val || val->type != LI_VALUE_NUMBER || val->data.number < 0) {
+		ERROR(srv, "%s", "dirlist.cache_size expects a positive number as parameter");
+		return FALSE;
+	}
+
+	pd->cache_size = val->data.number;
+
+	return TRUE;
+}
+
 static const liPluginSetup setups[] = {
+	{ "dirlist.cache_size", dirlist_cache_size, NULL },
+
 	{ NULL, NULL, NULL }
 };
 
+static void dirlist_prepare(liServer *srv, liPlugin *p) {
+	dirlist_plugin_data *pd = p->data;
+	guint i;
+
+	if (0 == pd->cache_size) return;
+
+	pd->worker_count = srv->worker_count;
+	pd->caches = g_slice_alloc0(sizeof(dirlist_cache) * pd->worker_count);
+	for (i = 0; i < pd->worker_count; i++) {
+		pd->caches[i].entries = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, NULL, dirlist_cache_entry_free);
+		g_queue_init(&pd->caches[i].lru);
+	}
+}
+
 
 static void plugin_dirlist_free(liServer *srv, liPlugin *p) {
 	dirlist_plugin_data *pd;
@@ -800,6 +984,16 @@ static void plugin_dirlist_free(liServer *srv, liPlugin *p) {
 	UNUSED(srv);
 
 	pd = p->data;
+
+	if (NULL != pd->caches) {
+		guint i;
+
+		for (i = 0; i < pd->worker_count; i++) {
+			g_hash_table_destroy(pd->caches[i].entries);
+		}
+		g_slice_free1(sizeof(dirlist_cache) * pd->worker_count, pd->caches);
+	}
+
 	g_slice_free(dirlist_plugin_data, pd);
 }
 
@@ -813,8 +1007,10 @@ static void plugin_dirlist_init(liServer *srv, liPlugin *p, gpointer userdata) {
 	p->actions = actions;
 	p->setups = setups;
 	p->free = plugin_dirlist_free;
+	p->handle_prepare = dirlist_prepare;
 
 	pd = g_slice_new0(dirlist_plugin_data);
+	pd->cache_size = DIRLIST_CACHE_DEFAULT_SIZE;
 	p->data = pd;
 }
 
@@ -13,12 +13,25 @@
  * Actions:
  *     fastcgi <socket>  - connect to backend at <socket>
  *         socket: string, either "ip:port" or "unix:/path"
+ *     fastcgi <options> - same, but with a hash of following parameters:
+ *       socket          - (mandatory) the backend address, see above
+ *       max_connections - connections per worker, other requests wait for a free one (default: unlimited)
+ *       connect_timeout - seconds to wait for a free connection and connecting (default 0: no timeout)
+ *       max_idle        - idle keep-alive connections kept per worker (default 16, 0 disables FCGI_KEEP_CONN)
+ *       idle_timeout    - seconds an idle connection is kept (default 30)
+ *       max_requests    - requests per connection before it gets closed (default 0: unlimited)
+ *       multiplex       - connections per worker that carry many concurrent requests (FCGI_MPXS_CONNS);
+ *                         default 0: one connection per request. Only for backends that support it; falls back
+ *                         to one connection per request if the backend answers with FCGI_CANT_MPX_CONN.
+ *                         max_connections, connect_timeout and max_requests don't apply to these connections.
+ *                         A request buffers at most 512kb of its response (or io.buffer_out if lower); the
+ *                         shared connection stops reading while one of its requests is over that limit
  *
  * Example config:
  *     fastcgi "127.0.0.1:9090"
+ *     fastcgi [ "socket" => "unix:/var/run/php.sock", "max_idle" => 32, "max_requests" => 500 ]
  *
  * Todo:
- *     - reuse fastcgi connections (keepalive)
  *     - option for alternative doc-root?
  *
  * Author:
@@ -38,6 +51,10 @@ LI_API gboolean mod_fastcgi_free(liModules *mods, liModule *mod);
 
 typedef struct fastcgi_connection fastcgi_connection;
 typedef struct fastcgi_context fastcgi_context;
+typedef struct fastcgi_pool fastcgi_pool;
+typedef struct fastcgi_mpx_con fastcgi_mpx_con;
+typedef struct fastcgi_worker_data fastcgi_worker_data;
+typedef struct fastcgi_data fastcgi_data;
 typedef struct FCGI_Record FCGI_Record;
 
 
@@ -65,14 +82,22 @@ struct fastcgi_connection {
 	fastcgi_context *ctx;
 	liVRequest *vr;
 	fastcgi_state state;
+	liBackendConnection *bcon;
+	liBackendWait *bwait;
 	int fd;
 	ev_io fd_watcher;
 	liChunkQueue *fcgi_in, *fcgi_out, *stdout;
 	liBuffer *fcgi_in_buffer;
+	liChunkPipe *fcgi_in_pipe;
 
 	GByteArray *buf_in_record;
 	FCGI_Record fcgi_in_record;
 	guint16 requestid;
+	gboolean keep_conn, end_request;
+
+	gboolean multiplex, mpx_retry;
+	fastcgi_mpx_con *mcon; /* the shared backend connection; fd, fcgi_in and fd_watcher are unused then */
+	GList mpx_link;
 	
 	liHttpResponseCtx parse_response_ctx;
 	gboolean response_headers_finished;
@@ -80,12 +105,57 @@ struct fastcgi_connection {
 
 struct fastcgi_context {
 	gint refcount;
-	liSocketAddress socket;
-	GString *socket_str;
-	guint timeout;
+	liBackendPool *pool;
 	liPlugin *plugin;
 
-	gint last_errno;
+	guint multiplex;
+	gint mpx_unsupported;
+};
+
+/* multiplexed connections of a context in one worker; the others are in ctx->pool */
+struct fastcgi_pool {
+	fastcgi_context *ctx;
+	liWorker *wrk;
+
+	GQueue mpx; /* fastcgi_mpx_con */
+	liWaitQueue mpx_idle_queue;
+};
+
+/* a backend connection shared by several requests with different request ids */
+struct fastcgi_mpx_con {
+	fastcgi_context *ctx;
+	liWorker *wrk;
+	fastcgi_pool *pool; /* NULL after the worker stopped */
+	GList link; /* in pool->mpx */
+	liWaitQueueElem timeout_elem; /* queued while no request uses it */
+
+	int fd;
+	gboolean connecting, failed;
+	ev_io fd_watcher;
+	liChunkQueue *fcgi_in, *fcgi_out;
+	liBuffer *fcgi_in_buffer;
+	GByteArray *buf_in_record;
+	FCGI_Record fcgi_in_record;
+
+	GPtrArray *requests; /* request id - 1 -> fastcgi_connection*, MPX_ABORTED or NULL (free id) */
+	guint active; /* used request ids */
+	GQueue live; /* fastcgi_connection, via mpx_link */
+};
+
+/* the request is gone, but the backend didn't send FCGI_END_REQUEST yet */
+static gchar mpx_aborted_slot;
+#define MPX_ABORTED ((gpointer) &mpx_aborted_slot)
+#define MPX_MAX_REQUESTS 1024
+#define MPX_MAX_BUFFERED (512*1024) /* response bytes a request may buffer before the shared connection pauses */
+
+struct fastcgi_worker_data {
+	GHashTable *pools; /* fastcgi_context* -> fastcgi_pool* */
+	gboolean stopped; /* don't keep connections after li_worker_stop */
+};
+
+struct fastcgi_data {
+	fastcgi_worker_data *workers;
+	guint worker_count;
 };
 
 /* fastcgi types */
@@ -127,20 +197,16 @@ enum FCGI_ProtocolStatus {
 
 /**********************************************************************************/
 
-static fastcgi_context* fastcgi_context_new(liServer *srv, liPlugin *p, GString *dest_socket) {
-	liSocketAddress saddr;
+static fastcgi_context* fastcgi_context_new(liServer *srv, liPlugin *p, const liBackendConfig *config, GString *dest_socket) {
+	liBackendPool *pool;
 	fastcgi_context* ctx;
-	saddr = li_sockaddr_from_string(dest_socket, 0);
-	if (NULL == saddr.addr) {
-		ERROR(srv, "Invalid socket address '%s'", dest_socket->str);
-		return NULL;
-	}
+	pool = li_backend_pool_new(srv, config, dest_socket, 0);
+	if (NULL == pool) return NULL;
 	ctx = g_slice_new0(fastcgi_context);
 	ctx->refcount = 1;
-	ctx->socket = saddr;
-	ctx->timeout = 5;
+	ctx->pool = pool;
 	ctx->plugin = p;
-	ctx->socket_str = g_string_new_len(GSTR_LEN(dest_socket));
+	ctx->multiplex = 0;
 	return ctx;
 }
 
@@ -148,8 +214,7 @@ static void fastcgi_context_release(fastcgi_context *ctx) {
 	if (!ctx) return;
 	assert(g_atomic_int_get(&ctx->refcount) > 0);
 	if (g_atomic_int_dec_and_test(&ctx->refcount)) {
-		li_sockaddr_clear(&ctx->socket);
-		g_string_free(ctx->socket_str, TRUE);
+		li_backend_pool_release(ctx->pool);
 		g_slice_free(fastcgi_context, ctx);
 	}
 }
@@ -159,6 +224,61 @@ static void fastcgi_context_acquire(fastcgi_context *ctx) {
 	g_atomic_int_inc(&ctx->refcount);
 }
 
+/**********************************************************************************/
+/* per worker state for multiplexed connections */
+
+static void fastcgi_mpx_con_orphan(fastcgi_mpx_con *mcon);
+static void fastcgi_mpx_idle_timeout_cb(liWaitQueue *wq, gpointer data);
+static void fastcgi_mpx_detach(fastcgi_connection *fcon);
+
+static void fastcgi_pool_free(gpointer data) {
+	fastcgi_pool *pool = data;
+	GList *link;
+
+	while (NULL != (link = g_queue_peek_head_link(&pool->mpx))) {
+		fastcgi_mpx_con_orphan(link->data);
+	}
+	li_waitqueue_stop(&pool->mpx_idle_queue);
+	fastcgi_context_release(pool->ctx);
+	g_slice_free(fastcgi_pool, pool);
+}
+
+static fastcgi_pool* fastcgi_pool_get(liWorker *wrk, fastcgi_context *ctx, gboolean create) {
+	fastcgi_data *fdata = ctx->plugin->data;
+	GHashTable *pools = fdata->workers[wrk->ndx].pools;
+	fastcgi_pool *pool;
+
+	if (NULL != (pool = g_hash_table_lookup(pools, ctx)) || !create) return pool;
+
+	pool = g_slice_new0(fastcgi_pool);
+	fastcgi_context_acquire(ctx);
+	pool->ctx = ctx;
+	pool->wrk = wrk;
+	li_waitqueue_init(&pool->mpx_idle_queue, wrk->loop, fastcgi_mpx_idle_timeout_cb, ctx->pool->config.idle_timeout, pool);
+	g_hash_table_insert(pools, ctx, pool);
+
+	return pool;
+}
+
+/* the request is complete and the backend keeps the connection open */
+static gboolean fastcgi_connection_reusable(fastcgi_connection *fcon) {
+	return fcon->keep_conn && fcon->end_request
+		&& !fcon->fcgi_in->is_closed && 0 == fcon->fcgi_in->length
+		&& (!fcon->fcgi_in_record.valid || (0 == fcon->fcgi_in_record.remainingContent && 0 == fcon->fcgi_in_record.remainingPadding))
+		&& fcon->fcgi_out->is_closed && 0 == fcon->fcgi_out->length;
+}
+
+/* gives the backend connection back to the pool, or closes it */
+static void fastcgi_backend_put(liVRequest *vr, fastcgi_connection *fcon, gboolean closecon) {
+	ev_io_stop(vr->wrk->loop, &fcon->fd_watcher);
+	ev_io_set(&fcon->fd_watcher, -1, 0);
+	li_backend_put(vr->wrk, fcon->ctx->pool, fcon->bcon, closecon);
+	fcon->bcon = NULL;
+	fcon->fd = -1;
+}
+
+/**********************************************************************************/
+
 static void fastcgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents);
 
 static fastcgi_connection* fastcgi_connection_new(liVRequest *vr, fastcgi_context *ctx) {
@@ -188,14 +308,20 @@ static void fastcgi_connection_free(fastcgi_connection *fcon) {
 
 	vr = fcon->vr;
 	ev_io_stop(vr->wrk->loop, &fcon->fd_watcher);
+	if (fcon->mcon) {
+		fastcgi_mpx_detach(fcon);
+	} else {
+		li_backend_wait_stop(vr, fcon->ctx->pool, &fcon->bwait);
+		if (NULL != fcon->bcon) fastcgi_backend_put(vr, fcon, !fastcgi_connection_reusable(fcon));
+	}
 	fastcgi_context_release(fcon->ctx);
-	if (fcon->fd != -1) close(fcon->fd);
 	li_vrequest_backend_finished(vr);
 
 	li_chunkqueue_free(fcon->fcgi_in);
 	li_chunkqueue_free(fcon->fcgi_out);
 	li_chunkqueue_free(fcon->stdout);
 	li_buffer_release(fcon->fcgi_in_buffer);
+	li_chunkpipe_release(fcon->fcgi_in_pipe);
 	g_byte_array_free(fcon->buf_in_record, TRUE);
 
 	li_http_response_parser_clear(&fcon->parse_response_ctx);
@@ -309,7 +435,7 @@ static void fastcgi_send_begin(fastcgi_connection *fcon) {
 	stream_build_fcgi_record(buf, FCGI_BEGIN_REQUEST, fcon->requestid, 8);
 	w = htons(FCGI_RESPONDER);
 	g_byte_array_append(buf, (const guint8*) &w, sizeof(w));
-	l_byte_array_append_c(buf, 0); /* TODO: FCGI_KEEP_CONN */
+	l_byte_array_append_c(buf, fcon->keep_conn ? FCGI_KEEP_CONN : 0);
 	append_padding(buf, 5);
 	li_chunkqueue_append_bytearr(fcon->fcgi_out, buf);
 }
@@ -457,128 +583,219 @@ static void fastcgi_send_env(liVRequest *vr, fastcgi_connection *fcon) {
 
 static void fastcgi_forward_request(liVRequest *vr, fastcgi_connection *fcon) {
 	stream_send_chunks(fcon->fcgi_out, FCGI_STDIN, fcon->requestid, vr->in);
-	if (fcon->fcgi_out->length > 0)
+	if (fcon->multiplex) {
+		/* fcgi_out only contains complete records, and is_closed stays with fcon */
+		fastcgi_mpx_con *mcon = fcon->mcon;
+		if (NULL == mcon) return; /* connection already gone */
+		li_chunkqueue_steal_all(mcon->fcgi_out, fcon->fcgi_out);
+		if (mcon->fcgi_out->length > 0 && !mcon->connecting)
+			li_ev_io_add_events(vr->wrk->loop, &mcon->fd_watcher, EV_WRITE);
+	} else if (fcon->fcgi_out->length > 0) {
 		li_ev_io_add_events(vr->wrk->loop, &fcon->fd_watcher, EV_WRITE);
+	}
 }
 
-static gboolean fastcgi_get_packet(fastcgi_connection *fcon) {
+static gboolean fastcgi_get_packet(liVRequest *vr, liChunkQueue *in, FCGI_Record *rec, GByteArray *buf_in_record) {
 	const unsigned char *data;
 
 	/* already got packet */
-	if (fcon->fcgi_in_record.valid) {
-		if (0 == fcon->fcgi_in_record.remainingContent) {
+	if (rec->valid) {
+		if (0 == rec->remainingContent) {
 			/* wait for padding data ? */
-			gint len = fcon->fcgi_in->length;
-			if (len > fcon->fcgi_in_record.remainingPadding) len = fcon->fcgi_in_record.remainingPadding;
-			li_chunkqueue_skip(fcon->fcgi_in, len);
-			fcon->fcgi_in_record.remainingPadding -= len;
-			if (0 != fcon->fcgi_in_record.remainingPadding) return FALSE; /* wait for data */
-			fcon->fcgi_in_record.valid = FALSE; /* read next packet */
+			gint len = in->length;
+			if (len > rec->remainingPadding) len = rec->remainingPadding;
+			li_chunkqueue_skip(in, len);
+			rec->remainingPadding -= len;
+			if (0 != rec->remainingPadding) return FALSE; /* wait for data */
+			rec->valid = FALSE; /* read next packet */
 		} else {
-			return (fcon->fcgi_in->length > 0); /* wait for/handle more content */
+			return (in->length > 0); /* wait for/handle more content */
 		}
 	}
 
-	if (!li_chunkqueue_extract_to_bytearr(fcon->vr, fcon->fcgi_in, FCGI_HEADER_LEN, fcon->buf_in_record)) return FALSE; /* need more data */
+	if (!li_chunkqueue_extract_to_bytearr(vr, in, FCGI_HEADER_LEN, buf_in_record)) return FALSE; /* need more data */
 
-	data = (const unsigned char*) fcon->buf_in_record->data;
-	fcon->fcgi_in_record.version = data[0];
-	fcon->fcgi_in_record.type = data[1];
-	fcon->fcgi_in_record.requestID = (data[2] << 8) | (data[3]);
-	fcon->fcgi_in_record.contentLength = (data[4] << 8) | (data[5]);
-	fcon->fcgi_in_record.paddingLength = data[6];
-	fcon->fcgi_in_record.remainingContent = fcon->fcgi_in_record.contentLength;
-	fcon->fcgi_in_record.remainingPadding = fcon->fcgi_in_record.paddingLength;
-	fcon->fcgi_in_record.valid = TRUE;
-	fcon->fcgi_in_record.first = TRUE;
+	data = (const unsigned char*) buf_in_record->data;
+	rec->version = data[0];
+	rec->type = data[1];
+	rec->requestID = (data[2] << 8) | (data[3]);
+	rec->contentLength = (data[4] << 8) | (data[5]);
+	rec->paddingLength = data[6];
+	rec->remainingContent = rec->contentLength;
+	rec->remainingPadding = rec->paddingLength;
+	rec->valid = TRUE;
+	rec->first = TRUE;
 
-	li_chunkqueue_skip(fcon->fcgi_in, FCGI_HEADER_LEN);
+	li_chunkqueue_skip(in, FCGI_HEADER_LEN);
 
 	return TRUE;
 }
 
 /* get available data and mark it as read (subtract it from contentLength) */
-static int fastcgi_available(fastcgi_connection *fcon) {
-	gint len = fcon->fcgi_in->length;
-	if (len > fcon->fcgi_in_record.remainingContent) len = fcon->fcgi_in_record.remainingContent;
-	fcon->fcgi_in_record.remainingContent -= len;
+static int fastcgi_available(liChunkQueue *in, FCGI_Record *rec) {
+	gint len = in->length;
+	if (len > rec->remainingContent) len = rec->remainingContent;
+	rec->remainingContent -= len;
 	return len;
 }
 
-static gboolean fastcgi_parse_response(fastcgi_connection *fcon) {
+/* handles the available content of the current record for fcon
+ * returns FALSE if the record needs more data first
+ */
+static gboolean fastcgi_handle_record(fastcgi_connection *fcon, liChunkQueue *in, FCGI_Record *rec) {
 	liVRequest *vr = fcon->vr;
 	liPlugin *p = fcon->ctx->plugin;
 	gint len;
-	while (fastcgi_get_packet(fcon)) {
+
+	switch (rec->type) {
+	case FCGI_END_REQUEST:
+		/* wait for the complete body: appStatus (4 bytes), protocolStatus, reserved (3 bytes) */
+		if (in->length < rec->remainingContent) return FALSE;
+		if (rec->remainingContent >= 8 && li_chunkqueue_extract_to(vr, in, 8, vr->wrk->tmp_str)
+		    && FCGI_CANT_MPX_CONN == (guint8) vr->wrk->tmp_str->str[4] && fcon->mcon) {
+			VR_ERROR(vr, "(%s) backend can't multiplex requests, disabling multiplexing", fcon->ctx->pool->name->str);
+			g_atomic_int_set(&fcon->ctx->mpx_unsupported, 1);
+			/* the backend didn't run it: send it again on a connection of its own (unless the body is gone) */
+			fcon->mpx_retry = (0 == fcon->stdout->bytes_in && vr->request.content_length <= 0);
+		}
+		li_chunkqueue_skip(in, fastcgi_available(in, rec));
+		if (!fcon->mpx_retry) fcon->stdout->is_closed = TRUE;
+		fcon->end_request = TRUE;
+		break;
+	case FCGI_STDOUT:
+		if (0 == rec->contentLength) {
+			fcon->stdout->is_closed = TRUE;
+		} else {
+			li_chunkqueue_steal_len(fcon->stdout, in, fastcgi_available(in, rec));
+		}
+		break;
+	case FCGI_STDERR:
+		len = fastcgi_available(in, rec);
+		li_chunkqueue_extract_to(vr, in, len, vr->wrk->tmp_str);
+		if (OPTION(FASTCGI_OPTION_LOG_PLAIN_ERRORS).boolean) {
+			li_log_split_lines(vr->wrk->srv, vr, LI_LOG_LEVEL_BACKEND, 0, vr->wrk->tmp_str->str, "");
+		} else {
+			VR_BACKEND_LINES(vr, vr->wrk->tmp_str->str, "(fcgi-stderr %s) ", fcon->ctx->pool->name->str);
+		}
+		li_chunkqueue_skip(in, len);
+		break;
+	default:
+		if (rec->first) VR_WARNING(vr, "(%s) Unhandled fastcgi record type %i", fcon->ctx->pool->name->str, (gint) rec->type);
+		li_chunkqueue_skip(in, fastcgi_available(in, rec));
+		break;
+	}
+	rec->first = FALSE;
+	return TRUE;
+}
+
+static gboolean fastcgi_parse_response(fastcgi_connection *fcon) {
+	liVRequest *vr = fcon->vr;
+	while (fastcgi_get_packet(vr, fcon->fcgi_in, &fcon->fcgi_in_record, fcon->buf_in_record)) {
 		if (fcon->fcgi_in_record.version != FCGI_VERSION_1) {
-			VR_ERROR(vr, "(%s) Unknown fastcgi protocol version %i", fcon->ctx->socket_str->str, (gint) fcon->fcgi_in_record.version);
-			close(fcon->fd);
-			fcon->fd = -1;
+			VR_ERROR(vr, "(%s) Unknown fastcgi protocol version %i", fcon->ctx->pool->name->str, (gint) fcon->fcgi_in_record.version);
+			if (NULL != fcon->bcon) fastcgi_backend_put(vr, fcon, TRUE);
 			li_vrequest_error(vr);
 			return FALSE;
 		}
-		switch (fcon->fcgi_in_record.type) {
-		case FCGI_END_REQUEST:
-			li_chunkqueue_skip(fcon->fcgi_in, fastcgi_available(fcon));
-			fcon->stdout->is_closed = TRUE;
-			break;
-		case FCGI_STDOUT:
-			if (0 == fcon->fcgi_in_record.contentLength) {
-				fcon->stdout->is_closed = TRUE;
-			} else {
-				li_chunkqueue_steal_len(fcon->stdout, fcon->fcgi_in, fastcgi_available(fcon));
-			}
+		if (!fastcgi_handle_record(fcon, fcon->fcgi_in, &fcon->fcgi_in_record)) break;
+	}
+	return TRUE;
+}
+
+/* parse the response headers and forward the body from stdout */
+static void fastcgi_forward_response(fastcgi_connection *fcon) {
+	if (!fcon->response_headers_finished) {
+		switch (li_http_response_parse(fcon->vr, &fcon->parse_response_ctx)) {
+		case LI_HANDLER_GO_ON:
+			fcon->response_headers_finished = TRUE;
+			li_vrequest_handle_response_headers(fcon->vr);
 			break;
-		case FCGI_STDERR:
-			len = fastcgi_available(fcon);
-			li_chunkqueue_extract_to(vr, fcon->fcgi_in, len, vr->wrk->tmp_str);
-			if (OPTION(FASTCGI_OPTION_LOG_PLAIN_ERRORS).boolean) {
-				li_log_split_lines(vr->wrk->srv, vr, LI_LOG_LEVEL_BACKEND, 0, vr->wrk->tmp_str->str, "");
-			} else {
-				VR_BACKEND_LINES(vr, vr->wrk->tmp_str->str, "(fcgi-stderr %s) ", fcon->ctx->socket_str->str);
-			}
-			li_chunkqueue_skip(fcon->fcgi_in, len);
+		case LI_HANDLER_ERROR:
+			VR_ERROR(fcon->vr, "Parsing response header failed for: %s", fcon->ctx->pool->name->str);
+			li_vrequest_error(fcon->vr);
 			break;
 		default:
-			if (fcon->fcgi_in_record.first) VR_WARNING(vr, "(%s) Unhandled fastcgi record type %i", fcon->ctx->socket_str->str, (gint) fcon->fcgi_in_record.type);
-			li_chunkqueue_skip(fcon->fcgi_in, fastcgi_available(fcon));
 			break;
 		}
-		fcon->fcgi_in_record.first = FALSE;
 	}
-	return TRUE;
+
+	if (fcon->response_headers_finished) {
+		li_chunkqueue_steal_all(fcon->vr->out, fcon->stdout);
+		fcon->vr->out->is_closed = fcon->stdout->is_closed;
+		li_vrequest_handle_response_body(fcon->vr);
+	}
 }
 
 /**********************************************************************************/
 
 static liHandlerResult fastcgi_statemachine(liVRequest *vr, fastcgi_connection *fcon);
 
-static void fastcgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
-	fastcgi_connection *fcon = (fastcgi_connection*) w->data;
+/* safe methods (RFC 7231 4.2.1) may be retried automatically, others could run twice */
+static gboolean fastcgi_method_is_safe(liHttpMethod method) {
+	switch (method) {
+	case LI_HTTP_METHOD_GET:
+	case LI_HTTP_METHOD_HEAD:
+	case LI_HTTP_METHOD_OPTIONS:
+	case LI_HTTP_METHOD_PROPFIND:
+	case LI_HTTP_METHOD_REPORT:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
 
-	if (fcon->state == FS_CONNECTING) {
-		if (LI_HANDLER_GO_ON != fastcgi_statemachine(fcon->vr, fcon)) {
-			li_vrequest_error(fcon->vr);
-		}
-		return;
+/* the backend closed a connection from the idle pool before sending anything:
+ * a safe request without body can be sent again on a new connection
+ */
+static gboolean fastcgi_retry(liVRequest *vr, fastcgi_connection *fcon) {
+	if (fcon->bcon->requests < 2 || fcon->fcgi_in->bytes_in > 0
+	    || vr->request.content_length > 0 || !fastcgi_method_is_safe(vr->request.http_method)) return FALSE;
+
+	fastcgi_backend_put(vr, fcon, TRUE);
+
+	li_chunkqueue_reset(fcon->fcgi_in);
+	li_chunkqueue_reset(fcon->fcgi_out);
+	g_byte_array_set_size(fcon->buf_in_record, 0);
+	memset(&fcon->fcgi_in_record, 0, sizeof(fcon->fcgi_in_record));
+	fcon->keep_conn = fcon->end_request = FALSE;
+	fcon->state = FS_CONNECTING;
+
+	if (LI_HANDLER_GO_ON != fastcgi_statemachine(vr, fcon)) {
+		li_vrequest_error(vr);
 	}
+	return TRUE;
+}
+
+static void fastcgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	fastcgi_connection *fcon = (fastcgi_connection*) w->data;
 
 	if (revents & EV_READ) {
 		if (fcon->fcgi_in->is_closed) {
 			li_ev_io_rem_events(loop, w, EV_READ);
 		} else {
-			switch (li_network_read(fcon->vr, w->fd, fcon->fcgi_in, &fcon->fcgi_in_buffer)) {
+			liNetworkStatus res;
+
+			if (fcon->response_headers_finished && 0 == fcon->fcgi_in->length && fcon->fcgi_in_record.valid
+			    && FCGI_STDOUT == fcon->fcgi_in_record.type && fcon->fcgi_in_record.remainingContent > 0) {
+				/* the content of a stdout record is only forwarded: splice it (but not the next record header) */
+				res = li_network_read_splice(fcon->vr, w->fd, fcon->fcgi_in, fcon->fcgi_in_record.remainingContent, &fcon->fcgi_in_buffer, &fcon->fcgi_in_pipe);
+			} else {
+				res = li_network_read(fcon->vr, w->fd, fcon->fcgi_in, &fcon->fcgi_in_buffer);
+			}
+
+			switch (res) {
 			case LI_NETWORK_STATUS_SUCCESS:
+				li_backend_first_byte(fcon->vr->wrk, fcon->bcon);
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(fcon->vr, "(%s) network read fatal error", fcon->ctx->socket_str->str);
+				if (fastcgi_retry(fcon->vr, fcon)) return;
+				VR_ERROR(fcon->vr, "(%s) network read fatal error", fcon->ctx->pool->name->str);
 				li_vrequest_error(fcon->vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+				if (fastcgi_retry(fcon->vr, fcon)) return;
 				fcon->fcgi_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(fcon->fd);
-				fcon->fd = -1;
+				fastcgi_backend_put(fcon->vr, fcon, TRUE);
 				li_vrequest_backend_finished(fcon->vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
@@ -593,14 +810,14 @@ static void fastcgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 			case LI_NETWORK_STATUS_SUCCESS:
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(fcon->vr, "(%s) network write fatal error", fcon->ctx->socket_str->str);
+				if (fastcgi_retry(fcon->vr, fcon)) return;
+				VR_ERROR(fcon->vr, "(%s) network write fatal error", fcon->ctx->pool->name->str);
 				li_vrequest_error(fcon->vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+				if (fastcgi_retry(fcon->vr, fcon)) return;
 				fcon->fcgi_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(fcon->fd);
-				fcon->fd = -1;
+				fastcgi_backend_put(fcon->vr, fcon, TRUE);
 				li_vrequest_backend_finished(fcon->vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
@@ -614,40 +831,434 @@ static void fastcgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 
 	if (!fastcgi_parse_response(fcon)) return;
 
-	if (!fcon->response_headers_finished) {
-		switch (li_http_response_parse(fcon->vr, &fcon->parse_response_ctx)) {
-		case LI_HANDLER_GO_ON:
-			fcon->response_headers_finished = TRUE;
-			li_vrequest_handle_response_headers(fcon->vr);
-			break;
-		case LI_HANDLER_ERROR:
-			VR_ERROR(fcon->vr, "Parsing response header failed for: %s", fcon->ctx->socket_str->str);
-			li_vrequest_error(fcon->vr);
+	fastcgi_forward_response(fcon);
+
+	if (fcon->fcgi_in->is_closed && !fcon->vr->out->is_closed) {
+		VR_ERROR(fcon->vr, "(%s) unexpected end-of-file (perhaps the fastcgi process died)", fcon->ctx->pool->name->str);
+		li_vrequest_error(fcon->vr);
+	}
+}
+
+/**********************************************************************************/
+/* multiplexed backend connections */
+
+static void fastcgi_close(liVRequest *vr, liPlugin *p);
+
+static void fastcgi_mpx_con_free(fastcgi_mpx_con *mcon) {
+	if (mcon->pool) {
+		g_queue_unlink(&mcon->pool->mpx, &mcon->link);
+		li_waitqueue_remove(&mcon->pool->mpx_idle_queue, &mcon->timeout_elem);
+	}
+	ev_io_stop(mcon->wrk->loop, &mcon->fd_watcher);
+	if (-1 != mcon->fd) close(mcon->fd);
+
+	li_chunkqueue_free(mcon->fcgi_in);
+	li_chunkqueue_free(mcon->fcgi_out);
+	li_buffer_release(mcon->fcgi_in_buffer);
+	g_byte_array_free(mcon->buf_in_record, TRUE);
+	g_ptr_array_free(mcon->requests, TRUE);
+
+	fastcgi_context_release(mcon->ctx);
+	g_slice_free(fastcgi_mpx_con, mcon);
+}
+
+/* the worker stops: no new requests, close it after the current ones */
+static void fastcgi_mpx_con_orphan(fastcgi_mpx_con *mcon) {
+	g_queue_unlink(&mcon->pool->mpx, &mcon->link);
+	li_waitqueue_remove(&mcon->pool->mpx_idle_queue, &mcon->timeout_elem);
+	mcon->pool = NULL;
+	if (0 == mcon->live.length) fastcgi_mpx_con_free(mcon);
+}
+
+static void fastcgi_mpx_idle_timeout_cb(liWaitQueue *wq, gpointer data) {
+	liWaitQueueElem *wqe;
+	UNUSED(data);
+
+	while (NULL != (wqe = li_waitqueue_pop(wq))) {
+		fastcgi_mpx_con_free(wqe->data);
+	}
+
+	li_waitqueue_update(wq);
+}
+
+/* stop reading the shared connection while any of its requests has too much response buffered */
+static void fastcgi_mpx_update_events(fastcgi_mpx_con *mcon) {
+	GList *link;
+
+	if (mcon->connecting) return;
+
+	for (link = mcon->live.head; NULL != link; link = link->next) {
+		fastcgi_connection *fcon = link->data;
+		if (!fcon->end_request && fcon->vr->out->limit->locked) {
+			li_ev_io_rem_events(mcon->wrk->loop, &mcon->fd_watcher, EV_READ);
+			return;
+		}
+	}
+	li_ev_io_add_events(mcon->wrk->loop, &mcon->fd_watcher, EV_READ);
+}
+
+static void fastcgi_mpx_limit_notify(liVRequest *vr, gpointer context, gboolean locked) {
+	fastcgi_connection *fcon = context;
+	UNUSED(vr); UNUSED(locked);
+
+	if (NULL != fcon->mcon) fastcgi_mpx_update_events(fcon->mcon);
+}
+
+/* remove the request from the shared connection */
+static void fastcgi_mpx_detach(fastcgi_connection *fcon) {
+	fastcgi_mpx_con *mcon = fcon->mcon;
+	fastcgi_data *fdata = mcon->ctx->plugin->data;
+	FCGI_Record *rec = &mcon->fcgi_in_record;
+
+	fcon->mcon = NULL;
+	g_queue_unlink(&mcon->live, &fcon->mpx_link);
+
+	if (fcon->end_request || mcon->failed) {
+		g_ptr_array_index(mcon->requests, fcon->requestid - 1) = NULL;
+		mcon->active--;
+	} else {
+		/* the id stays reserved until the backend confirms with FCGI_END_REQUEST */
+		g_ptr_array_index(mcon->requests, fcon->requestid - 1) = MPX_ABORTED;
+		stream_send_fcgi_record(mcon->fcgi_out, FCGI_ABORT_REQUEST, fcon->requestid, 0);
+		if (!mcon->connecting) li_ev_io_add_events(mcon->wrk->loop, &mcon->fd_watcher, EV_WRITE);
+	}
+
+	if (mcon->failed) return;
+	if (mcon->live.length > 0) {
+		fastcgi_mpx_update_events(mcon);
+		return;
+	}
+
+	if (NULL == mcon->pool || fdata->workers[mcon->wrk->ndx].stopped || mcon->connecting || mcon->active > 0 || mcon->fcgi_out->length > 0 || mcon->fcgi_in->length > 0
+	    || (rec->valid && (rec->remainingContent > 0 || rec->remainingPadding > 0))) {
+		/* no request left to drain it */
+		fastcgi_mpx_con_free(mcon);
+		return;
+	}
+
+	/* idle: an EV_READ now means eof */
+	li_ev_io_set_events(mcon->wrk->loop, &mcon->fd_watcher, EV_READ);
+	li_waitqueue_push(&mcon->pool->mpx_idle_queue, &mcon->timeout_elem);
+}
+
+/* returns FALSE if the connect failed, *berror tells why */
+static gboolean fastcgi_mpx_connect(liVRequest *vr, fastcgi_mpx_con *mcon, liBackendError *berror) {
+	fastcgi_context *ctx = mcon->ctx;
+
+	if (-1 == connect(mcon->fd, &ctx->pool->config.sock.addr->plain, ctx->pool->config.sock.len)) {
+		switch (errno) {
+		case EINPROGRESS:
+		case EALREADY:
+		case EINTR:
+			return TRUE;
+		case EAGAIN: /* backend overloaded */
+			*berror = LI_BACKEND_OVERLOAD;
+			return FALSE;
+		case EISCONN:
 			break;
 		default:
+			if (errno != g_atomic_int_get(&ctx->pool->last_errno)) {
+				g_atomic_int_set(&ctx->pool->last_errno, errno);
+				VR_ERROR(vr, "Couldn't connect to '%s': %s",
+					li_sockaddr_to_string(ctx->pool->config.sock, vr->wrk->tmp_str, TRUE)->str,
+					g_strerror(errno));
+			}
+			*berror = LI_BACKEND_DEAD;
+			return FALSE;
+		}
+	}
+
+	g_atomic_int_set(&ctx->pool->last_errno, 0);
+	mcon->connecting = FALSE;
+	return TRUE;
+}
+
+/* the backend connection is gone: fail all requests still waiting for their response */
+static void fastcgi_mpx_con_fail(fastcgi_mpx_con *mcon, gboolean connect_failed, liBackendError berror) {
+	GList *link;
+
+	mcon->failed = TRUE;
+	while (NULL != (link = g_queue_peek_head_link(&mcon->live))) {
+		fastcgi_connection *fcon = link->data;
+		liVRequest *vr = fcon->vr;
+
+		if (fcon->end_request && !fcon->mpx_retry) {
+			fastcgi_mpx_detach(fcon);
+			continue;
+		}
+
+		fastcgi_close(vr, fcon->ctx->plugin);
+		if (connect_failed) {
+			li_vrequest_backend_error(vr, berror);
+		} else {
+			li_vrequest_error(vr);
+		}
+	}
+
+	fastcgi_mpx_con_free(mcon);
+}
+
+static gboolean fastcgi_mpx_parse_response(liVRequest *vr, fastcgi_mpx_con *mcon) {
+	FCGI_Record *rec = &mcon->fcgi_in_record;
+
+	while (fastcgi_get_packet(vr, mcon->fcgi_in, rec, mcon->buf_in_record)) {
+		gpointer slot = NULL;
+
+		if (rec->version != FCGI_VERSION_1) {
+			VR_ERROR(vr, "(%s) Unknown fastcgi protocol version %i", mcon->ctx->pool->name->str, (gint) rec->version);
+			return FALSE;
+		}
+
+		if (rec->requestID > 0 && rec->requestID <= mcon->requests->len) {
+			slot = g_ptr_array_index(mcon->requests, rec->requestID - 1);
+		}
+
+		if (NULL == slot || MPX_ABORTED == slot) {
+			/* management records and records of requests that are gone */
+			li_chunkqueue_skip(mcon->fcgi_in, fastcgi_available(mcon->fcgi_in, rec));
+			if (MPX_ABORTED == slot && FCGI_END_REQUEST == rec->type && 0 == rec->remainingContent) {
+				g_ptr_array_index(mcon->requests, rec->requestID - 1) = NULL;
+				mcon->active--;
+			}
+			continue;
+		}
+
+		if (!fastcgi_handle_record(slot, mcon->fcgi_in, rec)) break;
+		fastcgi_forward_response(slot);
+	}
+
+	return TRUE;
+}
+
+/* send a request the backend refused with FCGI_CANT_MPX_CONN on a connection of its own */
+static void fastcgi_mpx_retry(fastcgi_connection *fcon) {
+	liVRequest *vr = fcon->vr;
+
+	fastcgi_mpx_detach(fcon);
+
+	fcon->multiplex = fcon->mpx_retry = FALSE;
+	fcon->keep_conn = fcon->end_request = FALSE;
+	fcon->requestid = 1;
+	li_chunkqueue_reset(fcon->fcgi_out);
+	vr->out->limit->notify = NULL;
+	vr->out->limit->context = NULL;
+	vr->out->limit->io_watcher = &fcon->fd_watcher;
+	fcon->state = FS_CONNECTING;
+
+	if (LI_HANDLER_GO_ON != fastcgi_statemachine(vr, fcon)) {
+		li_vrequest_error(vr);
+	}
+}
+
+/* returns FALSE if mcon may be gone */
+static gboolean fastcgi_mpx_retry_requests(fastcgi_mpx_con *mcon) {
+	GList *link = mcon->live.head;
+
+	while (NULL != link) {
+		fastcgi_connection *fcon = link->data;
+		gboolean last = (NULL == link->next);
+
+		link = link->next;
+		if (fcon->mpx_retry) {
+			/* detaching the last request can free mcon */
+			fastcgi_mpx_retry(fcon);
+			if (last) return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void fastcgi_mpx_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	fastcgi_mpx_con *mcon = (fastcgi_mpx_con*) w->data;
+	liVRequest *vr;
+
+	if (0 == mcon->live.length) {
+		/* idle: eof (or data we didn't ask for) */
+		fastcgi_mpx_con_free(mcon);
+		return;
+	}
+
+	/* any of the requests provides the context for logging and the network backend */
+	vr = ((fastcgi_connection*) g_queue_peek_head(&mcon->live))->vr;
+
+	if (mcon->connecting) {
+		liBackendError berror;
+
+		if (!fastcgi_mpx_connect(vr, mcon, &berror)) {
+			fastcgi_mpx_con_fail(mcon, TRUE, berror);
+			return;
+		}
+		if (mcon->connecting) return;
+	}
+
+	if (revents & EV_READ) {
+		switch (li_network_read(vr, w->fd, mcon->fcgi_in, &mcon->fcgi_in_buffer)) {
+		case LI_NETWORK_STATUS_SUCCESS:
+			break;
+		case LI_NETWORK_STATUS_FATAL_ERROR:
+			VR_ERROR(vr, "(%s) network read fatal error", mcon->ctx->pool->name->str);
+			fastcgi_mpx_con_fail(mcon, FALSE, LI_BACKEND_DEAD);
+			return;
+		case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+			mcon->fcgi_in->is_closed = TRUE;
+			break;
+		case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
 			break;
 		}
 	}
 
-	if (fcon->response_headers_finished) {
-		li_chunkqueue_steal_all(fcon->vr->out, fcon->stdout);
-		fcon->vr->out->is_closed = fcon->stdout->is_closed;
-		li_vrequest_handle_response_body(fcon->vr);
+	if (!mcon->fcgi_in->is_closed && (revents & EV_WRITE)) {
+		if (mcon->fcgi_out->length > 0) {
+			switch (li_network_write(vr, w->fd, mcon->fcgi_out, 256*1024)) {
+			case LI_NETWORK_STATUS_SUCCESS:
+				break;
+			case LI_NETWORK_STATUS_FATAL_ERROR:
+				VR_ERROR(vr, "(%s) network write fatal error", mcon->ctx->pool->name->str);
+				fastcgi_mpx_con_fail(mcon, FALSE, LI_BACKEND_DEAD);
+				return;
+			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+				mcon->fcgi_in->is_closed = TRUE;
+				break;
+			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
+				break;
+			}
+		}
+		if (mcon->fcgi_out->length == 0) {
+			li_ev_io_rem_events(loop, w, EV_WRITE);
+		}
 	}
 
-	if (fcon->fcgi_in->is_closed && !fcon->vr->out->is_closed) {
-		VR_ERROR(fcon->vr, "(%s) unexpected end-of-file (perhaps the fastcgi process died)", fcon->ctx->socket_str->str);
-		li_vrequest_error(fcon->vr);
+	if (!fastcgi_mpx_parse_response(vr, mcon)) {
+		fastcgi_mpx_con_fail(mcon, FALSE, LI_BACKEND_DEAD);
+		return;
+	}
+
+	if (!fastcgi_mpx_retry_requests(mcon)) return;
+
+	if (mcon->fcgi_in->is_closed) {
+		if (mcon->active > 0) {
+			VR_ERROR(vr, "(%s) unexpected end-of-file (perhaps the fastcgi process died)", mcon->ctx->pool->name->str);
+		}
+		fastcgi_mpx_con_fail(mcon, FALSE, LI_BACKEND_DEAD);
+	} else if (mcon->live.length > 0) {
+		fastcgi_mpx_update_events(mcon);
 	}
 }
 
 /**********************************************************************************/
 /* state machine */
 
-static void fastcgi_close(liVRequest *vr, liPlugin *p);
+static void fastcgi_start_request(liVRequest *vr, fastcgi_connection *fcon) {
+	liBackendConfig *config = &fcon->ctx->pool->config;
+
+	fcon->state = FS_CONNECTED;
+	if (fcon->mcon) {
+		fcon->keep_conn = TRUE;
+	} else {
+		fcon->keep_conn = (config->max_idle > 0 && (0 == config->max_requests || fcon->bcon->requests < config->max_requests));
+	}
+
+	/* prepare stream */
+	fastcgi_send_begin(fcon);
+	fastcgi_send_env(vr, fcon);
+}
+
+static liHandlerResult fastcgi_mpx_attach(liVRequest *vr, fastcgi_connection *fcon) {
+	fastcgi_context *ctx = fcon->ctx;
+	fastcgi_pool *pool = fastcgi_pool_get(vr->wrk, ctx, TRUE);
+	fastcgi_mpx_con *mcon = NULL;
+	GList *link;
+	guint i;
+
+	/* the least busy connection */
+	for (link = pool->mpx.head; NULL != link; link = link->next) {
+		fastcgi_mpx_con *m = link->data;
+		if (m->active < MPX_MAX_REQUESTS && (NULL == mcon || m->active < mcon->active)) mcon = m;
+	}
+
+	if (NULL == mcon || (mcon->active > 0 && pool->mpx.length < ctx->multiplex)) {
+		liBackendError berror;
+		int fd;
+
+		if (pool->mpx.length >= ctx->multiplex && NULL == mcon) {
+			/* all connections carry MPX_MAX_REQUESTS requests */
+			fastcgi_close(vr, ctx->plugin);
+			li_vrequest_backend_overloaded(vr);
+			return LI_HANDLER_GO_ON;
+		}
+
+		vr->wrk->stats.backend_pool_misses++;
+
+		do {
+			fd = socket(ctx->pool->config.sock.addr->plain.sa_family, SOCK_STREAM, 0);
+		} while (-1 == fd && errno == EINTR);
+		if (-1 == fd) {
+			if (errno == EMFILE) {
+				li_server_out_of_fds(vr->wrk->srv);
+			} else if (errno != g_atomic_int_get(&ctx->pool->last_errno)) {
+				g_atomic_int_set(&ctx->pool->last_errno, errno);
+				VR_ERROR(vr, "Couldn't open socket: %s", g_strerror(errno));
+			}
+			return LI_HANDLER_ERROR;
+		}
+		li_fd_init(fd);
+
+		mcon = g_slice_new0(fastcgi_mpx_con);
+		fastcgi_context_acquire(ctx);
+		mcon->ctx = ctx;
+		mcon->wrk = vr->wrk;
+		mcon->pool = pool;
+		mcon->fd = fd;
+		mcon->connecting = TRUE;
+		mcon->fcgi_in = li_chunkqueue_new();
+		mcon->fcgi_out = li_chunkqueue_new();
+		mcon->buf_in_record = g_byte_array_sized_new(FCGI_HEADER_LEN);
+		mcon->requests = g_ptr_array_new();
+		mcon->timeout_elem.data = mcon;
+		mcon->link.data = mcon;
+		g_queue_push_tail_link(&pool->mpx, &mcon->link);
+
+		ev_init(&mcon->fd_watcher, fastcgi_mpx_fd_cb);
+		ev_io_set(&mcon->fd_watcher, fd, EV_READ | EV_WRITE);
+		mcon->fd_watcher.data = mcon;
+		ev_io_start(vr->wrk->loop, &mcon->fd_watcher);
+
+		if (!fastcgi_mpx_connect(vr, mcon, &berror)) {
+			fastcgi_mpx_con_free(mcon);
+			fastcgi_close(vr, ctx->plugin);
+			li_vrequest_backend_error(vr, berror);
+			return LI_HANDLER_GO_ON;
+		}
+	} else {
+		vr->wrk->stats.backend_pool_hits++;
+		if (0 == mcon->live.length) {
+			/* was idle */
+			li_waitqueue_remove(&pool->mpx_idle_queue, &mcon->timeout_elem);
+			li_ev_io_set_events(vr->wrk->loop, &mcon->fd_watcher, EV_READ);
+		}
+	}
+
+	/* lowest free request id */
+	for (i = 0; i < mcon->requests->len && NULL != g_ptr_array_index(mcon->requests, i); i++) ;
+	if (i == mcon->requests->len) g_ptr_array_add(mcon->requests, NULL);
+	g_ptr_array_index(mcon->requests, i) = fcon;
+	mcon->active++;
+
+	fcon->mcon = mcon;
+	fcon->requestid = i + 1;
+	fcon->mpx_link.data = fcon;
+	g_queue_push_tail_link(&mcon->live, &fcon->mpx_link);
+
+	fastcgi_start_request(vr, fcon);
+	fastcgi_forward_request(vr, fcon);
+
+	return LI_HANDLER_GO_ON;
+}
 
 static liHandlerResult fastcgi_statemachine(liVRequest *vr, fastcgi_connection *fcon) {
 	liPlugin *p = fcon->ctx->plugin;
+	liBackendError berror;
 
 	switch (fcon->state) {
 	case FS_WAIT_FOR_REQUEST:
@@ -660,57 +1271,26 @@ static liHandlerResult fastcgi_statemachine(liVRequest *vr, fastcgi_connection *
 
 		/* fall through */
 	case FS_CONNECT:
-		do {
-			fcon->fd = socket(fcon->ctx->socket.addr->plain.sa_family, SOCK_STREAM, 0);
-		} while (-1 == fcon->fd && errno == EINTR);
-		if (-1 == fcon->fd) {
-			if (errno == EMFILE) {
-				li_server_out_of_fds(vr->wrk->srv);
-			} else if (errno != g_atomic_int_get(&fcon->ctx->last_errno)) {
-				g_atomic_int_set(&fcon->ctx->last_errno, errno);
-				VR_ERROR(vr, "Couldn't open socket: %s", g_strerror(errno));
-			}
-			return LI_HANDLER_ERROR;
-		}
-		li_fd_init(fcon->fd);
-		ev_io_set(&fcon->fd_watcher, fcon->fd, EV_READ | EV_WRITE);
-		ev_io_start(vr->wrk->loop, &fcon->fd_watcher);
+		if (fcon->multiplex) return fastcgi_mpx_attach(vr, fcon);
 
 		/* fall through */
 	case FS_CONNECTING:
-		if (-1 == connect(fcon->fd, &fcon->ctx->socket.addr->plain, fcon->ctx->socket.len)) {
-			switch (errno) {
-			case EINPROGRESS:
-			case EALREADY:
-			case EINTR:
-				fcon->state = FS_CONNECTING;
-				return LI_HANDLER_GO_ON;
-			case EAGAIN: /* backend overloaded */
-				fastcgi_close(vr, p);
-				li_vrequest_backend_overloaded(vr);
-				return LI_HANDLER_GO_ON;
-			case EISCONN:
-				break;
-			default:
-				if (errno != g_atomic_int_get(&fcon->ctx->last_errno)) {
-					g_atomic_int_set(&fcon->ctx->last_errno, errno);
-					VR_ERROR(vr, "Couldn't connect to '%s': %s",
-						li_sockaddr_to_string(fcon->ctx->socket, vr->wrk->tmp_str, TRUE)->str,
-						g_strerror(errno));
-				}
-				fastcgi_close(vr, p);
-				li_vrequest_backend_dead(vr);
-				return LI_HANDLER_GO_ON;
-			}
+		switch (li_backend_get(vr, fcon->ctx->pool, &fcon->bcon, &fcon->bwait, &berror)) {
+		case LI_BACKEND_SUCCESS:
+			break;
+		case LI_BACKEND_WAIT:
+			fcon->state = FS_CONNECTING;
+			return LI_HANDLER_GO_ON;
+		case LI_BACKEND_ERROR:
+			fastcgi_close(vr, p);
+			li_vrequest_backend_error(vr, berror);
+			return LI_HANDLER_GO_ON;
 		}
 
-		g_atomic_int_set(&fcon->ctx->last_errno, 0);
-
-		fcon->state = FS_CONNECTED;
-
-		/* prepare stream */
-		fastcgi_send_begin(fcon);
-		fastcgi_send_env(vr, fcon);
+		fcon->fd = fcon->bcon->fd;
+		ev_io_set(&fcon->fd_watcher, fcon->fd, EV_READ | EV_WRITE);
+		ev_io_start(vr->wrk->loop, &fcon->fd_watcher);
+		fastcgi_start_request(vr, fcon);
 
 		/* fall through */
 	case FS_CONNECTED:
@@ -742,7 +1322,16 @@ static liHandlerResult fastcgi_handle(liVRequest *vr, gpointer param, gpointer *
 	li_chunkqueue_set_limit(fcon->fcgi_in, vr->out->limit);
 	li_chunkqueue_set_limit(fcon->stdout, vr->out->limit);
 	li_chunkqueue_set_limit(fcon->fcgi_out, vr->in->limit);
-	if (vr->out->limit) vr->out->limit->io_watcher = &fcon->fd_watcher;
+
+	fcon->multiplex = (ctx->multiplex > 0 && !g_atomic_int_get(&ctx->mpx_unsupported) && NULL != vr->out->limit);
+	if (fcon->multiplex) {
+		/* a shared connection can't be paused for a single request: it stops reading while any request is over its limit */
+		if (vr->out->limit->limit <= 0 || vr->out->limit->limit > MPX_MAX_BUFFERED) li_cqlimit_set_limit(vr->out->limit, MPX_MAX_BUFFERED);
+		vr->out->limit->notify = fastcgi_mpx_limit_notify;
+		vr->out->limit->context = fcon;
+	} else if (vr->out->limit) {
+		vr->out->limit->io_watcher = &fcon->fd_watcher;
+	}
 
 	return fastcgi_statemachine(vr, fcon);
 }
@@ -759,7 +1348,11 @@ static void fastcgi_close(liVRequest *vr, liPlugin *p) {
 	fastcgi_connection *fcon = (fastcgi_connection*) g_ptr_array_index(vr->plugin_ctx, p->id);
 	g_ptr_array_index(vr->plugin_ctx, p->id) = NULL;
 	if (fcon) {
-		if (vr->out->limit) vr->out->limit->io_watcher = NULL;
+		if (vr->out->limit) {
+			vr->out->limit->io_watcher = NULL;
+			vr->out->limit->notify = NULL;
+			vr->out->limit->context = NULL;
+		}
 		fastcgi_connection_free(fcon);
 	}
 }
@@ -774,17 +1367,60 @@ static void fastcgi_free(liServer *srv, gpointer param) {
 
 static liAction* fastcgi_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	fastcgi_context *ctx;
+	GString *socket_str = NULL;
+	liBackendConfig config;
+	gint64 multiplex = 0;
 
 	UNUSED(wrk); UNUSED(userdata);
 
-	if (val->type != LI_VALUE_STRING) {
-		ERROR(srv, "%s", "fastcgi expects a string as parameter");
-		return FALSE;
+	li_backend_config_init(&config);
+	config.max_idle = 16;
+
+	if (val->type == LI_VALUE_STRING) {
+		socket_str = val->data.string;
+	} else if (val->type == LI_VALUE_HASH) {
+		GHashTableIter hti;
+		gpointer hkey, hvalue;
+
+		g_hash_table_iter_init(&hti, val->data.hash);
+		while (g_hash_table_iter_next(&hti, &hkey, &hvalue)) {
+			GString *htkey = hkey;
+			liValue *htval = hvalue;
+
+			if (g_str_equal(htkey->str, "multiplex")) {
+				if (htval->type != LI_VALUE_NUMBER || htval->data.number < 0) {
+					ERROR(srv, "%s", "fastcgi multiplex expects a non-negative number as parameter");
+					return NULL;
+				}
+				multiplex = htval->data.number;
+				continue;
+			}
+
+			switch (li_backend_config_option(srv, "fastcgi", &config, &socket_str, htkey->str, htval)) {
+			case 1:
+				break;
+			case 0:
+				ERROR(srv, "unknown option for fastcgi '%s'", htkey->str);
+				return NULL;
+			default:
+				return NULL;
+			}
+		}
+
+		if (!socket_str) {
+			ERROR(srv, "%s", "fastcgi needs a socket parameter");
+			return NULL;
+		}
+	} else {
+		ERROR(srv, "%s", "fastcgi expects a string or a hash as parameter");
+		return NULL;
 	}
 
-	ctx = fastcgi_context_new(srv, p, val->data.string);
+	ctx = fastcgi_context_new(srv, p, &config, socket_str);
 	if (!ctx) return NULL;
 
+	ctx->multiplex = multiplex;
+
 	return li_action_new_function(fastcgi_handle, NULL, fastcgi_free, ctx);
 }
 
@@ -804,15 +1440,58 @@ static const liPluginSetup setups[] = {
 };
 
 
+static void fastcgi_prepare(liServer *srv, liPlugin *p) {
+	fastcgi_data *fdata = p->data;
+	guint i;
+
+	fdata->worker_count = srv->worker_count;
+	fdata->workers = g_slice_alloc0(sizeof(fastcgi_worker_data) * fdata->worker_count);
+	for (i = 0; i < fdata->worker_count; i++) {
+		fdata->workers[i].pools = g_hash_table_new_full(NULL, NULL, NULL, fastcgi_pool_free);
+	}
+}
+
+static void fastcgi_worker_stop(liServer *srv, liPlugin *p, liWorker *wrk) {
+	fastcgi_data *fdata = p->data;
+	UNUSED(srv);
+
+	if (!fdata->workers) return;
+
+	/* close the idle connections */
+	fdata->workers[wrk->ndx].stopped = TRUE;
+	g_hash_table_remove_all(fdata->workers[wrk->ndx].pools);
+}
+
+static void plugin_free(liServer *srv, liPlugin *p) {
+	fastcgi_data *fdata = p->data;
+	guint i;
+	UNUSED(srv);
+
+	if (fdata->workers) {
+		for (i = 0; i < fdata->worker_count; i++) {
+			g_hash_table_destroy(fdata->workers[i].pools);
+		}
+		g_slice_free1(sizeof(fastcgi_worker_data) * fdata->worker_count, fdata->workers);
+	}
+
+	g_slice_free(fastcgi_data, fdata);
+}
+
 static void plugin_init(liServer *srv, liPlugin *p, gpointer userdata) {
 	UNUSED(srv); UNUSED(userdata);
 
+	p->data = g_slice_new0(fastcgi_data);
+
 	p->options = options;
 	p->actions = actions;
 	p->setups = setups;
 
+	p->free = plugin_free;
+
 	p->handle_request_body = fastcgi_handle_request_body;
 	p->handle_vrclose = fastcgi_close;
+	p->handle_prepare = fastcgi_prepare;
+	p->handle_worker_stop = fastcgi_worker_stop;
 }
 
 
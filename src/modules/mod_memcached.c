@@ -456,7 +456,7 @@ static liHandlerResult memcache_store_filter(liVRequest *vr, liFilter *f) {
 
 		ci = li_chunkqueue_iter(f->in);
 
-		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(vr, ci, 0, 16*1024, &data, &len)))
+		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read_async(vr, ci, 0, 16*1024, &data, &len)))
 			return res;
 
 		if ((gssize) (len + mf->buf->used) > (gssize) mf->ctx->maxsize) {
@@ -11,6 +11,9 @@
  *       ca-file    - contains certificate chain
  *       ciphers    - contains colon separated list of allowed ciphers
  *       allow-ssl2 - boolean option to allow ssl2 (disabled by default)
+ *       ktls       - boolean option to let the kernel encrypt the records after the handshake (kTLS),
+ *                    so responses can use sendfile(); connections with ciphers the kernel doesn't
+ *                    support keep using SSL_write (disabled by default, needs OpenSSL >= 3.0)
  *
  * Example config:
  *     setup openssl [ "listen": "0.0.0.0:8443", "pemfile": "server.pem" ];
@@ -27,6 +30,10 @@
 #include <openssl/err.h>
 #include <openssl/rand.h>
 
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+# define USE_OPENSSL_KTLS
+#endif
+
 LI_API gboolean mod_openssl_init(liModules *mods, liModule *mod);
 LI_API gboolean mod_openssl_free(liModules *mods, liModule *mod);
 
@@ -40,6 +47,8 @@ struct openssl_connection_ctx {
 
 	int con_events;
 	liJob con_handle_events_job;
+
+	gboolean write_pending; /* SSL_write has to be repeated with the same data */
 };
 
 struct openssl_context {
@@ -152,6 +161,18 @@ static liNetworkStatus openssl_con_write(liConnection *con, goffset write_max) {
 	liChunkQueue *cq = con->raw_out;
 	openssl_connection_ctx *conctx = con->srv_sock_data;
 
+#ifdef USE_OPENSSL_KTLS
+	if (!conctx->write_pending && SSL_is_init_finished(conctx->ssl) && BIO_get_ktls_send(SSL_get_wbio(conctx->ssl))) {
+		/* the kernel builds the records: use the normal network backend (sendfile for FILE_CHUNKs) */
+		liNetworkStatus res = li_network_write(con->mainvr, con->sock_watcher.fd, cq, write_max);
+
+		if (0 != cq->length) {
+			li_ev_io_add_events(con->wrk->loop, &con->sock_watcher, EV_WRITE);
+		}
+		return res;
+	}
+#endif
+
 	do {
 		if (0 == cq->length)
 			return LI_NETWORK_STATUS_SUCCESS;
@@ -181,9 +202,11 @@ static liNetworkStatus openssl_con_write(liConnection *con, goffset write_max) {
 
 			switch (SSL_get_error(conctx->ssl, r)) {
 			case SSL_ERROR_WANT_READ:
+				conctx->write_pending = TRUE;
 				li_ev_io_add_events(con->wrk->loop, &con->sock_watcher, EV_READ);
 				return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
 			case SSL_ERROR_WANT_WRITE:
+				conctx->write_pending = TRUE;
 				li_ev_io_add_events(con->wrk->loop, &con->sock_watcher, EV_WRITE);
 				return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
 			case SSL_ERROR_SYSCALL:
@@ -229,6 +252,7 @@ static liNetworkStatus openssl_con_write(liConnection *con, goffset write_max) {
 			}
 		}
 
+		conctx->write_pending = FALSE;
 		li_chunkqueue_skip(cq, r);
 		write_max -= r;
 	} while (r == block_len && write_max > 0);
@@ -435,7 +459,7 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 	/* options */
 	const char *pemfile = NULL, *ca_file = NULL, *ciphers = NULL;
 	GString *ipstr = NULL;
-	gboolean allow_ssl2 = FALSE;
+	gboolean allow_ssl2 = FALSE, ktls = FALSE;
 
 	UNUSED(p); UNUSED(userdata);
 
@@ -478,6 +502,12 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 				return FALSE;
 			}
 			allow_ssl2 = htval->data.boolean;
+		} else if (g_str_equal(htkey->str, "ktls")) {
+			if (htval->type != LI_VALUE_BOOLEAN) {
+				ERROR(srv, "%s", "openssl ktls expects a boolean as parameter");
+				return FALSE;
+			}
+			ktls = htval->data.boolean;
 		}
 	}
 
@@ -506,6 +536,15 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 		}
 	}
 
+	if (ktls) {
+#ifdef USE_OPENSSL_KTLS
+		/* openssl installs the keys with setsockopt(TLS_TX/TLS_RX) after the handshake if the kernel supports the cipher */
+		SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
+#else
+		WARNING(srv, "%s", "openssl ktls: not supported by this OpenSSL build, ignoring");
+#endif
+	}
+
 	if (ciphers) {
 		/* Disable support for low encryption ciphers */
 		if (SSL_CTX_set_cipher_list(ctx->ssl_ctx, ciphers) != 1) {
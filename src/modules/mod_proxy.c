@@ -11,12 +11,20 @@
  * Actions:
  *     proxy <socket>  - connect to backend at <socket>
  *         socket: string, either "ip:port" or "unix:/path"
+ *     proxy <hash>    - same with connection parameters:
+ *         socket          - see above
+ *         max_connections - connections per worker, other requests wait for a free one (default: unlimited)
+ *         connect_timeout - seconds to wait for a free connection and connecting (default 0: no timeout)
+ *         max_idle        - idle keep-alive connections kept per worker (default 16, 0 disables keep-alive)
+ *         idle_timeout    - seconds an idle connection is kept (default 30)
+ *         max_requests    - requests per connection before it gets closed (default 0: unlimited)
+ *
+ * Requests are sent as HTTP/1.1; the end of a response is found from its
+ * Content-Length or chunked encoding, so the connection can be used again.
  *
  * Example config:
  *     proxy "127.0.0.1:9090"
- *
- * TODO:
- *     - keep-alive connections
+ *     proxy [ "socket" => "127.0.0.1:9090", "max_idle" => 64, "max_connections" => 128 ]
  *
  * Author:
  *     Copyright (c) 2009 Stefan Bühler
@@ -37,7 +45,7 @@ typedef struct proxy_context proxy_context;
 typedef enum {
 	SS_WAIT_FOR_REQUEST,
 	SS_CONNECT,
-	SS_CONNECTING,
+	SS_CONNECTING, /* waiting for a backend connection */
 	SS_CONNECTED,
 	SS_DONE
 } proxy_state;
@@ -47,39 +55,42 @@ struct proxy_connection {
 	proxy_context *ctx;
 	liVRequest *vr;
 	proxy_state state;
+	liBackendConnection *bcon;
+	liBackendWait *bwait;
 	int fd;
 	ev_io fd_watcher;
 	liChunkQueue *proxy_in, *proxy_out;
 	liBuffer *proxy_in_buffer;
+	liChunkPipe *proxy_in_pipe;
 
 	liHttpResponseCtx parse_response_ctx;
 	gboolean response_headers_finished;
+
+	gboolean keep_conn; /* didn't send "Connection: close" */
+	gboolean response_keep_alive; /* the backend keeps the connection open */
+	gboolean response_chunked;
+	goffset response_remaining; /* body bytes left; -1: until eof or end of chunked body */
+	gboolean response_finished;
+	liFilterDecodeState chunked_state;
 };
 
 struct proxy_context {
 	gint refcount;
-	liSocketAddress socket;
-	GString *socket_str;
-	guint timeout;
+	liBackendPool *pool;
 	liPlugin *plugin;
 };
 
 /**********************************************************************************/
 
-static proxy_context* proxy_context_new(liServer *srv, liPlugin *p, GString *dest_socket) {
-	liSocketAddress saddr;
+static proxy_context* proxy_context_new(liServer *srv, liPlugin *p, const liBackendConfig *config, GString *dest_socket) {
+	liBackendPool *pool;
 	proxy_context* ctx;
-	saddr = li_sockaddr_from_string(dest_socket, 80);
-	if (NULL == saddr.addr) {
-		ERROR(srv, "Invalid socket address '%s'", dest_socket->str);
-		return NULL;
-	}
+	pool = li_backend_pool_new(srv, config, dest_socket, 80);
+	if (NULL == pool) return NULL;
 	ctx = g_slice_new0(proxy_context);
 	ctx->refcount = 1;
-	ctx->socket = saddr;
-	ctx->timeout = 5;
+	ctx->pool = pool;
 	ctx->plugin = p;
-	ctx->socket_str = g_string_new_len(GSTR_LEN(dest_socket));
 	return ctx;
 }
 
@@ -87,8 +98,7 @@ static void proxy_context_release(proxy_context *ctx) {
 	if (!ctx) return;
 	assert(g_atomic_int_get(&ctx->refcount) > 0);
 	if (g_atomic_int_dec_and_test(&ctx->refcount)) {
-		li_sockaddr_clear(&ctx->socket);
-		g_string_free(ctx->socket_str, TRUE);
+		li_backend_pool_release(ctx->pool);
 		g_slice_free(proxy_context, ctx);
 	}
 }
@@ -98,6 +108,26 @@ static void proxy_context_acquire(proxy_context *ctx) {
 	g_atomic_int_inc(&ctx->refcount);
 }
 
+/**********************************************************************************/
+
+/* the exchange is complete and the backend keeps the connection open */
+static gboolean proxy_connection_reusable(proxy_connection *pcon) {
+	return pcon->keep_conn && pcon->response_keep_alive && pcon->response_finished
+		&& !pcon->proxy_in->is_closed && 0 == pcon->proxy_in->length
+		&& pcon->proxy_out->is_closed && 0 == pcon->proxy_out->length;
+}
+
+/* gives the backend connection back to the pool, or closes it */
+static void proxy_backend_put(liVRequest *vr, proxy_connection *pcon, gboolean closecon) {
+	ev_io_stop(vr->wrk->loop, &pcon->fd_watcher);
+	ev_io_set(&pcon->fd_watcher, -1, 0);
+	li_backend_put(vr->wrk, pcon->ctx->pool, pcon->bcon, closecon);
+	pcon->bcon = NULL;
+	pcon->fd = -1;
+}
+
+/**********************************************************************************/
+
 static void proxy_fd_cb(struct ev_loop *loop, ev_io *w, int revents);
 
 static proxy_connection* proxy_connection_new(liVRequest *vr, proxy_context *ctx) {
@@ -124,13 +154,17 @@ static void proxy_connection_free(proxy_connection *pcon) {
 
 	vr = pcon->vr;
 	ev_io_stop(vr->wrk->loop, &pcon->fd_watcher);
+	li_backend_wait_stop(vr, pcon->ctx->pool, &pcon->bwait);
+	if (NULL != pcon->bcon) {
+		proxy_backend_put(vr, pcon, !proxy_connection_reusable(pcon));
+	}
 	proxy_context_release(pcon->ctx);
-	if (pcon->fd != -1) close(pcon->fd);
 	li_vrequest_backend_finished(vr);
 
 	li_chunkqueue_free(pcon->proxy_in);
 	li_chunkqueue_free(pcon->proxy_out);
 	li_buffer_release(pcon->proxy_in_buffer);
+	li_chunkpipe_release(pcon->proxy_in_pipe);
 
 	li_http_response_parser_clear(&pcon->parse_response_ctx);
 
@@ -168,26 +202,30 @@ static void proxy_send_headers(liVRequest *vr, proxy_connection *pcon) {
 		g_string_append_len(head, GSTR_LEN(vr->request.uri.query));
 	}
 
-	switch (vr->request.http_version) {
-	case LI_HTTP_VERSION_1_1:
-		/* g_string_append_len(head, CONST_STR_LEN(" HTTP/1.1\r\n")); */
-		g_string_append_len(head, CONST_STR_LEN(" HTTP/1.0\r\n"));
-		break;
-	case LI_HTTP_VERSION_1_0:
-	default:
-		g_string_append_len(head, CONST_STR_LEN(" HTTP/1.0\r\n"));
-		break;
-	}
+	/* HTTP/1.1 for the backend connection, independent of the client */
+	g_string_append_len(head, CONST_STR_LEN(" HTTP/1.1\r\n"));
 
 	for (iter = g_queue_peek_head_link(&vr->request.headers->entries); iter; iter = g_list_next(iter)) {
 		header = (liHttpHeader*) iter->data;
 		if (li_http_header_key_is(header, CONST_STR_LEN("Connection"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("Proxy-Connection"))) continue;
+		if (li_http_header_key_is(header, CONST_STR_LEN("Keep-Alive"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("X-Forwarded-Proto"))) continue;
 		g_string_append_len(head, GSTR_LEN(header->data));
 		g_string_append_len(head, CONST_STR_LEN("\r\n"));
 	}
 
+	/* HTTP/1.1 requires a Host header */
+	if (NULL == li_http_header_lookup(vr->request.headers, CONST_STR_LEN("Host"))) {
+		g_string_append_len(head, CONST_STR_LEN("Host: "));
+		g_string_append_len(head, GSTR_LEN(vr->request.uri.authority));
+		g_string_append_len(head, CONST_STR_LEN("\r\n"));
+	}
+
+	if (!pcon->keep_conn) {
+		g_string_append_len(head, CONST_STR_LEN("Connection: close\r\n"));
+	}
+
 	g_string_append_len(head, CONST_STR_LEN("X-Forwarded-For: "));
 	g_string_append_len(head, GSTR_LEN(vr->coninfo->remote_addr_str));
 	g_string_append_len(head, CONST_STR_LEN("\r\n"));
@@ -206,7 +244,7 @@ static void proxy_send_headers(liVRequest *vr, proxy_connection *pcon) {
 
 static void proxy_forward_request(liVRequest *vr, proxy_connection *pcon) {
 	stream_send_chunks(pcon->proxy_out, vr->in);
-	if (pcon->proxy_out->length > 0)
+	if (pcon->proxy_out->length > 0 && pcon->fd != -1)
 		li_ev_io_add_events(vr->wrk->loop, &pcon->fd_watcher, EV_WRITE);
 }
 
@@ -214,33 +252,159 @@ static void proxy_forward_request(liVRequest *vr, proxy_connection *pcon) {
 
 static liHandlerResult proxy_statemachine(liVRequest *vr, proxy_connection *pcon);
 
-static void proxy_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
-	proxy_connection *pcon = (proxy_connection*) w->data;
+/* find out where the response body ends, and whether the backend keeps the connection */
+static void proxy_response_framing(liVRequest *vr, proxy_connection *pcon) {
+	liHttpHeaders *headers = vr->response.headers;
+	liHttpHeader *hh;
+	gint status = vr->response.http_status;
+
+	switch (pcon->parse_response_ctx.http_version) {
+	case LI_HTTP_VERSION_1_1:
+		pcon->response_keep_alive = !li_http_header_is(headers, CONST_STR_LEN("connection"), CONST_STR_LEN("close"));
+		break;
+	case LI_HTTP_VERSION_1_0:
+		pcon->response_keep_alive = li_http_header_is(headers, CONST_STR_LEN("connection"), CONST_STR_LEN("keep-alive"));
+		break;
+	default:
+		pcon->response_keep_alive = FALSE;
+		break;
+	}
+
+	pcon->response_remaining = -1;
+	if (vr->request.http_method == LI_HTTP_METHOD_HEAD || status == 204 || status == 304) {
+		pcon->response_remaining = 0;
+	} else if (li_http_header_is(headers, CONST_STR_LEN("transfer-encoding"), CONST_STR_LEN("chunked"))) {
+		/* forward the decoded body; it gets encoded again for the client if needed */
+		pcon->response_chunked = TRUE;
+		li_http_header_remove(headers, CONST_STR_LEN("transfer-encoding"));
+		li_http_header_remove(headers, CONST_STR_LEN("content-length"));
+	} else if (NULL != li_http_header_lookup(headers, CONST_STR_LEN("transfer-encoding"))) {
+		/* unknown encoding: read until eof */
+		li_http_header_remove(headers, CONST_STR_LEN("content-length"));
+	} else if (NULL != (hh = li_http_header_lookup(headers, CONST_STR_LEN("content-length")))) {
+		gchar *err;
+		gint64 len = g_ascii_strtoll(LI_HEADER_VALUE(hh), &err, 10);
+
+		if ('\0' == *err && len >= 0 && len < G_MAXINT64) pcon->response_remaining = len;
+	}
+
+	if (-1 == pcon->response_remaining && !pcon->response_chunked) {
+		/* the body ends with the connection */
+		pcon->response_keep_alive = FALSE;
+	}
+}
+
+/* safe methods (RFC 7231 4.2.1) may be retried automatically, others could run twice */
+static gboolean proxy_method_is_safe(liHttpMethod method) {
+	switch (method) {
+	case LI_HTTP_METHOD_GET:
+	case LI_HTTP_METHOD_HEAD:
+	case LI_HTTP_METHOD_OPTIONS:
+	case LI_HTTP_METHOD_PROPFIND:
+	case LI_HTTP_METHOD_REPORT:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* the backend closed a connection from the idle pool before answering:
+ * a safe request without body can be sent again on a new connection
+ */
+static gboolean proxy_retry(liVRequest *vr, proxy_connection *pcon) {
+	if (pcon->bcon->requests < 2 || pcon->response_headers_finished || pcon->proxy_in->length > 0
+	    || vr->request.content_length > 0 || !proxy_method_is_safe(vr->request.http_method)) return FALSE;
+
+	proxy_backend_put(vr, pcon, TRUE);
+
+	li_chunkqueue_reset(pcon->proxy_in);
+	li_chunkqueue_reset(pcon->proxy_out);
+	li_http_response_parser_reset(&pcon->parse_response_ctx);
+	pcon->state = SS_CONNECT;
 
-	if (pcon->state == SS_CONNECTING) {
-		if (LI_HANDLER_GO_ON != proxy_statemachine(pcon->vr, pcon)) {
-			li_vrequest_error(pcon->vr);
+	if (LI_HANDLER_GO_ON != proxy_statemachine(vr, pcon)) {
+		li_vrequest_error(vr);
+	}
+	return TRUE;
+}
+
+static void proxy_forward_response(liVRequest *vr, proxy_connection *pcon) {
+	if (!pcon->response_headers_finished) {
+		switch (li_http_response_parse(vr, &pcon->parse_response_ctx)) {
+		case LI_HANDLER_GO_ON:
+			pcon->response_headers_finished = TRUE;
+			proxy_response_framing(vr, pcon);
+			li_vrequest_handle_response_headers(vr);
+			break;
+		case LI_HANDLER_ERROR:
+			VR_ERROR(vr, "(%s) Parsing response header failed", pcon->ctx->pool->name->str);
+			li_vrequest_error(vr);
+			return;
+		default:
+			break;
 		}
-		return;
 	}
 
+	if (!pcon->response_headers_finished || pcon->response_finished) return;
+
+	if (pcon->response_chunked) {
+		if (LI_HANDLER_ERROR == li_filter_chunked_decode(vr, vr->out, pcon->proxy_in, &pcon->chunked_state)) {
+			VR_ERROR(vr, "(%s) invalid chunked response body", pcon->ctx->pool->name->str);
+			li_vrequest_error(vr);
+			return;
+		}
+		pcon->response_finished = vr->out->is_closed;
+	} else if (pcon->response_remaining >= 0) {
+		pcon->response_remaining -= li_chunkqueue_steal_len(vr->out, pcon->proxy_in, pcon->response_remaining);
+		pcon->response_finished = (0 == pcon->response_remaining);
+		vr->out->is_closed = pcon->response_finished;
+	} else {
+		li_chunkqueue_steal_all(vr->out, pcon->proxy_in);
+		vr->out->is_closed = pcon->proxy_in->is_closed;
+	}
+	li_vrequest_handle_response_body(vr);
+
+	if (pcon->response_finished && proxy_connection_reusable(pcon)) {
+		/* don't keep the connection until the client got everything */
+		proxy_backend_put(vr, pcon, FALSE);
+		li_vrequest_backend_finished(vr);
+	}
+}
+
+static void proxy_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
+	proxy_connection *pcon = (proxy_connection*) w->data;
+	liVRequest *vr = pcon->vr;
+
 	if (revents & EV_READ) {
-		if (pcon->proxy_in->is_closed) {
+		if (pcon->proxy_in->is_closed || pcon->response_finished) {
 			li_ev_io_rem_events(loop, w, EV_READ);
 		} else {
-			switch (li_network_read(pcon->vr, w->fd, pcon->proxy_in, &pcon->proxy_in_buffer)) {
+			liNetworkStatus res;
+
+			if (pcon->response_headers_finished && !pcon->response_chunked
+			    && (-1 == pcon->response_remaining || pcon->response_remaining > pcon->proxy_in->length)) {
+				/* the body is only forwarded: splice it (but nothing after its end) */
+				goffset len = pcon->response_remaining;
+				if (len > 0) len -= pcon->proxy_in->length;
+				res = li_network_read_splice(vr, w->fd, pcon->proxy_in, len, &pcon->proxy_in_buffer, &pcon->proxy_in_pipe);
+			} else {
+				res = li_network_read(vr, w->fd, pcon->proxy_in, &pcon->proxy_in_buffer);
+			}
+
+			switch (res) {
 			case LI_NETWORK_STATUS_SUCCESS:
+				li_backend_first_byte(vr->wrk, pcon->bcon);
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(pcon->vr, "(%s) network read fatal error", pcon->ctx->socket_str->str);
-				li_vrequest_error(pcon->vr);
+				if (proxy_retry(vr, pcon)) return;
+				VR_ERROR(vr, "(%s) network read fatal error", pcon->ctx->pool->name->str);
+				li_vrequest_error(vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+				if (proxy_retry(vr, pcon)) return;
 				pcon->proxy_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(pcon->fd);
-				pcon->fd = -1;
-				li_vrequest_backend_finished(pcon->vr);
+				proxy_backend_put(vr, pcon, TRUE);
+				li_vrequest_backend_finished(vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
 				break;
@@ -250,47 +414,35 @@ static void proxy_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 
 	if (pcon->fd != -1 && (revents & EV_WRITE)) {
 		if (pcon->proxy_out->length > 0) {
-			switch (li_network_write(pcon->vr, w->fd, pcon->proxy_out, 256*1024)) {
+			switch (li_network_write(vr, w->fd, pcon->proxy_out, 256*1024)) {
 			case LI_NETWORK_STATUS_SUCCESS:
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(pcon->vr, "(%s) network write fatal error", pcon->ctx->socket_str->str);
-				li_vrequest_error(pcon->vr);
+				if (proxy_retry(vr, pcon)) return;
+				VR_ERROR(vr, "(%s) network write fatal error", pcon->ctx->pool->name->str);
+				li_vrequest_error(vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
+				if (proxy_retry(vr, pcon)) return;
 				pcon->proxy_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(pcon->fd);
-				pcon->fd = -1;
-				li_vrequest_backend_finished(pcon->vr);
+				proxy_backend_put(vr, pcon, TRUE);
+				li_vrequest_backend_finished(vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
 				break;
 			}
 		}
-		if (pcon->proxy_out->length == 0) {
+		if (pcon->fd != -1 && pcon->proxy_out->length == 0) {
 			li_ev_io_rem_events(loop, w, EV_WRITE);
 		}
 	}
 
-	if (!pcon->response_headers_finished && LI_HANDLER_GO_ON == li_http_response_parse(pcon->vr, &pcon->parse_response_ctx)) {
-		/* "ignore" 1xx response headers */
-		if (!(pcon->vr->response.http_status >= 100 && pcon->vr->response.http_status < 200)) {
-			pcon->response_headers_finished = TRUE;
-			li_vrequest_handle_response_headers(pcon->vr);
-		}
-	}
-
-	if (pcon->response_headers_finished) {
-		li_chunkqueue_steal_all(pcon->vr->out, pcon->proxy_in);
-		pcon->vr->out->is_closed = pcon->proxy_in->is_closed;
-		li_vrequest_handle_response_body(pcon->vr);
-	}
+	proxy_forward_response(vr, pcon);
 
-	/* only possible if we didn't found a header */
-	if (pcon->proxy_in->is_closed && !pcon->vr->out->is_closed) {
-		VR_ERROR(pcon->vr, "(%s) unexpected end-of-file (perhaps the proxy process died)", pcon->ctx->socket_str->str);
-		li_vrequest_error(pcon->vr);
+	/* only possible if we didn't find a header or the body ended early */
+	if (pcon->proxy_in->is_closed && !vr->out->is_closed) {
+		VR_ERROR(vr, "(%s) unexpected end-of-file (perhaps the proxy process died)", pcon->ctx->pool->name->str);
+		li_vrequest_error(vr);
 	}
 }
 
@@ -299,8 +451,19 @@ static void proxy_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 
 static void proxy_close(liVRequest *vr, liPlugin *p);
 
+static void proxy_start_request(liVRequest *vr, proxy_connection *pcon) {
+	liBackendConfig *config = &pcon->ctx->pool->config;
+
+	pcon->state = SS_CONNECTED;
+	pcon->keep_conn = (config->max_idle > 0 && (0 == config->max_requests || pcon->bcon->requests < config->max_requests));
+
+	/* prepare stream */
+	proxy_send_headers(vr, pcon);
+}
+
 static liHandlerResult proxy_statemachine(liVRequest *vr, proxy_connection *pcon) {
 	liPlugin *p = pcon->ctx->plugin;
+	liBackendError berror;
 
 	switch (pcon->state) {
 	case SS_WAIT_FOR_REQUEST:
@@ -309,49 +472,23 @@ static liHandlerResult proxy_statemachine(liVRequest *vr, proxy_connection *pcon
 
 		/* fall through */
 	case SS_CONNECT:
-		do {
-			pcon->fd = socket(pcon->ctx->socket.addr->plain.sa_family, SOCK_STREAM, 0);
-		} while (-1 == pcon->fd && errno == EINTR);
-		if (-1 == pcon->fd) {
-			if (errno == EMFILE) {
-				li_server_out_of_fds(vr->wrk->srv);
-			}
-			VR_ERROR(vr, "Couldn't open socket: %s", g_strerror(errno));
-			return LI_HANDLER_ERROR;
-		}
-		li_fd_init(pcon->fd);
-		ev_io_set(&pcon->fd_watcher, pcon->fd, EV_READ | EV_WRITE);
-		ev_io_start(vr->wrk->loop, &pcon->fd_watcher);
-
-		/* fall through */
 	case SS_CONNECTING:
-		if (-1 == connect(pcon->fd, &pcon->ctx->socket.addr->plain, pcon->ctx->socket.len)) {
-			switch (errno) {
-			case EINPROGRESS:
-			case EALREADY:
-			case EINTR:
-				pcon->state = SS_CONNECTING;
-				return LI_HANDLER_GO_ON;
-			case EAGAIN: /* backend overloaded */
-				proxy_close(vr, p);
-				li_vrequest_backend_overloaded(vr);
-				return LI_HANDLER_GO_ON;
-			case EISCONN:
-				break;
-			default:
-				VR_ERROR(vr, "Couldn't connect to '%s': %s",
-					li_sockaddr_to_string(pcon->ctx->socket, vr->wrk->tmp_str, TRUE)->str,
-					g_strerror(errno));
-				proxy_close(vr, p);
-				li_vrequest_backend_dead(vr);
-				return LI_HANDLER_GO_ON;
-			}
+		switch (li_backend_get(vr, pcon->ctx->pool, &pcon->bcon, &pcon->bwait, &berror)) {
+		case LI_BACKEND_SUCCESS:
+			break;
+		case LI_BACKEND_WAIT:
+			pcon->state = SS_CONNECTING;
+			return LI_HANDLER_GO_ON;
+		case LI_BACKEND_ERROR:
+			proxy_close(vr, p);
+			li_vrequest_backend_error(vr, berror);
+			return LI_HANDLER_GO_ON;
 		}
 
-		pcon->state = SS_CONNECTED;
-
-		/* prepare stream */
-		proxy_send_headers(vr, pcon);
+		pcon->fd = pcon->bcon->fd;
+		ev_io_set(&pcon->fd_watcher, pcon->fd, EV_READ | EV_WRITE);
+		ev_io_start(vr->wrk->loop, &pcon->fd_watcher);
+		proxy_start_request(vr, pcon);
 
 		/* fall through */
 	case SS_CONNECTED:
@@ -414,14 +551,45 @@ static void proxy_free(liServer *srv, gpointer param) {
 
 static liAction* proxy_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	proxy_context *ctx;
+	GString *socket_str = NULL;
+	liBackendConfig config;
+
 	UNUSED(wrk); UNUSED(userdata);
 
-	if (val->type != LI_VALUE_STRING) {
-		ERROR(srv, "%s", "proxy expects a string as parameter");
-		return FALSE;
+	li_backend_config_init(&config);
+	config.max_idle = 16;
+
+	if (val->type == LI_VALUE_STRING) {
+		socket_str = val->data.string;
+	} else if (val->type == LI_VALUE_HASH) {
+		GHashTableIter hti;
+		gpointer hkey, hvalue;
+
+		g_hash_table_iter_init(&hti, val->data.hash);
+		while (g_hash_table_iter_next(&hti, &hkey, &hvalue)) {
+			GString *htkey = hkey;
+
+			switch (li_backend_config_option(srv, "proxy", &config, &socket_str, htkey->str, hvalue)) {
+			case 1:
+				break;
+			case 0:
+				ERROR(srv, "unknown option for proxy '%s'", htkey->str);
+				return NULL;
+			default:
+				return NULL;
+			}
+		}
+
+		if (!socket_str) {
+			ERROR(srv, "%s", "proxy needs a socket parameter");
+			return NULL;
+		}
+	} else {
+		ERROR(srv, "%s", "proxy expects a string or a hash as parameter");
+		return NULL;
 	}
 
-	ctx = proxy_context_new(srv, p, val->data.string);
+	ctx = proxy_context_new(srv, p, &config, socket_str);
 	if (!ctx) return NULL;
 
 	return li_action_new_function(proxy_handle, NULL, proxy_free, ctx);
@@ -11,9 +11,16 @@
  * Actions:
  *     scgi <socket>  - connect to backend at <socket>
  *         socket: string, either "ip:port" or "unix:/path"
+ *     scgi <hash>    - same with connection parameters:
+ *         socket          - see above
+ *         max_connections - connections per worker, other requests wait for a free one (default: unlimited)
+ *         connect_timeout - seconds to wait for a free connection and connecting (default 0: no timeout)
+ *
+ * SCGI closes the connection after each request, so there is no keep-alive.
  *
  * Example config:
  *     scgi "127.0.0.1:9090"
+ *     scgi [ "socket" => "127.0.0.1:9090", "max_connections" => 32 ]
  *
  * Author:
  *     Copyright (c) 2009 Stefan Bühler
@@ -34,7 +41,7 @@ typedef struct scgi_context scgi_context;
 typedef enum {
 	SS_WAIT_FOR_REQUEST,
 	SS_CONNECT,
-	SS_CONNECTING,
+	SS_CONNECTING, /* waiting for a backend connection */
 	SS_CONNECTED,
 	SS_DONE
 } scgi_state;
@@ -44,10 +51,13 @@ struct scgi_connection {
 	scgi_context *ctx;
 	liVRequest *vr;
 	scgi_state state;
+	liBackendConnection *bcon;
+	liBackendWait *bwait;
 	int fd;
 	ev_io fd_watcher;
 	liChunkQueue *scgi_in, *scgi_out;
 	liBuffer *scgi_in_buffer;
+	liChunkPipe *scgi_in_pipe;
 
 	liHttpResponseCtx parse_response_ctx;
 	gboolean response_headers_finished;
@@ -55,28 +65,21 @@ struct scgi_connection {
 
 struct scgi_context {
 	gint refcount;
-	liSocketAddress socket;
-	GString *socket_str;
-	guint timeout;
+	liBackendPool *pool;
 	liPlugin *plugin;
 };
 
 /**********************************************************************************/
 
-static scgi_context* scgi_context_new(liServer *srv, liPlugin *p, GString *dest_socket) {
-	liSocketAddress saddr;
+static scgi_context* scgi_context_new(liServer *srv, liPlugin *p, const liBackendConfig *config, GString *dest_socket) {
+	liBackendPool *pool;
 	scgi_context* ctx;
-	saddr = li_sockaddr_from_string(dest_socket, 0);
-	if (NULL == saddr.addr) {
-		ERROR(srv, "Invalid socket address '%s'", dest_socket->str);
-		return NULL;
-	}
+	pool = li_backend_pool_new(srv, config, dest_socket, 0);
+	if (NULL == pool) return NULL;
 	ctx = g_slice_new0(scgi_context);
 	ctx->refcount = 1;
-	ctx->socket = saddr;
-	ctx->timeout = 5;
+	ctx->pool = pool;
 	ctx->plugin = p;
-	ctx->socket_str = g_string_new_len(GSTR_LEN(dest_socket));
 	return ctx;
 }
 
@@ -84,8 +87,7 @@ static void scgi_context_release(scgi_context *ctx) {
 	if (!ctx) return;
 	assert(g_atomic_int_get(&ctx->refcount) > 0);
 	if (g_atomic_int_dec_and_test(&ctx->refcount)) {
-		li_sockaddr_clear(&ctx->socket);
-		g_string_free(ctx->socket_str, TRUE);
+		li_backend_pool_release(ctx->pool);
 		g_slice_free(scgi_context, ctx);
 	}
 }
@@ -95,6 +97,15 @@ static void scgi_context_acquire(scgi_context *ctx) {
 	g_atomic_int_inc(&ctx->refcount);
 }
 
+/* scgi connections are never reused: closes the backend connection */
+static void scgi_backend_close(liVRequest *vr, scgi_connection *scon) {
+	ev_io_stop(vr->wrk->loop, &scon->fd_watcher);
+	ev_io_set(&scon->fd_watcher, -1, 0);
+	li_backend_put(vr->wrk, scon->ctx->pool, scon->bcon, TRUE);
+	scon->bcon = NULL;
+	scon->fd = -1;
+}
+
 static void scgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents);
 
 static scgi_connection* scgi_connection_new(liVRequest *vr, scgi_context *ctx) {
@@ -121,13 +132,15 @@ static void scgi_connection_free(scgi_connection *scon) {
 
 	vr = scon->vr;
 	ev_io_stop(vr->wrk->loop, &scon->fd_watcher);
+	li_backend_wait_stop(vr, scon->ctx->pool, &scon->bwait);
+	if (NULL != scon->bcon) scgi_backend_close(vr, scon);
 	scgi_context_release(scon->ctx);
-	if (scon->fd != -1) close(scon->fd);
 	li_vrequest_backend_finished(vr);
 
 	li_chunkqueue_free(scon->scgi_in);
 	li_chunkqueue_free(scon->scgi_out);
 	li_buffer_release(scon->scgi_in_buffer);
+	li_chunkpipe_release(scon->scgi_in_pipe);
 
 	li_http_response_parser_clear(&scon->parse_response_ctx);
 
@@ -320,29 +333,30 @@ static liHandlerResult scgi_statemachine(liVRequest *vr, scgi_connection *scon);
 static void scgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 	scgi_connection *scon = (scgi_connection*) w->data;
 
-	if (scon->state == SS_CONNECTING) {
-		if (LI_HANDLER_GO_ON != scgi_statemachine(scon->vr, scon)) {
-			li_vrequest_error(scon->vr);
-		}
-		return;
-	}
-
 	if (revents & EV_READ) {
 		if (scon->scgi_in->is_closed) {
 			li_ev_io_rem_events(loop, w, EV_READ);
 		} else {
-			switch (li_network_read(scon->vr, w->fd, scon->scgi_in, &scon->scgi_in_buffer)) {
+			liNetworkStatus res;
+
+			if (scon->response_headers_finished) {
+				/* the body is only forwarded: splice it */
+				res = li_network_read_splice(scon->vr, w->fd, scon->scgi_in, -1, &scon->scgi_in_buffer, &scon->scgi_in_pipe);
+			} else {
+				res = li_network_read(scon->vr, w->fd, scon->scgi_in, &scon->scgi_in_buffer);
+			}
+
+			switch (res) {
 			case LI_NETWORK_STATUS_SUCCESS:
+				li_backend_first_byte(scon->vr->wrk, scon->bcon);
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(scon->vr, "(%s) network read fatal error", scon->ctx->socket_str->str);
+				VR_ERROR(scon->vr, "(%s) network read fatal error", scon->ctx->pool->name->str);
 				li_vrequest_error(scon->vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
 				scon->scgi_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(scon->fd);
-				scon->fd = -1;
+				scgi_backend_close(scon->vr, scon);
 				li_vrequest_backend_finished(scon->vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
@@ -357,14 +371,12 @@ static void scgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 			case LI_NETWORK_STATUS_SUCCESS:
 				break;
 			case LI_NETWORK_STATUS_FATAL_ERROR:
-				VR_ERROR(scon->vr, "(%s) network write fatal error", scon->ctx->socket_str->str);
+				VR_ERROR(scon->vr, "(%s) network write fatal error", scon->ctx->pool->name->str);
 				li_vrequest_error(scon->vr);
 				return;
 			case LI_NETWORK_STATUS_CONNECTION_CLOSE:
 				scon->scgi_in->is_closed = TRUE;
-				ev_io_stop(loop, w);
-				close(scon->fd);
-				scon->fd = -1;
+				scgi_backend_close(scon->vr, scon);
 				li_vrequest_backend_finished(scon->vr);
 				break;
 			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
@@ -389,7 +401,7 @@ static void scgi_fd_cb(struct ev_loop *loop, ev_io *w, int revents) {
 
 	/* only possible if we didn't found a header */
 	if (scon->scgi_in->is_closed && !scon->vr->out->is_closed) {
-		VR_ERROR(scon->vr, "(%s) unexpected end-of-file (perhaps the scgi process died)", scon->ctx->socket_str->str);
+		VR_ERROR(scon->vr, "(%s) unexpected end-of-file (perhaps the scgi process died)", scon->ctx->pool->name->str);
 		li_vrequest_error(scon->vr);
 	}
 }
@@ -401,6 +413,7 @@ static void scgi_close(liVRequest *vr, liPlugin *p);
 
 static liHandlerResult scgi_statemachine(liVRequest *vr, scgi_connection *scon) {
 	liPlugin *p = scon->ctx->plugin;
+	liBackendError berror;
 
 	switch (scon->state) {
 	case SS_WAIT_FOR_REQUEST:
@@ -415,45 +428,23 @@ static liHandlerResult scgi_statemachine(liVRequest *vr, scgi_connection *scon)
 
 		/* fall through */
 	case SS_CONNECT:
-		do {
-			scon->fd = socket(scon->ctx->socket.addr->plain.sa_family, SOCK_STREAM, 0);
-		} while (-1 == scon->fd && errno == EINTR);
-		if (-1 == scon->fd) {
-			if (errno == EMFILE) {
-				li_server_out_of_fds(vr->wrk->srv);
-			}
-			VR_ERROR(vr, "Couldn't open socket: %s", g_strerror(errno));
-			return LI_HANDLER_ERROR;
+	case SS_CONNECTING:
+		switch (li_backend_get(vr, scon->ctx->pool, &scon->bcon, &scon->bwait, &berror)) {
+		case LI_BACKEND_SUCCESS:
+			break;
+		case LI_BACKEND_WAIT:
+			scon->state = SS_CONNECTING;
+			return LI_HANDLER_GO_ON;
+		case LI_BACKEND_ERROR:
+			scgi_close(vr, p);
+			li_vrequest_backend_error(vr, berror);
+			return LI_HANDLER_GO_ON;
 		}
-		li_fd_init(scon->fd);
+
+		scon->fd = scon->bcon->fd;
 		ev_io_set(&scon->fd_watcher, scon->fd, EV_READ | EV_WRITE);
 		ev_io_start(vr->wrk->loop, &scon->fd_watcher);
 
-		/* fall through */
-	case SS_CONNECTING:
-		if (-1 == connect(scon->fd, &scon->ctx->socket.addr->plain, scon->ctx->socket.len)) {
-			switch (errno) {
-			case EINPROGRESS:
-			case EALREADY:
-			case EINTR:
-				scon->state = SS_CONNECTING;
-				return LI_HANDLER_GO_ON;
-			case EAGAIN: /* backend overloaded */
-				scgi_close(vr, p);
-				li_vrequest_backend_overloaded(vr);
-				return LI_HANDLER_GO_ON;
-			case EISCONN:
-				break;
-			default:
-				VR_ERROR(vr, "Couldn't connect to '%s': %s",
-					li_sockaddr_to_string(scon->ctx->socket, vr->wrk->tmp_str, TRUE)->str,
-					g_strerror(errno));
-				scgi_close(vr, p);
-				li_vrequest_backend_dead(vr);
-				return LI_HANDLER_GO_ON;
-			}
-		}
-
 		scon->state = SS_CONNECTED;
 
 		/* prepare stream */
@@ -520,14 +511,49 @@ static void scgi_free(liServer *srv, gpointer param) {
 
 static liAction* scgi_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	scgi_context *ctx;
+	GString *socket_str = NULL;
+	liBackendConfig config;
+
 	UNUSED(wrk); UNUSED(userdata);
 
-	if (val->type != LI_VALUE_STRING) {
-		ERROR(srv, "%s", "scgi expects a string as parameter");
-		return FALSE;
+	li_backend_config_init(&config);
+
+	if (val->type == LI_VALUE_STRING) {
+		socket_str = val->data.string;
+	} else if (val->type == LI_VALUE_HASH) {
+		GHashTableIter hti;
+		gpointer hkey, hvalue;
+
+		g_hash_table_iter_init(&hti, val->data.hash);
+		while (g_hash_table_iter_next(&hti, &hkey, &hvalue)) {
+			GString *htkey = hkey;
+
+			if (g_str_equal(htkey->str, "max_idle") || g_str_equal(htkey->str, "idle_timeout") || g_str_equal(htkey->str, "max_requests")) {
+				ERROR(srv, "scgi doesn't support keep-alive, '%s' not allowed", htkey->str);
+				return NULL;
+			}
+
+			switch (li_backend_config_option(srv, "scgi", &config, &socket_str, htkey->str, hvalue)) {
+			case 1:
+				break;
+			case 0:
+				ERROR(srv, "unknown option for scgi '%s'", htkey->str);
+				return NULL;
+			default:
+				return NULL;
+			}
+		}
+
+		if (!socket_str) {
+			ERROR(srv, "%s", "scgi needs a socket parameter");
+			return NULL;
+		}
+	} else {
+		ERROR(srv, "%s", "scgi expects a string or a hash as parameter");
+		return NULL;
 	}
 
-	ctx = scgi_context_new(srv, p, val->data.string);
+	ctx = scgi_context_new(srv, p, &config, socket_str);
 	if (!ctx) return NULL;
 
 	return li_action_new_function(scgi_handle, NULL, scgi_free, ctx);
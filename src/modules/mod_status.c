@@ -188,6 +188,34 @@ static const gchar html_connections_sum[] =
 	"				<td>%u</td>\n"
 	"			</tr>\n"
 	"		</table>\n";
+static const gchar html_content_cache[] =
+	"		<table cellspacing=\"0\">\n"
+	"			<tr>\n"
+	"				<th style=\"width: 100px;\">hits</th>\n"
+	"				<th style=\"width: 175px;\">misses</th>\n"
+	"				<th style=\"width: 175px;\">cached files</th>\n"
+	"				<th style=\"width: 175px;\">cached bytes</th>\n"
+	"			</tr>\n"
+	"			<tr>\n"
+	"				<td>%s</td>\n"
+	"				<td>%s</td>\n"
+	"				<td>%u</td>\n"
+	"				<td>%s</td>\n"
+	"			</tr>\n"
+	"		</table>\n";
+static const gchar html_backend_pool[] =
+	"		<table cellspacing=\"0\">\n"
+	"			<tr>\n"
+	"				<th style=\"width: 100px;\">hits</th>\n"
+	"				<th style=\"width: 175px;\">misses</th>\n"
+	"				<th style=\"width: 175px;\">idle connections</th>\n"
+	"			</tr>\n"
+	"			<tr>\n"
+	"				<td>%s</td>\n"
+	"				<td>%s</td>\n"
+	"				<td>%u</td>\n"
+	"			</tr>\n"
+	"		</table>\n";
 static const gchar html_status_codes[] =
 	"		<table cellspacing=\"0\">\n"
 	"			<tr>\n"
@@ -499,6 +527,13 @@ static void status_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result
 			totals.bytes_in += sd->stats.bytes_in;
 			totals.requests += sd->stats.requests;
 			totals.actions_executed += sd->stats.actions_executed;
+			totals.backend_pool_hits += sd->stats.backend_pool_hits;
+			totals.backend_pool_misses += sd->stats.backend_pool_misses;
+			totals.backend_pool_idle += sd->stats.backend_pool_idle;
+			for (j = 0; j < LI_BACKEND_LATENCY_BUCKETS; j++) {
+				totals.backend_connect_latency[j] += sd->stats.backend_connect_latency[j];
+				totals.backend_first_byte_latency[j] += sd->stats.backend_first_byte_latency[j];
+			}
 			total_connections += sd->connections->len;
 
 			totals.requests_5s_diff += sd->stats.requests_5s_diff;
@@ -748,6 +783,53 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 		mod_status_response_codes[2], mod_status_response_codes[3], mod_status_response_codes[4]
 	);
 
+	/* content cache */
+	if (NULL != vr->wrk->srv->content_cache) {
+		liContentCacheStats ccs;
+
+		li_content_cache_get_stats(vr->wrk->srv->content_cache, &ccs);
+		li_counter_format(ccs.hits, COUNTER_UNITS, count_req);
+		li_counter_format(ccs.misses, COUNTER_UNITS, count_bin);
+		li_counter_format(ccs.bytes, COUNTER_BYTES, count_bout);
+		g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Content cache</strong></div>\n"));
+		g_string_append_printf(html, html_content_cache, count_req->str, count_bin->str, ccs.entries, count_bout->str);
+	}
+
+	/* backend connection pools */
+	if (0 != totals->backend_pool_hits + totals->backend_pool_misses) {
+		li_counter_format(totals->backend_pool_hits, COUNTER_UNITS, count_req);
+		li_counter_format(totals->backend_pool_misses, COUNTER_UNITS, count_bin);
+		g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Backend connection pools</strong></div>\n"));
+		g_string_append_printf(html, html_backend_pool, count_req->str, count_bin->str, totals->backend_pool_idle);
+	}
+
+	/* backend latency */
+	for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+		if (0 != totals->backend_connect_latency[i] + totals->backend_first_byte_latency[i]) break;
+	}
+	if (i < LI_BACKEND_LATENCY_BUCKETS) {
+		g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Backend latency</strong></div>\n"));
+		g_string_append_len(html, CONST_STR_LEN("\t\t<table cellspacing=\"0\">\n\t\t\t<tr>\n\t\t\t\t<th></th>\n"));
+		for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+			if (i < LI_BACKEND_LATENCY_BUCKETS - 1) {
+				g_string_append_printf(html, "\t\t\t\t<th>&lt; %ums</th>\n", li_backend_latency_bucket_limit(i));
+			} else {
+				g_string_append_printf(html, "\t\t\t\t<th>&gt;= %ums</th>\n", li_backend_latency_bucket_limit(i - 1));
+			}
+		}
+		g_string_append_len(html, CONST_STR_LEN("\t\t\t</tr>\n\t\t\t<tr>\n\t\t\t\t<td>connect</td>\n"));
+		for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+			li_counter_format(totals->backend_connect_latency[i], COUNTER_UNITS, count_req);
+			g_string_append_printf(html, "\t\t\t\t<td>%s</td>\n", count_req->str);
+		}
+		g_string_append_len(html, CONST_STR_LEN("\t\t\t</tr>\n\t\t\t<tr>\n\t\t\t\t<td>first byte</td>\n"));
+		for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+			li_counter_format(totals->backend_first_byte_latency[i], COUNTER_UNITS, count_req);
+			g_string_append_printf(html, "\t\t\t\t<td>%s</td>\n", count_req->str);
+		}
+		g_string_append_len(html, CONST_STR_LEN("\t\t\t</tr>\n\t\t</table>\n"));
+	}
+
 
 	/* list connections */
 	if (!short_info) {
@@ -827,8 +909,19 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 	return html;
 }
 
+/* "<limit>ms: " or "inf: " for the last bucket */
+static void status_append_latency_bucket(GString *s, guint bucket) {
+	if (bucket < LI_BACKEND_LATENCY_BUCKETS - 1) {
+		li_string_append_int(s, li_backend_latency_bucket_limit(bucket));
+		g_string_append_len(s, CONST_STR_LEN("ms: "));
+	} else {
+		g_string_append_len(s, CONST_STR_LEN("inf: "));
+	}
+}
+
 static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *totals, guint total_connections, guint *connection_count) {
 	GString *html;
+	guint i;
 
 	html = g_string_sized_new(1024 - 1);
 
@@ -885,6 +978,39 @@ static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *to
 	li_string_append_int(html, mod_status_response_codes[3]);
 	g_string_append_len(html, CONST_STR_LEN("\nstatus_5xx: "));
 	li_string_append_int(html, mod_status_response_codes[4]);
+	/* content cache */
+	if (NULL != vr->wrk->srv->content_cache) {
+		liContentCacheStats ccs;
+
+		li_content_cache_get_stats(vr->wrk->srv->content_cache, &ccs);
+		g_string_append_len(html, CONST_STR_LEN("\n\n# Content Cache (since start)\ncontent_cache_hits: "));
+		li_string_append_int(html, ccs.hits);
+		g_string_append_len(html, CONST_STR_LEN("\ncontent_cache_misses: "));
+		li_string_append_int(html, ccs.misses);
+		g_string_append_len(html, CONST_STR_LEN("\ncontent_cache_files: "));
+		li_string_append_int(html, ccs.entries);
+		g_string_append_len(html, CONST_STR_LEN("\ncontent_cache_bytes: "));
+		li_string_append_int(html, ccs.bytes);
+	}
+	/* backend connection pools */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Backend Connection Pools (since start)\nbackend_pool_hits: "));
+	li_string_append_int(html, totals->backend_pool_hits);
+	g_string_append_len(html, CONST_STR_LEN("\nbackend_pool_misses: "));
+	li_string_append_int(html, totals->backend_pool_misses);
+	g_string_append_len(html, CONST_STR_LEN("\nbackend_pool_idle: "));
+	li_string_append_int(html, totals->backend_pool_idle);
+	/* backend latency histograms: bucket name is the upper bound in ms */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Backend Latency (since start)"));
+	for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+		g_string_append_len(html, CONST_STR_LEN("\nbackend_connect_latency_"));
+		status_append_latency_bucket(html, i);
+		li_string_append_int(html, totals->backend_connect_latency[i]);
+	}
+	for (i = 0; i < LI_BACKEND_LATENCY_BUCKETS; i++) {
+		g_string_append_len(html, CONST_STR_LEN("\nbackend_first_byte_latency_"));
+		status_append_latency_bucket(html, i);
+		li_string_append_int(html, totals->backend_first_byte_latency[i]);
+	}
 
 	li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/plain"));
 
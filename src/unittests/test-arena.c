@@ -0,0 +1,97 @@
+#include <lighttpd/base.h>
+
+static void test_arena_alloc_reset(void) {
+	liArenaStats *stats = li_arena_stats_new("test arena");
+	liArena arena;
+	gchar *a, *b, *big;
+	guint i;
+
+	li_arena_init(&arena, stats);
+
+	a = li_arena_strndup(&arena, CONST_STR_LEN("hello"));
+	b = li_arena_alloc(&arena, 3);
+	g_assert_cmpstr(a, ==, "hello");
+	g_assert(0 == ((gsize) b) % sizeof(gpointer));
+	g_assert_cmpuint(stats->blocks, ==, 1);
+
+	/* gets a block of its own, small allocations continue in the first block */
+	big = li_arena_alloc(&arena, LI_ARENA_BLOCK_SIZE);
+	memset(big, 'x', LI_ARENA_BLOCK_SIZE);
+	g_assert_cmpuint(stats->blocks, ==, 2);
+	li_arena_alloc(&arena, 16);
+	g_assert_cmpuint(stats->blocks, ==, 2);
+	g_assert_cmpstr(a, ==, "hello");
+
+	li_arena_reset(&arena);
+	g_assert_cmpuint(stats->resets, ==, 1);
+	g_assert_cmpuint(stats->high_water, >, LI_ARENA_BLOCK_SIZE);
+	g_assert_cmpuint(stats->idle, ==, LI_ARENA_BLOCK_SIZE);
+
+	/* the first block is kept */
+	for (i = 0; i < 100; i++) li_arena_alloc0(&arena, 64);
+	g_assert_cmpuint(stats->blocks, ==, 2);
+	g_assert_cmpuint(stats->idle, ==, 0);
+
+	/* trim only releases an unused arena */
+	li_arena_trim(&arena);
+	li_arena_alloc(&arena, 16);
+	g_assert_cmpuint(stats->blocks, ==, 2);
+
+	li_arena_reset(&arena);
+	li_arena_trim(&arena);
+	g_assert_cmpuint(stats->idle, ==, 0);
+	li_arena_alloc(&arena, 16);
+	g_assert_cmpuint(stats->blocks, ==, 3);
+
+	li_arena_clear(&arena);
+	g_assert_cmpuint(stats->resets, ==, 3);
+	g_assert_cmpuint(stats->idle, ==, 0);
+
+	li_arena_stats_free(stats);
+}
+
+static void test_arena_headers(void) {
+	liArena arena;
+	liHttpHeaders *headers = li_http_headers_new();
+	liHttpHeader *h;
+	GString *tmp = g_string_sized_new(0);
+
+	li_arena_init(&arena, NULL);
+	li_http_headers_use_arena(headers, &arena);
+
+	li_http_header_insert(headers, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/plain"));
+	li_http_header_append(headers, CONST_STR_LEN("Vary"), CONST_STR_LEN("Accept"));
+	li_http_header_append(headers, CONST_STR_LEN("Vary"), CONST_STR_LEN("Accept-Encoding, Cookie, User-Agent"));
+	li_http_header_overwrite(headers, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/html; charset=utf-8"));
+
+	h = li_http_header_lookup(headers, CONST_STR_LEN("vary"));
+	g_assert(NULL != h);
+	g_assert_cmpstr(h->data->str, ==, "Vary: Accept, Accept-Encoding, Cookie, User-Agent");
+
+	li_http_header_get_all(tmp, headers, CONST_STR_LEN("content-type"));
+	g_assert_cmpstr(tmp->str, ==, "text/html; charset=utf-8");
+
+	g_assert(li_http_header_remove(headers, CONST_STR_LEN("Vary")));
+	g_assert(NULL == li_http_header_lookup(headers, CONST_STR_LEN("Vary")));
+	g_assert_cmpuint(headers->entries.length, ==, 1);
+
+	li_http_headers_reset(headers);
+	li_arena_reset(&arena);
+	g_assert_cmpuint(headers->entries.length, ==, 0);
+
+	li_http_header_insert(headers, CONST_STR_LEN("Server"), CONST_STR_LEN("lighttpd"));
+	g_assert(NULL != li_http_header_lookup(headers, CONST_STR_LEN("Server")));
+
+	li_http_headers_free(headers);
+	li_arena_clear(&arena);
+	g_string_free(tmp, TRUE);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/arena/alloc-reset", test_arena_alloc_reset);
+	g_test_add_func("/arena/headers", test_arena_headers);
+
+	return g_test_run();
+}
@@ -50,10 +50,160 @@ static void test_filter_chunked_decode(void) {
 	li_chunkqueue_free(cq2);
 }
 
+static void test_chunkqueue_ring(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+	liChunkIter ci;
+	liBuffer *buf;
+	guint i, n;
+
+	/* shared buffer: appends don't get merged */
+	buf = li_buffer_new_slice(10);
+	memcpy(buf->addr, "0123456789", 10);
+	buf->used = 10;
+
+	/* wrap around and grow the ring while chunks are in it */
+	for (i = 0; i < 100; i++) {
+		li_buffer_acquire(buf);
+		li_chunkqueue_append_buffer2(cq, buf, 0, 10);
+		if (i % 3 == 0) g_assert(5 == li_chunkqueue_skip(cq, 5));
+	}
+	g_assert(li_chunkqueue_count(cq) == 100 - 17);
+	g_assert(cq->length == 1000 - 34 * 5);
+
+	n = 0;
+	ci = li_chunkqueue_iter(cq);
+	do {
+		g_assert(li_chunkiter_length(ci) == 10);
+		n++;
+	} while (li_chunkiter_next(&ci));
+	g_assert(n == li_chunkqueue_count(cq));
+	g_assert(NULL == li_chunkiter_chunk(ci));
+
+	/* split a chunk */
+	g_assert(15 == li_chunkqueue_steal_len(cq2, cq, 15));
+	cq_assert_eq(cq2, CONST_STR_LEN("012345678901234"));
+	g_assert(li_chunkqueue_count(cq2) == 2);
+	g_assert(li_chunkiter_length(li_chunkqueue_iter(cq)) == 5);
+
+	g_assert(5 == li_chunkqueue_steal_chunk(cq2, cq));
+	cq_assert_eq(cq2, CONST_STR_LEN("01234567890123456789"));
+
+	n = li_chunkqueue_count(cq);
+	g_assert(cq->length == li_chunkqueue_steal_all(cq2, cq));
+	g_assert(0 == li_chunkqueue_count(cq) && 0 == cq->length);
+	g_assert(n + 3 == li_chunkqueue_count(cq2));
+
+	/* into an empty queue */
+	g_assert(20 + n * 10 == li_chunkqueue_steal_all(cq, cq2));
+	g_assert(0 == li_chunkqueue_count(cq2) && 0 == cq2->length);
+	g_assert(n + 3 == li_chunkqueue_count(cq));
+	g_assert(0 == cq2->mem_usage);
+
+	li_chunkqueue_skip_all(cq);
+	g_assert(NULL == li_chunkqueue_first_chunk(cq));
+	g_assert(0 == cq->mem_usage);
+
+	li_buffer_release(buf);
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+}
+
+static void test_chunkqueue_inline(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+	liBuffer *buf;
+
+	/* small appends get merged into one inline chunk */
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("14\r\n"));
+	li_chunkqueue_append_string(cq, g_string_new("0123456789"));
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("0123456789\r\n"));
+	g_assert(1 == li_chunkqueue_count(cq));
+	g_assert(INLINE_CHUNK == li_chunkqueue_first_chunk(cq)->type);
+	cq_assert_eq(cq, CONST_STR_LEN("14\r\n01234567890123456789\r\n"));
+
+	/* full: next one gets a new chunk */
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("0123456789012345678901234567890123456789"));
+	g_assert(2 == li_chunkqueue_count(cq));
+	g_assert(cq->length == 26 + 40);
+	g_assert(cq->mem_usage == 26 + 40);
+
+	/* split an inline chunk */
+	g_assert(4 == li_chunkqueue_steal_len(cq2, cq, 4));
+	cq_assert_eq(cq2, CONST_STR_LEN("14\r\n"));
+	g_assert(22 == li_chunkqueue_skip(cq, 22));
+	cq_assert_eq(cq, CONST_STR_LEN("0123456789012345678901234567890123456789"));
+
+	/* appending to the last buffer */
+	buf = li_buffer_new_slice(1024);
+	memcpy(buf->addr, "HTTP/1.1 200 OK\r\n", 17);
+	buf->used = 17;
+	li_chunkqueue_append_buffer(cq2, buf);
+	li_chunkqueue_append_mem(cq2, CONST_STR_LEN("\r\n"));
+	g_assert(2 == li_chunkqueue_count(cq2));
+	cq_assert_eq(cq2, CONST_STR_LEN("14\r\nHTTP/1.1 200 OK\r\n\r\n"));
+
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+}
+
+#define BENCHMARK_ROUNDS 100000
+#define BENCHMARK_PIPELINE 16
+
+static void test_chunkqueue_benchmark(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+	gdouble t_append, t_steal, t_skip;
+	guint i, j;
+
+	if (!g_test_perf()) return;
+
+	/* pipelined small responses: a few small chunks per response */
+	g_test_timer_start();
+	for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+		for (j = 0; j < BENCHMARK_PIPELINE; j++) {
+			li_chunkqueue_append_mem(cq, CONST_STR_LEN("HTTP/1.1 200 OK\r\n"));
+		}
+		li_chunkqueue_skip_all(cq);
+	}
+	t_append = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+		for (j = 0; j < BENCHMARK_PIPELINE; j++) {
+			li_chunkqueue_append_mem(cq, CONST_STR_LEN("HTTP/1.1 200 OK\r\n"));
+		}
+		while (cq->length > 0) li_chunkqueue_steal_len(cq2, cq, 21);
+		li_chunkqueue_skip_all(cq2);
+	}
+	t_steal = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+		for (j = 0; j < BENCHMARK_PIPELINE; j++) {
+			li_chunkqueue_append_mem(cq, CONST_STR_LEN("HTTP/1.1 200 OK\r\n"));
+		}
+		while (cq->length > 0) li_chunkqueue_skip(cq, 7);
+	}
+	t_skip = g_test_timer_elapsed();
+
+	g_test_message("%u appends: append+skip_all %.1f ns, append+steal_len %.1f ns, append+skip %.1f ns per append",
+		BENCHMARK_ROUNDS * BENCHMARK_PIPELINE,
+		t_append * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE),
+		t_steal * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE),
+		t_skip * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE));
+	g_test_minimized_result(t_append * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE), "append+skip_all: %.1f ns per append", t_append * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE));
+	g_test_minimized_result(t_steal * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE), "append+steal_len: %.1f ns per append", t_steal * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE));
+	g_test_minimized_result(t_skip * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE), "append+skip: %.1f ns per append", t_skip * 1e9 / (BENCHMARK_ROUNDS * BENCHMARK_PIPELINE));
+
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+}
+
 int main(int argc, char **argv) {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/chunk/filter_chunked_decode", test_filter_chunked_decode);
+	g_test_add_func("/chunk/chunkqueue_ring", test_chunkqueue_ring);
+	g_test_add_func("/chunk/chunkqueue_inline", test_chunkqueue_inline);
+	g_test_add_func("/chunk/chunkqueue_benchmark", test_chunkqueue_benchmark);
 
 	return g_test_run();
 }
@@ -0,0 +1,191 @@
+
+#include <lighttpd/base.h>
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+#define PINGPONG_ROUNDS 200000
+
+static void test_mpscring_push_pop(void) {
+	liMPSCRing *ring = li_mpsc_ring_new(sizeof(guint), 8);
+	guint i, v;
+
+	/* only the first push after a reset needs a wakeup */
+	g_assert(li_mpsc_ring_push(ring, &(guint){ 0 }));
+	for (i = 1; i < 5; i++) {
+		g_assert(!li_mpsc_ring_push(ring, &i));
+	}
+	g_assert_cmpuint(li_mpsc_ring_length(ring), ==, 5);
+
+	li_mpsc_ring_wakeup_reset(ring);
+
+	for (i = 0; i < 5; i++) {
+		g_assert(li_mpsc_ring_pop(ring, &v));
+		g_assert_cmpuint(v, ==, i);
+	}
+	g_assert(!li_mpsc_ring_pop(ring, &v));
+	g_assert_cmpuint(li_mpsc_ring_length(ring), ==, 0);
+
+	i = 42;
+	g_assert(li_mpsc_ring_push(ring, &i));
+	g_assert(li_mpsc_ring_pop(ring, &v));
+	g_assert_cmpuint(v, ==, 42);
+
+	li_mpsc_ring_free(ring);
+}
+
+static void test_mpscring_overflow(void) {
+	liMPSCRing *ring = li_mpsc_ring_new(sizeof(guint64), 4);
+	guint64 i, v, sum = 0;
+
+	for (i = 0; i < 100; i++) {
+		li_mpsc_ring_push(ring, &i);
+	}
+	g_assert_cmpuint(li_mpsc_ring_length(ring), ==, 100);
+
+	for (i = 0; i < 100; i++) {
+		g_assert(li_mpsc_ring_pop(ring, &v));
+		sum += v;
+	}
+	g_assert(!li_mpsc_ring_pop(ring, &v));
+	g_assert_cmpuint(sum, ==, 99*100/2);
+
+	/* free with remaining overflow entries */
+	for (i = 0; i < 10; i++) {
+		li_mpsc_ring_push(ring, &i);
+	}
+
+	li_mpsc_ring_free(ring);
+}
+
+typedef struct {
+	guint producer, seq;
+} test_item;
+
+static gpointer producer_thread(gpointer data) {
+	liMPSCRing *ring = data;
+	static gint next_producer = 0;
+	test_item item;
+
+	item.producer = g_atomic_int_exchange_and_add(&next_producer, 1) % PRODUCERS;
+	for (item.seq = 0; item.seq < ITEMS_PER_PRODUCER; item.seq++) {
+		li_mpsc_ring_push(ring, &item);
+	}
+
+	return NULL;
+}
+
+static void test_mpscring_threads(void) {
+	liMPSCRing *ring = li_mpsc_ring_new(sizeof(test_item), 1024);
+	GThread *threads[PRODUCERS];
+	guint counts[PRODUCERS];
+	guint i, total = 0;
+	test_item item;
+
+	memset(counts, 0, sizeof(counts));
+
+	for (i = 0; i < PRODUCERS; i++) {
+		threads[i] = g_thread_create(producer_thread, ring, TRUE, NULL);
+	}
+
+	while (total < PRODUCERS * ITEMS_PER_PRODUCER) {
+		if (li_mpsc_ring_pop(ring, &item)) {
+			g_assert_cmpuint(item.producer, <, PRODUCERS);
+			counts[item.producer]++;
+			total++;
+		}
+	}
+
+	for (i = 0; i < PRODUCERS; i++) {
+		g_thread_join(threads[i]);
+		g_assert_cmpuint(counts[i], ==, ITEMS_PER_PRODUCER);
+	}
+	g_assert(!li_mpsc_ring_pop(ring, &item));
+
+	li_mpsc_ring_free(ring);
+}
+
+/* handoff latency: ping-pong a token between two threads, both sides busy-poll */
+
+typedef struct {
+	liMPSCRing *ring_ping, *ring_pong;
+	GAsyncQueue *queue_ping, *queue_pong;
+} pingpong;
+
+static gpointer pong_ring_thread(gpointer data) {
+	pingpong *pp = data;
+	guint i, v;
+
+	for (i = 0; i < PINGPONG_ROUNDS; i++) {
+		while (!li_mpsc_ring_pop(pp->ring_ping, &v)) ;
+		li_mpsc_ring_push(pp->ring_pong, &v);
+	}
+
+	return NULL;
+}
+
+static gpointer pong_queue_thread(gpointer data) {
+	pingpong *pp = data;
+	guint i;
+	gpointer v;
+
+	for (i = 0; i < PINGPONG_ROUNDS; i++) {
+		while (NULL == (v = g_async_queue_try_pop(pp->queue_ping))) ;
+		g_async_queue_push(pp->queue_pong, v);
+	}
+
+	return NULL;
+}
+
+static void test_mpscring_benchmark(void) {
+	pingpong pp;
+	GThread *thread;
+	guint i, v;
+	gpointer p;
+	gdouble t_ring, t_queue;
+
+	if (!g_test_perf()) return;
+
+	pp.ring_ping = li_mpsc_ring_new(sizeof(guint), 64);
+	pp.ring_pong = li_mpsc_ring_new(sizeof(guint), 64);
+	pp.queue_ping = g_async_queue_new();
+	pp.queue_pong = g_async_queue_new();
+
+	thread = g_thread_create(pong_ring_thread, &pp, TRUE, NULL);
+	g_test_timer_start();
+	for (i = 0; i < PINGPONG_ROUNDS; i++) {
+		li_mpsc_ring_push(pp.ring_ping, &i);
+		while (!li_mpsc_ring_pop(pp.ring_pong, &v)) ;
+	}
+	t_ring = g_test_timer_elapsed();
+	g_thread_join(thread);
+
+	thread = g_thread_create(pong_queue_thread, &pp, TRUE, NULL);
+	g_test_timer_start();
+	for (i = 0; i < PINGPONG_ROUNDS; i++) {
+		g_async_queue_push(pp.queue_ping, GUINT_TO_POINTER(i+1));
+		while (NULL == (p = g_async_queue_try_pop(pp.queue_pong))) ;
+	}
+	t_queue = g_test_timer_elapsed();
+	g_thread_join(thread);
+
+	g_test_message("handoff round trip: liMPSCRing %.1f ns, GAsyncQueue %.1f ns",
+		t_ring * 1e9 / PINGPONG_ROUNDS, t_queue * 1e9 / PINGPONG_ROUNDS);
+	g_test_minimized_result(t_ring * 1e9 / PINGPONG_ROUNDS, "liMPSCRing round trip: %.1f ns", t_ring * 1e9 / PINGPONG_ROUNDS);
+
+	li_mpsc_ring_free(pp.ring_ping);
+	li_mpsc_ring_free(pp.ring_pong);
+	g_async_queue_unref(pp.queue_ping);
+	g_async_queue_unref(pp.queue_pong);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/mpscring/push-pop", test_mpscring_push_pop);
+	g_test_add_func("/mpscring/overflow", test_mpscring_overflow);
+	g_test_add_func("/mpscring/threads", test_mpscring_threads);
+	g_test_add_func("/mpscring/benchmark", test_mpscring_benchmark);
+
+	return g_test_run();
+}
@@ -29,6 +29,17 @@ class TestSimpleRequest(CurlRequest):
 	EXPECT_RESPONSE_BODY = TEST_TXT
 	EXPECT_RESPONSE_CODE = 200
 
+class TestStatusLine(CurlRequest):
+	URL = "/test.txt"
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Length", str(len(TEST_TXT)))]
+
+	def CheckResponse(self):
+		if self.resp_first_line != "HTTP/1.1 200 OK":
+			raise CurlRequestException("Unexpected status line '%s'" % (self.resp_first_line))
+		return True
+
 class TestSimpleInfo(CurlRequest):
 	URL = "/?a_simple_query"
 	EXPECT_RESPONSE_BODY = "a_simple_query"
@@ -53,7 +64,7 @@ status.info;
 """
 
 class Test(GroupTest):
-	group = [TestSimpleRequest,TestSimpleInfo,TestBadRequest1,ProvideStatus]
+	group = [TestSimpleRequest,TestStatusLine,TestSimpleInfo,TestBadRequest1,ProvideStatus]
 
 	def Prepare(self):
 		self.PrepareFile("www/default/test.txt", TEST_TXT)